@@ -0,0 +1,226 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "bench_protocol.hpp"
+
+#include <algorithm>
+
+namespace bench
+{
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_packets.html
+void append_packet(
+    Bytes& t_out, const Bytes& t_payload, unsigned char& t_sequence_id)
+{
+  std::size_t pos = 0;
+  while(true) {
+    const std::size_t length = std::min(t_payload.size() - pos,
+        static_cast<std::size_t>(proxy::MySqlPacket::MAX_PAYLOAD_LENGTH));
+    t_out.push_back(static_cast<unsigned char>(length & 0xffu));
+    t_out.push_back(static_cast<unsigned char>((length >> 8u) & 0xffu));
+    t_out.push_back(static_cast<unsigned char>((length >> 16u) & 0xffu));
+    t_out.push_back(t_sequence_id++);
+    t_out.insert(t_out.end(), t_payload.begin() + pos,
+        t_payload.begin() + pos + length);
+    pos += length;
+    if(length < proxy::MySqlPacket::MAX_PAYLOAD_LENGTH) {
+      return;
+    }
+  }
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_dt_integers.html
+void append_lenenc_uint(Bytes& t_out, std::uint64_t t_value)
+{
+  std::size_t length = 0;
+  if(t_value < 251) {
+    t_out.push_back(static_cast<unsigned char>(t_value));
+    return;
+  } else if(t_value < 0x10000) {
+    t_out.push_back(0xfc);
+    length = 2;
+  } else if(t_value < 0x1000000) {
+    t_out.push_back(0xfd);
+    length = 3;
+  } else {
+    t_out.push_back(0xfe);
+    length = 8;
+  }
+  for(std::size_t i = 0; i < length; ++i) {
+    t_out.push_back(static_cast<unsigned char>((t_value >> (8 * i)) & 0xffu));
+  }
+}
+
+void append_lenenc_string(Bytes& t_out, const std::string& t_string)
+{
+  append_lenenc_uint(t_out, t_string.size());
+  t_out.insert(t_out.end(), t_string.begin(), t_string.end());
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_ok_packet.html
+void append_ok(Bytes& t_out, unsigned char& t_sequence_id)
+{
+  // Affected rows, last insert id, status flags and warnings.
+  append_packet(t_out,
+      {0x00, 0x00, 0x00, proxy::MySqlServerStatus::SERVER_STATUS_AUTOCOMMIT,
+          0x00, 0x00, 0x00},
+      t_sequence_id);
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_err_packet.html
+void append_err(Bytes& t_out,
+    unsigned char& t_sequence_id,
+    std::uint16_t t_error_code,
+    const std::string& t_message)
+{
+  Bytes payload{0xff, static_cast<unsigned char>(t_error_code & 0xffu),
+      static_cast<unsigned char>(t_error_code >> 8u), '#', 'H', 'Y', '0', '0',
+      '0'};
+  payload.insert(payload.end(), t_message.begin(), t_message.end());
+  append_packet(t_out, payload, t_sequence_id);
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_query_response_text_resultset.html
+void append_result_set(Bytes& t_out,
+    unsigned char& t_sequence_id,
+    std::size_t t_columns,
+    std::size_t t_rows,
+    std::size_t t_value_length,
+    bool t_deprecate_eof)
+{
+  // EOF and the OK packet ending the rows with CLIENT_DEPRECATE_EOF.
+  const Bytes eof{0xfe, 0x00, 0x00,
+      proxy::MySqlServerStatus::SERVER_STATUS_AUTOCOMMIT, 0x00};
+  const Bytes ok_eof{0xfe, 0x00, 0x00,
+      proxy::MySqlServerStatus::SERVER_STATUS_AUTOCOMMIT, 0x00, 0x00, 0x00};
+
+  Bytes payload;
+  append_lenenc_uint(payload, t_columns);
+  append_packet(t_out, payload, t_sequence_id);
+
+  for(std::size_t i = 0; i < t_columns; ++i) {
+    const std::string name = "column_" + std::to_string(i);
+    payload.clear();
+    append_lenenc_string(payload, "def");
+    append_lenenc_string(payload, "bench");
+    append_lenenc_string(payload, "t");
+    append_lenenc_string(payload, "t");
+    append_lenenc_string(payload, name);
+    append_lenenc_string(payload, name);
+    // Length of the fixed fields, charset utf8, column length,
+    // type VARCHAR, flags, decimals and the filler.
+    payload.insert(payload.end(), {0x0c, 0x21, 0x00, 0xff, 0xff, 0x00, 0x00,
+                                      0xfd, 0x00, 0x00, 0x00, 0x00, 0x00});
+    append_packet(t_out, payload, t_sequence_id);
+  }
+  if(!t_deprecate_eof) {
+    append_packet(t_out, eof, t_sequence_id);
+  }
+
+  for(std::size_t row = 0; row < t_rows; ++row) {
+    std::string value = std::to_string(row);
+    value.resize(std::max(t_value_length, value.size()), 'x');
+    payload.clear();
+    for(std::size_t i = 0; i < t_columns; ++i) {
+      append_lenenc_string(payload, value);
+    }
+    append_packet(t_out, payload, t_sequence_id);
+  }
+  append_packet(t_out, t_deprecate_eof ? ok_eof : eof, t_sequence_id);
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_v10.html
+Bytes make_greeting(std::uint32_t t_connection_id)
+{
+  const std::string version = "8.0.30-bench";
+  const std::string plugin = "mysql_native_password";
+  const std::string scramble = "0123456789abcdefghij";
+
+  Bytes payload{0x0a};
+  payload.insert(payload.end(), version.begin(), version.end());
+  payload.push_back(0x00);
+  for(std::size_t i = 0; i < 4; ++i) {
+    payload.push_back(
+        static_cast<unsigned char>((t_connection_id >> (8 * i)) & 0xffu));
+  }
+  payload.insert(payload.end(), scramble.begin(), scramble.begin() + 8);
+  payload.push_back(0x00);
+  payload.push_back(static_cast<unsigned char>(CAPABILITIES & 0xffu));
+  payload.push_back(static_cast<unsigned char>((CAPABILITIES >> 8u) & 0xffu));
+  // Charset utf8, status flags.
+  payload.insert(payload.end(),
+      {0x21, proxy::MySqlServerStatus::SERVER_STATUS_AUTOCOMMIT, 0x00});
+  payload.push_back(static_cast<unsigned char>((CAPABILITIES >> 16u) & 0xffu));
+  payload.push_back(static_cast<unsigned char>((CAPABILITIES >> 24u) & 0xffu));
+  // Length of the auth plugin data and the reserved bytes.
+  payload.push_back(static_cast<unsigned char>(scramble.size() + 1));
+  payload.insert(payload.end(), 10, 0x00);
+  payload.insert(payload.end(), scramble.begin() + 8, scramble.end());
+  payload.push_back(0x00);
+  payload.insert(payload.end(), plugin.begin(), plugin.end());
+  payload.push_back(0x00);
+
+  Bytes packet;
+  unsigned char sequence_id = 0;
+  append_packet(packet, payload, sequence_id);
+  return packet;
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_response.html
+Bytes make_handshake_response(const std::string& t_user)
+{
+  const std::string plugin = "mysql_native_password";
+
+  Bytes payload;
+  for(std::size_t i = 0; i < 4; ++i) {
+    payload.push_back(
+        static_cast<unsigned char>((CAPABILITIES >> (8 * i)) & 0xffu));
+  }
+  // Max packet size 16 MB, charset utf8 and the filler.
+  payload.insert(payload.end(), {0x00, 0x00, 0x00, 0x01, 0x21});
+  payload.insert(payload.end(), 23, 0x00);
+  payload.insert(payload.end(), t_user.begin(), t_user.end());
+  payload.push_back(0x00);
+  // The empty auth response.
+  payload.push_back(0x00);
+  payload.insert(payload.end(), plugin.begin(), plugin.end());
+  payload.push_back(0x00);
+
+  Bytes packet;
+  unsigned char sequence_id = 1;
+  append_packet(packet, payload, sequence_id);
+  return packet;
+}
+
+Bytes make_command(
+    proxy::MySqlCommand::Command t_command, const std::string& t_argument)
+{
+  Bytes payload{static_cast<unsigned char>(t_command)};
+  payload.insert(payload.end(), t_argument.begin(), t_argument.end());
+
+  Bytes packet;
+  unsigned char sequence_id = 0;
+  append_packet(packet, payload, sequence_id);
+  return packet;
+}
+
+}  // namespace bench
@@ -0,0 +1,84 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_BENCH_PROTOCOL_HPP
+#define PROXY_BENCH_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packet.hpp"
+
+namespace bench
+{
+using Bytes = std::vector<unsigned char>;
+
+/// The capabilities of the fake MySQL server and the load generator.
+const std::uint32_t CAPABILITIES = proxy::MySqlCapability::CLIENT_PROTOCOL_41
+    | proxy::MySqlCapability::CLIENT_TRANSACTIONS
+    | proxy::MySqlCapability::CLIENT_SECURE_CONNECTION
+    | proxy::MySqlCapability::CLIENT_PLUGIN_AUTH
+    | proxy::MySqlCapability::CLIENT_DEPRECATE_EOF;
+
+/// Append the payload as the MySQL packet, the payload of 16 MB and longer
+/// is sent in the parts, the last part is shorter than 16 MB.
+void append_packet(
+    Bytes& t_out, const Bytes& t_payload, unsigned char& t_sequence_id);
+
+void append_lenenc_uint(Bytes& t_out, std::uint64_t t_value);
+void append_lenenc_string(Bytes& t_out, const std::string& t_string);
+
+/// Append the OK packet.
+void append_ok(Bytes& t_out, unsigned char& t_sequence_id);
+
+/// Append the ERR packet.
+void append_err(Bytes& t_out,
+    unsigned char& t_sequence_id,
+    std::uint16_t t_error_code,
+    const std::string& t_message);
+
+/// Append the text result set, the values of the rows have t_value_length
+/// bytes. Without CLIENT_DEPRECATE_EOF the definitions and the rows are ended
+/// by the EOF packets, with it the rows are ended by the OK packet.
+void append_result_set(Bytes& t_out,
+    unsigned char& t_sequence_id,
+    std::size_t t_columns,
+    std::size_t t_rows,
+    std::size_t t_value_length,
+    bool t_deprecate_eof);
+
+/// Make the server's greeting, Protocol::HandshakeV10.
+Bytes make_greeting(std::uint32_t t_connection_id);
+
+/// Make the client's HandshakeResponse41 of the user without the password.
+Bytes make_handshake_response(const std::string& t_user);
+
+/// Make the command packet with the argument, like the SQL of COM_QUERY.
+Bytes make_command(
+    proxy::MySqlCommand::Command t_command, const std::string& t_argument);
+
+}  // namespace bench
+
+#endif  // PROXY_BENCH_PROTOCOL_HPP
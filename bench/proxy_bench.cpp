@@ -0,0 +1,369 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_protocol.hpp"
+#include "packet.hpp"
+
+namespace
+{
+using bench::Bytes;
+
+/// The read size of the debug build, see Connection::BUFFER_LENGTH.
+const std::size_t DEBUG_BUFFER_LENGTH = 60;
+
+/// The read size of the release build, see Connection::BUFFER_LENGTH.
+const std::size_t BUFFER_LENGTH = 8192;
+
+/// The client's command and the server's response to it.
+struct Exchange
+{
+  Bytes m_request;
+  Bytes m_response;
+};
+
+/// The synthetic MySQL session in the command phase. The server's greeting
+/// is not parsed, so the result sets have the classic EOF packets.
+struct Stream
+{
+  std::string m_name;
+  std::vector<Exchange> m_exchanges;
+  std::uint64_t m_bytes = 0;
+};
+
+/// The sizes of the reads which split the stream.
+struct Splitter
+{
+  std::string m_name;
+  std::vector<std::size_t> m_sizes;
+};
+
+/// The best result of the stream split by the splitter.
+struct Result
+{
+  std::string m_key;
+  double m_bytes_per_second = 0;
+  double m_packets_per_second = 0;
+};
+
+Bytes make_query(const std::string& t_sql)
+{
+  return bench::make_command(proxy::MySqlCommand::Command::COM_QUERY, t_sql);
+}
+
+Bytes make_ok()
+{
+  Bytes response;
+  unsigned char sequence_id = 1;
+  bench::append_ok(response, sequence_id);
+  return response;
+}
+
+Bytes make_result_set(std::size_t t_columns, std::size_t t_rows)
+{
+  Bytes response;
+  unsigned char sequence_id = 1;
+  bench::append_result_set(response, sequence_id, t_columns, t_rows, 20, false);
+  return response;
+}
+
+/// Many short queries, each answered by OK or by the one row.
+Stream make_small_queries()
+{
+  Stream stream;
+  stream.m_name = "small-queries";
+  const Bytes ok = make_ok();
+  const Bytes row = make_result_set(2, 1);
+  for(std::size_t i = 0; i < 20000; ++i) {
+    const std::string id = std::to_string(i);
+    if(0 == i % 2) {
+      stream.m_exchanges.push_back(
+          {make_query("SELECT id, name FROM users WHERE id = " + id), row});
+    } else {
+      stream.m_exchanges.push_back(
+          {make_query("UPDATE counters SET hits = hits + 1 WHERE id = " + id),
+              ok});
+    }
+  }
+  return stream;
+}
+
+/// The queries of 16 MB and longer in the many packet parts.
+Stream make_multi_part()
+{
+  Stream stream;
+  stream.m_name = "multi-part";
+  const Bytes ok = make_ok();
+  const std::string insert = "INSERT INTO blobs VALUES ('";
+  // The payload of exactly 16 MB - 1 is ended by the empty part.
+  const std::size_t exact =
+      proxy::MySqlPacket::MAX_PAYLOAD_LENGTH - 1 - insert.size() - 2;
+  for(std::size_t length : {exact, std::size_t{20} * 1024 * 1024}) {
+    stream.m_exchanges.push_back(
+        {make_query(insert + std::string(length, 'x') + "')"), ok});
+  }
+  return stream;
+}
+
+/// The big result sets.
+Stream make_result_sets()
+{
+  Stream stream;
+  stream.m_name = "result-sets";
+  const Bytes result_set = make_result_set(4, 10000);
+  for(std::size_t i = 0; i < 10; ++i) {
+    stream.m_exchanges.push_back(
+        {make_query("SELECT * FROM t LIMIT " + std::to_string(i * 10000)
+             + ", 10000"),
+            result_set});
+  }
+  return stream;
+}
+
+/// Collect the data by the reads of the splitter's sizes,
+/// as Connection does it. Returns the number of the received packets.
+template<typename Packet, typename ReceivedHandler>
+std::uint64_t collect(Packet& t_packet,
+    const Bytes& t_data,
+    const Splitter& t_splitter,
+    std::size_t& t_read_index,
+    proxy::MySqlConnectionState& t_connection_state,
+    ReceivedHandler t_received_handler)
+{
+  std::uint64_t packets = 0;
+  std::size_t pos = 0;
+  while(pos < t_data.size()) {
+    const std::size_t read_size =
+        t_splitter.m_sizes[t_read_index++ % t_splitter.m_sizes.size()];
+    const std::size_t read_end = std::min(t_data.size(), pos + read_size);
+    for(; pos < read_end; ++pos) {
+      t_packet.collect(t_data[pos], t_connection_state);
+      if(t_packet.is_received()) {
+        ++packets;
+        t_received_handler();
+      }
+    }
+  }
+  return packets;
+}
+
+/// Parse the stream once. Returns false if the responses
+/// are not tracked to their ends.
+bool parse_stream(
+    const Stream& t_stream, const Splitter& t_splitter, std::uint64_t& t_packets)
+{
+  proxy::FromClientPacket client_packet;
+  proxy::FromServerPacket server_packet;
+  proxy::MySqlConnectionState connection_state =
+      proxy::MySqlConnectionState::COMMAND_PHASE;
+  std::size_t read_index = 0;
+  t_packets = 0;
+
+  for(const Exchange& exchange : t_stream.m_exchanges) {
+    t_packets += collect(client_packet, exchange.m_request, t_splitter,
+        read_index, connection_state, [&]() -> void {
+          server_packet.expect_response(client_packet.command(),
+              client_packet.payload_length(), bench::CAPABILITIES);
+        });
+    t_packets += collect(server_packet, exchange.m_response, t_splitter,
+        read_index, connection_state, []() -> void {});
+    if(!client_packet.is_packet_start()
+        || !server_packet.is_response_complete()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Read the reference results, "<stream>/<split> <bytes/s>".
+std::map<std::string, double> read_baseline(const std::string& t_file_path)
+{
+  std::map<std::string, double> baseline;
+  std::ifstream file(t_file_path);
+  std::string key;
+  double bytes_per_second = 0;
+  while(file >> key >> bytes_per_second) {
+    baseline[key] = bytes_per_second;
+  }
+  return baseline;
+}
+
+void write_baseline(
+    const std::string& t_file_path, const std::vector<Result>& t_results)
+{
+  std::ofstream file(t_file_path);
+  for(const Result& result : t_results) {
+    file << result.m_key << " " << std::fixed << std::setprecision(0)
+         << result.m_bytes_per_second << "\n";
+  }
+}
+
+}  // namespace
+
+int main(int t_argc, char* t_argv[])
+{
+  std::size_t repeat = 5;
+  double tolerance = 25;
+  std::string baseline_file_path;
+  bool update_baseline = false;
+
+  // Read the options.
+  for(int i = 1; i < t_argc; ++i) {
+    const std::string option = t_argv[i];
+    const std::size_t equal_pos = option.find('=');
+    const std::string name = option.substr(0, equal_pos);
+    const std::string value = (std::string::npos == equal_pos)
+        ? std::string()
+        : option.substr(equal_pos + 1);
+    try {
+      if("--repeat" == name) {
+        repeat = std::max<std::size_t>(1, std::stoul(value));
+      } else if("--tolerance" == name) {
+        tolerance = std::stod(value);
+      } else if("--baseline" == name) {
+        baseline_file_path = value;
+      } else if("--update-baseline" == name) {
+        update_baseline = true;
+      } else {
+        throw std::invalid_argument(option);
+      }
+    } catch(std::exception&) {
+      std::cerr << "Wrong option: " << option << "\n"
+                << "Usage: proxy_bench [--repeat=<N>] [--baseline=<file>]"
+                   " [--tolerance=<percent>] [--update-baseline]\n";
+      return 1;
+    }
+  }
+
+  std::vector<Stream> streams;
+  streams.push_back(make_small_queries());
+  streams.push_back(make_multi_part());
+  streams.push_back(make_result_sets());
+  for(Stream& stream : streams) {
+    for(const Exchange& exchange : stream.m_exchanges) {
+      stream.m_bytes += exchange.m_request.size() + exchange.m_response.size();
+    }
+  }
+
+  // The random reads are the same in each run.
+  Splitter random_splitter{"random", {}};
+  std::mt19937 random_engine(2019);
+  std::uniform_int_distribution<std::size_t> random_size(1, 2 * BUFFER_LENGTH);
+  for(std::size_t i = 0; i < 4096; ++i) {
+    random_splitter.m_sizes.push_back(random_size(random_engine));
+  }
+  const std::vector<Splitter> splitters{random_splitter,
+      {std::to_string(DEBUG_BUFFER_LENGTH), {DEBUG_BUFFER_LENGTH}},
+      {std::to_string(BUFFER_LENGTH), {BUFFER_LENGTH}}};
+
+  std::vector<Result> results;
+  std::cout << std::left << std::setw(24) << "stream/split" << std::right
+            << std::setw(12) << "MB/s" << std::setw(16) << "packets/s"
+            << "\n";
+  for(const Stream& stream : streams) {
+    for(const Splitter& splitter : splitters) {
+      double best_seconds = 0;
+      std::uint64_t packets = 0;
+      for(std::size_t i = 0; i < repeat; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        if(!parse_stream(stream, splitter, packets)) {
+          std::cerr << stream.m_name << "/" << splitter.m_name
+                    << ": the packets are parsed wrong\n";
+          return 1;
+        }
+        const std::chrono::duration<double> seconds =
+            std::chrono::steady_clock::now() - start;
+        if(0 == i || seconds.count() < best_seconds) {
+          best_seconds = seconds.count();
+        }
+      }
+
+      Result result;
+      result.m_key = stream.m_name + "/" + splitter.m_name;
+      result.m_bytes_per_second = stream.m_bytes / best_seconds;
+      result.m_packets_per_second = packets / best_seconds;
+      results.push_back(result);
+      std::cout << std::left << std::setw(24) << result.m_key << std::right
+                << std::fixed << std::setprecision(1) << std::setw(12)
+                << result.m_bytes_per_second / 1e6 << std::setprecision(0)
+                << std::setw(16) << result.m_packets_per_second << "\n";
+    }
+  }
+
+  if(baseline_file_path.empty()) {
+    return 0;
+  }
+
+  // The baseline is written only on the request, the missing baseline
+  // fails the check instead of passing it with the current results.
+  if(update_baseline) {
+    write_baseline(baseline_file_path, results);
+    std::cout << "Baseline is written to " << baseline_file_path << "\n";
+    return 0;
+  }
+  const std::map<std::string, double> baseline =
+      read_baseline(baseline_file_path);
+  if(baseline.empty()) {
+    std::cerr << "No baseline in " << baseline_file_path
+              << ", write it with --update-baseline\n";
+    return 1;
+  }
+
+  // The single results are noisy, so the geometric mean of the ratios
+  // to the baseline is checked.
+  double log_ratio_sum = 0;
+  std::size_t compared = 0;
+  for(const Result& result : results) {
+    const auto it = baseline.find(result.m_key);
+    if(baseline.end() == it || 0 >= it->second) {
+      continue;
+    }
+    const double ratio = result.m_bytes_per_second / it->second;
+    std::cout << std::left << std::setw(24) << result.m_key << std::right
+              << std::setprecision(0) << std::setw(12) << ratio * 100
+              << "% of the baseline\n";
+    log_ratio_sum += std::log(ratio);
+    ++compared;
+  }
+  if(0 == compared) {
+    std::cerr << "No results of the baseline " << baseline_file_path
+              << " match the benchmarks\n";
+    return 1;
+  }
+
+  const double mean_ratio = std::exp(log_ratio_sum / compared);
+  std::cout << "Throughput is " << std::setprecision(0) << mean_ratio * 100
+            << "% of the baseline, the tolerance is " << tolerance << "%\n";
+  return (mean_ratio < 1 - tolerance / 100) ? 1 : 0;
+}
@@ -0,0 +1,422 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "bench_protocol.hpp"
+#include "endpoint.hpp"
+#include "packet.hpp"
+
+namespace
+{
+using bench::Bytes;
+using proxy::StreamProtocol;
+
+/// Distribution of the service time of the queries, in microseconds.
+struct ServiceTime
+{
+  enum class Distribution
+  {
+    FIXED,
+    UNIFORM,
+    EXPONENTIAL
+  };
+
+  Distribution m_distribution = Distribution::FIXED;
+  double m_min = 0;
+  double m_max = 0;
+};
+
+/// Settings of the fake MySQL server.
+struct FakeServerSettings
+{
+  std::size_t m_threads = 1;
+
+  /// The result set of "SELECT <N>" has N rows,
+  /// the other SELECT queries get m_rows rows.
+  std::size_t m_rows = 1;
+  std::size_t m_columns = 1;
+  std::size_t m_value_length = 16;
+
+  ServiceTime m_service_time;
+};
+
+/// Parse "<us>", "uniform:<min us>:<max us>" or "exponential:<mean us>".
+ServiceTime parse_service_time(const std::string& t_value)
+{
+  ServiceTime service_time;
+  const std::size_t colon_pos = t_value.find(':');
+  const std::string name = t_value.substr(0, colon_pos);
+  const std::string args =
+      (std::string::npos == colon_pos) ? "" : t_value.substr(colon_pos + 1);
+
+  if("uniform" == name) {
+    const std::size_t args_colon_pos = args.find(':');
+    if(std::string::npos == args_colon_pos) {
+      throw std::invalid_argument("Wrong service time: " + t_value);
+    }
+    service_time.m_distribution = ServiceTime::Distribution::UNIFORM;
+    service_time.m_min = std::stod(args.substr(0, args_colon_pos));
+    service_time.m_max = std::stod(args.substr(args_colon_pos + 1));
+  } else if("exponential" == name) {
+    service_time.m_distribution = ServiceTime::Distribution::EXPONENTIAL;
+    service_time.m_min = std::stod(args);
+  } else {
+    service_time.m_min = std::stod(t_value);
+  }
+  if(service_time.m_min < 0 || service_time.m_max < 0) {
+    throw std::invalid_argument("Wrong service time: " + t_value);
+  }
+  return service_time;
+}
+
+std::chrono::microseconds next_service_time(
+    const ServiceTime& t_service_time, std::mt19937& t_random_engine)
+{
+  double microseconds = t_service_time.m_min;
+  switch(t_service_time.m_distribution) {
+    case ServiceTime::Distribution::FIXED: {
+      break;
+    }
+    case ServiceTime::Distribution::UNIFORM: {
+      std::uniform_real_distribution<double> distribution(
+          t_service_time.m_min, t_service_time.m_max);
+      microseconds = distribution(t_random_engine);
+      break;
+    }
+    case ServiceTime::Distribution::EXPONENTIAL: {
+      if(0 < t_service_time.m_min) {
+        std::exponential_distribution<double> distribution(
+            1 / t_service_time.m_min);
+        microseconds = distribution(t_random_engine);
+      }
+      break;
+    }
+  }
+  return std::chrono::microseconds(static_cast<std::int64_t>(microseconds));
+}
+
+/// Get the number of the rows for the SELECT query, -1 for the other queries.
+std::int64_t query_rows(
+    const std::string& t_sql, const FakeServerSettings& t_settings)
+{
+  const std::string select = "SELECT ";
+  if(0 != t_sql.compare(0, select.size(), select)) {
+    return -1;
+  }
+  const std::string rows = t_sql.substr(select.size());
+  if(rows.empty() || std::string::npos != rows.find_first_not_of("0123456789")) {
+    return static_cast<std::int64_t>(t_settings.m_rows);
+  }
+  return std::stoll(rows);
+}
+
+
+/// The session of the fake MySQL server. The handshake is accepted
+/// for any user, the queries are answered after the service time.
+class FakeSession : public std::enable_shared_from_this<FakeSession>
+{
+public:
+  FakeSession(const FakeSession&) = delete;
+  FakeSession(FakeSession&&) = delete;
+  FakeSession& operator=(const FakeSession&) = delete;
+  FakeSession& operator=(FakeSession&&) = delete;
+
+  ~FakeSession() = default;
+
+  explicit FakeSession(boost::asio::io_context& t_io_context,
+      StreamProtocol::socket t_socket,
+      const FakeServerSettings& t_settings,
+      std::uint32_t t_connection_id);
+
+  void start();
+
+private:
+  void do_read();
+  void do_write();
+
+  /// Append the response to the received client's packet.
+  void packet_is_received();
+
+  StreamProtocol::socket m_socket;
+  boost::asio::steady_timer m_timer;
+  const FakeServerSettings& m_settings;
+  std::mt19937 m_random_engine;
+
+  proxy::FromClientPacket m_packet;
+  proxy::MySqlConnectionState m_connection_state =
+      proxy::MySqlConnectionState::CONNECTION_PHASE;
+  bool m_deprecate_eof = false;
+  bool m_quit = false;
+
+  std::array<unsigned char, 8192> m_read_buffer{};
+  Bytes m_response;
+  std::chrono::microseconds m_service_time{0};
+};
+
+FakeSession::FakeSession(boost::asio::io_context& t_io_context,
+    StreamProtocol::socket t_socket,
+    const FakeServerSettings& t_settings,
+    std::uint32_t t_connection_id)
+    : m_socket(std::move(t_socket))
+    , m_timer(t_io_context)
+    , m_settings(t_settings)
+    , m_random_engine(t_connection_id)
+{
+  m_response = bench::make_greeting(t_connection_id);
+}
+
+void FakeSession::start()
+{
+  do_write();
+}
+
+void FakeSession::do_read()
+{
+  auto self = shared_from_this();
+  m_socket.async_read_some(boost::asio::buffer(m_read_buffer),
+      [this, self](const boost::system::error_code& l_error,
+          std::size_t l_bytes_transferred) -> void {
+        if(l_error) {
+          return;
+        }
+
+        try {
+          for(std::size_t i = 0; i < l_bytes_transferred; ++i) {
+            m_packet.collect(m_read_buffer[i], m_connection_state);
+            if(m_packet.is_received()) {
+              packet_is_received();
+            }
+          }
+        } catch(std::exception&) {
+          // The broken packet closes the session.
+          return;
+        }
+
+        if(m_response.empty()) {
+          if(!m_quit) {
+            do_read();
+          }
+        } else if(0 < m_service_time.count()) {
+          m_timer.expires_after(m_service_time);
+          m_timer.async_wait(
+              [this, self](const boost::system::error_code& l_error) -> void {
+                if(!l_error) {
+                  do_write();
+                }
+              });
+        } else {
+          do_write();
+        }
+      });
+}
+
+void FakeSession::do_write()
+{
+  auto self = shared_from_this();
+  boost::asio::async_write(m_socket, boost::asio::buffer(m_response),
+      [this, self](const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        m_response.clear();
+        m_service_time = std::chrono::microseconds(0);
+        if(!l_error && !m_quit) {
+          do_read();
+        }
+      });
+}
+
+void FakeSession::packet_is_received()
+{
+  unsigned char sequence_id =
+      static_cast<unsigned char>(m_packet.sequence_id() + 1);
+
+  // HandshakeResponse is accepted without the authentication.
+  if(proxy::MySqlConnectionState::CONNECTION_PHASE == m_connection_state) {
+    m_deprecate_eof = 0
+        != (m_packet.capabilities() & bench::CAPABILITIES
+            & proxy::MySqlCapability::CLIENT_DEPRECATE_EOF);
+    bench::append_ok(m_response, sequence_id);
+    m_connection_state = proxy::MySqlConnectionState::COMMAND_PHASE;
+    return;
+  }
+
+  switch(m_packet.command()) {
+    case proxy::MySqlCommand::Command::COM_QUIT: {
+      m_quit = true;
+      break;
+    }
+    case proxy::MySqlCommand::Command::COM_QUERY: {
+      m_service_time +=
+          next_service_time(m_settings.m_service_time, m_random_engine);
+      const std::int64_t rows =
+          query_rows(m_packet.get_sql_string(), m_settings);
+      if(0 <= rows) {
+        bench::append_result_set(m_response, sequence_id, m_settings.m_columns,
+            static_cast<std::size_t>(rows), m_settings.m_value_length,
+            m_deprecate_eof);
+      } else {
+        bench::append_ok(m_response, sequence_id);
+      }
+      break;
+    }
+    case proxy::MySqlCommand::Command::COM_INIT_DB:
+    case proxy::MySqlCommand::Command::COM_PING:
+    case proxy::MySqlCommand::Command::COM_RESET_CONNECTION: {
+      bench::append_ok(m_response, sequence_id);
+      break;
+    }
+    default: {
+      // ER_UNKNOWN_COM_ERROR
+      bench::append_err(m_response, sequence_id, 1047, "Unknown command");
+      break;
+    }
+  }
+}
+
+
+/// Accept the connections and start the sessions.
+void do_accept(boost::asio::io_context& t_io_context,
+    proxy::StreamAcceptor& t_acceptor,
+    const FakeServerSettings& t_settings,
+    std::uint32_t t_connection_id)
+{
+  t_acceptor.async_accept(
+      [&t_io_context, &t_acceptor, &t_settings, t_connection_id](
+          const boost::system::error_code& l_error,
+          StreamProtocol::socket l_socket) -> void {
+        if(l_error == boost::asio::error::operation_aborted) {
+          return;
+        }
+        if(!l_error) {
+          boost::system::error_code error;
+          l_socket.set_option(boost::asio::ip::tcp::no_delay(true), error);
+          std::make_shared<FakeSession>(
+              t_io_context, std::move(l_socket), t_settings, t_connection_id)
+              ->start();
+        }
+        do_accept(t_io_context, t_acceptor, t_settings, t_connection_id + 1);
+      });
+}
+
+}  // namespace
+
+int main(int t_argc, char* t_argv[])
+{
+  if(t_argc < 3) {
+    std::cerr << "Usage: proxy_fake_server <ip> <port> [--threads=<N>]"
+                 " [--rows=<N>] [--columns=<N>] [--value-length=<bytes>]"
+                 " [--service-time=<us>|uniform:<min us>:<max us>"
+                 "|exponential:<mean us>]\n";
+    return 1;
+  }
+
+  FakeServerSettings settings;
+  for(int i = 3; i < t_argc; ++i) {
+    const std::string option = t_argv[i];
+    const std::size_t equal_pos = option.find('=');
+    const std::string name = option.substr(0, equal_pos);
+    const std::string value = (std::string::npos == equal_pos)
+        ? std::string()
+        : option.substr(equal_pos + 1);
+    try {
+      if("--threads" == name) {
+        settings.m_threads = std::max<std::size_t>(1, std::stoul(value));
+      } else if("--rows" == name) {
+        settings.m_rows = std::stoul(value);
+      } else if("--columns" == name) {
+        settings.m_columns = std::max<std::size_t>(1, std::stoul(value));
+      } else if("--value-length" == name) {
+        settings.m_value_length = std::stoul(value);
+      } else if("--service-time" == name) {
+        settings.m_service_time = parse_service_time(value);
+      } else {
+        throw std::invalid_argument(option);
+      }
+    } catch(std::exception&) {
+      std::cerr << "Wrong option: " << option << "\n";
+      return 1;
+    }
+  }
+
+  try {
+    boost::asio::io_context io_context;
+    const std::string address = proxy::is_unix_address(t_argv[1])
+        ? std::string(t_argv[1])
+        : std::string(t_argv[1]) + ":" + t_argv[2];
+    const StreamProtocol::endpoint endpoint =
+        proxy::resolve_endpoint(io_context, address);
+
+    proxy::StreamAcceptor acceptor(io_context);
+    acceptor.open(endpoint.protocol());
+    if(proxy::is_tcp_endpoint(endpoint)) {
+      acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    } else {
+      // The socket file of the previous run prevents the binding.
+      const std::string socket_path =
+          address.substr(std::strlen(proxy::UNIX_ADDRESS_PREFIX));
+      std::remove(socket_path.c_str());
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen(boost::asio::socket_base::max_listen_connections);
+
+    boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait(
+        [&io_context](const boost::system::error_code& /*l_error*/,
+            int /*l_signal_number*/) -> void { io_context.stop(); });
+
+    do_accept(io_context, acceptor, settings, 1);
+    std::cout << "Fake MySQL server is listening on " << address << "\n";
+
+    // The sessions of one io_context run in the threads one by one,
+    // each session has only one handler in progress.
+    std::vector<std::thread> threads;
+    for(std::size_t i = 1; i < settings.m_threads; ++i) {
+      threads.emplace_back([&io_context]() -> void { io_context.run(); });
+    }
+    io_context.run();
+    for(std::thread& thread : threads) {
+      thread.join();
+    }
+  } catch(std::exception& e) {
+    std::cerr << "Fake MySQL server stopped with exception: " << e.what()
+              << "\n";
+    return 1;
+  }
+
+  return 0;
+}
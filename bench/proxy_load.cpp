@@ -0,0 +1,598 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "bench_protocol.hpp"
+#include "endpoint.hpp"
+#include "packet.hpp"
+
+namespace
+{
+using bench::Bytes;
+using proxy::StreamProtocol;
+
+/// Settings of the load generator.
+struct LoadSettings
+{
+  std::size_t m_sessions = 16;
+  std::size_t m_threads = 1;
+
+  /// Time of the measurement in seconds, after all sessions are connected.
+  double m_duration = 10;
+
+  /// The user without the password.
+  std::string m_user = "bench";
+
+  /// The query of the sessions and the percent of the COM_PING instead of it.
+  std::string m_query = "SELECT 1";
+  std::size_t m_ping_percent = 0;
+
+  /// The sessions which are connected and send nothing.
+  std::size_t m_idle_sessions = 0;
+
+  /// The pause of the sessions between the commands in milliseconds.
+  std::size_t m_trickle_interval = 0;
+
+  /// The period of the progress reports in seconds, 0 disables them.
+  double m_report_interval = 0;
+
+  /// The process of the proxy whose memory is reported.
+  pid_t m_proxy_pid = 0;
+};
+
+/// The commands sent by the sessions.
+struct Commands
+{
+  Bytes m_handshake_response;
+  Bytes m_query;
+  Bytes m_ping;
+};
+
+/// The counters and the latencies of the sessions of one thread.
+struct LoadStats
+{
+  std::uint64_t m_queries = 0;
+  std::uint64_t m_errors = 0;
+  std::uint64_t m_bytes_sent = 0;
+  std::uint64_t m_bytes_received = 0;
+
+  /// Latencies of the commands in microseconds.
+  std::vector<std::uint32_t> m_latencies;
+};
+
+/// The state shared by the sessions of all threads.
+struct LoadControl
+{
+  std::atomic<std::size_t> m_connected{0};
+  std::atomic<std::size_t> m_failed{0};
+
+  /// The connected sessions which are closed by the server.
+  std::atomic<std::size_t> m_closed{0};
+
+  /// The responses for the progress reports.
+  std::atomic<std::uint64_t> m_responses{0};
+
+  /// The commands are counted.
+  std::atomic<bool> m_measuring{false};
+
+  /// The sessions send the next commands.
+  std::atomic<bool> m_running{true};
+};
+
+
+/// The client's session which sends the commands one by one
+/// and waits for each response.
+class LoadSession : public std::enable_shared_from_this<LoadSession>
+{
+public:
+  LoadSession(const LoadSession&) = delete;
+  LoadSession(LoadSession&&) = delete;
+  LoadSession& operator=(const LoadSession&) = delete;
+  LoadSession& operator=(LoadSession&&) = delete;
+
+  ~LoadSession() = default;
+
+  explicit LoadSession(boost::asio::io_context& t_io_context,
+      const LoadSettings& t_settings,
+      const Commands& t_commands,
+      LoadStats& t_stats,
+      LoadControl& t_control,
+      bool t_is_idle);
+
+  void start(const StreamProtocol::endpoint& t_endpoint);
+
+private:
+  void do_read();
+  void do_write(const Bytes& t_request);
+
+  /// Answer the handshake packets of the server.
+  void handshake_packet_is_received();
+
+  /// Count the response and send the next command.
+  void response_is_received();
+  void send_command();
+
+  /// Send the next command after the trickle interval.
+  void schedule_command();
+
+  void connect_failed();
+
+  StreamProtocol::socket m_socket;
+  boost::asio::steady_timer m_trickle_timer;
+  const LoadSettings& m_settings;
+  const Commands& m_commands;
+  LoadStats& m_stats;
+  LoadControl& m_control;
+  const bool m_is_idle;
+
+  proxy::FromServerPacket m_packet;
+  proxy::MySqlConnectionState m_connection_state =
+      proxy::MySqlConnectionState::CONNECTION_PHASE;
+  bool m_is_connected = false;
+  bool m_greeting_is_received = false;
+
+  /// The idle sessions read the small handshake packets only.
+  Bytes m_read_buffer;
+  Bytes m_auth_response;
+  std::uint64_t m_command_number = 0;
+  std::chrono::steady_clock::time_point m_command_start;
+};
+
+LoadSession::LoadSession(boost::asio::io_context& t_io_context,
+    const LoadSettings& t_settings,
+    const Commands& t_commands,
+    LoadStats& t_stats,
+    LoadControl& t_control,
+    bool t_is_idle)
+    : m_socket(t_io_context)
+    , m_trickle_timer(t_io_context)
+    , m_settings(t_settings)
+    , m_commands(t_commands)
+    , m_stats(t_stats)
+    , m_control(t_control)
+    , m_is_idle(t_is_idle)
+    , m_read_buffer(t_is_idle ? 256 : 8192)
+{
+}
+
+void LoadSession::start(const StreamProtocol::endpoint& t_endpoint)
+{
+  auto self = shared_from_this();
+  m_socket.async_connect(
+      t_endpoint, [this, self](const boost::system::error_code& l_error) {
+        if(l_error) {
+          connect_failed();
+          return;
+        }
+        boost::system::error_code error;
+        m_socket.set_option(boost::asio::ip::tcp::no_delay(true), error);
+        do_read();
+      });
+}
+
+void LoadSession::do_read()
+{
+  auto self = shared_from_this();
+  m_socket.async_read_some(boost::asio::buffer(m_read_buffer),
+      [this, self](const boost::system::error_code& l_error,
+          std::size_t l_bytes_transferred) -> void {
+        if(l_error) {
+          if(!m_is_connected) {
+            connect_failed();
+          } else if(m_control.m_running.load(std::memory_order_relaxed)) {
+            ++m_control.m_closed;
+          }
+          return;
+        }
+
+        if(m_control.m_measuring.load(std::memory_order_relaxed)) {
+          m_stats.m_bytes_received += l_bytes_transferred;
+        }
+        for(std::size_t i = 0; i < l_bytes_transferred; ++i) {
+          m_packet.collect(m_read_buffer[i], m_connection_state);
+          if(m_packet.is_received()) {
+            if(m_is_connected) {
+              response_is_received();
+            } else {
+              handshake_packet_is_received();
+            }
+          }
+        }
+
+        if(m_socket.is_open()) {
+          do_read();
+        }
+      });
+}
+
+void LoadSession::do_write(const Bytes& t_request)
+{
+  auto self = shared_from_this();
+  boost::asio::async_write(m_socket, boost::asio::buffer(t_request),
+      [self](const boost::system::error_code& /*l_error*/,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        // The errors are found by the reads.
+      });
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase.html
+void LoadSession::handshake_packet_is_received()
+{
+  // The OK packet moves the connection to the command phase.
+  if(proxy::MySqlConnectionState::COMMAND_PHASE == m_connection_state) {
+    m_is_connected = true;
+    ++m_control.m_connected;
+    if(!m_is_idle) {
+      send_command();
+    }
+    return;
+  }
+
+  const unsigned char payload_0 =
+      (0 < m_packet.payload_head_length()) ? m_packet.payload_head()[0] : 0;
+  if(0xff == payload_0) {
+    connect_failed();
+    return;
+  }
+
+  if(!m_greeting_is_received) {
+    m_greeting_is_received = true;
+    do_write(m_commands.m_handshake_response);
+  } else if(0xfe == payload_0) {
+    // AuthSwitchRequest, the empty password has the empty auth response.
+    m_auth_response = {0x00, 0x00, 0x00,
+        static_cast<unsigned char>(m_packet.sequence_id() + 1)};
+    do_write(m_auth_response);
+  }
+}
+
+void LoadSession::response_is_received()
+{
+  if(!m_packet.is_response_complete()) {
+    return;
+  }
+
+  if(m_control.m_measuring.load(std::memory_order_relaxed)) {
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - m_command_start);
+    ++m_stats.m_queries;
+    if(m_packet.is_response_failed()) {
+      ++m_stats.m_errors;
+    }
+    m_stats.m_latencies.push_back(static_cast<std::uint32_t>(latency.count()));
+  }
+  m_control.m_responses.fetch_add(1, std::memory_order_relaxed);
+  schedule_command();
+}
+
+void LoadSession::schedule_command()
+{
+  if(0 == m_settings.m_trickle_interval) {
+    send_command();
+    return;
+  }
+
+  auto self = shared_from_this();
+  m_trickle_timer.expires_after(
+      std::chrono::milliseconds(m_settings.m_trickle_interval));
+  m_trickle_timer.async_wait(
+      [this, self](const boost::system::error_code& l_error) -> void {
+        if(!l_error && m_socket.is_open()) {
+          send_command();
+        }
+      });
+}
+
+void LoadSession::send_command()
+{
+  if(!m_control.m_running.load(std::memory_order_relaxed)) {
+    boost::system::error_code error;
+    m_socket.close(error);
+    return;
+  }
+
+  const bool is_ping = (m_command_number++ % 100) < m_settings.m_ping_percent;
+  const Bytes& request = is_ping ? m_commands.m_ping : m_commands.m_query;
+  m_packet.expect_response(is_ping ? proxy::MySqlCommand::Command::COM_PING
+                                   : proxy::MySqlCommand::Command::COM_QUERY,
+      request.size() - 4, bench::CAPABILITIES);
+
+  if(m_control.m_measuring.load(std::memory_order_relaxed)) {
+    m_stats.m_bytes_sent += request.size();
+  }
+  m_command_start = std::chrono::steady_clock::now();
+  do_write(request);
+}
+
+void LoadSession::connect_failed()
+{
+  ++m_control.m_failed;
+  boost::system::error_code error;
+  m_socket.close(error);
+}
+
+
+/// Get the percentile of the sorted latencies.
+std::uint32_t percentile(
+    const std::vector<std::uint32_t>& t_latencies, double t_percent)
+{
+  if(t_latencies.empty()) {
+    return 0;
+  }
+  const auto index = static_cast<std::size_t>(
+      static_cast<double>(t_latencies.size()) * t_percent / 100);
+  return t_latencies[std::min(index, t_latencies.size() - 1)];
+}
+
+/// Get the resident memory of the process in bytes, 0 if it is unknown.
+std::size_t read_resident(pid_t t_pid)
+{
+  // See https://man7.org/linux/man-pages/man5/proc.5.html
+  // The second field of /proc/<pid>/statm is the resident pages.
+  std::ifstream statm("/proc/" + std::to_string(t_pid) + "/statm");
+  std::size_t size_pages = 0;
+  std::size_t resident_pages = 0;
+  if(!(statm >> size_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+/// Print the memory of the proxy and ask it to print its allocator's
+/// statistics.
+void report_proxy_memory(pid_t t_pid,
+    std::size_t t_resident_baseline,
+    std::size_t t_sessions)
+{
+  const std::size_t resident = read_resident(t_pid);
+  std::cout << ", proxy resident " << resident << " bytes";
+  if(0 < t_sessions && resident > t_resident_baseline) {
+    std::cout << ", " << (resident - t_resident_baseline) / t_sessions
+              << " bytes per session";
+  }
+  ::kill(t_pid, SIGUSR1);
+}
+
+/// Allow the file descriptors of all sessions up to the hard limit.
+void raise_file_limit()
+{
+  struct rlimit limit = {};
+  if(0 == ::getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+}  // namespace
+
+int main(int t_argc, char* t_argv[])
+{
+  if(t_argc < 3) {
+    std::cerr << "Usage: proxy_load <ip> <port> [--sessions=<N>]"
+                 " [--threads=<N>] [--duration=<s>] [--user=<name>]"
+                 " [--query=<SQL>] [--ping-percent=<N>]"
+                 " [--idle-sessions=<N>] [--trickle-interval=<ms>]"
+                 " [--report-interval=<s>] [--proxy-pid=<pid>]\n";
+    return 1;
+  }
+
+  LoadSettings settings;
+  for(int i = 3; i < t_argc; ++i) {
+    const std::string option = t_argv[i];
+    const std::size_t equal_pos = option.find('=');
+    const std::string name = option.substr(0, equal_pos);
+    const std::string value = (std::string::npos == equal_pos)
+        ? std::string()
+        : option.substr(equal_pos + 1);
+    try {
+      if("--sessions" == name) {
+        settings.m_sessions = std::stoul(value);
+      } else if("--threads" == name) {
+        settings.m_threads = std::max<std::size_t>(1, std::stoul(value));
+      } else if("--duration" == name) {
+        settings.m_duration = std::stod(value);
+      } else if("--user" == name) {
+        settings.m_user = value;
+      } else if("--query" == name) {
+        settings.m_query = value;
+      } else if("--ping-percent" == name) {
+        settings.m_ping_percent = std::min<std::size_t>(100, std::stoul(value));
+      } else if("--idle-sessions" == name) {
+        settings.m_idle_sessions = std::stoul(value);
+      } else if("--trickle-interval" == name) {
+        settings.m_trickle_interval = std::stoul(value);
+      } else if("--report-interval" == name) {
+        settings.m_report_interval = std::stod(value);
+      } else if("--proxy-pid" == name) {
+        settings.m_proxy_pid = static_cast<pid_t>(std::stoul(value));
+      } else {
+        throw std::invalid_argument(option);
+      }
+    } catch(std::exception&) {
+      std::cerr << "Wrong option: " << option << "\n";
+      return 1;
+    }
+  }
+  const std::size_t session_count =
+      settings.m_sessions + settings.m_idle_sessions;
+  if(0 == session_count) {
+    std::cerr << "No sessions\n";
+    return 1;
+  }
+  raise_file_limit();
+
+  Commands commands;
+  commands.m_handshake_response = bench::make_handshake_response(settings.m_user);
+  commands.m_query =
+      bench::make_command(proxy::MySqlCommand::Command::COM_QUERY, settings.m_query);
+  commands.m_ping =
+      bench::make_command(proxy::MySqlCommand::Command::COM_PING, "");
+
+  std::vector<LoadStats> stats(settings.m_threads);
+  LoadControl control;
+
+  try {
+    // Each thread runs its own io_context with its part of the sessions.
+    std::vector<std::unique_ptr<boost::asio::io_context>> io_contexts;
+    for(std::size_t i = 0; i < settings.m_threads; ++i) {
+      io_contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+    }
+    const std::string address = proxy::is_unix_address(t_argv[1])
+        ? std::string(t_argv[1])
+        : std::string(t_argv[1]) + ":" + t_argv[2];
+    const StreamProtocol::endpoint endpoint =
+        proxy::resolve_endpoint(*io_contexts.front(), address);
+
+    // The growth of the proxy's memory is divided by the sessions.
+    const std::size_t resident_baseline = (0 < settings.m_proxy_pid)
+        ? read_resident(settings.m_proxy_pid)
+        : 0;
+
+    const auto connect_start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < session_count; ++i) {
+      const std::size_t thread_index = i % settings.m_threads;
+      std::make_shared<LoadSession>(*io_contexts[thread_index], settings,
+          commands, stats[thread_index], control, settings.m_sessions <= i)
+          ->start(endpoint);
+    }
+    std::vector<std::thread> threads;
+    for(auto& io_context : io_contexts) {
+      threads.emplace_back([&io_context]() -> void { io_context->run(); });
+    }
+
+    // The measurement starts when all sessions are connected
+    // or the rest of them do not answer.
+    const auto connect_deadline = connect_start + std::chrono::seconds(60);
+    while(control.m_connected + control.m_failed < session_count
+        && std::chrono::steady_clock::now() < connect_deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const std::chrono::duration<double> connect_time =
+        std::chrono::steady_clock::now() - connect_start;
+    std::cout << std::fixed << std::setprecision(2)
+              << "Sessions: " << control.m_connected << " connected, "
+              << control.m_failed << " failed in " << connect_time.count()
+              << " s";
+    if(0 < settings.m_proxy_pid) {
+      report_proxy_memory(
+          settings.m_proxy_pid, resident_baseline, control.m_connected);
+    }
+    std::cout << std::endl;
+
+    control.m_measuring = true;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration_cast<
+        std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(settings.m_duration));
+    if(0 < settings.m_report_interval) {
+      // The soak reports show the leaks and the closed sessions over time.
+      const auto interval =
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(settings.m_report_interval));
+      for(auto report_time = start + interval; report_time < end;
+          report_time += interval) {
+        std::this_thread::sleep_until(report_time);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        const std::size_t open_sessions =
+            control.m_connected - control.m_closed;
+        std::cout << elapsed.count() << " s: " << open_sessions
+                  << " sessions, " << control.m_responses << " responses";
+        if(0 < settings.m_proxy_pid) {
+          report_proxy_memory(
+              settings.m_proxy_pid, resident_baseline, open_sessions);
+        }
+        std::cout << std::endl;
+      }
+    }
+    std::this_thread::sleep_until(end);
+    control.m_measuring = false;
+    if(0 < settings.m_proxy_pid) {
+      const std::size_t open_sessions = control.m_connected - control.m_closed;
+      std::cout << "Memory: " << open_sessions << " sessions";
+      report_proxy_memory(
+          settings.m_proxy_pid, resident_baseline, open_sessions);
+      std::cout << std::endl;
+    }
+    const std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+
+    control.m_running = false;
+    for(auto& io_context : io_contexts) {
+      io_context->stop();
+    }
+    for(std::thread& thread : threads) {
+      thread.join();
+    }
+
+    LoadStats total;
+    for(LoadStats& thread_stats : stats) {
+      total.m_queries += thread_stats.m_queries;
+      total.m_errors += thread_stats.m_errors;
+      total.m_bytes_sent += thread_stats.m_bytes_sent;
+      total.m_bytes_received += thread_stats.m_bytes_received;
+      total.m_latencies.insert(total.m_latencies.end(),
+          thread_stats.m_latencies.begin(), thread_stats.m_latencies.end());
+    }
+    std::sort(total.m_latencies.begin(), total.m_latencies.end());
+
+    const double seconds = duration.count();
+    std::cout << "Duration: " << seconds << " s, queries: " << total.m_queries
+              << ", errors: " << total.m_errors
+              << ", closed sessions: " << control.m_closed << "\n"
+              << "QPS: " << total.m_queries / seconds << "\n"
+              << "Throughput: sent " << total.m_bytes_sent / seconds / 1e6
+              << " MB/s, received " << total.m_bytes_received / seconds / 1e6
+              << " MB/s\n"
+              << "Latency, us: min " << percentile(total.m_latencies, 0)
+              << ", p50 " << percentile(total.m_latencies, 50) << ", p90 "
+              << percentile(total.m_latencies, 90) << ", p99 "
+              << percentile(total.m_latencies, 99) << ", p99.9 "
+              << percentile(total.m_latencies, 99.9) << ", max "
+              << percentile(total.m_latencies, 100) << "\n";
+  } catch(std::exception& e) {
+    std::cerr << "Load generator stopped with exception: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
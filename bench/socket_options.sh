@@ -0,0 +1,112 @@
+#!/bin/bash
+# ****************************************************************************
+#  Project:  Boost_Asio_MySQL_Proxy
+#  Purpose:  Test project
+#  Author:   NikitaFeodonit, nfeodonit@yandex.com
+# ****************************************************************************
+#    Copyright (c) 2019 NikitaFeodonit
+#
+#     This file is part of the Boost_Asio_MySQL_Proxy project.
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published
+#     by the Free Software Foundation, either version 3 of the License,
+#     or (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+#     See the GNU General Public License for more details.
+#
+#     You should have received a copy of the GNU General Public License
+#     along with this program. If not, see <http://www.gnu.org/licenses/>.
+# ****************************************************************************
+
+# Runs the same proxy_load through the proxy with each socket option
+# toggled against the defaults and prints the QPS and the latencies
+# of each run.
+#
+# Usage: socket_options.sh <build dir> [<proxy_load option> ...]
+#
+# The environment variables:
+#   FAKE_PORT -- port of proxy_fake_server (3310 by default).
+#   PROXY_PORT -- port of the proxy (16530 by default).
+#   FAKE_OPTIONS -- options of proxy_fake_server ("--threads=2" by default).
+#   PROXY_OPTIONS -- common options of the proxy ("--threads=2" by default).
+#   VARIANTS -- the proxy options of the runs, separated by spaces,
+#     "default" is the run without the extra option.
+
+set -e
+
+if [ -z "$1" ]; then
+  echo "Usage: socket_options.sh <build dir> [<proxy_load option> ...]" >&2
+  exit 1
+fi
+BUILD_DIR="$1"
+shift
+
+FAKE_PORT="${FAKE_PORT:-3310}"
+PROXY_PORT="${PROXY_PORT:-16530}"
+FAKE_OPTIONS="${FAKE_OPTIONS:---threads=2}"
+PROXY_OPTIONS="${PROXY_OPTIONS:---threads=2}"
+VARIANTS="${VARIANTS:-default --tcp-nodelay=0 --tcp-quickack=1 \
+--busy-poll=50 --notsent-lowat=16384}"
+
+LOG_DIR="$(mktemp -d)"
+FAKE_PID=""
+PROXY_PID=""
+
+stop() {
+  if [ -n "$PROXY_PID" ]; then
+    kill "$PROXY_PID" 2>/dev/null || true
+    wait "$PROXY_PID" 2>/dev/null || true
+    PROXY_PID=""
+  fi
+}
+
+cleanup() {
+  stop
+  if [ -n "$FAKE_PID" ]; then
+    kill "$FAKE_PID" 2>/dev/null || true
+    wait "$FAKE_PID" 2>/dev/null || true
+  fi
+  rm -rf "$LOG_DIR"
+}
+trap cleanup EXIT
+
+# Wait until the port accepts the connections.
+wait_port() {
+  for i in $(seq 50); do
+    if (exec 3<>"/dev/tcp/127.0.0.1/$1") 2>/dev/null; then
+      return 0
+    fi
+    sleep 0.1
+  done
+  echo "Port $1 is not open" >&2
+  return 1
+}
+
+# shellcheck disable=SC2086
+"$BUILD_DIR/proxy_fake_server" 127.0.0.1 "$FAKE_PORT" $FAKE_OPTIONS \
+  > "$LOG_DIR/fake_server.out" 2>&1 &
+FAKE_PID=$!
+wait_port "$FAKE_PORT"
+
+for variant in $VARIANTS; do
+  option=""
+  if [ "default" != "$variant" ]; then
+    option="$variant"
+  fi
+
+  # shellcheck disable=SC2086
+  "$BUILD_DIR/boost-asio-mysql-proxy" 127.0.0.1 "$PROXY_PORT" \
+    127.0.0.1 "$FAKE_PORT" "$LOG_DIR/sql_log.log" $PROXY_OPTIONS $option \
+    > "$LOG_DIR/proxy.out" 2>&1 &
+  PROXY_PID=$!
+  wait_port "$PROXY_PORT"
+
+  echo "== $variant"
+  "$BUILD_DIR/proxy_load" 127.0.0.1 "$PROXY_PORT" "$@" \
+    | grep -E "^(Duration|QPS|Latency)"
+  stop
+done
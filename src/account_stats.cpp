@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "account_stats.hpp"
+
+#include <iostream>
+
+#include "sql_scanner.hpp"
+
+namespace proxy
+{
+namespace
+{
+/// The counters are written by the thread of their worker only,
+/// the atomic stores are for the readers of the stats output.
+void add(std::atomic<std::uint64_t>& t_counter, std::uint64_t t_value)
+{
+  t_counter.store(t_counter.load(std::memory_order_relaxed) + t_value,
+      std::memory_order_relaxed);
+}
+
+/// The counters summed over the workers.
+struct AccountTotals
+{
+  std::uint64_t m_queries = 0;
+  std::uint64_t m_bytes_in = 0;
+  std::uint64_t m_bytes_out = 0;
+  std::uint64_t m_busy_time = 0;
+
+  void add(const AccountCounters& t_counters)
+  {
+    m_queries += t_counters.m_queries.load(std::memory_order_relaxed);
+    m_bytes_in += t_counters.m_bytes_in.load(std::memory_order_relaxed);
+    m_bytes_out += t_counters.m_bytes_out.load(std::memory_order_relaxed);
+    m_busy_time += t_counters.m_busy_time.load(std::memory_order_relaxed);
+  }
+};
+
+void print_totals(const char* t_title,
+    const std::string& t_route_name,
+    const std::vector<std::string>& t_names,
+    const std::array<AccountTotals, AccountNames::MAX_IDS>& t_totals)
+{
+  std::cout << t_title << " of route " << t_route_name << ":\n";
+  for(std::size_t id = 0; id < AccountNames::MAX_IDS; ++id) {
+    const AccountTotals& totals = t_totals[id];
+    if(0 == totals.m_queries + totals.m_bytes_in + totals.m_bytes_out) {
+      continue;
+    }
+    std::cout << "  ";
+    if(AccountNames::NONE_ID == id) {
+      std::cout << "(none)";
+    } else if(AccountNames::OTHER_ID == id) {
+      std::cout << "(other)";
+    } else if(id < t_names.size()) {
+      std::cout << t_names[id];
+    }
+    std::cout << ": " << totals.m_queries << " queries, " << totals.m_bytes_in
+              << " bytes in, " << totals.m_bytes_out << " bytes out, busy "
+              << totals.m_busy_time << " us\n";
+  }
+}
+
+}  // namespace
+
+AccountNames::AccountNames()
+{
+  m_names.reserve(MAX_IDS);
+  m_names.emplace_back();
+  m_ids.emplace(std::string(), NONE_ID);
+}
+
+AccountNames::Id AccountNames::intern(const std::string& t_name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto found = m_ids.find(t_name);
+  if(m_ids.end() != found) {
+    return found->second;
+  }
+  if(OTHER_ID <= m_names.size()) {
+    return OTHER_ID;
+  }
+  const auto id = static_cast<Id>(m_names.size());
+  m_names.push_back(t_name);
+  m_ids.emplace(t_name, id);
+  return id;
+}
+
+std::vector<std::string> AccountNames::names() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_names;
+}
+
+std::string AccountStats::use_statement_schema(std::string_view t_sql)
+{
+  // See https://dev.mysql.com/doc/refman/8.0/en/use.html
+  SqlScanner scanner(t_sql);
+  const SqlToken first = scanner.next();
+  if(SqlTokenType::WORD != first.m_type
+      || !SqlScanner::equals_nocase(first.m_text, "use")) {
+    return std::string();
+  }
+  const SqlToken schema = scanner.next();
+  if(SqlTokenType::WORD != schema.m_type) {
+    return std::string();
+  }
+  return std::string(schema.m_text);
+}
+
+void AccountStats::add_query(
+    AccountNames::Id t_user, AccountNames::Id t_schema)
+{
+  add(m_users[t_user].m_queries, 1);
+  add(m_schemas[t_schema].m_queries, 1);
+}
+
+void AccountStats::add_bytes(AccountNames::Id t_user,
+    AccountNames::Id t_schema,
+    bool t_is_in,
+    std::uint64_t t_bytes)
+{
+  if(t_is_in) {
+    add(m_users[t_user].m_bytes_in, t_bytes);
+    add(m_schemas[t_schema].m_bytes_in, t_bytes);
+  } else {
+    add(m_users[t_user].m_bytes_out, t_bytes);
+    add(m_schemas[t_schema].m_bytes_out, t_bytes);
+  }
+}
+
+void AccountStats::add_busy_time(AccountNames::Id t_user,
+    AccountNames::Id t_schema,
+    std::chrono::steady_clock::duration t_time)
+{
+  const auto time = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(t_time).count());
+  add(m_users[t_user].m_busy_time, time);
+  add(m_schemas[t_schema].m_busy_time, time);
+}
+
+void AccountStats::print(const std::string& t_route_name,
+    const AccountNames& t_users,
+    const AccountNames& t_schemas,
+    const std::vector<std::unique_ptr<AccountStats>>& t_stats)
+{
+  std::array<AccountTotals, AccountNames::MAX_IDS> users{};
+  std::array<AccountTotals, AccountNames::MAX_IDS> schemas{};
+  for(const std::unique_ptr<AccountStats>& stats : t_stats) {
+    for(std::size_t id = 0; id < AccountNames::MAX_IDS; ++id) {
+      users[id].add(stats->m_users[id]);
+      schemas[id].add(stats->m_schemas[id]);
+    }
+  }
+
+  print_totals("Users", t_route_name, t_users.names(), users);
+  print_totals("Schemas", t_route_name, t_schemas.names(), schemas);
+}
+
+}  // namespace proxy
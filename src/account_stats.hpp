@@ -0,0 +1,135 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_ACCOUNT_STATS_HPP
+#define PROXY_ACCOUNT_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace proxy
+{
+/// The names of the users or of the schemas of a route interned
+/// into small ids shared by the workers. The names are interned once
+/// per session and per schema change, the counters are indexed by the ids.
+class AccountNames
+{
+public:
+  using Id = std::uint8_t;
+
+  /// Maximum number of the ids including the reserved ones.
+  static constexpr std::size_t MAX_IDS = 256;
+
+  /// The id of the empty name, the session without a schema for example.
+  static constexpr Id NONE_ID = 0;
+
+  /// The id of the names over the limit.
+  static constexpr Id OTHER_ID = MAX_IDS - 1;
+
+  AccountNames(const AccountNames&) = delete;
+  AccountNames(AccountNames&&) = delete;
+  AccountNames& operator=(const AccountNames&) = delete;
+  AccountNames& operator=(AccountNames&&) = delete;
+
+  ~AccountNames() = default;
+
+  explicit AccountNames();
+
+  /// Get the id of the name, a new name gets the next free id.
+  Id intern(const std::string& t_name);
+
+  /// Get the copy of the interned names indexed by their ids.
+  std::vector<std::string> names() const;
+
+private:
+  mutable std::mutex m_mutex;
+  std::unordered_map<std::string, Id> m_ids;
+  std::vector<std::string> m_names;
+};
+
+/// The resource counters of a user or of a schema.
+struct AccountCounters
+{
+  std::atomic<std::uint64_t> m_queries{0};
+  std::atomic<std::uint64_t> m_bytes_in{0};
+  std::atomic<std::uint64_t> m_bytes_out{0};
+
+  /// Summary time of the server's responses in microseconds.
+  std::atomic<std::uint64_t> m_busy_time{0};
+};
+
+/// The resource usage of the users and of the schemas of a worker.
+/// The counters are written by the thread of the worker only
+/// and are summed over the workers by the stats output.
+class AccountStats
+{
+public:
+  AccountStats(const AccountStats&) = delete;
+  AccountStats(AccountStats&&) = delete;
+  AccountStats& operator=(const AccountStats&) = delete;
+  AccountStats& operator=(AccountStats&&) = delete;
+
+  ~AccountStats() = default;
+
+  explicit AccountStats() = default;
+
+  /// Get the schema of the USE statement, empty if it is another statement.
+  static std::string use_statement_schema(std::string_view t_sql);
+
+  /// Count the client's command.
+  void add_query(AccountNames::Id t_user, AccountNames::Id t_schema);
+
+  /// Count the bytes from the client or to the client.
+  void add_bytes(AccountNames::Id t_user,
+      AccountNames::Id t_schema,
+      bool t_is_in,
+      std::uint64_t t_bytes);
+
+  /// Count the time of the server's response.
+  void add_busy_time(AccountNames::Id t_user,
+      AccountNames::Id t_schema,
+      std::chrono::steady_clock::duration t_time);
+
+  /// Print the counters of the route summed over the workers.
+  static void print(const std::string& t_route_name,
+      const AccountNames& t_users,
+      const AccountNames& t_schemas,
+      const std::vector<std::unique_ptr<AccountStats>>& t_stats);
+
+private:
+  std::array<AccountCounters, AccountNames::MAX_IDS> m_users{};
+  std::array<AccountCounters, AccountNames::MAX_IDS> m_schemas{};
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_ACCOUNT_STATS_HPP
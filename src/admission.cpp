@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "admission.hpp"
+
+namespace proxy
+{
+Admission::Admission(
+    std::size_t t_max_connections, std::size_t t_max_connections_per_ip)
+    : m_max_connections(t_max_connections)
+    , m_max_connections_per_ip(t_max_connections_per_ip)
+{
+}
+
+bool Admission::admit(const std::string& t_client_ip)
+{
+  const std::size_t connections =
+      m_connections.fetch_add(1, std::memory_order_relaxed);
+  if(0 < m_max_connections && connections >= m_max_connections) {
+    m_connections.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if(0 < m_max_connections_per_ip && !t_client_ip.empty()) {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t& ip_connections = m_ip_connections[t_client_ip];
+    if(ip_connections >= m_max_connections_per_ip) {
+      m_connections.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+    ++ip_connections;
+  }
+  return true;
+}
+
+void Admission::release(const std::string& t_client_ip)
+{
+  if(0 < m_max_connections_per_ip && !t_client_ip.empty()) {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_ip_connections.find(t_client_ip);
+    if(m_ip_connections.end() != it && 0 == --it->second) {
+      m_ip_connections.erase(it);
+    }
+  }
+  m_connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+}  // namespace proxy
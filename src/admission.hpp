@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_ADMISSION_HPP
+#define PROXY_ADMISSION_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace proxy
+{
+/// The admission control of the accepted connections: the limit
+/// of the process connections and the limit of the connections
+/// from one client's IP address. The connections are admitted
+/// by the accepting thread and released by the threads of the workers.
+class Admission
+{
+public:
+  Admission(const Admission&) = delete;
+  Admission(Admission&&) = delete;
+  Admission& operator=(const Admission&) = delete;
+  Admission& operator=(Admission&&) = delete;
+
+  ~Admission() = default;
+
+  /// Construct the admission with the limits, 0 turns the limit off.
+  explicit Admission(
+      std::size_t t_max_connections, std::size_t t_max_connections_per_ip);
+
+  /// Admit the connection from the client's IP address, which is empty
+  /// for the Unix domain socket. Returns false if a limit is reached.
+  bool admit(const std::string& t_client_ip);
+
+  /// Release the admitted connection when it is closed.
+  void release(const std::string& t_client_ip);
+
+  /// Get the number of the admitted connections.
+  std::size_t connections() const;
+
+private:
+  const std::size_t m_max_connections;
+  const std::size_t m_max_connections_per_ip;
+
+  std::atomic<std::size_t> m_connections{0};
+
+  /// The connections of the client's IP addresses,
+  /// counted if their limit is on.
+  std::unordered_map<std::string, std::size_t> m_ip_connections;
+  std::mutex m_mutex;
+};
+
+inline std::size_t Admission::connections() const
+{
+  return m_connections.load(std::memory_order_relaxed);
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_ADMISSION_HPP
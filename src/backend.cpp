@@ -0,0 +1,300 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "backend.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <utility>
+
+#include "packet.hpp"
+
+namespace proxy
+{
+namespace
+{
+/// The probe login has no default schema.
+const std::string PROBE_SCHEMA;
+
+/// The client's capabilities and utf8mb4_general_ci of the probe login.
+const std::uint32_t PROBE_CAPABILITIES = MySqlCapability::CLIENT_PROTOCOL_41
+    | MySqlCapability::CLIENT_SECURE_CONNECTION
+    | MySqlCapability::CLIENT_PLUGIN_AUTH;
+const unsigned char PROBE_COLLATION_ID = 45;
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_quit.html
+const std::array<unsigned char, 5> COM_QUIT_PACKET{1, 0, 0, 0, 0x01};
+
+}  // namespace
+
+// ======== Backend ========
+
+Backend::Backend(boost::asio::io_context& t_io_context,
+    const std::string& t_name,
+    const StreamProtocol::endpoint& t_endpoint,
+    const ConnectionSettings& t_settings,
+    TimingWheel& t_timing_wheel)
+    : m_name(t_name)
+    , m_endpoint(t_endpoint)
+    , m_settings(t_settings)
+    , m_timing_wheel(t_timing_wheel)
+    , m_probe_socket(t_io_context)
+    , m_probe_login(t_settings.m_health_check_user,
+          t_settings.m_health_check_password, PROBE_SCHEMA)
+    , m_interval_timer([this]() -> void { do_probe(); })
+    , m_probe_timer([this]() -> void {
+      // The socket close finishes the probe operations with the error.
+      boost::system::error_code error;
+      m_probe_socket.close(error);
+    })
+{
+  m_probe_login.set_client(PROBE_CAPABILITIES, PROBE_COLLATION_ID);
+}
+
+void Backend::start_health_checks()
+{
+  if(0 < m_settings.m_health_check_interval) {
+    do_probe();
+  }
+}
+
+void Backend::stop()
+{
+  m_is_stopped = true;
+  m_interval_timer.cancel();
+  m_probe_timer.cancel();
+  boost::system::error_code error;
+  m_probe_socket.close(error);
+}
+
+void Backend::connect_failed()
+{
+  // Without the health checks the backend would never be marked up again.
+  if(0 == m_settings.m_health_check_interval
+      || !m_is_healthy.exchange(false)) {
+    return;
+  }
+  ++m_state_changes;
+
+  std::cout << "MySQL server " << m_name << " is down: connect failed\n";
+}
+
+void Backend::do_probe()
+{
+  if(m_is_stopped || m_probe_in_progress) {
+    return;
+  }
+  m_probe_in_progress = true;
+  m_probe_error = nullptr;
+
+  boost::system::error_code error;
+  m_probe_socket.close(error);
+  m_probe_socket.open(m_endpoint.protocol(), error);
+  if(error) {
+    probe_is_done(false);
+    return;
+  }
+
+  m_timing_wheel.arm(m_probe_timer,
+      std::chrono::milliseconds(m_settings.m_health_check_timeout));
+  m_probe_socket.async_connect(
+      m_endpoint, [this](const boost::system::error_code& l_error) -> void {
+        if(m_is_stopped) {
+          return;
+        }
+        if(l_error) {
+          if(l_error != boost::asio::error::operation_aborted
+              || m_probe_in_progress) {
+            probe_is_done(false);
+          }
+          return;
+        }
+
+        if(!m_settings.m_health_check_user.empty()) {
+          do_probe_read();
+          return;
+        }
+
+        // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_v10.html
+        // The server starts with the greeting, protocol version 10,
+        // or with the ERR packet, e.g. for the blocked host.
+        boost::asio::async_read(m_probe_socket,
+            boost::asio::buffer(m_probe_buffer),
+            [this](const boost::system::error_code& l_error,
+                std::size_t /*l_bytes_transferred*/) -> void {
+              if(m_is_stopped) {
+                return;
+              }
+              if(l_error == boost::asio::error::operation_aborted
+                  && !m_probe_in_progress) {
+                return;
+              }
+              probe_is_done(!l_error && 0x0a == m_probe_buffer[4]);
+            });
+      });
+}
+
+void Backend::do_probe_read()
+{
+  boost::asio::async_read(m_probe_socket,
+      boost::asio::buffer(m_probe_buffer.data(), 4),
+      [this](const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(m_is_stopped) {
+          return;
+        }
+        if(l_error) {
+          probe_is_done(false);
+          return;
+        }
+
+        m_probe_packet.resize(m_probe_buffer[0] | (m_probe_buffer[1] << 8u)
+            | (m_probe_buffer[2] << 16u));
+        boost::asio::async_read(m_probe_socket,
+            boost::asio::buffer(m_probe_packet),
+            [this](const boost::system::error_code& l_error,
+                std::size_t /*l_bytes_transferred*/) -> void {
+              if(m_is_stopped) {
+                return;
+              }
+              if(l_error) {
+                probe_is_done(false);
+                return;
+              }
+              probe_packet_is_received();
+            });
+      });
+}
+
+void Backend::probe_packet_is_received()
+{
+  switch(m_probe_login.packet_is_received(m_probe_buffer[3], m_probe_packet)) {
+    case ServerLogin::Step::SEND: {
+      boost::asio::async_write(m_probe_socket,
+          boost::asio::buffer(m_probe_login.packet()),
+          [this](const boost::system::error_code& l_error,
+              std::size_t /*l_bytes_transferred*/) -> void {
+            if(m_is_stopped) {
+              return;
+            }
+            if(l_error) {
+              probe_is_done(false);
+              return;
+            }
+            do_probe_read();
+          });
+      return;
+    }
+    case ServerLogin::Step::READ: {
+      do_probe_read();
+      return;
+    }
+    case ServerLogin::Step::DONE: {
+      // The session is closed by the server after COM_QUIT.
+      boost::asio::async_write(m_probe_socket,
+          boost::asio::buffer(COM_QUIT_PACKET),
+          [this](const boost::system::error_code& l_error,
+              std::size_t /*l_bytes_transferred*/) -> void {
+            if(m_is_stopped) {
+              return;
+            }
+            probe_is_done(!l_error);
+          });
+      return;
+    }
+    case ServerLogin::Step::FAILED: {
+      m_probe_error = m_probe_login.error();
+      probe_is_done(false);
+      return;
+    }
+  }
+}
+
+void Backend::probe_is_done(bool t_success)
+{
+  m_probe_in_progress = false;
+  m_probe_timer.cancel();
+  boost::system::error_code error;
+  m_probe_socket.close(error);
+
+  if(t_success) {
+    m_failures = 0;
+    if(!m_is_healthy && ++m_successes >= m_settings.m_health_check_rise) {
+      m_successes = 0;
+      m_is_healthy = true;
+      ++m_state_changes;
+      std::cout << "MySQL server " << m_name << " is up\n";
+    }
+  } else {
+    m_successes = 0;
+    if(m_is_healthy && ++m_failures >= m_settings.m_health_check_fall) {
+      m_failures = 0;
+      m_is_healthy = false;
+      ++m_state_changes;
+      std::cout << "MySQL server " << m_name << " is down: health check failed";
+      if(nullptr != m_probe_error) {
+        std::cout << ", " << m_probe_error;
+      }
+      std::cout << "\n";
+    }
+  }
+
+  if(!m_is_stopped) {
+    m_timing_wheel.arm(m_interval_timer,
+        std::chrono::milliseconds(m_settings.m_health_check_interval));
+  }
+}
+
+
+// ======== BackendPool ========
+
+void BackendPool::add(std::unique_ptr<Backend>&& t_backend)
+{
+  m_backends.push_back(std::move(t_backend));
+}
+
+std::size_t BackendPool::select(std::size_t t_first_index) const
+{
+  for(std::size_t i = t_first_index; i < m_backends.size(); ++i) {
+    if(m_backends[i]->is_healthy()) {
+      return i;
+    }
+  }
+  return m_backends.size();
+}
+
+void BackendPool::start_health_checks()
+{
+  for(const auto& backend : m_backends) {
+    backend->start_health_checks();
+  }
+}
+
+void BackendPool::stop()
+{
+  for(const auto& backend : m_backends) {
+    backend->stop();
+  }
+}
+
+}  // namespace proxy
@@ -0,0 +1,205 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_BACKEND_HPP
+#define PROXY_BACKEND_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "endpoint.hpp"
+#include "server_login.hpp"
+#include "settings.hpp"
+#include "timing_wheel.hpp"
+
+namespace proxy
+{
+/// The MySQL server the connections are proxied to, with its health state.
+/// The health is checked actively by the periodic probes: the TCP connection
+/// and the MySQL server's greeting, or the login with the health check
+/// account and COM_QUIT if it is set. The backend is marked down after
+/// the fall number of the failed probes in a row and is marked up
+/// after the rise number of the successful probes in a row.
+class Backend
+{
+public:
+  Backend(const Backend&) = delete;
+  Backend(Backend&&) = delete;
+  Backend& operator=(const Backend&) = delete;
+  Backend& operator=(Backend&&) = delete;
+
+  ~Backend() = default;
+
+  explicit Backend(boost::asio::io_context& t_io_context,
+      const std::string& t_name,
+      const StreamProtocol::endpoint& t_endpoint,
+      const ConnectionSettings& t_settings,
+      TimingWheel& t_timing_wheel);
+
+  /// Get the name of the MySQL server, its address and port.
+  const std::string& name() const;
+
+  /// Get the endpoint of the MySQL server.
+  const StreamProtocol::endpoint& endpoint() const;
+
+  /// Check if the backend can take the new connections.
+  bool is_healthy() const;
+
+  /// Get the number of the health state changes, the data recorded
+  /// from the MySQL server before the change can be stale.
+  std::uint32_t state_changes() const;
+
+  /// Start the periodic health checks if they are turned on.
+  void start_health_checks();
+
+  /// Stop the health checks, the aborted probe is not counted
+  /// and the next one is not scheduled.
+  void stop();
+
+  /// Mark the backend down after the failed connection of the client's
+  /// session, the health checks mark it up again. Can be called
+  /// from any thread.
+  void connect_failed();
+
+private:
+  /// Perform the health check probe.
+  void do_probe();
+
+  /// Read the next server's packet of the probe login.
+  void do_probe_read();
+
+  /// Perform the actions for the server's packet of the probe login.
+  void probe_packet_is_received();
+
+  /// Perform the actions for the probe result and schedule the next probe.
+  void probe_is_done(bool t_success);
+
+  std::string m_name;
+  StreamProtocol::endpoint m_endpoint;
+  const ConnectionSettings& m_settings;
+  TimingWheel& m_timing_wheel;
+
+  /// The probe connection and the beginning of the server's greeting:
+  /// the packet header and the protocol version or the ERR packet header.
+  StreamProtocol::socket m_probe_socket;
+  std::array<unsigned char, 5> m_probe_buffer{};
+
+  /// The login of the probe with the health check account and the payload
+  /// of its last server's packet. A probe which quits after the login
+  /// is not a handshake error of the MySQL server's host cache.
+  ServerLogin m_probe_login;
+  std::vector<unsigned char> m_probe_packet;
+  const char* m_probe_error = nullptr;
+
+  /// Interval between the probes and the probe timeout.
+  WheelTimer m_interval_timer;
+  WheelTimer m_probe_timer;
+
+  /// The state is read by the workers' threads and is set by the connection
+  /// failures in them, the probes run in the accepting thread.
+  std::atomic<bool> m_is_healthy{true};
+  std::atomic<std::uint32_t> m_state_changes{0};
+  bool m_is_stopped = false;
+  bool m_probe_in_progress = false;
+  std::uint32_t m_successes = 0;
+  std::uint32_t m_failures = 0;
+};
+
+inline const std::string& Backend::name() const
+{
+  return m_name;
+}
+
+inline const StreamProtocol::endpoint& Backend::endpoint() const
+{
+  return m_endpoint;
+}
+
+inline bool Backend::is_healthy() const
+{
+  return m_is_healthy;
+}
+
+inline std::uint32_t Backend::state_changes() const
+{
+  return m_state_changes;
+}
+
+
+/// The MySQL servers in the order of their priority, the new sessions
+/// are sent to the first healthy one.
+class BackendPool
+{
+public:
+  BackendPool(const BackendPool&) = delete;
+  BackendPool(BackendPool&&) = delete;
+  BackendPool& operator=(const BackendPool&) = delete;
+  BackendPool& operator=(BackendPool&&) = delete;
+
+  ~BackendPool() = default;
+
+  explicit BackendPool() = default;
+
+  /// Add the backend with the lower priority than the added ones.
+  void add(std::unique_ptr<Backend>&& t_backend);
+
+  /// Get the number of the backends.
+  std::size_t size() const;
+
+  /// Get the backend by its index.
+  Backend& backend(std::size_t t_index);
+
+  /// Find the first healthy backend starting from the index.
+  /// Returns the backend index or size() if there is no healthy backend.
+  std::size_t select(std::size_t t_first_index = 0) const;
+
+  /// Start the health checks of the backends.
+  void start_health_checks();
+
+  /// Stop the health checks of the backends.
+  void stop();
+
+private:
+  std::vector<std::unique_ptr<Backend>> m_backends;
+};
+
+inline std::size_t BackendPool::size() const
+{
+  return m_backends.size();
+}
+
+inline Backend& BackendPool::backend(std::size_t t_index)
+{
+  return *m_backends[t_index];
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_BACKEND_HPP
@@ -0,0 +1,311 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "compression.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef PROXY_WITH_ZSTD
+#include <zstd.h>
+#endif  // ifdef PROXY_WITH_ZSTD
+
+namespace proxy
+{
+namespace
+{
+// The window of the compressor covers the chunk of the plain data,
+// the smaller window and hash keep the memory of the stream low.
+const int DEFLATE_WINDOW_BITS = 13;
+const int DEFLATE_MEMORY_LEVEL = 6;
+
+std::size_t read_uint24(const unsigned char* t_data)
+{
+  return static_cast<std::size_t>(t_data[0])
+      | static_cast<std::size_t>(t_data[1]) << 8u
+      | static_cast<std::size_t>(t_data[2]) << 16u;
+}
+
+void write_uint24(unsigned char* t_data, std::size_t t_value)
+{
+  t_data[0] = static_cast<unsigned char>(t_value);
+  t_data[1] = static_cast<unsigned char>(t_value >> 8u);
+  t_data[2] = static_cast<unsigned char>(t_value >> 16u);
+}
+
+}  // namespace
+
+PacketCompression::PacketCompression(
+    CompressionAlgorithm t_algorithm, int t_level)
+    : m_algorithm(t_algorithm)
+    , m_level(t_level)
+{
+  switch(m_algorithm) {
+    case CompressionAlgorithm::ZLIB: {
+      if(Z_OK != inflateInit(&m_inflate_stream)) {
+        throw std::bad_alloc();
+      }
+      if(Z_OK
+          != deflateInit2(&m_deflate_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+              DEFLATE_WINDOW_BITS, DEFLATE_MEMORY_LEVEL, Z_DEFAULT_STRATEGY)) {
+        inflateEnd(&m_inflate_stream);
+        throw std::bad_alloc();
+      }
+      break;
+    }
+    case CompressionAlgorithm::ZSTD: {
+#ifdef PROXY_WITH_ZSTD
+      m_zstd_compress = ZSTD_createCCtx();
+      m_zstd_decompress = ZSTD_createDCtx();
+      if(nullptr == m_zstd_compress || nullptr == m_zstd_decompress) {
+        ZSTD_freeCCtx(m_zstd_compress);
+        ZSTD_freeDCtx(m_zstd_decompress);
+        throw std::bad_alloc();
+      }
+#endif  // ifdef PROXY_WITH_ZSTD
+      break;
+    }
+    case CompressionAlgorithm::NONE: {
+      break;
+    }
+  }
+}
+
+PacketCompression::~PacketCompression()
+{
+  if(CompressionAlgorithm::ZLIB == m_algorithm) {
+    inflateEnd(&m_inflate_stream);
+    deflateEnd(&m_deflate_stream);
+  }
+#ifdef PROXY_WITH_ZSTD
+  ZSTD_freeCCtx(m_zstd_compress);
+  ZSTD_freeDCtx(m_zstd_decompress);
+#endif  // ifdef PROXY_WITH_ZSTD
+}
+
+bool PacketCompression::is_supported(CompressionAlgorithm t_algorithm)
+{
+  switch(t_algorithm) {
+    case CompressionAlgorithm::ZLIB: {
+      return true;
+    }
+    case CompressionAlgorithm::ZSTD: {
+#ifdef PROXY_WITH_ZSTD
+      return true;
+#else  // ifdef PROXY_WITH_ZSTD
+      return false;
+#endif  // ifdef PROXY_WITH_ZSTD
+    }
+    case CompressionAlgorithm::NONE: {
+      break;
+    }
+  }
+  return false;
+}
+
+bool PacketCompression::decompress(const unsigned char*& t_data,
+    std::size_t& t_length,
+    std::size_t& t_plain_length)
+{
+  t_plain_length = 0;
+  while(t_plain_length < m_plain.size()) {
+    if(!m_payload_is_next) {
+      if(0 == t_length) {
+        break;
+      }
+      m_header[m_header_length++] = *t_data++;
+      --t_length;
+      if(m_header_length < HEADER_LENGTH) {
+        continue;
+      }
+
+      m_header_length = 0;
+      m_compressed_remaining = read_uint24(m_header.data());
+      m_plain_remaining = read_uint24(m_header.data() + 4);
+      m_sequence_id = static_cast<unsigned char>(m_header[3] + 1);
+      m_payload_is_compressed = 0 != m_plain_remaining;
+      if(!m_payload_is_compressed) {
+        m_plain_remaining = m_compressed_remaining;
+      }
+      m_payload_is_next = 0 != m_compressed_remaining;
+      if(!m_payload_is_next && m_payload_is_compressed) {
+        return false;
+      }
+      continue;
+    }
+
+    const std::size_t data_length = std::min(t_length, m_compressed_remaining);
+    std::size_t consumed = 0;
+    std::size_t produced = 0;
+    bool is_ended = false;
+    if(m_payload_is_compressed) {
+      if(!inflate_payload(t_data, data_length, m_plain.data() + t_plain_length,
+             m_plain.size() - t_plain_length, consumed, produced,
+             is_ended)) {
+        return false;
+      }
+    } else {
+      consumed = std::min(data_length, m_plain.size() - t_plain_length);
+      produced = consumed;
+      std::memcpy(m_plain.data() + t_plain_length, t_data, consumed);
+      is_ended = consumed == m_compressed_remaining;
+    }
+
+    if(produced > m_plain_remaining) {
+      return false;
+    }
+    t_data += consumed;
+    t_length -= consumed;
+    t_plain_length += produced;
+    m_compressed_remaining -= consumed;
+    m_plain_remaining -= produced;
+
+    if(is_ended) {
+      // The next compressed packet follows.
+      if(0 != m_compressed_remaining || 0 != m_plain_remaining) {
+        return false;
+      }
+      m_payload_is_next = false;
+      continue;
+    }
+    if(0 == consumed && 0 == produced) {
+      // The stream is truncated if all payload is consumed.
+      if(0 == m_compressed_remaining) {
+        return false;
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+bool PacketCompression::inflate_payload(const unsigned char* t_data,
+    std::size_t t_length,
+    unsigned char* t_plain,
+    std::size_t t_plain_space,
+    std::size_t& t_consumed,
+    std::size_t& t_produced,
+    bool& t_is_ended)
+{
+  switch(m_algorithm) {
+    case CompressionAlgorithm::ZLIB: {
+      m_inflate_stream.next_in = const_cast<Bytef*>(t_data);
+      m_inflate_stream.avail_in = static_cast<uInt>(t_length);
+      m_inflate_stream.next_out = t_plain;
+      m_inflate_stream.avail_out = static_cast<uInt>(t_plain_space);
+      const int result = inflate(&m_inflate_stream, Z_NO_FLUSH);
+      if(Z_OK != result && Z_STREAM_END != result && Z_BUF_ERROR != result) {
+        return false;
+      }
+      t_consumed = t_length - m_inflate_stream.avail_in;
+      t_produced = t_plain_space - m_inflate_stream.avail_out;
+      t_is_ended = Z_STREAM_END == result;
+      if(t_is_ended) {
+        inflateReset(&m_inflate_stream);
+      }
+      return true;
+    }
+    case CompressionAlgorithm::ZSTD: {
+#ifdef PROXY_WITH_ZSTD
+      ZSTD_inBuffer input{t_data, t_length, 0};
+      ZSTD_outBuffer output{t_plain, t_plain_space, 0};
+      const std::size_t result =
+          ZSTD_decompressStream(m_zstd_decompress, &output, &input);
+      if(ZSTD_isError(result)) {
+        return false;
+      }
+      t_consumed = input.pos;
+      t_produced = output.pos;
+      t_is_ended = 0 == result;
+      if(t_is_ended) {
+        ZSTD_DCtx_reset(m_zstd_decompress, ZSTD_reset_session_only);
+      }
+      return true;
+#else  // ifdef PROXY_WITH_ZSTD
+      return false;
+#endif  // ifdef PROXY_WITH_ZSTD
+    }
+    case CompressionAlgorithm::NONE: {
+      break;
+    }
+  }
+  return false;
+}
+
+std::size_t PacketCompression::compress(
+    const unsigned char* t_data, std::size_t t_length)
+{
+  std::size_t payload_length = 0;
+  std::size_t plain_length = t_length;
+  if(MIN_COMPRESS_LENGTH <= t_length) {
+    payload_length = deflate_payload(t_data, t_length);
+  }
+  if(0 == payload_length) {
+    std::memcpy(m_packet.data() + HEADER_LENGTH, t_data, t_length);
+    payload_length = t_length;
+    plain_length = 0;
+  }
+
+  write_uint24(m_packet.data(), payload_length);
+  m_packet[3] = m_sequence_id++;
+  write_uint24(m_packet.data() + 4, plain_length);
+  return HEADER_LENGTH + payload_length;
+}
+
+std::size_t PacketCompression::deflate_payload(
+    const unsigned char* t_data, std::size_t t_length)
+{
+  // The compressed payload is useful if it is shorter than the plain data.
+  unsigned char* payload = m_packet.data() + HEADER_LENGTH;
+  const std::size_t payload_space = t_length - 1;
+
+  switch(m_algorithm) {
+    case CompressionAlgorithm::ZLIB: {
+      deflateReset(&m_deflate_stream);
+      m_deflate_stream.next_in = const_cast<Bytef*>(t_data);
+      m_deflate_stream.avail_in = static_cast<uInt>(t_length);
+      m_deflate_stream.next_out = payload;
+      m_deflate_stream.avail_out = static_cast<uInt>(payload_space);
+      if(Z_STREAM_END != deflate(&m_deflate_stream, Z_FINISH)) {
+        return 0;
+      }
+      return payload_space - m_deflate_stream.avail_out;
+    }
+    case CompressionAlgorithm::ZSTD: {
+#ifdef PROXY_WITH_ZSTD
+      const std::size_t result = ZSTD_compressCCtx(m_zstd_compress, payload,
+          payload_space, t_data, t_length, m_level);
+      return ZSTD_isError(result) ? 0 : result;
+#else  // ifdef PROXY_WITH_ZSTD
+      return 0;
+#endif  // ifdef PROXY_WITH_ZSTD
+    }
+    case CompressionAlgorithm::NONE: {
+      break;
+    }
+  }
+  return 0;
+}
+
+}  // namespace proxy
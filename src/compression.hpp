@@ -0,0 +1,163 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_COMPRESSION_HPP
+#define PROXY_COMPRESSION_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <zlib.h>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace proxy
+{
+/// Algorithms of the compressed MySQL protocol.
+enum class CompressionAlgorithm
+{
+  NONE,
+  ZLIB,
+  ZSTD
+};
+
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_compression.html
+/// The compressed protocol of the client's connection. The received
+/// compressed packets are decompressed into the plain MySQL packets,
+/// the sent data is wrapped into the compressed packets. The streams
+/// and the buffers are reused for all packets of the connection.
+class PacketCompression
+{
+public:
+  /// Max length of the plain data of one call, the longer data
+  /// is split into several compressed packets, the MySQL packets
+  /// can span the compressed packets.
+#ifdef PROXY_PACKET_DEBUG
+  static const std::size_t CHUNK_LENGTH = 60;
+#else  // ifdef PROXY_PACKET_DEBUG
+  static const std::size_t CHUNK_LENGTH = 8192;
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  /// The compressed packet header: the 3-byte length of the compressed
+  /// payload, the sequence id and the 3-byte length of the payload before
+  /// the compression, 0 if the payload is not compressed.
+  static const std::size_t HEADER_LENGTH = 7;
+
+  /// The shorter data is sent uncompressed, as the MySQL server does.
+  static const std::size_t MIN_COMPRESS_LENGTH = 50;
+
+  PacketCompression(const PacketCompression&) = delete;
+  PacketCompression(PacketCompression&&) = delete;
+  PacketCompression& operator=(const PacketCompression&) = delete;
+  PacketCompression& operator=(PacketCompression&&) = delete;
+
+  ~PacketCompression();
+
+  /// Construct the streams of the algorithm, the level is used by zstd,
+  /// zlib uses its default level. Throws std::bad_alloc if the streams
+  /// can not be allocated.
+  explicit PacketCompression(CompressionAlgorithm t_algorithm, int t_level);
+
+  /// Check if the algorithm is built in.
+  static bool is_supported(CompressionAlgorithm t_algorithm);
+
+  /// Decompress the received bytes of the compressed packets till
+  /// the bytes are consumed or the plain data buffer is full, t_data
+  /// and t_length are moved behind the consumed bytes. t_plain_length gets
+  /// the length of the plain data at plain_data(). Returns false
+  /// if the compressed packet is broken.
+  bool decompress(const unsigned char*& t_data,
+      std::size_t& t_length,
+      std::size_t& t_plain_length);
+
+  /// Get the plain data of the last decompress().
+  unsigned char* plain_data();
+
+  /// Wrap the plain data of CHUNK_LENGTH at most into the compressed packet
+  /// at packet_data(), returns the packet length. The data is sent
+  /// uncompressed if it is short or is not compressed to the smaller length.
+  std::size_t compress(const unsigned char* t_data, std::size_t t_length);
+
+  /// Get the compressed packet of the last compress().
+  const unsigned char* packet_data() const;
+
+private:
+  /// Decompress the bytes of the compressed payload to the plain data
+  /// buffer, t_is_ended is set at the end of its stream. Returns false
+  /// if the payload is broken.
+  bool inflate_payload(const unsigned char* t_data,
+      std::size_t t_length,
+      unsigned char* t_plain,
+      std::size_t t_plain_space,
+      std::size_t& t_consumed,
+      std::size_t& t_produced,
+      bool& t_is_ended);
+
+  /// Compress the data to the packet payload, returns 0 if the compressed
+  /// data does not fit the length of the plain data.
+  std::size_t deflate_payload(const unsigned char* t_data, std::size_t t_length);
+
+  const CompressionAlgorithm m_algorithm;
+  const int m_level;
+
+  /// zlib streams, initialized for ZLIB.
+  z_stream m_inflate_stream{};
+  z_stream m_deflate_stream{};
+
+  /// zstd contexts, exist for ZSTD.
+  ZSTD_CCtx_s* m_zstd_compress = nullptr;
+  ZSTD_DCtx_s* m_zstd_decompress = nullptr;
+
+  /// Sequence id of the next sent compressed packet, follows the sequence id
+  /// of the last received one, as the sequence ids of the MySQL packets do.
+  unsigned char m_sequence_id = 0;
+
+  /// State of the received compressed packet.
+  std::array<unsigned char, HEADER_LENGTH> m_header{};
+  std::size_t m_header_length = 0;
+  bool m_payload_is_next = false;
+  bool m_payload_is_compressed = false;
+  std::size_t m_compressed_remaining = 0;
+  std::size_t m_plain_remaining = 0;
+
+  /// The plain data of the received packets and the sent packet.
+  std::array<unsigned char, CHUNK_LENGTH> m_plain{};
+  std::array<unsigned char, HEADER_LENGTH + CHUNK_LENGTH> m_packet{};
+};
+
+inline unsigned char* PacketCompression::plain_data()
+{
+  return m_plain.data();
+}
+
+inline const unsigned char* PacketCompression::packet_data() const
+{
+  return m_packet.data();
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_COMPRESSION_HPP
@@ -23,115 +23,1631 @@
 
 #include "connection.hpp"
 
+#include <algorithm>
+#include <iostream>
 #include <utility>
 
+#include "connection_pool.hpp"
+#include "socket_options.hpp"
+#include "worker.hpp"
+
 #ifdef PROXY_PACKET_DEBUG
 #include <iomanip>
-#include <iostream>
 #endif  // ifdef PROXY_PACKET_DEBUG
 
 namespace proxy
 {
-Connection::Connection(boost::asio::ip::tcp::socket t_client_socket,
-    const boost::asio::ip::tcp::endpoint& t_server_endpoint,
-    StopTransferFunc&& t_stop_handler_func,
-    PacketLoggerFunc&& t_packet_logger_func)
-    : m_client_socket(std::move(t_client_socket))
-    , m_server_endpoint(t_server_endpoint)
+Connection::Connection(StreamProtocol::socket t_client_socket,
+    RoutePtr t_route,
+    Worker& t_worker,
+    std::string&& t_client_ip)
+    : m_worker(t_worker)
+    , m_route(std::move(t_route))
+    , m_client_ip(std::move(t_client_ip))
+    , m_client_socket(std::move(t_client_socket))
+    , m_backends(m_route->backends())
     , m_server_socket(m_client_socket.get_executor().context())
     , m_client_buffer{}
     , m_server_buffer{}
-    , m_stop_transfer_func(std::move(t_stop_handler_func))
-    , m_packet_logger_func(std::move(t_packet_logger_func))
+    , m_packet_logger(m_route->packet_logger())
+    , m_settings(m_route->settings().m_connection)
+    , m_local_reply(m_route->local_reply(m_worker.index()))
+    , m_tls_context(m_route->tls_context(m_worker.index()))
+    , m_table_stats(m_route->table_stats(m_worker.index()))
+    , m_transaction_stats(m_route->transaction_stats(m_worker.index()))
+    , m_account_stats(m_route->account_stats(m_worker.index()))
+    , m_timing_wheel(m_worker.timing_wheel())
+    , m_timeout_timer([this]() -> void { timeout_is_expired(); })
+    , m_held_packet{}
+    , m_transaction_timer([this]() -> void { transaction_is_long(); })
+{
+  m_client_packet.set_sql_capture_limit(m_settings.m_sql_capture_limit);
+
+  boost::system::error_code error;
+  if(is_tcp_endpoint(m_client_socket.local_endpoint(error))) {
+    set_socket_options(m_client_socket, m_settings.m_socket);
+    m_client_quick_ack = m_settings.m_socket.m_tcp_quickack;
+  }
+
+  if(0 < m_settings.m_params_sample_rate) {
+    m_statement_params = std::make_unique<StatementParams>();
+  }
+}
+
+Connection::~Connection()
 {
+  m_worker.admission().release(m_client_ip);
 }
 
 void Connection::start()
 {
+  arm_timeout(Timeout::HANDSHAKE);
+  if(m_worker.begin_connect(ConnectionPtr(this))) {
+    connect();
+  }
+}
+
+void Connection::connect()
+{
+  m_is_connecting = true;
   do_connect();
 }
 
 void Connection::stop()
 {
+  m_timeout_timer.cancel();
+  if(m_in_transaction) {
+    // The MySQL server rolls back the transaction of the closed session.
+    end_transaction(true);
+  }
+  if(m_client_tls) {
+    TlsContext::keep_session(*m_client_tls);
+  }
+  if(m_server_tls) {
+    TlsContext::keep_session(*m_server_tls);
+  }
   m_client_socket.close();
   m_server_socket.close();
+  m_packet_logger.flush();
+  if(m_mirror) {
+    m_mirror->close();
+    m_mirror.reset();
+  }
+  for(const std::shared_ptr<ShardSession>& shard : m_shards) {
+    if(shard) {
+      shard->close();
+    }
+  }
+  m_shards.clear();
+  m_request_shard = nullptr;
+
+  if(m_is_connecting) {
+    m_is_connecting = false;
+    m_worker.end_connect();
+  }
+}
+
+void Connection::stop_by_worker()
+{
+  // The pointer keeps the connection alive till the worker's actions
+  // are finished.
+  m_worker.stop_connection(ConnectionPtr(this));
+}
+
+void Connection::drain()
+{
+  m_is_draining = true;
+  if(is_at_command_boundary()) {
+    do_drain_close();
+  }
 }
 
 void Connection::do_connect()
 {
   // Open the server connection. Connection from the client is already opened.
-  m_server_socket.open(m_server_endpoint.protocol());
-  m_server_socket.async_connect(m_server_endpoint,
-      [this](const boost::system::error_code& l_error) -> void {
+  connect_backend(m_backends.select());
+}
+
+void Connection::connect_backend(std::size_t t_backend_index)
+{
+  m_backend_index = t_backend_index;
+  if(m_backend_index >= m_backends.size()) {
+    do_connect_error();
+    return;
+  }
+
+  const StreamProtocol::endpoint& server_endpoint =
+      m_backends.backend(m_backend_index).endpoint();
+  boost::system::error_code error;
+  m_server_tls.reset();
+  m_server_socket.close(error);
+  m_server_socket.open(server_endpoint.protocol(), error);
+  if(is_tcp_endpoint(server_endpoint)) {
+    set_socket_options(m_server_socket, m_settings.m_socket);
+    m_server_quick_ack = m_settings.m_socket.m_tcp_quickack;
+  }
+  arm_timeout(Timeout::CONNECT);
+  m_server_socket.async_connect(server_endpoint,
+      [this, l_self = ConnectionPtr(this)](
+          const boost::system::error_code& l_error) -> void {
         if(!l_error) {
           // The connection was successful.
           // Start listening for the data on the connections.
+          arm_timeout(Timeout::HANDSHAKE);
           do_receive();
+        } else if(l_error != boost::asio::error::operation_aborted) {
+          // The server is not available, try the next one.
+          m_backends.backend(m_backend_index).connect_failed();
+          connect_backend(m_backends.select(m_backend_index + 1));
         }
       });
 }
 
+void Connection::do_connect_error()
+{
+  m_timeout_timer.cancel();
+
+  // See https://dev.mysql.com/doc/refman/8.0/en/client-error-reference.html
+  // CR_CONN_HOST_ERROR, the client's connection error for the unavailable
+  // server. The error is sent in place of the greeting, without the SQL state.
+  const std::string packet = LocalReply::make_err_packet(
+      0, 2003, nullptr, "Can't connect to MySQL server: no server is available");
+  write_to_client(boost::asio::buffer(packet));
+
+  // Perform the actions for the connection stop.
+  stop_by_worker();
+}
+
+void Connection::arm_timeout(Timeout t_timeout)
+{
+  std::uint32_t timeout_ms = 0;
+  switch(t_timeout) {
+    case Timeout::CONNECT: {
+      timeout_ms = m_settings.m_connect_timeout;
+      break;
+    }
+    case Timeout::HANDSHAKE: {
+      timeout_ms = m_settings.m_handshake_timeout;
+      break;
+    }
+    case Timeout::IDLE: {
+      timeout_ms = m_settings.m_idle_timeout;
+      break;
+    }
+    case Timeout::QUERY: {
+      timeout_ms = m_settings.m_query_timeout;
+      break;
+    }
+  }
+
+  m_timeout = t_timeout;
+  if(0 < timeout_ms) {
+    m_timing_wheel.arm(
+        m_timeout_timer, std::chrono::milliseconds(timeout_ms));
+  } else {
+    m_timeout_timer.cancel();
+  }
+}
+
+void Connection::timeout_is_expired()
+{
+  switch(m_timeout) {
+    case Timeout::CONNECT: {
+      // Fail over to the next server, the pending connect is cancelled.
+      std::cout << "Connection timeout: MySQL server connect\n";
+      m_backends.backend(m_backend_index).connect_failed();
+      connect_backend(m_backends.select(m_backend_index + 1));
+      return;
+    }
+    case Timeout::HANDSHAKE: {
+      std::cout << "Connection timeout: handshake\n";
+      break;
+    }
+    case Timeout::IDLE: {
+      std::cout << "Connection timeout: idle session\n";
+      break;
+    }
+    case Timeout::QUERY: {
+      std::cout << "Connection timeout: query duration\n";
+      break;
+    }
+  }
+
+  // Perform the actions for the connection stop.
+  stop_by_worker();
+}
+
 void Connection::do_receive()
 {
-  // Start listening for the data on the client connection.
-  m_client_socket.async_receive(boost::asio::buffer(m_client_buffer),
-      [this](const boost::system::error_code& l_error,
-          std::size_t l_bytes_transferred) -> void {
-        if(!l_error) {
-          // Transfer the data from the client to the server.
-          do_transfer(m_client_socket, m_server_socket,
-              boost::asio::buffer(m_client_buffer), l_bytes_transferred, true);
-        }
-      });
+  // Start listening for the data on the server connection.
+  do_read(false);
 
-  // Also listen for the data on the server connection.
-  m_server_socket.async_receive(boost::asio::buffer(m_server_buffer),
-      [this](const boost::system::error_code& l_error,
-          std::size_t l_bytes_transferred) -> void {
-        if(!l_error) {
-          // Transfer the data from the server to the client.
-          do_transfer(m_server_socket, m_client_socket,
-              boost::asio::buffer(m_server_buffer), l_bytes_transferred, false);
-        }
-      });
+  // Also listen for the data on the client connection. The client waits
+  // for the greeting, which is sent after the TLS with the server
+  // is established.
+  if(nullptr == m_tls_context || nullptr == m_tls_context->server_context()) {
+    do_read(true);
+  }
+}
+
+void Connection::do_read(bool t_from_client_to_server)
+{
+  // The handlers keep the connection alive, the handler of the completed
+  // read is called even if the connection is stopped before it.
+  auto handler = [this, l_self = ConnectionPtr(this), t_from_client_to_server](
+                     const boost::system::error_code& l_error,
+                     std::size_t l_bytes_transferred) -> void {
+    if(!l_error) {
+      // The worker stops the connection if the handling throws.
+      m_worker.set_handled_connection(this);
+      do_transfer(t_from_client_to_server, l_bytes_transferred);
+      m_worker.set_handled_connection(nullptr);
+    } else if(l_error != boost::asio::error::operation_aborted) {
+      // Perform the actions for the connection stop.
+      stop_after_writes();
+    }
+  };
+
+  auto& read_buffer =
+      t_from_client_to_server ? m_client_buffer : m_server_buffer;
+  TlsStream* tls =
+      t_from_client_to_server ? m_client_tls.get() : m_server_tls.get();
+  if(nullptr != tls) {
+    tls->async_read_some(boost::asio::buffer(read_buffer), std::move(handler));
+  } else {
+    StreamProtocol::socket& socket =
+        t_from_client_to_server ? m_client_socket : m_server_socket;
+    socket.async_read_some(boost::asio::buffer(read_buffer), std::move(handler));
+  }
 }
 
 // This function is called whenever the data is received.
-void Connection::do_transfer(boost::asio::ip::tcp::socket& t_read_from,
-    boost::asio::ip::tcp::socket& t_send_to,
-    const boost::asio::mutable_buffer& t_read_buffer,
-    std::size_t t_bytes_transferred,
-    bool t_from_client_to_server)
+void Connection::do_transfer(
+    bool t_from_client_to_server, std::size_t t_bytes_transferred)
 {
-  do_packet_logging(
-      t_read_buffer, t_bytes_transferred, t_from_client_to_server);
+  StreamProtocol::socket& read_from =
+      t_from_client_to_server ? m_client_socket : m_server_socket;
+
+  // The data received before the stop of the connection is dropped.
+  if(!read_from.is_open() || m_stop_is_pending) {
+    return;
+  }
+
+  // The bytes of the handshake have no user yet.
+  if(m_handshake_is_complete) {
+    m_account_stats.add_bytes(
+        m_user_id, m_schema_id, t_from_client_to_server, t_bytes_transferred);
+  }
+
+  const boost::asio::mutable_buffer read_buffer = t_from_client_to_server
+      ? boost::asio::buffer(m_client_buffer)
+      : boost::asio::buffer(m_server_buffer);
+
+#ifdef PROXY_PACKET_DEBUG
+  debug_print_buffer(read_buffer, t_from_client_to_server);
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  if(t_from_client_to_server ? m_client_quick_ack : m_server_quick_ack) {
+    set_quick_ack(read_from);
+  }
+
+  auto* buffer_data = static_cast<unsigned char*>(read_buffer.data());
+  std::size_t send_length = t_bytes_transferred;
+
+  // Collects the corresponding packets from the incoming stream of bytes.
+  if(m_is_opaque) {
+    if(t_from_client_to_server) {
+      arm_timeout(Timeout::IDLE);
+    }
+  } else if(t_from_client_to_server) {
+    if(m_client_compression) {
+      if(!do_compressed_client_packets(buffer_data, t_bytes_transferred)) {
+        std::cout << "Connection: the client's compressed packet is broken\n";
+        stop_by_worker();
+        return;
+      }
+      send_length = 0;
+    } else {
+      send_length =
+          do_client_packets(buffer_data, t_bytes_transferred, false);
+    }
+  } else {
+    do_server_packets(buffer_data, t_bytes_transferred);
+  }
 
   // Forward the received data on to "the other side".
-  t_send_to.send(boost::asio::buffer(t_read_buffer, t_bytes_transferred));
+  if(0 < send_length) {
+    if(t_from_client_to_server) {
+      write_to_server(boost::asio::buffer(read_buffer, send_length));
+    } else {
+      write_to_client(boost::asio::buffer(read_buffer, send_length));
+    }
+  }
+
+  // The compressed protocol starts after the OK of the handshake.
+  if(m_compression_requested) {
+    m_compression_requested = false;
+    m_client_compression = std::make_unique<PacketCompression>(
+        m_compression_algorithm, m_compression_level);
+  }
+
+  // The drained connection is closed after the response is relayed.
+  if(m_is_draining && is_at_command_boundary()) {
+    do_drain_close();
+    return;
+  }
+
+  // The TLS handshake replaces the reads of the plain data.
+  if(m_client_tls_requested) {
+    m_client_tls_requested = false;
+    start_client_tls(m_client_tls_data_begin, m_client_tls_data_length);
+    return;
+  }
+  if(m_server_tls_requested) {
+    m_server_tls_requested = false;
+    start_server_tls();
+    return;
+  }
+
+  // The client's next command is read after the shard's response,
+  // the responses keep the order of the commands.
+  if(t_from_client_to_server && nullptr != m_request_shard) {
+    m_client_read_is_paused = true;
+    return;
+  }
+
+  // The next read waits for the previous data queued to the TLS stream,
+  // the data to the slow side is not buffered without a limit.
+  TlsWriteQueue& write_queue =
+      t_from_client_to_server ? m_server_write_queue : m_client_write_queue;
+  if(!write_queue.m_pending.empty()) {
+    write_queue.m_read_is_waiting = true;
+    return;
+  }
 
   // Read more data from "this side".
-  t_read_from.async_read_some(boost::asio::buffer(t_read_buffer, BUFFER_LENGTH),
-      [this, &t_read_from, &t_send_to, t_read_buffer, t_from_client_to_server](
+  do_read(t_from_client_to_server);
+}
+
+void Connection::write_to_client(const boost::asio::const_buffer& t_buffer)
+{
+  if(!m_client_compression) {
+    write_to_client_stream(t_buffer);
+    return;
+  }
+
+  // The longer data is sent in several compressed packets.
+  const auto* data = static_cast<const unsigned char*>(t_buffer.data());
+  const std::size_t chunk_length = PacketCompression::CHUNK_LENGTH;
+  for(std::size_t pos = 0; pos < t_buffer.size(); pos += chunk_length) {
+    const std::size_t packet_length = m_client_compression->compress(
+        data + pos, std::min(chunk_length, t_buffer.size() - pos));
+    write_to_client_stream(boost::asio::buffer(
+        m_client_compression->packet_data(), packet_length));
+  }
+}
+
+void Connection::write_to_client_stream(
+    const boost::asio::const_buffer& t_buffer)
+{
+  if(m_client_tls) {
+    write_to_tls(false, t_buffer);
+    return;
+  }
+  boost::system::error_code error;
+  boost::asio::write(m_client_socket, t_buffer, error);
+}
+
+void Connection::write_to_server(const boost::asio::const_buffer& t_buffer)
+{
+  // The mirror session copies the commands, it never waits for its server.
+  if(m_mirror) {
+    m_mirror->copy(
+        static_cast<const unsigned char*>(t_buffer.data()), t_buffer.size());
+  }
+
+  if(m_server_tls) {
+    write_to_tls(true, t_buffer);
+    return;
+  }
+  boost::system::error_code error;
+  boost::asio::write(m_server_socket, t_buffer, error);
+}
+
+void Connection::write_to_tls(
+    bool t_to_server, const boost::asio::const_buffer& t_buffer)
+{
+  // The data is copied, the callers reuse their buffers before
+  // the write is completed.
+  TlsWriteQueue& queue =
+      t_to_server ? m_server_write_queue : m_client_write_queue;
+  const auto* data = static_cast<const unsigned char*>(t_buffer.data());
+  queue.m_pending.insert(queue.m_pending.end(), data, data + t_buffer.size());
+  if(!queue.m_is_writing) {
+    do_tls_write(t_to_server);
+  }
+}
+
+void Connection::do_tls_write(bool t_to_server)
+{
+  // The buffers are swapped, both keep their capacity.
+  TlsWriteQueue& queue =
+      t_to_server ? m_server_write_queue : m_client_write_queue;
+  queue.m_writing.swap(queue.m_pending);
+  queue.m_pending.clear();
+  queue.m_is_writing = true;
+
+  TlsStream& tls = t_to_server ? *m_server_tls : *m_client_tls;
+  boost::asio::async_write(tls, boost::asio::buffer(queue.m_writing),
+      [this, l_self = ConnectionPtr(this), t_to_server](
           const boost::system::error_code& l_error,
-          std::size_t l_bytes_transferred) -> void {
-        if(!l_error) {
-          do_transfer(t_read_from, t_send_to, t_read_buffer,
-              l_bytes_transferred, t_from_client_to_server);
-        } else if(l_error != boost::asio::error::operation_aborted) {
-          // Perform the actions for the connection stop.
-          if(m_stop_transfer_func) {
-            m_stop_transfer_func(shared_from_this());
+          std::size_t /*l_bytes_transferred*/) -> void {
+        TlsWriteQueue& l_queue =
+            t_to_server ? m_server_write_queue : m_client_write_queue;
+        l_queue.m_is_writing = false;
+        if(l_error) {
+          if(l_error != boost::asio::error::operation_aborted) {
+            stop_by_worker();
+          }
+          return;
+        }
+        StreamProtocol::socket& socket =
+            t_to_server ? m_server_socket : m_client_socket;
+        if(!socket.is_open()) {
+          return;
+        }
+
+        if(!l_queue.m_pending.empty()) {
+          do_tls_write(t_to_server);
+        }
+        if(m_stop_is_pending) {
+          if(!is_tls_writing()) {
+            stop_by_worker();
           }
+          return;
+        }
+        // The data to the server is read from the client and vice versa.
+        if(l_queue.m_read_is_waiting) {
+          l_queue.m_read_is_waiting = false;
+          do_read(t_to_server);
         }
       });
 }
 
-void Connection::do_packet_logging(
-    const boost::asio::mutable_buffer& t_read_buffer,
+bool Connection::is_tls_writing() const
+{
+  return m_client_write_queue.m_is_writing || m_server_write_queue.m_is_writing;
+}
+
+void Connection::stop_after_writes()
+{
+  // The data relayed before the peer's close is written to the other side,
+  // the server's error before its close for example.
+  if(is_tls_writing()) {
+    m_stop_is_pending = true;
+    return;
+  }
+  stop_by_worker();
+}
+
+bool Connection::do_compressed_client_packets(
+    const unsigned char* t_buffer_data, std::size_t t_bytes_transferred)
+{
+  // The plain data is collected and forwarded by the chunks
+  // of the decompression buffer.
+  const unsigned char* data = t_buffer_data;
+  std::size_t length = t_bytes_transferred;
+  while(true) {
+    std::size_t plain_length = 0;
+    if(!m_client_compression->decompress(data, length, plain_length)) {
+      return false;
+    }
+    if(0 == plain_length) {
+      return true;
+    }
+
+    // The full buffer can have the more plain data of the consumed bytes.
+    unsigned char* plain_data = m_client_compression->plain_data();
+    const std::size_t send_length = do_client_packets(plain_data, plain_length,
+        0 < length || PacketCompression::CHUNK_LENGTH == plain_length);
+    if(0 < send_length) {
+      write_to_server(boost::asio::buffer(plain_data, send_length));
+    }
+  }
+}
+
+std::size_t Connection::do_client_packets(unsigned char* t_buffer_data,
     std::size_t t_bytes_transferred,
-    bool t_from_client_to_server)
+    bool t_data_follows)
+{
+  // The bytes to forward are moved to the buffer begin, the bytes of
+  // the held back packet are kept at its end till the packet is decided.
+  std::size_t send_length = 0;
+  std::size_t held_begin = 0;
+
+  for(std::size_t i = 0; i < t_bytes_transferred; ++i) {
+    // Hold back every command until its type is known.
+    if(HoldState::NONE == m_hold_state && m_client_packet.is_packet_start()) {
+      // The zstd level changes the length of HandshakeResponse,
+      // SSLRequest is answered by the proxy.
+      m_hold_state = (MySqlConnectionState::COMMAND_PHASE == m_connection_state)
+          ? HoldState::UNDECIDED
+          : HoldState::HANDSHAKE;
+      held_begin = send_length;
+    }
+
+    const unsigned char received_byte = t_buffer_data[i];
+    const unsigned char forwarded_byte =
+        (MySqlConnectionState::CONNECTION_PHASE == m_connection_state)
+        ? client_handshake_byte(received_byte)
+        : received_byte;
+    m_client_packet.collect(received_byte, m_connection_state);
+    t_buffer_data[send_length++] = forwarded_byte;
+
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_ssl_request.html
+    // SSLRequest is the 32-byte packet after the greeting.
+    if(HoldState::HANDSHAKE == m_hold_state
+        && (4 <= m_client_packet.received_bytes()
+            || m_client_packet.is_received())
+        && (nullptr == m_tls_context || m_client_tls
+            || 1 != m_client_packet.sequence_id()
+            || 32 != m_client_packet.payload_length())) {
+      m_hold_state = HoldState::NONE;
+      if(is_handshake_response()) {
+        select_compression(t_buffer_data + held_begin);
+      }
+      forward_held_packet();
+    }
+
+    if(HoldState::UNDECIDED == m_hold_state
+        && (0 < m_client_packet.received_bytes()
+            || m_client_packet.is_received())) {
+      start_payload_capture();
+      if(is_local_reply_candidate()) {
+        m_hold_state = HoldState::CANDIDATE;
+      } else if(is_shard_candidate()) {
+        // The whole query is held, its begin is moved to the query.
+        m_hold_state = HoldState::SHARD;
+        m_shard_query.assign(
+            m_held_packet.begin(), m_held_packet.begin() + m_held_length);
+        m_held_length = 0;
+      } else {
+        m_hold_state = HoldState::NONE;
+        forward_held_packet();
+      }
+    }
+
+    if(m_client_packet.is_received()) {
+      if(m_compression_level_is_dropped) {
+        m_compression_level_is_dropped = false;
+        m_compression_level = received_byte;
+        --send_length;
+      }
+
+      if(HoldState::HANDSHAKE == m_hold_state) {
+        m_hold_state = HoldState::NONE;
+        if(is_tls_request()) {
+          // The rest of the data is the begin of the TLS handshake.
+          client_packet_is_received(true);
+          m_client_tls_requested = true;
+          m_client_tls_data_begin = i + 1;
+          m_client_tls_data_length = t_bytes_transferred - i - 1;
+          m_held_length = 0;
+          return held_begin;
+        }
+        forward_held_packet();
+      }
+
+      if(nullptr == m_tls_context && is_tls_request()) {
+        // The rest of the data is forwarded as is.
+        client_packet_is_received(false);
+        start_opaque_relay();
+        std::copy(t_buffer_data + i + 1, t_buffer_data + t_bytes_transferred,
+            t_buffer_data + send_length);
+        return send_length + t_bytes_transferred - i - 1;
+      }
+
+      bool replied_locally = false;
+      if(HoldState::CANDIDATE == m_hold_state
+          || HoldState::SHARD == m_hold_state) {
+        const bool is_candidate = HoldState::CANDIDATE == m_hold_state;
+        m_hold_state = HoldState::NONE;
+        replied_locally = is_candidate && do_local_reply();
+        if(replied_locally) {
+          send_length = held_begin;
+          m_held_length = 0;
+        } else if(!t_data_follows && i + 1 == t_bytes_transferred
+            && route_to_shard(
+                t_buffer_data + held_begin, send_length - held_begin)) {
+          // The commands after the query in the same data go to the MySQL
+          // server of the session, so the query goes there too and
+          // the responses keep the order of the commands.
+          send_length = held_begin;
+        } else {
+          forward_held_packet();
+        }
+      }
+      client_packet_is_received(replied_locally);
+    }
+  }
+
+  // Keep the undecided packet begin for the next received data.
+  if(HoldState::SHARD == m_hold_state) {
+    m_shard_query.insert(m_shard_query.end(), t_buffer_data + held_begin,
+        t_buffer_data + send_length);
+    send_length = held_begin;
+  } else if(HoldState::NONE != m_hold_state) {
+    std::copy(t_buffer_data + held_begin, t_buffer_data + send_length,
+        m_held_packet.begin() + m_held_length);
+    m_held_length += send_length - held_begin;
+    send_length = held_begin;
+  }
+
+  return send_length;
+}
+
+void Connection::do_server_packets(
+    unsigned char* t_buffer_data, std::size_t t_bytes_transferred)
+{
+  std::size_t record_begin = 0;
+
+  for(std::size_t i = 0; i < t_bytes_transferred; ++i) {
+    const unsigned char received_byte = t_buffer_data[i];
+    if(MySqlConnectionState::CONNECTION_PHASE == m_connection_state) {
+      t_buffer_data[i] = server_handshake_byte(received_byte);
+    }
+    m_server_packet.collect(received_byte, m_connection_state);
+
+    if(m_server_packet.is_received()) {
+      // The greeting is followed by the TLS handshake of the proxy.
+      if(nullptr != m_tls_context && nullptr != m_tls_context->server_context()
+          && !m_server_tls && 0 == m_server_packet.sequence_id()
+          && 0 != m_server_packet.capabilities()
+          && MySqlConnectionState::CONNECTION_PHASE == m_connection_state) {
+        m_server_tls_requested = true;
+      }
+
+      if(m_recording_response && m_server_packet.is_response_complete()) {
+        m_recorded_response.append(
+            reinterpret_cast<const char*>(t_buffer_data) + record_begin,
+            i + 1 - record_begin);
+        record_begin = i + 1;
+      }
+      server_packet_is_received();
+    }
+  }
+
+  if(m_recording_response) {
+    m_recorded_response.append(
+        reinterpret_cast<const char*>(t_buffer_data) + record_begin,
+        t_bytes_transferred - record_begin);
+  }
+}
+
+unsigned char Connection::client_handshake_byte(
+    unsigned char t_received_byte) const
+{
+  if(m_client_packet.is_sequence_id_next()) {
+    return static_cast<unsigned char>(t_received_byte - m_sequence_offset);
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_response.html
+  // The capability flags of HandshakeResponse, the response follows
+  // SSLRequest of the TLS client. The MySQL server gets the uncompressed
+  // packets.
+  const unsigned char response_sequence_id = m_client_tls ? 2 : 1;
+  if(!m_client_packet.is_first_payload_next()
+      || response_sequence_id != m_client_packet.sequence_id()
+      || 32 == m_client_packet.payload_length()) {
+    return t_received_byte;
+  }
+  switch(m_client_packet.received_bytes()) {
+    case 0: {
+      const auto compress_flag =
+          static_cast<unsigned char>(MySqlCapability::CLIENT_COMPRESS);
+      return static_cast<unsigned char>(t_received_byte & ~compress_flag);
+    }
+    case 1: {
+      if(nullptr == m_tls_context) {
+        break;
+      }
+      const auto ssl_flag =
+          static_cast<unsigned char>(MySqlCapability::CLIENT_SSL >> 8u);
+      return (nullptr != m_tls_context->server_context())
+          ? static_cast<unsigned char>(t_received_byte | ssl_flag)
+          : static_cast<unsigned char>(t_received_byte & ~ssl_flag);
+    }
+    case 3: {
+      // HandshakeResponse320 has the 2-byte capability flags.
+      const auto protocol_41_flag =
+          static_cast<unsigned char>(MySqlCapability::CLIENT_PROTOCOL_41 >> 8u);
+      const auto zstd_flag = static_cast<unsigned char>(
+          MySqlCapability::CLIENT_ZSTD_COMPRESSION_ALGORITHM >> 24u);
+      if(0 != (m_client_packet.payload_head()[1] & protocol_41_flag)) {
+        return static_cast<unsigned char>(t_received_byte & ~zstd_flag);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return t_received_byte;
+}
+
+unsigned char Connection::server_handshake_byte(
+    unsigned char t_received_byte) const
+{
+  if(m_server_packet.is_sequence_id_next()) {
+    return static_cast<unsigned char>(t_received_byte + m_sequence_offset);
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_v10.html
+  // The greeting has the protocol version, the NUL-terminated server version,
+  // the thread id, 8 bytes of the auth data, the filler, the lower
+  // capability flags, the charset, the status flags and the upper
+  // capability flags.
+  const std::uint64_t offset = m_server_packet.received_bytes();
+  if(!m_server_packet.is_first_payload_next()
+      || 0 != m_server_packet.sequence_id() || 0 != m_server_packet.capabilities()
+      || 0 == offset || MySqlPacket::PAYLOAD_HEAD_LENGTH < offset) {
+    return t_received_byte;
+  }
+  const unsigned char* head = m_server_packet.payload_head();
+  const unsigned char* version_end = std::find(head + 1, head + offset, 0);
+  if(0x0A != head[0] || head + offset == version_end) {
+    return t_received_byte;
+  }
+
+  switch(offset - static_cast<std::uint64_t>(version_end - head)) {
+    case 4 + 8 + 1 + 1: {
+      const auto compress_flag =
+          static_cast<unsigned char>(MySqlCapability::CLIENT_COMPRESS);
+      return is_compression_offered(CompressionAlgorithm::ZLIB,
+                 0 != (t_received_byte & compress_flag))
+          ? static_cast<unsigned char>(t_received_byte | compress_flag)
+          : static_cast<unsigned char>(t_received_byte & ~compress_flag);
+    }
+    case 4 + 8 + 1 + 2: {
+      if(nullptr == m_tls_context) {
+        break;
+      }
+      const auto ssl_flag =
+          static_cast<unsigned char>(MySqlCapability::CLIENT_SSL >> 8u);
+      return (nullptr != m_tls_context->client_context())
+          ? static_cast<unsigned char>(t_received_byte | ssl_flag)
+          : static_cast<unsigned char>(t_received_byte & ~ssl_flag);
+    }
+    case 4 + 8 + 1 + 2 + 1 + 2 + 2: {
+      const auto zstd_flag = static_cast<unsigned char>(
+          MySqlCapability::CLIENT_ZSTD_COMPRESSION_ALGORITHM >> 24u);
+      return is_compression_offered(CompressionAlgorithm::ZSTD,
+                 0 != (t_received_byte & zstd_flag))
+          ? static_cast<unsigned char>(t_received_byte | zstd_flag)
+          : static_cast<unsigned char>(t_received_byte & ~zstd_flag);
+    }
+    default: {
+      break;
+    }
+  }
+  return t_received_byte;
+}
+
+bool Connection::is_tls_request() const
+{
+  return MySqlConnectionState::CONNECTION_PHASE == m_connection_state
+      && 1 == m_client_packet.sequence_id()
+      && 32 == m_client_packet.payload_length()
+      && 0 != (m_client_packet.capabilities() & MySqlCapability::CLIENT_SSL);
+}
+
+bool Connection::is_compression_offered(
+    CompressionAlgorithm t_algorithm, bool t_server_supports_it) const
+{
+  const bool is_enabled = (CompressionAlgorithm::ZLIB == t_algorithm)
+      ? m_settings.m_zlib_compression
+      : m_settings.m_zstd_compression;
+  return is_enabled && PacketCompression::is_supported(t_algorithm)
+      && (nullptr != m_tls_context || t_server_supports_it);
+}
+
+bool Connection::is_handshake_response() const
+{
+  const unsigned char response_sequence_id = m_client_tls ? 2 : 1;
+  return MySqlConnectionState::CONNECTION_PHASE == m_connection_state
+      && response_sequence_id == m_client_packet.sequence_id()
+      && 32 != m_client_packet.payload_length()
+      && 4 <= m_client_packet.payload_head_length()
+      && 0 != (MySqlPacket::read_uint32(m_client_packet.payload_head())
+                  & MySqlCapability::CLIENT_PROTOCOL_41);
+}
+
+void Connection::select_compression(unsigned char* t_buffer_held)
+{
+  const std::uint32_t capabilities =
+      MySqlPacket::read_uint32(m_client_packet.payload_head());
+  const std::uint32_t server_capabilities = m_server_packet.capabilities();
+  if(0 != (capabilities & MySqlCapability::CLIENT_ZSTD_COMPRESSION_ALGORITHM)
+      && is_compression_offered(CompressionAlgorithm::ZSTD,
+          0 != (server_capabilities
+                   & MySqlCapability::CLIENT_ZSTD_COMPRESSION_ALGORITHM))) {
+    m_compression_algorithm = CompressionAlgorithm::ZSTD;
+  } else if(0 != (capabilities & MySqlCapability::CLIENT_COMPRESS)
+      && is_compression_offered(CompressionAlgorithm::ZLIB,
+          0 != (server_capabilities & MySqlCapability::CLIENT_COMPRESS))) {
+    m_compression_algorithm = CompressionAlgorithm::ZLIB;
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_response.html
+  // The zstd level is the last byte of HandshakeResponse. The packet length
+  // is in the first bytes of the held packet, in m_held_packet
+  // and after it in the buffer.
+  if(0 == (capabilities & MySqlCapability::CLIENT_ZSTD_COMPRESSION_ALGORITHM)) {
+    return;
+  }
+  m_compression_level_is_dropped = true;
+  for(std::size_t i = 0; i < 3; ++i) {
+    unsigned char& length_byte = (i < m_held_length)
+        ? m_held_packet[i]
+        : t_buffer_held[i - m_held_length];
+    if(0 != length_byte--) {
+      break;
+    }
+  }
+}
+
+void Connection::start_client_tls(
+    std::size_t t_data_begin, std::size_t t_data_length)
+{
+  boost::asio::ssl::context* client_context = m_tls_context->client_context();
+  if(nullptr == client_context) {
+    std::cout << "Connection: the client's TLS is not supported\n";
+    stop_by_worker();
+    return;
+  }
+
+  // The client's packets get the next sequence ids after SSLRequest.
+  ++m_sequence_offset;
+  m_client_tls = std::make_unique<TlsStream>(m_client_socket, *client_context);
+  m_client_tls->async_handshake(boost::asio::ssl::stream_base::server,
+      boost::asio::buffer(m_client_buffer.data() + t_data_begin, t_data_length),
+      [this, l_self = ConnectionPtr(this)](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(!m_client_socket.is_open()) {
+          return;
+        }
+        if(l_error) {
+          std::cout << "Connection: the client's TLS handshake failed: "
+                    << l_error.message() << "\n";
+          stop_by_worker();
+          return;
+        }
+        do_read(true);
+      });
+}
+
+void Connection::start_server_tls()
+{
+  if(0 == (m_server_packet.capabilities() & MySqlCapability::CLIENT_SSL)) {
+    std::cout << "Connection: the MySQL server does not support TLS\n";
+    stop_by_worker();
+    return;
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_ssl_request.html
+  // The server reads the client's capability flags and the charset again
+  // from HandshakeResponse after the TLS handshake.
+  const std::uint32_t capabilities = MySqlCapability::CLIENT_SSL
+      | (m_server_packet.capabilities()
+          & (MySqlCapability::CLIENT_PROTOCOL_41
+              | MySqlCapability::CLIENT_SECURE_CONNECTION
+              | MySqlCapability::CLIENT_PLUGIN_AUTH));
+  const std::uint32_t max_packet_size = 0x01000000;
+  const unsigned char utf8_general_ci = 33;
+  std::array<unsigned char, 4 + 32> tls_request{};
+  tls_request[0] = 32;
+  tls_request[3] = 1;
+  for(std::size_t i = 0; i < 4; ++i) {
+    tls_request[4 + i] = static_cast<unsigned char>(capabilities >> (8u * i));
+    tls_request[8 + i] = static_cast<unsigned char>(max_packet_size >> (8u * i));
+  }
+  tls_request[12] = utf8_general_ci;
+  write_to_server(boost::asio::buffer(tls_request));
+
+  // The server's packets get the next sequence ids after SSLRequest.
+  --m_sequence_offset;
+  m_server_tls = std::make_unique<TlsStream>(
+      m_server_socket, *m_tls_context->server_context());
+  m_tls_context->resume_server_session(*m_server_tls, m_backend_index);
+  m_server_tls->async_handshake(boost::asio::ssl::stream_base::client,
+      [this, l_self = ConnectionPtr(this)](
+          const boost::system::error_code& l_error) -> void {
+        if(!m_server_socket.is_open()) {
+          return;
+        }
+        if(l_error) {
+          std::cout << "Connection: the MySQL server's TLS handshake failed: "
+                    << l_error.message() << "\n";
+          stop_by_worker();
+          return;
+        }
+
+        // The client answers the greeting now.
+        do_read(false);
+        do_read(true);
+      });
+}
+
+void Connection::start_opaque_relay()
+{
+  m_is_opaque = true;
+
+  // The end of the handshake is not known, the connection is idle.
+  m_handshake_is_complete = true;
+  arm_timeout(Timeout::IDLE);
+  if(m_is_connecting) {
+    m_is_connecting = false;
+    m_worker.end_connect();
+  }
+}
+
+bool Connection::is_local_reply_candidate() const
+{
+  // Answer only the new commands when no response is being sent
+  // to the client.
+  if(0 != m_client_packet.sequence_id() || 0 == m_client_packet.payload_length()
+      || !m_server_packet.is_response_complete()) {
+    return false;
+  }
+
+  switch(m_client_packet.command()) {
+    case MySqlCommand::Command::COM_PING: {
+      return 1 == m_client_packet.payload_length();
+    }
+    case MySqlCommand::Command::COM_QUERY: {
+      return m_client_packet.payload_length() <= LocalReply::MAX_QUERY_LENGTH;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+bool Connection::do_local_reply()
+{
+  const std::uint32_t capabilities = m_client_packet.capabilities();
+  std::array<unsigned char, LocalReply::OK_PACKET_LENGTH> ok_packet{};
+
+  if(MySqlCommand::Command::COM_PING == m_client_packet.command()) {
+    const std::size_t length = LocalReply::make_ok_packet(
+        1, m_server_packet.status_flags(), capabilities, ok_packet);
+    write_to_client(boost::asio::buffer(ok_packet, length));
+    return true;
+  }
+
+  const char* charset = nullptr;
+  const LocalReply::Query query =
+      LocalReply::classify(m_client_packet.get_sql_string(), charset);
+  switch(query) {
+    case LocalReply::Query::VERSION_COMMENT: {
+      // The status flags of the recorded response are replaced
+      // by the session's ones.
+      if(m_server_packet.has_status_flags()) {
+        const std::string& response = m_local_reply.version_comment_response(
+            version_comment_key(), m_server_packet.status_flags());
+        if(!response.empty()) {
+          write_to_client(boost::asio::buffer(response));
+          return true;
+        }
+      }
+      m_recording_response = true;
+      m_recorded_response.clear();
+      return false;
+    }
+
+    case LocalReply::Query::SET_NAMES: {
+      if(nullptr != charset && charset == m_session_charset) {
+        break;
+      }
+      m_pending_charset = charset;
+      return false;
+    }
+
+    case LocalReply::Query::SET_AUTOCOMMIT_ON:
+    case LocalReply::Query::SET_AUTOCOMMIT_OFF: {
+      const bool autocommit_is_on = (m_server_packet.status_flags()
+                                        & MySqlServerStatus::SERVER_STATUS_AUTOCOMMIT)
+          != 0;
+      if(m_server_packet.has_status_flags()
+          && (LocalReply::Query::SET_AUTOCOMMIT_ON == query)
+              == autocommit_is_on) {
+        break;
+      }
+      return false;
+    }
+
+    case LocalReply::Query::OTHER: {
+      return false;
+    }
+  }
+
+  // The session state already matches, answer with OK.
+  const std::size_t length = LocalReply::make_ok_packet(
+      1, m_server_packet.status_flags(), capabilities, ok_packet);
+  write_to_client(boost::asio::buffer(ok_packet, length));
+  return true;
+}
+
+LocalReply::ResponseKey Connection::version_comment_key() const
+{
+  LocalReply::ResponseKey key;
+  key.m_deprecate_eof =
+      (m_client_packet.capabilities() & m_server_packet.capabilities()
+          & MySqlCapability::CLIENT_DEPRECATE_EOF)
+      != 0;
+  key.m_collation_id = m_client_packet.collation_id();
+  key.m_charset = m_session_charset;
+  key.m_backend_index = m_backend_index;
+  key.m_backend_state_changes =
+      m_backends.backend(m_backend_index).state_changes();
+  return key;
+}
+
+void Connection::start_payload_capture()
+{
+  m_payload_is_captured = false;
+  if(!m_statement_params || 0 != m_client_packet.sequence_id()
+      || 0 == m_client_packet.payload_length()) {
+    return;
+  }
+
+  switch(m_client_packet.command()) {
+    case MySqlCommand::Command::COM_STMT_EXECUTE: {
+      // Decode the sampled executions only.
+      m_payload_is_captured =
+          (0 == ++m_execute_counter % m_settings.m_params_sample_rate);
+      break;
+    }
+    case MySqlCommand::Command::COM_STMT_SEND_LONG_DATA: {
+      m_payload_is_captured = true;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  if(m_payload_is_captured) {
+    m_client_packet.capture_payload(&m_statement_params->payload());
+  }
+}
+
+void Connection::forward_held_packet()
+{
+  // The bytes of the packet which are held back from the previous received data.
+  if(0 < m_held_length) {
+    write_to_server(boost::asio::buffer(m_held_packet, m_held_length));
+    m_held_length = 0;
+  }
+  if(!m_shard_query.empty()) {
+    write_to_server(boost::asio::buffer(m_shard_query));
+    m_shard_query.clear();
+  }
+}
+
+bool Connection::is_shard_candidate() const
+{
+  // Route only the new queries when no response is being sent
+  // to the client, the key is searched in the captured SQL string.
+  if(!m_route->shard_router() || 0 != m_client_packet.sequence_id()
+      || 0 == m_client_packet.payload_length() || m_request_in_flight
+      || !m_server_packet.is_response_complete()) {
+    return false;
+  }
+  // The shard session runs the query in autocommit, without the state
+  // of the client's session.
+  if(m_in_transaction || m_session_state_is_changed) {
+    return false;
+  }
+  return MySqlCommand::Command::COM_QUERY == m_client_packet.command()
+      && m_client_packet.payload_length() <= m_settings.m_sql_capture_limit
+      && m_client_packet.payload_length() < MySqlPacket::MAX_PAYLOAD_LENGTH;
+}
+
+bool Connection::route_to_shard(
+    const unsigned char* t_data, std::size_t t_length)
+{
+  // The session state which the proxy tracks is of the MySQL server
+  // of the session.
+  if(!is_shard_candidate() || nullptr != m_pending_charset
+      || m_recording_response) {
+    return false;
+  }
+  const std::shared_ptr<ShardRouter>& router = m_route->shard_router();
+  const std::size_t shard = router->select(m_client_packet.get_sql_string());
+  if(ShardRouter::NO_SHARD == shard) {
+    return false;
+  }
+
+  if(m_shards.empty()) {
+    m_shards.resize(router->size());
+  }
+  if(!m_shards[shard]) {
+    m_shards[shard] = std::make_shared<ShardSession>(
+        m_worker.io_context(), router, shard, *this);
+    m_shards[shard]->start(
+        m_client_packet.capabilities() & m_server_packet.capabilities(),
+        m_client_packet.collation_id());
+  }
+
+  // The held begin of the query and its rest are sent together.
+  m_shard_query.insert(m_shard_query.begin(), m_held_packet.begin(),
+      m_held_packet.begin() + m_held_length);
+  m_held_length = 0;
+  m_shard_query.insert(m_shard_query.end(), t_data, t_data + t_length);
+  m_shards[shard]->send(m_shard_query, m_client_packet.payload_length());
+  m_shard_query.clear();
+
+  m_request_shard = m_shards[shard].get();
+  router->query_is_routed(shard);
+  return true;
+}
+
+void Connection::shard_data_is_received(
+    const boost::asio::const_buffer& t_buffer)
+{
+  m_account_stats.add_bytes(m_user_id, m_schema_id, false, t_buffer.size());
+  write_to_client(t_buffer);
+}
+
+void Connection::shard_response_is_received()
+{
+  m_request_shard = nullptr;
+  m_request_in_flight = false;
+  arm_timeout(Timeout::IDLE);
+  count_request_tables();
+  count_request_busy_time();
+
+  // The drained connection is closed after the response is relayed.
+  if(m_is_draining && is_at_command_boundary()) {
+    do_drain_close();
+    return;
+  }
+
+  if(m_client_read_is_paused) {
+    m_client_read_is_paused = false;
+    do_read(true);
+  }
+}
+
+void Connection::shard_failed(ShardSession* t_session)
 {
+  // The next query to the shard opens the new session.
+  m_shards[t_session->shard()].reset();
+  if(m_request_shard != t_session) {
+    return;
+  }
+
+  if(t_session->is_response_started()) {
+    std::cout << "Connection: the shard's response is broken\n";
+    stop_by_worker();
+    return;
+  }
+
+  // See https://dev.mysql.com/doc/refman/8.0/en/client-error-reference.html
+  // CR_SERVER_LOST, the query fails and the client's session goes on.
+  const std::string packet = LocalReply::make_err_packet(
+      1, 2013, "HY000", "Lost connection to the shard during query");
+  write_to_client(boost::asio::buffer(packet));
+  shard_response_is_received();
+}
+
+void Connection::client_packet_is_received(bool t_replied_locally)
+{
+  const bool is_request = !t_replied_locally
+      && MySqlConnectionState::COMMAND_PHASE == m_connection_state
+      && 0 == m_client_packet.sequence_id()
+      && 0 < m_client_packet.payload_length();
+
+  if(is_request) {
+    request_is_sent();
+    arm_timeout(m_request_in_flight ? Timeout::QUERY : Timeout::IDLE);
+  } else if(m_handshake_is_complete && !m_request_in_flight) {
+    // The client is active, e.g. its command is answered by the proxy.
+    arm_timeout(Timeout::IDLE);
+  }
+
 #ifdef PROXY_PACKET_DEBUG
+  debug_print_packet(&m_client_packet, true);
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  // Perform the actions for the packet logging.
+  m_packet_logger.packet_logger(&m_client_packet, true);
+
+  if(is_request) {
+    switch(m_request_command) {
+      case MySqlCommand::Command::COM_STMT_PREPARE: {
+        // Keep the SQL string till the server's COM_STMT_PREPARE_OK.
+        m_preparing_sql = m_client_packet.take_sql_string();
+        break;
+      }
+      case MySqlCommand::Command::COM_STMT_CLOSE: {
+        if(5 == m_client_packet.payload_length()) {
+          m_prepared_statements.remove(m_request_statement_id);
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+    m_client_packet.set_prepared_statement(nullptr);
+    m_client_packet.set_statement_params(nullptr);
+  }
+}
+
+void Connection::server_packet_is_received()
+{
+  if(!m_handshake_is_complete
+      && MySqlConnectionState::COMMAND_PHASE == m_connection_state) {
+    m_handshake_is_complete = true;
+    arm_timeout(Timeout::IDLE);
+    if(m_is_connecting) {
+      m_is_connecting = false;
+      m_worker.end_connect();
+    }
+    m_session_charset = LocalReply::collation_charset(
+        m_client_packet.collation_id(), m_server_packet.version_major());
+    m_compression_requested =
+        CompressionAlgorithm::NONE != m_compression_algorithm;
+    m_user_id = m_route->account_users().intern(m_client_packet.login_user());
+    m_schema_id =
+        m_route->account_schemas().intern(m_client_packet.login_schema());
+
+    const std::shared_ptr<Mirror>& mirror = m_route->mirror();
+    if(mirror && mirror->is_sampled()) {
+      m_mirror = std::make_shared<MirrorSession>(m_worker.io_context(), mirror);
+      m_mirror->start(
+          m_client_packet.capabilities(), m_client_packet.collation_id());
+    }
+  }
+
+  if(m_request_in_flight && m_server_packet.is_response_complete()) {
+    response_is_received();
+  }
+
+#ifdef PROXY_PACKET_DEBUG
+  debug_print_packet(&m_server_packet, false);
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  // Perform the actions for the packet logging.
+  m_packet_logger.packet_logger(&m_server_packet, false);
+}
+
+void Connection::request_is_sent()
+{
+  m_request_command = m_client_packet.command();
+  m_request_start = std::chrono::steady_clock::now();
+  m_request_statement_id = 0;
+  m_request_transaction = TransactionStats::Statement::OTHER;
+  m_account_is_pending = false;
+  m_account_stats.add_query(m_user_id, m_schema_id);
+
+  if(nullptr != m_request_shard) {
+    // The shard's response is relayed by its session.
+    m_request_in_flight = true;
+  } else {
+    m_server_packet.expect_response(m_request_command,
+        m_client_packet.payload_length(), m_client_packet.capabilities());
+    m_request_in_flight = !m_server_packet.is_response_complete();
+  }
+
+  switch(m_request_command) {
+    case MySqlCommand::Command::COM_QUERY: {
+      m_request_transaction =
+          TransactionStats::statement_kind(m_client_packet.get_sql_string());
+      // Other statements may change the session charset.
+      if(nullptr == m_pending_charset
+          && LocalReply::is_set_statement(m_client_packet.get_sql_string())) {
+        m_session_charset = nullptr;
+      }
+      if(nullptr != m_table_stats) {
+        // The copy keeps the capacity, the cache can be cleared
+        // till the response end.
+        m_request_tables = m_table_stats->statement_tables(
+            m_client_packet.sql_digest(), m_client_packet.get_sql_string());
+      }
+      if(nullptr == m_request_shard && m_route->shard_router()
+          && ShardRouter::changes_session_state(
+              m_client_packet.get_sql_string())) {
+        m_session_state_is_changed = true;
+      }
+      m_pending_schema =
+          AccountStats::use_statement_schema(m_client_packet.get_sql_string());
+      if(!m_pending_schema.empty()) {
+        m_account_is_pending = true;
+        m_pending_user_is_changed = false;
+      }
+      break;
+    }
+    case MySqlCommand::Command::COM_INIT_DB: {
+      m_session_state_is_changed = true;
+      m_account_is_pending = true;
+      m_pending_user_is_changed = false;
+      m_pending_schema = m_client_packet.get_sql_string();
+      break;
+    }
+    case MySqlCommand::Command::COM_CHANGE_USER: {
+      m_session_charset = nullptr;
+      m_session_state_is_changed = true;
+      m_account_is_pending = true;
+      m_pending_user_is_changed = true;
+      m_pending_user = m_client_packet.login_user();
+      m_pending_schema = m_client_packet.login_schema();
+      break;
+    }
+    case MySqlCommand::Command::COM_RESET_CONNECTION: {
+      m_session_charset = nullptr;
+      break;
+    }
+    case MySqlCommand::Command::COM_STMT_PREPARE: {
+      m_preparing_digest = m_client_packet.sql_digest();
+      break;
+    }
+    case MySqlCommand::Command::COM_STMT_EXECUTE:
+    case MySqlCommand::Command::COM_STMT_CLOSE:
+    case MySqlCommand::Command::COM_STMT_RESET:
+    case MySqlCommand::Command::COM_STMT_SEND_LONG_DATA: {
+      // The O(1) lookup, the statement is referenced by the logger
+      // without the SQL string copy.
+      m_request_statement_id = m_client_packet.statement_id();
+      PreparedStatement* statement =
+          m_prepared_statements.find(m_request_statement_id);
+      m_client_packet.set_prepared_statement(statement);
+      if(m_statement_params) {
+        do_statement_params(statement);
+      }
+      if(nullptr != m_table_stats && nullptr != statement
+          && MySqlCommand::Command::COM_STMT_EXECUTE == m_request_command) {
+        m_request_tables = m_table_stats->statement_tables(
+            statement->m_digest, statement->m_sql);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+void Connection::do_statement_params(PreparedStatement* t_statement)
+{
+  const std::uint32_t capabilities =
+      m_client_packet.capabilities() & m_server_packet.capabilities();
+
+  switch(m_request_command) {
+    case MySqlCommand::Command::COM_STMT_EXECUTE: {
+      if(nullptr != t_statement) {
+        if(m_payload_is_captured) {
+          m_client_packet.set_statement_params(
+              &m_statement_params->decode_execute(capabilities, *t_statement));
+        } else {
+          // Remember the types for the next sampled execution.
+          StatementParams::read_types(m_client_packet.payload_head(),
+              m_client_packet.payload_head_length(), capabilities,
+              *t_statement);
+        }
+      }
+      m_statement_params->reset_long_data(m_request_statement_id);
+      break;
+    }
+    case MySqlCommand::Command::COM_STMT_SEND_LONG_DATA: {
+      m_statement_params->add_long_data(m_client_packet.payload_length());
+      break;
+    }
+    default: {
+      m_statement_params->reset_long_data(m_request_statement_id);
+      break;
+    }
+  }
+}
+
+void Connection::response_is_received()
+{
+  m_request_in_flight = false;
+  arm_timeout(Timeout::IDLE);
+  const bool response_failed = m_server_packet.is_response_failed();
+  count_request_tables();
+  count_request_busy_time();
+  if(m_account_is_pending) {
+    m_account_is_pending = false;
+    if(!response_failed) {
+      if(m_pending_user_is_changed) {
+        m_user_id = m_route->account_users().intern(m_pending_user);
+      }
+      m_schema_id = m_route->account_schemas().intern(m_pending_schema);
+    }
+  }
+  if(m_server_packet.has_status_flags()) {
+    transaction_status_is_received();
+  }
+
+  if(m_mirror) {
+    m_mirror->response_is_received(
+        std::chrono::steady_clock::now() - m_request_start,
+        m_server_packet.error_code(), m_server_packet.statement_id());
+  }
+
+  switch(m_request_command) {
+    case MySqlCommand::Command::COM_STMT_PREPARE: {
+      if(!response_failed) {
+        m_prepared_statements.add(m_server_packet.statement_id(),
+            m_server_packet.statement_num_params(), m_preparing_digest,
+            std::move(m_preparing_sql));
+      }
+      m_preparing_sql.clear();
+      break;
+    }
+    case MySqlCommand::Command::COM_STMT_EXECUTE: {
+      PreparedStatement* statement =
+          m_prepared_statements.find(m_request_statement_id);
+      if(nullptr != statement) {
+        ++statement->m_executions;
+        statement->m_execution_time +=
+            std::chrono::steady_clock::now() - m_request_start;
+      }
+      break;
+    }
+    case MySqlCommand::Command::COM_CHANGE_USER:
+    case MySqlCommand::Command::COM_RESET_CONNECTION: {
+      // The server deallocates the prepared statements of the session.
+      if(!response_failed) {
+        m_prepared_statements.clear();
+        if(MySqlCommand::Command::COM_RESET_CONNECTION == m_request_command) {
+          m_session_state_is_changed = false;
+        }
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  if(nullptr != m_pending_charset) {
+    m_session_charset = response_failed ? nullptr : m_pending_charset;
+    m_pending_charset = nullptr;
+  }
+
+  if(m_recording_response) {
+    m_recording_response = false;
+    if(!response_failed) {
+      m_local_reply.set_version_comment_response(
+          version_comment_key(), std::move(m_recorded_response));
+    }
+    m_recorded_response.clear();
+    m_recorded_response.shrink_to_fit();
+  }
+}
+
+void Connection::count_request_tables()
+{
+  if(!m_request_tables.empty()) {
+    TableStats::add_access(
+        m_request_tables, std::chrono::steady_clock::now() - m_request_start);
+    m_request_tables.clear();
+  }
+}
+
+void Connection::count_request_busy_time()
+{
+  m_account_stats.add_busy_time(m_user_id, m_schema_id,
+      std::chrono::steady_clock::now() - m_request_start);
+}
+
+void Connection::transaction_status_is_received()
+{
+  const bool in_transaction = 0
+      != (m_server_packet.status_flags()
+          & MySqlServerStatus::SERVER_STATUS_IN_TRANS);
+  const bool is_statement =
+      MySqlCommand::Command::COM_QUERY == m_request_command
+      || MySqlCommand::Command::COM_STMT_EXECUTE == m_request_command;
+
+  if(in_transaction) {
+    if(!m_in_transaction) {
+      // Started by BEGIN or by the first statement without autocommit.
+      m_in_transaction = true;
+      m_transaction_start = m_request_start;
+      m_transaction_statements = 0;
+      m_transaction_stats.transaction_is_started();
+      if(0 < m_settings.m_long_transaction_threshold) {
+        m_timing_wheel.arm(m_transaction_timer,
+            std::chrono::milliseconds(m_settings.m_long_transaction_threshold));
+      }
+    }
+    if(is_statement
+        && TransactionStats::Statement::BEGIN != m_request_transaction) {
+      ++m_transaction_statements;
+    }
+  } else if(m_in_transaction) {
+    // Ended by COMMIT, ROLLBACK, or implicitly, e.g. by DDL or by the reset
+    // of the session.
+    const bool is_rolled_back =
+        TransactionStats::Statement::ROLLBACK == m_request_transaction
+        || MySqlCommand::Command::COM_CHANGE_USER == m_request_command
+        || MySqlCommand::Command::COM_RESET_CONNECTION == m_request_command;
+    if(is_statement
+        && TransactionStats::Statement::OTHER == m_request_transaction) {
+      ++m_transaction_statements;
+    }
+    end_transaction(is_rolled_back);
+  }
+}
+
+void Connection::end_transaction(bool t_is_rolled_back)
+{
+  m_in_transaction = false;
+  m_transaction_timer.cancel();
+  m_transaction_stats.transaction_is_ended(
+      std::chrono::steady_clock::now() - m_transaction_start,
+      m_transaction_statements, t_is_rolled_back);
+}
+
+void Connection::transaction_is_long()
+{
+  const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - m_transaction_start);
+  std::cout << "Transaction: open for " << duration.count() << " ms with "
+            << m_transaction_statements << " statements, client "
+            << m_client_ip << "\n";
+  m_timing_wheel.arm(m_transaction_timer,
+      std::chrono::milliseconds(m_settings.m_long_transaction_threshold));
+}
+
+bool Connection::is_at_command_boundary() const
+{
+  // The boundaries of the relayed TLS are not known, the connection
+  // is closed by the drain timeout.
+  return !m_is_opaque && !m_request_in_flight
+      && HoldState::NONE == m_hold_state
+      && m_client_packet.is_packet_start()
+      && m_server_packet.is_response_complete();
+}
+
+void Connection::do_drain_close()
+{
+  // The session is ended by the client's command, the MySQL server
+  // does not count it as the aborted one.
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_quit.html
+  if(m_handshake_is_complete && !m_is_opaque) {
+    const std::array<unsigned char, 5> quit_packet{
+        1, 0, 0, 0, static_cast<unsigned char>(MySqlCommand::Command::COM_QUIT)};
+    write_to_server(boost::asio::buffer(quit_packet));
+  }
+
+  // The rest of the response and COM_QUIT are written over TLS first,
+  // the idle timeout closes the connection if they are not.
+  if(is_tls_writing()) {
+    m_stop_is_pending = true;
+    return;
+  }
+
+  m_timeout_timer.cancel();
+  boost::system::error_code error;
+  m_client_socket.shutdown(StreamProtocol::socket::shutdown_both, error);
+
+  // Perform the actions for the connection stop.
+  stop_by_worker();
+}
+
+#ifdef PROXY_PACKET_DEBUG
+void Connection::debug_print_buffer(
+    const boost::asio::mutable_buffer& t_read_buffer,
+    bool t_from_client_to_server) const
+{
   // Debug printers.
   std::string begin_str = t_from_client_to_server ? "--->>>" : "<<<===";
   std::string end_str = t_from_client_to_server ? "---+++" : "===|||";
@@ -150,42 +1666,25 @@ void Connection::do_packet_logging(
   std::string data(
       static_cast<char*>(t_read_buffer.data()), t_read_buffer.size());
   std::cout << begin_str << "BUFFER AS STRING: " << data << end_str << "\n";
-#endif  // ifdef PROXY_PACKET_DEBUG
-
-
-  // Collects the corresponding packet from the incoming stream of bytes.
-  MySqlPacket* packet = t_from_client_to_server
-      ? static_cast<MySqlPacket*>(&m_client_packet)
-      : static_cast<MySqlPacket*>(&m_server_packet);
-
-  auto* buffer_data = static_cast<unsigned char*>(t_read_buffer.data());
-
-  for(std::size_t i = 0; i < t_bytes_transferred; ++i) {
-    packet->collect(buffer_data[i], m_connection_state);
-  }
-
-
-  if(packet->is_received()) {
-#ifdef PROXY_PACKET_DEBUG
-    // Prints the all collected packet bytes.
-    std::cout << begin_str << "PACKET: "
-              << " [[[ length: " << std::setw(2) << packet->payload_length()
-              << ", sequence_id: " << std::setw(2) << packet->sequence_id()
-              << ", payload: ";
-    for(std::size_t k = 0; k < packet->payload().size(); ++k) {
-      unsigned char packet_byte =
-          static_cast<const unsigned char*>(packet->payload().data())[k];
-      std::cout << std::setw(2) << +packet_byte << " ";
-    }
-    std::cout << " ]]]\n";
-#endif  // ifdef PROXY_PACKET_DEBUG
+}
 
+void Connection::debug_print_packet(
+    const MySqlPacket* t_packet, bool t_from_client_to_server) const
+{
+  std::string begin_str = t_from_client_to_server ? "--->>>" : "<<<===";
 
-    // Perform the actions for the packet logging.
-    if(m_packet_logger_func) {
-      m_packet_logger_func(packet, t_from_client_to_server);
-    }
+  // Prints the all collected packet bytes.
+  std::cout << begin_str << "PACKET: "
+            << " [[[ length: " << std::setw(2) << t_packet->payload_length()
+            << ", sequence_id: " << std::setw(2) << +t_packet->sequence_id()
+            << ", payload: ";
+  for(std::size_t k = 0; k < t_packet->payload().size(); ++k) {
+    unsigned char packet_byte =
+        static_cast<const unsigned char*>(t_packet->payload().data())[k];
+    std::cout << std::setw(2) << +packet_byte << " ";
   }
+  std::cout << " ]]]\n";
 }
+#endif  // ifdef PROXY_PACKET_DEBUG
 
 }  // namespace proxy
@@ -25,22 +25,51 @@
 #define PROXY_CONNECTION_HPP
 
 #include <array>
+#include <chrono>
 #include <cstddef>
-#include <functional>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
+#include <boost/intrusive_ptr.hpp>
 
+#include "account_stats.hpp"
+#include "backend.hpp"
+#include "compression.hpp"
+#include "local_reply.hpp"
+#include "mirror.hpp"
 #include "packet.hpp"
+#include "packet_logger.hpp"
+#include "prepared_statements.hpp"
+#include "route.hpp"
+#include "settings.hpp"
+#include "shard.hpp"
+#include "statement_params.hpp"
+#include "table_stats.hpp"
+#include "timing_wheel.hpp"
+#include "tls_context.hpp"
+#include "transaction_stats.hpp"
 
 namespace proxy
 {
 class Connection;
+class Worker;
 
-using ConnectionPtr = std::shared_ptr<Connection>;
+/// The connections are allocated by the pool of their worker
+/// and counted by the intrusive pointers in the worker's thread.
+using ConnectionPtr = boost::intrusive_ptr<Connection>;
+
+/// Id of the open connection, unique in the process while the connection
+/// is open, is not reused soon after it is closed.
+using ConnectionId = std::uint64_t;
+
+/// The id of no connection.
+const ConnectionId NO_CONNECTION_ID = 0;
 
 /// Represents a single proxy connection between the client and MySQL server.
-class Connection : public std::enable_shared_from_this<Connection>
+class Connection
 {
 public:
   Connection(const Connection&) = delete;
@@ -48,55 +77,280 @@ public:
   Connection& operator=(const Connection&) = delete;
   Connection& operator=(Connection&&) = delete;
 
-  ~Connection() = default;
+  ~Connection();
 
-  /// Functor for the actions for the connection stop.
-  using StopTransferFunc = std::function<void(ConnectionPtr t_connection)>;
+  /// Construct a connection with the given client socket, served
+  /// by the worker with the route snapshot which is kept alive
+  /// by the connection. The connection of the client's IP address
+  /// is released by the worker's admission on the destruction.
+  /// Use ConnectionPool::make_connection().
+  explicit Connection(StreamProtocol::socket t_client_socket,
+      RoutePtr t_route,
+      Worker& t_worker,
+      std::string&& t_client_ip);
 
-  /// Functor for the actions for the packet logging.
-  using PacketLoggerFunc = std::function<void(
-      const MySqlPacket* t_packet, bool t_from_client_to_server)>;
-
-  /// Construct a connection with the given client socket and server endpoint.
-  explicit Connection(boost::asio::ip::tcp::socket t_client_socket,
-      const boost::asio::ip::tcp::endpoint& t_server_endpoint,
-      StopTransferFunc&& t_stop_handler_func,
-      PacketLoggerFunc&& t_packet_logger_func);
+  /// Get the id of the connection, set by the connection manager.
+  ConnectionId id() const;
+  void set_id(ConnectionId t_id);
 
   /// Start the first asynchronous operation for the connection.
+  /// The connection waits for the place of the MySQL server connect
+  /// in the worker's queue with the handshake timeout.
   void start();
 
-  /// Stop all asynchronous operations associated with the connection.
+  /// Start the MySQL server connect, called by the worker
+  /// when the connection has the place of the connect.
+  void connect();
+
+  /// Stop all asynchronous operations associated with the connection
+  /// and flush its log.
   void stop();
 
+  /// Close the connection at its next command boundary: at once
+  /// if the client waits for no response, else after the server's response
+  /// is relayed to the client.
+  void drain();
+
 private:
+  friend void intrusive_ptr_add_ref(Connection* t_connection);
+  friend void intrusive_ptr_release(Connection* t_connection);
+  friend class ShardSession;
+
+  /// Perform the actions for the connection stop by the worker.
+  void stop_by_worker();
+
   /// Perform an asynchronous connection operation.
   void do_connect();
 
+  /// Connect to the backend by its index, the client gets the error
+  /// if the index is out of the backends.
+  void connect_backend(std::size_t t_backend_index);
+
+  /// Send the error to the client instead of the server's greeting
+  /// and stop the connection.
+  void do_connect_error();
+
+  /// Kinds of the connection timeouts.
+  enum class Timeout
+  {
+    CONNECT,
+    HANDSHAKE,
+    IDLE,
+    QUERY
+  };
+
+  /// Arm the timeout of the connection stage, replaces the previous one.
+  void arm_timeout(Timeout t_timeout);
+
+  /// Close the connection after its timeout is expired.
+  void timeout_is_expired();
+
   /// Perform an asynchronous receive operation.
   void do_receive();
 
+  /// Read more data from the client or from the server.
+  void do_read(bool t_from_client_to_server);
+
   /// The handler used to process the transfer operation.
-  void do_transfer(boost::asio::ip::tcp::socket& t_read_from,
-      boost::asio::ip::tcp::socket& t_send_to,
-      const boost::asio::mutable_buffer& t_read_buffer,
+  void do_transfer(
+      bool t_from_client_to_server, std::size_t t_bytes_transferred);
+
+  /// Write the data to the client or to the server, over the TLS
+  /// if it is used. The data to the client is compressed if the client
+  /// uses the compressed protocol.
+  void write_to_client(const boost::asio::const_buffer& t_buffer);
+  void write_to_server(const boost::asio::const_buffer& t_buffer);
+
+  /// Write the data to the client's socket or to its TLS.
+  void write_to_client_stream(const boost::asio::const_buffer& t_buffer);
+
+  /// Queue the data to the TLS stream of the client or of the server,
+  /// the TLS stream allows no synchronous write beside its pending read.
+  void write_to_tls(bool t_to_server, const boost::asio::const_buffer& t_buffer);
+
+  /// Start the write of the queued data to the TLS stream.
+  void do_tls_write(bool t_to_server);
+
+  /// Check if the data is being written to a TLS stream.
+  bool is_tls_writing() const;
+
+  /// Stop the connection after the queued TLS data is written.
+  void stop_after_writes();
+
+  /// Decompresses the client's compressed packets and performs the packet
+  /// collection of the plain data. Returns false if the compressed packet
+  /// is broken.
+  bool do_compressed_client_packets(
+      const unsigned char* t_buffer_data, std::size_t t_bytes_transferred);
+
+  /// Performs the packet collection from the client's stream, runs the packet
+  /// logging and answers the commands which do not need the MySQL server.
+  /// Returns the length of the data to forward, placed at the buffer begin.
+  /// The more data of the same read follows the buffer if t_data_follows.
+  std::size_t do_client_packets(unsigned char* t_buffer_data,
       std::size_t t_bytes_transferred,
-      bool t_from_client_to_server);
+      bool t_data_follows);
 
-  /// Performs the packet collection from the incoming stream
+  /// Performs the packet collection from the server's stream
   /// and runs the packet logging.
-  void do_packet_logging(const boost::asio::mutable_buffer& t_read_buffer,
-      std::size_t t_bytes_transferred,
-      bool t_from_client_to_server);
+  void do_server_packets(
+      unsigned char* t_buffer_data, std::size_t t_bytes_transferred);
+
+  /// Get the byte of the connection phase to forward to the other side
+  /// for the TLS and the compression which are terminated by the proxy:
+  /// the sequence ids are shifted by the SSLRequests of the proxy
+  /// and of the client, CLIENT_SSL of the greeting and of the HandshakeResponse
+  /// is set for the TLS of the side which gets them, the compression flags
+  /// are offered to the client and are cleared for the MySQL server.
+  unsigned char client_handshake_byte(unsigned char t_received_byte) const;
+  unsigned char server_handshake_byte(unsigned char t_received_byte) const;
+
+  /// Check if the received client's packet is SSLRequest.
+  bool is_tls_request() const;
+
+  /// Check if the compression algorithm is offered to the client.
+  /// The client's TLS which is relayed as is carries the compression
+  /// of the MySQL server, it is offered only if the server supports it.
+  bool is_compression_offered(
+      CompressionAlgorithm t_algorithm, bool t_server_supports_it) const;
+
+  /// Check if the client's packet with the received capability flags
+  /// is HandshakeResponse.
+  bool is_handshake_response() const;
+
+  /// Select the compression algorithm of the client's HandshakeResponse.
+  /// The zstd level at the packet end is not forwarded, the length
+  /// of the held packet begin is shortened, t_buffer_held has the held bytes
+  /// after m_held_packet.
+  void select_compression(unsigned char* t_buffer_held);
+
+  /// Start the TLS handshake with the client, the data after its SSLRequest
+  /// is the begin of the handshake.
+  void start_client_tls(std::size_t t_data_begin, std::size_t t_data_length);
+
+  /// Send SSLRequest to the MySQL server after its greeting
+  /// and start the TLS handshake with it.
+  void start_server_tls();
+
+  /// Relay the TLS which is not terminated by the proxy as is,
+  /// without the packet collection.
+  void start_opaque_relay();
+
+  /// Check if the client's packet can be answered by the proxy.
+  bool is_local_reply_candidate() const;
+
+  /// Answer the client's packet if the MySQL server is not needed for it.
+  bool do_local_reply();
+
+  /// Get the session's settings of the recorded response
+  /// to "SELECT @@version_comment LIMIT 1".
+  LocalReply::ResponseKey version_comment_key() const;
+
+  /// Start the payload capture of the client's command
+  /// for the parameters decoding.
+  void start_payload_capture();
+
+  /// Send the held back bytes of the client's packet to the server.
+  void forward_held_packet();
+
+  /// Check if the client's packet can be routed to the shard by its key.
+  bool is_shard_candidate() const;
+
+  /// Send the received query with the shard key to its shard, the data
+  /// is the rest of the held back query. Returns false if the query
+  /// is not routed.
+  bool route_to_shard(const unsigned char* t_data, std::size_t t_length);
+
+  /// Relay the shard's response to the client.
+  void shard_data_is_received(const boost::asio::const_buffer& t_buffer);
+
+  /// Perform the actions for the shard's response fully relayed,
+  /// the client's next command is read.
+  void shard_response_is_received();
+
+  /// Perform the actions for the failed shard session, the query in flight
+  /// gets the error if its response is not started.
+  void shard_failed(ShardSession* t_session);
+
+  /// Perform the actions for the completely received client's packet.
+  void client_packet_is_received(bool t_replied_locally);
+
+  /// Perform the actions for the completely received server's packet.
+  void server_packet_is_received();
+
+  /// Perform the actions for the client's command forwarded to the server.
+  void request_is_sent();
+
+  /// Decode the parameters of COM_STMT_EXECUTE and keep the long data.
+  void do_statement_params(PreparedStatement* t_statement);
+
+  /// Perform the actions for the server's response fully received.
+  void response_is_received();
+
+  /// Count the access of the last statement to its tables.
+  void count_request_tables();
+
+  /// Count the time of the last command for the user and the schema.
+  void count_request_busy_time();
+
+  /// Track the transaction by the status flags of the server's response.
+  void transaction_status_is_received();
+
+  /// End the tracked transaction, it is rolled back if the session
+  /// is closed in it.
+  void end_transaction(bool t_is_rolled_back);
+
+  /// Log the transaction which is open longer than the threshold.
+  void transaction_is_long();
+
+  /// Check if no command is being received from the client
+  /// or answered by the server.
+  bool is_at_command_boundary() const;
+
+  /// Close the drained connection, the MySQL server gets COM_QUIT.
+  void do_drain_close();
+
+#ifdef PROXY_PACKET_DEBUG
+  /// Prints the buffer bytes.
+  void debug_print_buffer(const boost::asio::mutable_buffer& t_read_buffer,
+      bool t_from_client_to_server) const;
+
+  /// Prints the all collected packet bytes.
+  void debug_print_packet(
+      const MySqlPacket* t_packet, bool t_from_client_to_server) const;
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  ConnectionId m_id = NO_CONNECTION_ID;
+
+  /// Number of ConnectionPtr to the connection, used only by its worker.
+  std::size_t m_ref_count = 0;
+
+  /// The worker which serves the connection and the snapshot
+  /// of the route of the connection.
+  Worker& m_worker;
+  const RoutePtr m_route;
+
+  /// IP address of the client, empty for the Unix domain socket.
+  const std::string m_client_ip;
+
+  /// The connection has the place of the MySQL server connect
+  /// till the handshake is complete.
+  bool m_is_connecting = false;
 
   /// Socket for the connection from the client.
-  boost::asio::ip::tcp::socket m_client_socket;
+  StreamProtocol::socket m_client_socket;
+
+  /// The client's and the MySQL server's sockets are TCP sockets,
+  /// TCP_QUICKACK is set again after each read from them.
+  bool m_client_quick_ack = false;
+  bool m_server_quick_ack = false;
 
-  /// Endpoint for the server socket.
-  const boost::asio::ip::tcp::endpoint& m_server_endpoint;
+  /// The MySQL servers and the index of the connected one.
+  BackendPool& m_backends;
+  std::size_t m_backend_index = 0;
 
   /// Socket for the connection to the server.
-  boost::asio::ip::tcp::socket m_server_socket;
+  StreamProtocol::socket m_server_socket;
 
   // Min BUFFER_LENGTH == 2 for 100 connections, debug build.
 #ifdef PROXY_PACKET_DEBUG
@@ -111,9 +365,6 @@ private:
   /// Buffer for the incoming data from the server.
   std::array<char, BUFFER_LENGTH> m_server_buffer;
 
-  /// Set the actions for the connection stop.
-  StopTransferFunc m_stop_transfer_func;
-
   /// Stores the current state of the connection with MySQL server.
   MySqlConnectionState m_connection_state =
       MySqlConnectionState::CONNECTION_PHASE;
@@ -124,10 +375,198 @@ private:
   /// Collects the MySQL packet from the server.
   FromServerPacket m_server_packet;
 
-  /// Set the actions for the packet logging.
-  PacketLoggerFunc m_packet_logger_func;
+  /// The logger of the route, called directly for each packet.
+  PacketLogger& m_packet_logger;
+
+  /// Settings of the connection.
+  const ConnectionSettings& m_settings;
+
+  /// The answers to the commands which do not need the MySQL server.
+  LocalReply& m_local_reply;
+
+  /// The TLS contexts of the route for the worker, nullptr if the route
+  /// has no TLS settings.
+  TlsContext* const m_tls_context;
+
+  /// The table statistics of the route for the worker, nullptr
+  /// if the tables are not counted.
+  TableStats* const m_table_stats;
+
+  /// The transaction statistics of the route for the worker.
+  TransactionStats& m_transaction_stats;
+
+  /// The user and schema statistics of the route for the worker.
+  AccountStats& m_account_stats;
+
+  /// TLS of the client's and of the server's connections, exist
+  /// for the connections which use it.
+  std::unique_ptr<TlsStream> m_client_tls;
+  std::unique_ptr<TlsStream> m_server_tls;
+
+  /// The TLS handshake starts after the received data is forwarded.
+  bool m_client_tls_requested = false;
+  std::size_t m_client_tls_data_begin = 0;
+  std::size_t m_client_tls_data_length = 0;
+  bool m_server_tls_requested = false;
+
+  /// The data written to a TLS stream. The data queued during the write
+  /// is written after it, the read of the other side waits for it.
+  struct TlsWriteQueue
+  {
+    std::vector<unsigned char> m_writing;
+    std::vector<unsigned char> m_pending;
+    bool m_is_writing = false;
+    bool m_read_is_waiting = false;
+  };
+  TlsWriteQueue m_client_write_queue;
+  TlsWriteQueue m_server_write_queue;
+
+  /// The connection is stopped after the TLS writes are completed.
+  bool m_stop_is_pending = false;
+
+  /// The client's sequence id minus the server's one
+  /// in the connection phase.
+  int m_sequence_offset = 0;
+
+  /// The client's TLS is relayed without the packet collection.
+  bool m_is_opaque = false;
+
+  /// The compression algorithm and the zstd level negotiated
+  /// by the client's HandshakeResponse.
+  CompressionAlgorithm m_compression_algorithm = CompressionAlgorithm::NONE;
+  int m_compression_level = 3;
+
+  /// The zstd level at the HandshakeResponse end is not forwarded.
+  bool m_compression_level_is_dropped = false;
+
+  /// The compressed protocol starts after the OK of the handshake
+  /// is forwarded.
+  bool m_compression_requested = false;
+
+  /// Compressed protocol of the client's connection, exists after
+  /// the handshake of the client which negotiated it.
+  std::unique_ptr<PacketCompression> m_client_compression;
+
+  /// The timeout of the current connection stage, only one stage
+  /// timeout is armed at a time.
+  TimingWheel& m_timing_wheel;
+  WheelTimer m_timeout_timer;
+  Timeout m_timeout = Timeout::CONNECT;
+
+  /// States of the holding back of the client's packet.
+  enum class HoldState
+  {
+    NONE,  // The packet is forwarded to the server.
+    UNDECIDED,  // The command of the packet is not received yet.
+    CANDIDATE,  // The packet can be answered by the proxy.
+    SHARD,  // The query can be routed to the shard by its key.
+    HANDSHAKE  // The capability flags of the connection phase packet are
+               // not received yet, or the packet can be SSLRequest
+               // to the proxy.
+  };
+
+  HoldState m_hold_state = HoldState::NONE;
+
+  /// Begin of the client's packet which is held back.
+  std::array<unsigned char, 4 + LocalReply::MAX_QUERY_LENGTH> m_held_packet;
+  std::size_t m_held_length = 0;
+
+  /// The query which is held back till its shard key is known.
+  std::vector<unsigned char> m_shard_query;
+
+  /// The handshake with the MySQL server is complete.
+  bool m_handshake_is_complete = false;
+
+  /// The session state of the MySQL server of the session is changed
+  /// by the client, the queries are not routed to the shards till
+  /// the session reset.
+  bool m_session_state_is_changed = false;
+
+  /// Charset of the session if known, set by SET NAMES or by the handshake.
+  const char* m_session_charset = nullptr;
+
+  /// Charset from SET NAMES which waits for the server's answer.
+  const char* m_pending_charset = nullptr;
+
+  /// Records the server's response to store it in the local replies.
+  bool m_recording_response = false;
+  std::string m_recorded_response;
+
+  /// The last client's command forwarded to the server.
+  MySqlCommand::Command m_request_command = MySqlCommand::Command::UNKNOWN;
+  std::chrono::steady_clock::time_point m_request_start;
+  std::uint32_t m_request_statement_id = 0;
+  /// The tables of the last statement, counted at its response end.
+  TableStats::Accesses m_request_tables;
+
+  /// The server's response to the last command is not fully received.
+  bool m_request_in_flight = false;
+
+  /// The transaction of the session, tracked by the status flags
+  /// of the server's responses. The long transaction is logged
+  /// by its timer.
+  TransactionStats::Statement m_request_transaction =
+      TransactionStats::Statement::OTHER;
+  bool m_in_transaction = false;
+  std::chrono::steady_clock::time_point m_transaction_start;
+  std::uint32_t m_transaction_statements = 0;
+  WheelTimer m_transaction_timer;
+
+  /// The interned user and schema of the session, set by the handshake
+  /// and changed by COM_INIT_DB, USE and COM_CHANGE_USER after the server's
+  /// OK. The requested names are interned after the OK only, the rejected
+  /// names do not take the ids.
+  AccountNames::Id m_user_id = AccountNames::NONE_ID;
+  AccountNames::Id m_schema_id = AccountNames::NONE_ID;
+  bool m_account_is_pending = false;
+  bool m_pending_user_is_changed = false;
+  std::string m_pending_user;
+  std::string m_pending_schema;
+
+  /// The connection is closed at its next command boundary.
+  bool m_is_draining = false;
+
+  /// The statements prepared by the client.
+  PreparedStatements m_prepared_statements;
+
+  /// SQL string and its digest of COM_STMT_PREPARE waiting for the response.
+  std::string m_preparing_sql;
+  std::uint64_t m_preparing_digest = 0;
+
+  /// The session to the mirror server, exists for the sampled sessions
+  /// after the handshake.
+  std::shared_ptr<MirrorSession> m_mirror;
+
+  /// The sessions to the shards by their indexes, opened by the first
+  /// query to the shard.
+  std::vector<std::shared_ptr<ShardSession>> m_shards;
+
+  /// The shard session which relays the response to the last query.
+  /// The client's next command is not read till the response end.
+  ShardSession* m_request_shard = nullptr;
+  bool m_client_read_is_paused = false;
+
+  /// Decoder of the COM_STMT_EXECUTE parameters, exists if it is turned on.
+  std::unique_ptr<StatementParams> m_statement_params;
+  std::uint64_t m_execute_counter = 0;
+  bool m_payload_is_captured = false;
 };  // class connection
 
+inline ConnectionId Connection::id() const
+{
+  return m_id;
+}
+
+inline void Connection::set_id(ConnectionId t_id)
+{
+  m_id = t_id;
+}
+
+inline void intrusive_ptr_add_ref(Connection* t_connection)
+{
+  ++t_connection->m_ref_count;
+}
+
 }  // namespace proxy
 
 #endif  // PROXY_CONNECTION_HPP
@@ -27,27 +27,110 @@
 
 namespace proxy
 {
+namespace
+{
+// The connection id bits: the worker index, the slot generation
+// and the slot index.
+const unsigned int WORKER_INDEX_SHIFT = 48;
+const unsigned int GENERATION_SHIFT = 32;
+
+ConnectionId make_id(std::uint64_t t_worker_index,
+    std::uint16_t t_generation,
+    std::uint32_t t_slot_index)
+{
+  return (t_worker_index << WORKER_INDEX_SHIFT)
+      | (static_cast<std::uint64_t>(t_generation) << GENERATION_SHIFT)
+      | t_slot_index;
+}
+
+}  // namespace
+
+ConnectionManager::ConnectionManager(std::size_t t_worker_index)
+    : m_worker_index(t_worker_index)
+{
+}
+
 void ConnectionManager::start(const ConnectionPtr& t_connection)
 {
-  m_connections.insert(t_connection);
+  std::uint32_t slot_index = 0;
+  if(!m_free_slots.empty()) {
+    slot_index = m_free_slots.back();
+    m_free_slots.pop_back();
+  } else {
+    slot_index = static_cast<std::uint32_t>(m_slots.size());
+    m_slots.emplace_back();
+  }
+
+  Slot& slot = m_slots[slot_index];
+  slot.m_connection = t_connection;
+  slot.m_open_index = static_cast<std::uint32_t>(m_open_slots.size());
+  m_open_slots.push_back(slot_index);
+
+  t_connection->set_id(make_id(m_worker_index, slot.m_generation, slot_index));
   t_connection->start();
-  std::cout << "Opened connections: " << m_connections.size() << "\n";
 }
 
 void ConnectionManager::stop(const ConnectionPtr& t_connection)
 {
   t_connection->stop();
-  m_connections.erase(t_connection);
-  std::cout << "Opened connections: " << m_connections.size() << "\n";
+  if(find(t_connection->id()) == t_connection.get()) {
+    release_slot(static_cast<std::uint32_t>(t_connection->id()));
+  }
 }
 
 void ConnectionManager::stop_all()
 {
-  for(const auto& connecton : m_connections) {
-    connecton->stop();
+  for(const std::uint32_t slot_index : m_open_slots) {
+    m_slots[slot_index].m_connection->stop();
+  }
+  while(!m_open_slots.empty()) {
+    release_slot(m_open_slots.back());
   }
-  m_connections.clear();
   std::cout << " All connections are closed.\n";
 }
 
+void ConnectionManager::drain_all()
+{
+  // The idle connections are stopped by the drain at once, their places
+  // are taken by the last ones which are already drained.
+  for(std::size_t i = m_open_slots.size(); 0 < i; --i) {
+    // The copy keeps the connection alive till its drain returns.
+    const ConnectionPtr connection = m_slots[m_open_slots[i - 1]].m_connection;
+    connection->drain();
+  }
+}
+
+Connection* ConnectionManager::find(ConnectionId t_id) const
+{
+  const auto slot_index = static_cast<std::uint32_t>(t_id);
+  if((t_id >> WORKER_INDEX_SHIFT) != m_worker_index
+      || slot_index >= m_slots.size()) {
+    return nullptr;
+  }
+
+  const Slot& slot = m_slots[slot_index];
+  if(static_cast<std::uint16_t>(t_id >> GENERATION_SHIFT) != slot.m_generation
+      || !slot.m_connection) {
+    return nullptr;
+  }
+  return slot.m_connection.get();
+}
+
+void ConnectionManager::release_slot(std::uint32_t t_slot_index)
+{
+  Slot& slot = m_slots[t_slot_index];
+
+  // Move the last used slot to the place of the released one.
+  const std::uint32_t last_slot_index = m_open_slots.back();
+  m_open_slots[slot.m_open_index] = last_slot_index;
+  m_slots[last_slot_index].m_open_index = slot.m_open_index;
+  m_open_slots.pop_back();
+
+  slot.m_connection.reset();
+  if(0 == ++slot.m_generation) {
+    slot.m_generation = 1;
+  }
+  m_free_slots.push_back(t_slot_index);
+}
+
 }  // namespace proxy
@@ -24,7 +24,9 @@
 #ifndef PROXY_CONNECTION_MANAGER_HPP
 #define PROXY_CONNECTION_MANAGER_HPP
 
-#include <set>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "connection.hpp"
 
@@ -32,6 +34,13 @@ namespace proxy
 {
 /// Manages open connections so that they may be cleanly stopped when the server
 /// needs to shut down.
+///
+/// Each worker has its own manager, its connections are kept in the slot map
+/// without the locking. The start and the stop are O(1) and do not allocate
+/// after the slots are grown to the max number of the connections.
+/// The connection id is made of the worker index, the slot index
+/// and the generation of the slot, so the id of the closed connection
+/// does not refer to the next one in its slot.
 class ConnectionManager
 {
 public:
@@ -42,8 +51,8 @@ public:
 
   ~ConnectionManager() = default;
 
-  /// Construct a connection manager.
-  explicit ConnectionManager() = default;
+  /// Construct a connection manager of the worker.
+  explicit ConnectionManager(std::size_t t_worker_index);
 
   /// Add the specified connection to the manager and start it.
   void start(const ConnectionPtr& t_connection);
@@ -54,11 +63,46 @@ public:
   /// Stop all connections.
   void stop_all();
 
+  /// Close all connections at their command boundaries.
+  void drain_all();
+
+  /// Get the number of the connections.
+  std::size_t size() const;
+
+  /// Find the open connection by its id, nullptr if it is closed.
+  Connection* find(ConnectionId t_id) const;
+
 private:
-  /// The managed connections.
-  std::set<ConnectionPtr> m_connections;
+  /// The slot of the connection.
+  struct Slot
+  {
+    ConnectionPtr m_connection;
+
+    /// Is changed when the slot is freed, 0 is never used.
+    std::uint16_t m_generation = 1;
+
+    /// Index in m_open_slots if the slot is used.
+    std::uint32_t m_open_index = 0;
+  };
+
+  /// Free the slot of the stopped connection.
+  void release_slot(std::uint32_t t_slot_index);
+
+  const std::uint64_t m_worker_index;
+
+  /// The slots of the connections and the indexes of the free ones.
+  std::vector<Slot> m_slots;
+  std::vector<std::uint32_t> m_free_slots;
+
+  /// The indexes of the used slots, packed for the iteration.
+  std::vector<std::uint32_t> m_open_slots;
 };
 
+inline std::size_t ConnectionManager::size() const
+{
+  return m_open_slots.size();
+}
+
 }  // namespace proxy
 
 #endif  // PROXY_CONNECTION_MANAGER_HPP
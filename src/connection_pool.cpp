@@ -0,0 +1,70 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "connection_pool.hpp"
+
+#include <new>
+#include <utility>
+
+#include "worker.hpp"
+
+namespace proxy
+{
+ConnectionPtr ConnectionPool::make_connection(
+    StreamProtocol::socket&& t_client_socket,
+    RoutePtr t_route,
+    Worker& t_worker,
+    std::string&& t_client_ip)
+{
+  if(m_free_slots.empty()) {
+    m_chunks.emplace_back(new Slot[CHUNK_SLOTS]);
+    m_free_slots.reserve(m_chunks.size() * CHUNK_SLOTS);
+
+    // The slots of the chunk are taken from its beginning.
+    Slot* chunk = m_chunks.back().get();
+    for(std::size_t i = CHUNK_SLOTS; 0 < i; --i) {
+      m_free_slots.push_back(chunk + i - 1);
+    }
+  }
+
+  Slot* slot = m_free_slots.back();
+  auto* connection = new(slot) Connection(std::move(t_client_socket),
+      std::move(t_route), t_worker, std::move(t_client_ip));
+  m_free_slots.pop_back();
+  return ConnectionPtr(connection);
+}
+
+void ConnectionPool::destroy(Connection* t_connection)
+{
+  t_connection->~Connection();
+  m_free_slots.push_back(reinterpret_cast<Slot*>(t_connection));
+}
+
+void intrusive_ptr_release(Connection* t_connection)
+{
+  if(0 == --t_connection->m_ref_count) {
+    t_connection->m_worker.connection_pool().destroy(t_connection);
+  }
+}
+
+}  // namespace proxy
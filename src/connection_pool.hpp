@@ -0,0 +1,79 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_CONNECTION_POOL_HPP
+#define PROXY_CONNECTION_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "connection.hpp"
+#include "endpoint.hpp"
+#include "route.hpp"
+
+namespace proxy
+{
+/// The slab allocator of the connections of the worker.
+/// The connections are constructed in the slots of the chunks, a closed
+/// connection frees its slot for the next one without the heap allocation.
+/// The chunks are freed with the pool, the connections must be destroyed
+/// before it. Used only by the worker's thread.
+class ConnectionPool
+{
+public:
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool(ConnectionPool&&) = delete;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+  ConnectionPool& operator=(ConnectionPool&&) = delete;
+
+  ~ConnectionPool() = default;
+
+  /// Construct an empty pool, the chunks are allocated by the demand.
+  explicit ConnectionPool() = default;
+
+  /// Construct the connection in the free slot.
+  ConnectionPtr make_connection(StreamProtocol::socket&& t_client_socket,
+      RoutePtr t_route,
+      Worker& t_worker,
+      std::string&& t_client_ip);
+
+  /// Destroy the connection and free its slot, called by its last pointer.
+  void destroy(Connection* t_connection);
+
+private:
+  /// Number of the slots in the chunk.
+  static const std::size_t CHUNK_SLOTS = 16;
+
+  using Slot =
+      std::aligned_storage<sizeof(Connection), alignof(Connection)>::type;
+
+  std::vector<std::unique_ptr<Slot[]>> m_chunks;
+  std::vector<Slot*> m_free_slots;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_CONNECTION_POOL_HPP
@@ -0,0 +1,89 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "endpoint.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace proxy
+{
+bool is_unix_address(const std::string& t_address)
+{
+  return 0
+      == t_address.compare(
+          0, std::strlen(UNIX_ADDRESS_PREFIX), UNIX_ADDRESS_PREFIX);
+}
+
+StreamProtocol::endpoint resolve_endpoint(boost::asio::io_context& t_io_context,
+    const std::string& t_address,
+    const std::string& t_port)
+{
+  if(is_unix_address(t_address)) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    return StreamProtocol::endpoint(boost::asio::local::stream_protocol::endpoint(
+        t_address.substr(std::strlen(UNIX_ADDRESS_PREFIX))));
+#else  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    throw std::runtime_error("Unix domain sockets are not supported");
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  }
+
+  boost::asio::ip::tcp::resolver resolver(t_io_context);
+  return StreamProtocol::endpoint(
+      resolver.resolve(t_address, t_port).begin()->endpoint());
+}
+
+StreamProtocol::endpoint resolve_endpoint(
+    boost::asio::io_context& t_io_context, const std::string& t_address_port)
+{
+  if(is_unix_address(t_address_port)) {
+    return resolve_endpoint(t_io_context, t_address_port, "");
+  }
+
+  const std::size_t colon_pos = t_address_port.rfind(':');
+  if(std::string::npos == colon_pos) {
+    throw std::runtime_error("Wrong address '" + t_address_port + "'");
+  }
+  return resolve_endpoint(t_io_context, t_address_port.substr(0, colon_pos),
+      t_address_port.substr(colon_pos + 1));
+}
+
+bool is_tcp_endpoint(const StreamProtocol::endpoint& t_endpoint)
+{
+  const int family = t_endpoint.protocol().family();
+  return boost::asio::ip::tcp::v4().family() == family
+      || boost::asio::ip::tcp::v6().family() == family;
+}
+
+std::string endpoint_ip_address(const StreamProtocol::endpoint& t_endpoint)
+{
+  if(!is_tcp_endpoint(t_endpoint)) {
+    return std::string();
+  }
+
+  boost::asio::ip::tcp::endpoint tcp_endpoint;
+  std::memcpy(tcp_endpoint.data(), t_endpoint.data(), t_endpoint.size());
+  return tcp_endpoint.address().to_string();
+}
+
+}  // namespace proxy
@@ -0,0 +1,63 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_ENDPOINT_HPP
+#define PROXY_ENDPOINT_HPP
+
+#include <string>
+
+#include <boost/asio.hpp>
+
+namespace proxy
+{
+/// The stream protocol of the client's and the MySQL server's connections,
+/// TCP or Unix domain socket.
+using StreamProtocol = boost::asio::generic::stream_protocol;
+using StreamAcceptor = boost::asio::basic_socket_acceptor<StreamProtocol>;
+
+/// Prefix of the address of the Unix domain socket, "unix:<path>".
+constexpr char UNIX_ADDRESS_PREFIX[] = "unix:";
+
+/// Check if the address is the Unix domain socket address.
+bool is_unix_address(const std::string& t_address);
+
+/// Make the endpoint for the address and the port. The port is ignored
+/// for the Unix domain socket address. Throws std::runtime_error
+/// if the Unix domain sockets are not supported.
+StreamProtocol::endpoint resolve_endpoint(boost::asio::io_context& t_io_context,
+    const std::string& t_address,
+    const std::string& t_port);
+
+/// Make the endpoint for the "<address>:<port>" or "unix:<path>" string.
+StreamProtocol::endpoint resolve_endpoint(
+    boost::asio::io_context& t_io_context, const std::string& t_address_port);
+
+/// Check if the endpoint is the TCP one.
+bool is_tcp_endpoint(const StreamProtocol::endpoint& t_endpoint);
+
+/// Get the IP address of the TCP endpoint, empty for other endpoints.
+std::string endpoint_ip_address(const StreamProtocol::endpoint& t_endpoint);
+
+}  // namespace proxy
+
+#endif  // PROXY_ENDPOINT_HPP
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "listener.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "local_reply.hpp"
+#include "socket_options.hpp"
+
+namespace proxy
+{
+Listener::Listener(boost::asio::io_context& t_io_context,
+    const std::string& t_address,
+    std::vector<std::unique_ptr<Worker>>& t_workers,
+    Admission& t_admission,
+    const ProxySettings& t_settings,
+    int t_handoff_fd)
+    : m_address(t_address)
+    , m_acceptor(t_io_context)
+    , m_workers(t_workers)
+    , m_admission(t_admission)
+{
+  // Start listening on the client socket.
+  const StreamProtocol::endpoint client_ep =
+      resolve_endpoint(t_io_context, m_address);
+
+  // The passed socket is already bound and listening,
+  // its queue keeps the connections accepted by the kernel.
+  if(-1 != t_handoff_fd) {
+    m_acceptor.assign(client_ep.protocol(), t_handoff_fd);
+  } else {
+    // Open the acceptor with the option to reuse the address
+    // (i.e. SO_REUSEADDR).
+    m_acceptor.open(client_ep.protocol());
+    if(is_tcp_endpoint(client_ep)) {
+      m_acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    } else {
+      // The socket file of the previous run prevents the binding.
+      const std::string socket_path =
+          m_address.substr(std::strlen(UNIX_ADDRESS_PREFIX));
+      std::remove(socket_path.c_str());
+    }
+    m_acceptor.bind(client_ep);
+    m_acceptor.listen((0 < t_settings.m_listen_backlog)
+            ? static_cast<int>(t_settings.m_listen_backlog)
+            : boost::asio::socket_base::max_listen_connections);
+  }
+
+  // The connection is accepted when the client's data is received
+  // or the timeout is expired.
+  if(0 < t_settings.m_defer_accept && is_tcp_endpoint(client_ep)) {
+    set_defer_accept(m_acceptor, t_settings.m_defer_accept);
+  }
+
+  // The batch of the accepts ends with the would_block error.
+  m_acceptor.non_blocking(true);
+}
+
+void Listener::start()
+{
+  do_accept();
+}
+
+void Listener::stop()
+{
+  boost::system::error_code error;
+  m_acceptor.close(error);
+}
+
+void Listener::do_accept()
+{
+  // The connection socket is bound to the io_context of the next worker.
+  Worker& worker = next_worker();
+
+  // The listener removed by the reload lives till its handler is called.
+  m_acceptor.async_accept(worker.io_context(),
+      [this, self = shared_from_this(), &worker](
+          boost::system::error_code l_error,
+          StreamProtocol::socket l_client_socket) {
+        // Check whether the server was stopped by a signal before this
+        // completion handler had a chance to run.
+        if(!m_acceptor.is_open()) {
+          return;
+        }
+
+        if(!l_error) {
+          admit_connection(worker, std::move(l_client_socket));
+
+          // Accept the connections which are already queued by the kernel.
+          for(std::size_t i = 1; i < MAX_ACCEPT_BATCH; ++i) {
+            Worker& batch_worker = next_worker();
+            StreamProtocol::socket client_socket(batch_worker.io_context());
+            boost::system::error_code error;
+            m_acceptor.accept(client_socket, error);
+            if(error) {
+              break;
+            }
+            admit_connection(batch_worker, std::move(client_socket));
+          }
+        }
+
+        do_accept();
+      });
+}
+
+Worker& Listener::next_worker()
+{
+  Worker& worker = *m_workers[m_next_worker];
+  m_next_worker = (m_next_worker + 1) % m_workers.size();
+  return worker;
+}
+
+void Listener::admit_connection(
+    Worker& t_worker, StreamProtocol::socket&& t_socket)
+{
+  boost::system::error_code error;
+  std::string client_ip = endpoint_ip_address(t_socket.remote_endpoint(error));
+
+  if(!m_admission.admit(client_ip)) {
+    // See https://dev.mysql.com/doc/mysql-errors/8.0/en/server-error-reference.html
+    // ER_CON_COUNT_ERROR, the MySQL server sends it in place of the greeting
+    // when max_connections is reached.
+    const std::string packet =
+        LocalReply::make_err_packet(0, 1040, nullptr, "Too many connections");
+    boost::asio::write(t_socket, boost::asio::buffer(packet), error);
+    return;
+  }
+
+  // The connection is started in the worker's thread
+  // with the route snapshot of its accepting.
+  t_worker.post_connection(m_route, std::move(t_socket), std::move(client_ip));
+}
+
+}  // namespace proxy
@@ -0,0 +1,136 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_LISTENER_HPP
+#define PROXY_LISTENER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "admission.hpp"
+#include "endpoint.hpp"
+#include "route.hpp"
+#include "settings.hpp"
+#include "worker.hpp"
+
+namespace proxy
+{
+class Listener;
+
+using ListenerPtr = std::shared_ptr<Listener>;
+
+/// The listener of the route. The listener accepts the client connections
+/// and passes them with the current route snapshot to the workers in turn.
+/// The listener outlives the reloads which keep its address.
+class Listener : public std::enable_shared_from_this<Listener>
+{
+public:
+  Listener(const Listener&) = delete;
+  Listener(Listener&&) = delete;
+  Listener& operator=(const Listener&) = delete;
+  Listener& operator=(Listener&&) = delete;
+
+  ~Listener() = default;
+
+  /// Construct the listener on the address, "<address>:<port>"
+  /// or "unix:<path>", in the io_context of the accepting thread.
+  /// The listening socket passed by the old process of the upgrade
+  /// is used if its descriptor is not -1. The accepted connections
+  /// are admitted by the admission, the listen backlog and TCP_DEFER_ACCEPT
+  /// are taken from the settings.
+  explicit Listener(boost::asio::io_context& t_io_context,
+      const std::string& t_address,
+      std::vector<std::unique_ptr<Worker>>& t_workers,
+      Admission& t_admission,
+      const ProxySettings& t_settings,
+      int t_handoff_fd);
+
+  /// Get the listener address.
+  const std::string& address() const;
+
+  /// Get the descriptor of the listening socket.
+  StreamAcceptor::native_handle_type native_handle();
+
+  /// Set the route for the next accepted connections.
+  void set_route(RoutePtr t_route);
+
+  /// Start the listening.
+  void start();
+
+  /// Stop the listening.
+  void stop();
+
+private:
+  /// Perform an asynchronous accept operation.
+  void do_accept();
+
+  /// Get the worker for the next accepted connection, round robin.
+  Worker& next_worker();
+
+  /// Pass the accepted connection to the worker if it is admitted,
+  /// the client gets the error else.
+  void admit_connection(Worker& t_worker, StreamProtocol::socket&& t_socket);
+
+  /// Max number of the connections accepted on one wakeup,
+  /// the connections which are queued by the kernel are accepted
+  /// without the waiting.
+  static const std::size_t MAX_ACCEPT_BATCH = 32;
+
+  const std::string m_address;
+
+  /// Acceptor used to listen for incoming connections.
+  StreamAcceptor m_acceptor;
+
+  /// The route snapshot for the accepted connections.
+  RoutePtr m_route;
+
+  /// The workers which serve the accepted connections.
+  std::vector<std::unique_ptr<Worker>>& m_workers;
+  std::size_t m_next_worker = 0;
+
+  /// The limits of the connections.
+  Admission& m_admission;
+};
+
+inline const std::string& Listener::address() const
+{
+  return m_address;
+}
+
+inline StreamAcceptor::native_handle_type Listener::native_handle()
+{
+  return m_acceptor.native_handle();
+}
+
+inline void Listener::set_route(RoutePtr t_route)
+{
+  m_route = std::move(t_route);
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_LISTENER_HPP
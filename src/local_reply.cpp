@@ -0,0 +1,312 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "local_reply.hpp"
+
+#include <cctype>
+#include <string_view>
+#include <utility>
+
+#include "packet.hpp"
+
+namespace proxy
+{
+// static
+std::size_t LocalReply::normalize(
+    const std::string& t_sql, std::array<char, MAX_QUERY_LENGTH>& t_query)
+{
+  std::size_t length = 0;
+  bool space = false;
+
+  for(const char sql_char : t_sql) {
+    const auto ch = static_cast<unsigned char>(sql_char);
+    if(std::isspace(ch)) {
+      space = (0 < length);
+      continue;
+    }
+    if(space && '=' != ch && '=' != t_query[length - 1]) {
+      if(length == t_query.size()) {
+        return 0;
+      }
+      t_query[length++] = ' ';
+    }
+    space = false;
+    if(length == t_query.size()) {
+      return 0;
+    }
+    t_query[length++] = static_cast<char>(std::tolower(ch));
+  }
+
+  while(0 < length && ';' == t_query[length - 1]) {
+    --length;
+    while(0 < length && ' ' == t_query[length - 1]) {
+      --length;
+    }
+  }
+  return length;
+}
+
+// static
+LocalReply::Query LocalReply::classify(
+    const std::string& t_sql, const char*& t_charset)
+{
+  static const char* const CHARSETS[] = {
+      "utf8mb4", "utf8mb3", "utf8", "latin1", "ascii", "binary"};
+
+  t_charset = nullptr;
+
+  std::array<char, MAX_QUERY_LENGTH> buffer{};
+  const std::size_t length = normalize(t_sql, buffer);
+  std::string_view query(buffer.data(), length);
+
+  if(query == "select @@version_comment limit 1") {
+    return Query::VERSION_COMMENT;
+  }
+
+  const std::string_view set_names = "set names ";
+  if(query.substr(0, set_names.size()) == set_names) {
+    std::string_view charset = query.substr(set_names.size());
+    if(2 < charset.size()
+        && ('\'' == charset.front() || '"' == charset.front()
+            || '`' == charset.front())
+        && charset.back() == charset.front()) {
+      charset = charset.substr(1, charset.size() - 2);
+    }
+    for(const char* known_charset : CHARSETS) {
+      if(charset == known_charset) {
+        t_charset = known_charset;
+        break;
+      }
+    }
+    return Query::SET_NAMES;
+  }
+
+  for(const std::string_view set_autocommit :
+      {"set autocommit=", "set @@autocommit=", "set session autocommit=",
+          "set @@session.autocommit="}) {
+    if(query.substr(0, set_autocommit.size()) == set_autocommit) {
+      const std::string_view value = query.substr(set_autocommit.size());
+      if(value == "1" || value == "on" || value == "true") {
+        return Query::SET_AUTOCOMMIT_ON;
+      }
+      if(value == "0" || value == "off" || value == "false") {
+        return Query::SET_AUTOCOMMIT_OFF;
+      }
+      break;
+    }
+  }
+
+  return Query::OTHER;
+}
+
+// static
+bool LocalReply::is_set_statement(const std::string& t_sql)
+{
+  std::size_t pos = 0;
+  while(pos < t_sql.size()
+      && std::isspace(static_cast<unsigned char>(t_sql[pos]))) {
+    ++pos;
+  }
+  return pos + 3 < t_sql.size()
+      && 's' == std::tolower(static_cast<unsigned char>(t_sql[pos]))
+      && 'e' == std::tolower(static_cast<unsigned char>(t_sql[pos + 1]))
+      && 't' == std::tolower(static_cast<unsigned char>(t_sql[pos + 2]))
+      && std::isspace(static_cast<unsigned char>(t_sql[pos + 3]));
+}
+
+// static
+const char* LocalReply::collation_charset(
+    unsigned char t_collation_id, unsigned int t_server_version_major)
+{
+  // See https://dev.mysql.com/doc/refman/8.0/en/charset-charsets.html
+  // SET NAMES sets the default collation of the charset,
+  // so only the default collations are matched.
+  switch(t_collation_id) {
+    case 8: {  // latin1_swedish_ci
+      return "latin1";
+    }
+    case 11: {  // ascii_general_ci
+      return "ascii";
+    }
+    case 33: {  // utf8_general_ci
+      return "utf8";
+    }
+    case 45: {  // utf8mb4_general_ci, default before MySQL 8.0
+      return (t_server_version_major < 8) ? "utf8mb4" : nullptr;
+    }
+    case 63: {  // binary
+      return "binary";
+    }
+    case 255: {  // utf8mb4_0900_ai_ci, default since MySQL 8.0
+      return (t_server_version_major >= 8) ? "utf8mb4" : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+// static
+std::size_t LocalReply::make_ok_packet(unsigned char t_sequence_id,
+    std::uint16_t t_status_flags,
+    std::uint32_t t_capabilities,
+    std::array<unsigned char, OK_PACKET_LENGTH>& t_packet)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_ok_packet.html
+  std::size_t length = 4;
+  t_packet[length++] = 0x00;  // header
+  t_packet[length++] = 0x00;  // affected_rows
+  t_packet[length++] = 0x00;  // last_insert_id
+
+  if(t_capabilities
+      & (MySqlCapability::CLIENT_PROTOCOL_41
+          | MySqlCapability::CLIENT_TRANSACTIONS)) {
+    t_packet[length++] = static_cast<unsigned char>(t_status_flags & 0xFFu);
+    t_packet[length++] = static_cast<unsigned char>(t_status_flags >> 8u);
+  }
+  if(t_capabilities & MySqlCapability::CLIENT_PROTOCOL_41) {
+    t_packet[length++] = 0x00;  // warnings
+    t_packet[length++] = 0x00;
+  }
+
+  const std::size_t payload_length = length - 4;
+  t_packet[0] = static_cast<unsigned char>(payload_length);
+  t_packet[1] = 0x00;
+  t_packet[2] = 0x00;
+  t_packet[3] = t_sequence_id;
+  return length;
+}
+
+std::string LocalReply::make_err_packet(unsigned char t_sequence_id,
+    std::uint16_t t_error_code,
+    const char* t_sql_state,
+    const std::string& t_message)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_err_packet.html
+  std::string packet(4, '\0');
+  packet.push_back('\xFF');  // header
+  packet.push_back(static_cast<char>(t_error_code & 0xFFu));
+  packet.push_back(static_cast<char>(t_error_code >> 8u));
+  if(nullptr != t_sql_state) {
+    packet.push_back('#');  // sql_state_marker
+    packet.append(t_sql_state, 5);
+  }
+  packet.append(t_message);
+
+  const std::size_t payload_length = packet.size() - 4;
+  packet[0] = static_cast<char>(payload_length & 0xFFu);
+  packet[1] = static_cast<char>((payload_length >> 8u) & 0xFFu);
+  packet[2] = static_cast<char>((payload_length >> 16u) & 0xFFu);
+  packet[3] = static_cast<char>(t_sequence_id);
+  return packet;
+}
+
+const std::string& LocalReply::version_comment_response(
+    const ResponseKey& t_key, std::uint16_t t_status_flags)
+{
+  static const std::string EMPTY;
+  RecordedResponse& recorded =
+      m_version_comment_responses[t_key.m_deprecate_eof ? 1 : 0];
+  if(recorded.m_response.empty() || nullptr == t_key.m_charset
+      || recorded.m_key.m_collation_id != t_key.m_collation_id
+      || recorded.m_key.m_charset != t_key.m_charset
+      || recorded.m_key.m_backend_index != t_key.m_backend_index
+      || recorded.m_key.m_backend_state_changes
+          != t_key.m_backend_state_changes) {
+    return EMPTY;
+  }
+
+  // The response of the other session has its status flags.
+  const std::uint16_t status_flags = t_status_flags
+      & ~(MySqlServerStatus::SERVER_SESSION_STATE_CHANGED
+          | MySqlServerStatus::SERVER_MORE_RESULTS_EXISTS);
+  recorded.m_response[recorded.m_status_flags_pos] =
+      static_cast<char>(status_flags & 0xFFu);
+  recorded.m_response[recorded.m_status_flags_pos + 1] =
+      static_cast<char>(status_flags >> 8u);
+  return recorded.m_response;
+}
+
+void LocalReply::set_version_comment_response(
+    const ResponseKey& t_key, std::string&& t_response)
+{
+  if(nullptr == t_key.m_charset) {
+    return;
+  }
+  const std::size_t status_flags_pos =
+      find_status_flags(t_response, t_key.m_deprecate_eof);
+  if(0 == status_flags_pos) {
+    return;
+  }
+  const std::uint16_t status_flags = MySqlPacket::read_uint16(
+      reinterpret_cast<const unsigned char*>(t_response.data())
+      + status_flags_pos);
+  if(0 != (status_flags
+          & (MySqlServerStatus::SERVER_SESSION_STATE_CHANGED
+              | MySqlServerStatus::SERVER_MORE_RESULTS_EXISTS))) {
+    return;
+  }
+
+  RecordedResponse& recorded =
+      m_version_comment_responses[t_key.m_deprecate_eof ? 1 : 0];
+  recorded.m_key = t_key;
+  recorded.m_response = std::move(t_response);
+  recorded.m_status_flags_pos = status_flags_pos;
+}
+
+// static
+std::size_t LocalReply::find_status_flags(
+    const std::string& t_response, bool t_deprecate_eof)
+{
+  const auto* data = reinterpret_cast<const unsigned char*>(t_response.data());
+  const std::size_t size = t_response.size();
+
+  // The last packet of the response.
+  std::size_t packet_pos = 0;
+  std::size_t payload_length = 0;
+  for(std::size_t pos = 0; pos + 4 <= size; pos += 4 + payload_length) {
+    packet_pos = pos;
+    payload_length = MySqlPacket::read_uint32(data + pos) & 0xFFFFFFu;
+  }
+  const std::size_t payload_end = packet_pos + 4 + payload_length;
+  if(payload_end != size || 0 == payload_length
+      || 0xFE != data[packet_pos + 4]) {
+    return 0;
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_eof_packet.html
+  // header, warnings, status_flags.
+  std::size_t pos = packet_pos + 5;
+  if(t_deprecate_eof) {
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_ok_packet.html
+    // header, affected_rows, last_insert_id, status_flags.
+    std::uint64_t value = 0;
+    if(!MySqlPacket::read_lenenc_uint(data, payload_end, pos, value)
+        || !MySqlPacket::read_lenenc_uint(data, payload_end, pos, value)) {
+      return 0;
+    }
+  } else {
+    pos += 2;
+  }
+  return (pos + 2 <= payload_end) ? pos : 0;
+}
+
+}  // namespace proxy
@@ -0,0 +1,143 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_LOCAL_REPLY_HPP
+#define PROXY_LOCAL_REPLY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace proxy
+{
+/// Answers to the client's commands which the proxy sends itself,
+/// without the round trip to the MySQL server.
+class LocalReply
+{
+public:
+  LocalReply(const LocalReply&) = delete;
+  LocalReply(LocalReply&&) = delete;
+  LocalReply& operator=(const LocalReply&) = delete;
+  LocalReply& operator=(LocalReply&&) = delete;
+
+  ~LocalReply() = default;
+
+  explicit LocalReply() = default;
+
+  /// Max length of the SQL string which can be answered locally.
+  static const std::size_t MAX_QUERY_LENGTH = 64;
+
+  /// Max length of the OK packet made by the proxy.
+  static const std::size_t OK_PACKET_LENGTH = 11;
+
+  /// Queries which are sent by the drivers on every connection.
+  enum class Query
+  {
+    OTHER,
+    VERSION_COMMENT,  // SELECT @@version_comment LIMIT 1
+    SET_NAMES,  // SET NAMES <charset>
+    SET_AUTOCOMMIT_ON,  // SET autocommit=1
+    SET_AUTOCOMMIT_OFF  // SET autocommit=0
+  };
+
+  /// Recognize the query. For SET NAMES, t_charset is set to the charset name
+  /// if the charset is known, or to nullptr otherwise.
+  static Query classify(const std::string& t_sql, const char*& t_charset);
+
+  /// Check if the query is the SET statement.
+  static bool is_set_statement(const std::string& t_sql);
+
+  /// Get the charset name for the collation id from the HandshakeResponse
+  /// if the collation is the default one of the charset, or nullptr.
+  static const char* collation_charset(
+      unsigned char t_collation_id, unsigned int t_server_version_major);
+
+  /// Write the OK packet to t_packet and return the packet length.
+  static std::size_t make_ok_packet(unsigned char t_sequence_id,
+      std::uint16_t t_status_flags,
+      std::uint32_t t_capabilities,
+      std::array<unsigned char, OK_PACKET_LENGTH>& t_packet);
+
+  /// Make the ERR packet. The SQL state is omitted if t_sql_state is nullptr,
+  /// as in the ERR packet sent instead of the server's greeting.
+  static std::string make_err_packet(unsigned char t_sequence_id,
+      std::uint16_t t_error_code,
+      const char* t_sql_state,
+      const std::string& t_message);
+
+  /// The session's settings and the MySQL server which the recorded
+  /// response depends on.
+  struct ResponseKey
+  {
+    bool m_deprecate_eof = false;
+    unsigned char m_collation_id = 0;
+
+    /// The charset of the session, the response is not recorded
+    /// and not replayed if it is unknown.
+    const char* m_charset = nullptr;
+
+    /// The backend of the session and the number of its health state
+    /// changes, the response is stale after the change.
+    std::size_t m_backend_index = 0;
+    std::uint32_t m_backend_state_changes = 0;
+  };
+
+  /// Get the recorded server's response to "SELECT @@version_comment LIMIT 1"
+  /// for the session, its status flags are set to the session's ones.
+  /// Empty if the response is not recorded yet.
+  const std::string& version_comment_response(
+      const ResponseKey& t_key, std::uint16_t t_status_flags);
+
+  /// Store the server's response to "SELECT @@version_comment LIMIT 1".
+  /// The response with the session state changes or more results
+  /// is not stored.
+  void set_version_comment_response(
+      const ResponseKey& t_key, std::string&& t_response);
+
+private:
+  /// Lowercase the query, collapse the whitespaces and remove them around '=',
+  /// remove the trailing ';'. Returns the length or 0 if the query is too long.
+  static std::size_t normalize(
+      const std::string& t_sql, std::array<char, MAX_QUERY_LENGTH>& t_query);
+
+  /// Find the status flags of the OK or EOF packet which ends
+  /// the response. Returns their position or 0 if the packet is broken.
+  static std::size_t find_status_flags(
+      const std::string& t_response, bool t_deprecate_eof);
+
+  /// The server's response recorded for the session's settings.
+  struct RecordedResponse
+  {
+    ResponseKey m_key;
+    std::string m_response;
+    std::size_t m_status_flags_pos = 0;
+  };
+
+  /// Responses without and with CLIENT_DEPRECATE_EOF.
+  std::array<RecordedResponse, 2> m_version_comment_responses;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_LOCAL_REPLY_HPP
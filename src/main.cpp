@@ -23,22 +23,73 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
+#include "endpoint.hpp"
 #include "server.hpp"
+#include "settings.hpp"
+
+namespace
+{
+/// Make "<address>:<port>" or "unix:<path>" from the command line arguments.
+std::string address_port(const std::string& t_address, const std::string& t_port)
+{
+  return proxy::is_unix_address(t_address) ? t_address
+                                           : t_address + ":" + t_port;
+}
+
+}  // namespace
 
 int main(int t_argc, char* t_argv[])
 {
   try {
+    proxy::ProxySettings settings;
+    std::string config_file_path;
+    const std::string config_option = "--config=";
+    const std::string first_arg = (1 < t_argc) ? t_argv[1] : "";
+
     // Check command line arguments.
-    if(t_argc != 6) {
+    if(2 == t_argc
+        && 0 == first_arg.compare(0, config_option.size(), config_option)) {
+      // Read the routes from the configuration file.
+      config_file_path = first_arg.substr(config_option.size());
+      settings.load_file(config_file_path);
+    } else if(t_argc >= 6) {
+      // The single route from the command line arguments.
+      proxy::RouteSettings route;
+      route.m_name = "main";
+      route.m_listen = address_port(t_argv[1], t_argv[2]);
+      route.m_server = address_port(t_argv[3], t_argv[4]);
+      route.m_log_file = t_argv[5];
+
+      // Read the options.
+      for(int i = 6; i < t_argc; ++i) {
+        const std::string option = t_argv[i];
+        const std::size_t equal_pos = option.find('=');
+        if(0 != option.compare(0, 2, "--") || std::string::npos == equal_pos) {
+          std::cerr << "Wrong option: " << option << "\n";
+          return 1;
+        }
+        const std::string name = option.substr(2, equal_pos - 2);
+        const std::string value = option.substr(equal_pos + 1);
+        if(proxy::ProxySettings::is_option(name)) {
+          settings.set_option(name, value);
+        } else {
+          route.set_option(name, value);
+        }
+      }
+      settings.m_routes.push_back(route);
+    } else {
       std::cerr << "Usage: boost-asio-mysql-proxy"
-                   " <client ip> <port> <mysql server ip> <port> <log file>\n";
+                   " <client ip> <port> <mysql server ip> <port> <log file>"
+                   " [--<option>=<value> ...]\n"
+                   "       boost-asio-mysql-proxy --config=<file>\n";
       return 1;
     }
 
     // Initialise the server.
-    proxy::Server proxy_server(
-        t_argv[1], t_argv[2], t_argv[3], t_argv[4], t_argv[5]);
+    const std::vector<std::string> command_line(t_argv, t_argv + t_argc);
+    proxy::Server proxy_server(settings, config_file_path, command_line);
 
     // Run the server until stopped.
     proxy_server.run();
@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "memory_stats.hpp"
+
+#include <cstdlib>  // Defines __GLIBC__.
+#include <fstream>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#include <unistd.h>
+#endif  // if defined(__GLIBC__)
+
+namespace proxy
+{
+MemoryStats read_memory_stats()
+{
+  MemoryStats stats;
+
+#if defined(__GLIBC__)
+  // See https://man7.org/linux/man-pages/man5/proc.5.html
+  // The second field of /proc/self/statm is the resident pages.
+  std::ifstream statm("/proc/self/statm");
+  std::size_t size_pages = 0;
+  std::size_t resident_pages = 0;
+  if(statm >> size_pages >> resident_pages) {
+    stats.m_resident =
+        resident_pages * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  }
+
+  // See https://man7.org/linux/man-pages/man3/mallinfo.3.html
+  // mallinfo() has the int fields which overflow after 2 GB.
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+  const struct mallinfo2 info = ::mallinfo2();
+#else  // if __GLIBC__ > 2 || ...
+  const struct mallinfo info = ::mallinfo();
+#endif  // if __GLIBC__ > 2 || ...
+  stats.m_heap_in_use = static_cast<std::size_t>(info.uordblks)
+      + static_cast<std::size_t>(info.hblkhd);
+  stats.m_heap_free = static_cast<std::size_t>(info.fordblks);
+#endif  // if defined(__GLIBC__)
+
+  return stats;
+}
+
+}  // namespace proxy
@@ -0,0 +1,51 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_MEMORY_STATS_HPP
+#define PROXY_MEMORY_STATS_HPP
+
+#include <cstddef>
+
+namespace proxy
+{
+/// Memory usage of the process. The values which the system
+/// does not report are 0.
+struct MemoryStats
+{
+  /// Resident set size in bytes.
+  std::size_t m_resident = 0;
+
+  /// Bytes of the allocator's heap which are allocated,
+  /// including the big blocks mapped separately.
+  std::size_t m_heap_in_use = 0;
+
+  /// Bytes of the allocator's heap which are freed but kept by it.
+  std::size_t m_heap_free = 0;
+};
+
+/// Read the memory usage of this process.
+MemoryStats read_memory_stats();
+
+}  // namespace proxy
+
+#endif  // PROXY_MEMORY_STATS_HPP
@@ -0,0 +1,640 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "mirror.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include "socket_options.hpp"
+
+namespace proxy
+{
+namespace
+{
+std::uint64_t to_microseconds(std::chrono::steady_clock::duration t_duration)
+{
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(t_duration)
+          .count());
+}
+
+}  // namespace
+
+
+// ======== Mirror ========
+
+Mirror::Mirror(
+    boost::asio::io_context& t_io_context, const MirrorSettings& t_settings)
+    : m_settings(t_settings)
+    , m_endpoint(resolve_endpoint(t_io_context, t_settings.m_server))
+    , m_latency_threshold(
+          std::chrono::milliseconds(t_settings.m_latency_threshold))
+{
+}
+
+bool Mirror::is_sampled()
+{
+  if(0 != m_session_counter.fetch_add(1, std::memory_order_relaxed)
+          % m_settings.m_sample_rate) {
+    return false;
+  }
+  m_sessions.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void Mirror::session_failed()
+{
+  m_failed_sessions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Mirror::command_is_dropped()
+{
+  m_dropped_commands.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Mirror::responses_are_compared(
+    std::chrono::steady_clock::duration t_latency,
+    std::uint16_t t_error_code,
+    std::chrono::steady_clock::duration t_mirror_latency,
+    std::uint16_t t_mirror_error_code)
+{
+  m_commands.fetch_add(1, std::memory_order_relaxed);
+  m_latency_sum.fetch_add(
+      to_microseconds(t_latency), std::memory_order_relaxed);
+  m_mirror_latency_sum.fetch_add(
+      to_microseconds(t_mirror_latency), std::memory_order_relaxed);
+
+  if(t_error_code != t_mirror_error_code) {
+    m_error_mismatches.fetch_add(1, std::memory_order_relaxed);
+  }
+  if(t_mirror_latency > t_latency + m_latency_threshold) {
+    m_slower_responses.fetch_add(1, std::memory_order_relaxed);
+  } else if(t_latency > t_mirror_latency + m_latency_threshold) {
+    m_faster_responses.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Mirror::print_stats(const std::string& t_route_name) const
+{
+  const std::uint64_t commands = m_commands.load(std::memory_order_relaxed);
+  std::cout << "Mirror of route " << t_route_name << ": "
+            << m_sessions.load(std::memory_order_relaxed) << " sessions, "
+            << m_failed_sessions.load(std::memory_order_relaxed) << " failed, "
+            << commands << " commands compared, "
+            << m_dropped_commands.load(std::memory_order_relaxed)
+            << " dropped, "
+            << m_error_mismatches.load(std::memory_order_relaxed)
+            << " error mismatches, "
+            << m_slower_responses.load(std::memory_order_relaxed)
+            << " slower and "
+            << m_faster_responses.load(std::memory_order_relaxed)
+            << " faster responses";
+  if(0 < commands) {
+    const std::uint64_t latency =
+        m_latency_sum.load(std::memory_order_relaxed) / commands;
+    const std::uint64_t mirror_latency =
+        m_mirror_latency_sum.load(std::memory_order_relaxed) / commands;
+    std::cout << ", average response " << latency << " us, of the mirror "
+              << mirror_latency << " us";
+  }
+  std::cout << "\n";
+}
+
+
+// ======== MirrorSession ========
+
+MirrorSession::MirrorSession(
+    boost::asio::io_context& t_io_context, std::shared_ptr<Mirror> t_mirror)
+    : m_mirror(std::move(t_mirror))
+    , m_settings(m_mirror->settings())
+    , m_socket(t_io_context)
+    , m_login(m_settings.m_user, m_settings.m_password, m_settings.m_schema)
+    , m_close_timer(t_io_context)
+    , m_queue(new unsigned char[m_settings.m_queue_length])
+{
+}
+
+void MirrorSession::start(
+    std::uint32_t t_client_capabilities, unsigned char t_collation_id)
+{
+  m_login.set_client(t_client_capabilities, t_collation_id);
+
+  const StreamProtocol::endpoint& endpoint = m_mirror->endpoint();
+  boost::system::error_code error;
+  m_socket.open(endpoint.protocol(), error);
+  if(error) {
+    fail("the socket can not be opened");
+    return;
+  }
+  if(is_tcp_endpoint(endpoint)) {
+    SocketSettings socket_settings;
+    set_socket_options(m_socket, socket_settings);
+  }
+
+  m_socket.async_connect(endpoint,
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error) -> void {
+        if(!l_error) {
+          do_read_handshake_packet();
+        } else if(l_error != boost::asio::error::operation_aborted) {
+          fail("the mirror server is not available");
+        }
+      });
+}
+
+void MirrorSession::close()
+{
+  m_is_closing = true;
+  do_send();
+  if(!m_socket.is_open()) {
+    return;
+  }
+
+  m_close_timer.expires_after(CLOSE_TIMEOUT);
+  m_close_timer.async_wait([this, l_self = shared_from_this()](
+                               const boost::system::error_code& l_error) {
+    if(!l_error) {
+      stop();
+    }
+  });
+}
+
+void MirrorSession::stop()
+{
+  boost::system::error_code error;
+  m_close_timer.cancel();
+  m_socket.close(error);
+  m_commands.clear();
+  m_sent_commands = 0;
+  m_queue_size = 0;
+  m_is_in_flight = false;
+}
+
+void MirrorSession::fail(const char* t_reason)
+{
+  std::cout << "Mirror: " << t_reason << "\n";
+  m_mirror->session_failed();
+  stop();
+}
+
+void MirrorSession::do_read_handshake_packet()
+{
+  boost::asio::async_read(m_socket, boost::asio::buffer(m_header),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(l_error) {
+          if(l_error != boost::asio::error::operation_aborted) {
+            fail("the mirror server closed the connection");
+          }
+          return;
+        }
+
+        for(const unsigned char header_byte : m_header) {
+          m_server_packet.collect(header_byte, m_connection_state);
+        }
+        m_read_packet.resize(m_header[0] | (m_header[1] << 8u)
+            | (m_header[2] << 16u));
+
+        boost::asio::async_read(m_socket, boost::asio::buffer(m_read_packet),
+            [this, l_self](const boost::system::error_code& l_error,
+                std::size_t /*l_bytes_transferred*/) -> void {
+              if(l_error) {
+                if(l_error != boost::asio::error::operation_aborted) {
+                  fail("the mirror server closed the connection");
+                }
+                return;
+              }
+              for(const unsigned char payload_byte : m_read_packet) {
+                m_server_packet.collect(payload_byte, m_connection_state);
+              }
+              handshake_packet_is_received();
+            });
+      });
+}
+
+void MirrorSession::handshake_packet_is_received()
+{
+  switch(m_login.packet_is_received(m_header[3], m_read_packet)) {
+    case ServerLogin::Step::SEND: {
+      do_write_handshake_packet();
+      do_read_handshake_packet();
+      return;
+    }
+    case ServerLogin::Step::READ: {
+      do_read_handshake_packet();
+      return;
+    }
+    case ServerLogin::Step::DONE: {
+      // The commands are sent after the authentication.
+      m_is_ready = true;
+      do_read();
+      do_send();
+      return;
+    }
+    case ServerLogin::Step::FAILED: {
+      fail(m_login.error());
+      return;
+    }
+  }
+}
+
+void MirrorSession::do_write_handshake_packet()
+{
+  boost::asio::async_write(m_socket, boost::asio::buffer(m_login.packet()),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(l_error && l_error != boost::asio::error::operation_aborted) {
+          fail("the mirror server closed the connection");
+        }
+      });
+}
+
+void MirrorSession::do_read()
+{
+  m_socket.async_read_some(boost::asio::buffer(m_read_buffer),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t l_bytes_transferred) -> void {
+        if(!l_error) {
+          data_is_received(l_bytes_transferred);
+          do_read();
+        } else if(l_error != boost::asio::error::operation_aborted) {
+          fail("the mirror server closed the connection");
+        }
+      });
+}
+
+void MirrorSession::data_is_received(std::size_t t_bytes_transferred)
+{
+  for(std::size_t i = 0; i < t_bytes_transferred; ++i) {
+    m_server_packet.collect(m_read_buffer[i], m_connection_state);
+    if(!m_server_packet.is_received() || !m_is_in_flight) {
+      continue;
+    }
+
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_query_response_local_infile_request.html
+    // The LOCAL INFILE request gets the empty file.
+    if(0 == m_response_packets++ && 0 < m_server_packet.payload_head_length()
+        && 0xFB == m_server_packet.payload_head()[0]) {
+      m_infile_packet[3] =
+          static_cast<unsigned char>(m_server_packet.sequence_id() + 1);
+      m_infile_packet_is_pending = true;
+      do_send();
+    }
+
+    if(m_server_packet.is_response_complete()) {
+      mirror_response_is_received();
+    }
+  }
+}
+
+void MirrorSession::do_send()
+{
+  if(m_is_closing && !m_is_ready) {
+    // The commands are not sent without the authentication.
+    if(m_commands.empty()) {
+      stop();
+    }
+    return;
+  }
+  if(!m_is_ready || m_is_writing) {
+    return;
+  }
+
+  if(m_infile_packet_is_pending) {
+    m_infile_packet_is_pending = false;
+    m_is_writing = true;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_infile_packet),
+        [this, l_self = shared_from_this()](
+            const boost::system::error_code& l_error,
+            std::size_t /*l_bytes_transferred*/) -> void {
+          if(l_error) {
+            if(l_error != boost::asio::error::operation_aborted) {
+              fail("the mirror server closed the connection");
+            }
+            return;
+          }
+          m_is_writing = false;
+          do_send();
+        });
+    return;
+  }
+
+  if(m_is_in_flight) {
+    return;
+  }
+  if(m_sent_commands == m_commands.size()
+      || !m_commands[m_sent_commands].m_is_queued) {
+    if(m_is_closing) {
+      do_quit();
+    }
+    return;
+  }
+
+  QueuedCommand& command = m_commands[m_sent_commands++];
+  map_statement_id(command);
+  m_server_packet.expect_response(
+      command.m_command, command.m_payload_length, m_login.capabilities());
+  m_is_in_flight = !m_server_packet.is_response_complete();
+  m_response_packets = 0;
+  m_send_time = std::chrono::steady_clock::now();
+
+  // The command can wrap around the queue end.
+  const std::size_t capacity = m_settings.m_queue_length;
+  const std::size_t first_length =
+      std::min(command.m_length, capacity - m_queue_begin);
+  const std::array<boost::asio::const_buffer, 2> buffers{
+      boost::asio::buffer(m_queue.get() + m_queue_begin, first_length),
+      boost::asio::buffer(m_queue.get(), command.m_length - first_length)};
+
+  m_is_writing = true;
+  boost::asio::async_write(m_socket, buffers,
+      [this, l_self = shared_from_this(), l_length = command.m_length](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(l_error) {
+          if(l_error != boost::asio::error::operation_aborted) {
+            fail("the mirror server closed the connection");
+          }
+          return;
+        }
+
+        // The bytes of the sent command are released.
+        m_is_writing = false;
+        m_queue_begin = (m_queue_begin + l_length) % m_settings.m_queue_length;
+        m_queue_size -= l_length;
+
+        QueuedCommand& sent_command = m_commands[m_sent_commands - 1];
+        if(!sent_command.m_has_response) {
+          sent_command.m_has_mirror_response = true;
+          compare_responses();
+        }
+        do_send();
+      });
+}
+
+void MirrorSession::do_quit()
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_quit.html
+  // The MySQL server does not count the session as the aborted one.
+  static const std::array<unsigned char, 5> quit_packet{
+      1, 0, 0, 0, static_cast<unsigned char>(MySqlCommand::Command::COM_QUIT)};
+  m_is_writing = true;
+  boost::asio::async_write(m_socket, boost::asio::buffer(quit_packet),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& /*l_error*/,
+          std::size_t /*l_bytes_transferred*/) -> void { stop(); });
+}
+
+void MirrorSession::mirror_response_is_received()
+{
+  m_is_in_flight = false;
+
+  QueuedCommand& command = m_commands[m_sent_commands - 1];
+  command.m_has_mirror_response = true;
+  command.m_mirror_latency = std::chrono::steady_clock::now() - m_send_time;
+  command.m_mirror_error_code = m_server_packet.error_code();
+  command.m_mirror_statement_id = m_server_packet.statement_id();
+
+  compare_responses();
+  do_send();
+}
+
+void MirrorSession::response_is_received(
+    std::chrono::steady_clock::duration t_latency,
+    std::uint16_t t_error_code,
+    std::uint32_t t_statement_id)
+{
+  // The commands are ordered by the index, the dropped commands
+  // have no response to pair with.
+  const std::uint64_t index = m_response_index++;
+  auto command = std::lower_bound(m_commands.begin(), m_commands.end(), index,
+      [](const QueuedCommand& l_command, std::uint64_t l_index) -> bool {
+        return l_command.m_index < l_index;
+      });
+  while(command != m_commands.end() && command->m_index == index
+      && !command->m_has_response) {
+    ++command;
+  }
+  if(command == m_commands.end() || command->m_index != index) {
+    return;
+  }
+
+  command->m_has_server_response = true;
+  command->m_latency = t_latency;
+  command->m_error_code = t_error_code;
+  command->m_statement_id = t_statement_id;
+  compare_responses();
+}
+
+void MirrorSession::compare_responses()
+{
+  while(!m_commands.empty() && m_commands.front().m_has_server_response
+      && m_commands.front().m_has_mirror_response) {
+    const QueuedCommand& command = m_commands.front();
+    if(command.m_has_response) {
+      m_mirror->responses_are_compared(command.m_latency, command.m_error_code,
+          command.m_mirror_latency, command.m_mirror_error_code);
+
+      // The next commands of the statement get its id of the mirror server.
+      if(MySqlCommand::Command::COM_STMT_PREPARE == command.m_command
+          && 0 == command.m_error_code && 0 == command.m_mirror_error_code) {
+        m_statement_ids[command.m_statement_id] = command.m_mirror_statement_id;
+      }
+    }
+    m_commands.pop_front();
+    --m_sent_commands;
+  }
+}
+
+void MirrorSession::map_statement_id(const QueuedCommand& t_command)
+{
+  switch(t_command.m_command) {
+    case MySqlCommand::Command::COM_STMT_EXECUTE:
+    case MySqlCommand::Command::COM_STMT_FETCH:
+    case MySqlCommand::Command::COM_STMT_CLOSE:
+    case MySqlCommand::Command::COM_STMT_RESET:
+    case MySqlCommand::Command::COM_STMT_SEND_LONG_DATA: {
+      break;
+    }
+    case MySqlCommand::Command::COM_RESET_CONNECTION: {
+      m_statement_ids.clear();
+      return;
+    }
+    default: {
+      return;
+    }
+  }
+  if(t_command.m_payload_length < 5) {
+    return;
+  }
+
+  // The statement id follows the packet header and the command byte.
+  std::array<unsigned char, 4> id_bytes{};
+  for(std::size_t i = 0; i < id_bytes.size(); ++i) {
+    id_bytes[i] = queued_byte(5 + i);
+  }
+  const auto statement = m_statement_ids.find(
+      MySqlPacket::read_uint32(id_bytes.data()));
+  if(statement == m_statement_ids.end()) {
+    return;
+  }
+  for(std::size_t i = 0; i < id_bytes.size(); ++i) {
+    queued_byte(5 + i) =
+        static_cast<unsigned char>(statement->second >> (8u * i));
+  }
+  if(MySqlCommand::Command::COM_STMT_CLOSE == t_command.m_command) {
+    m_statement_ids.erase(statement);
+  }
+}
+
+void MirrorSession::copy(const unsigned char* t_data, std::size_t t_length)
+{
+  if(!m_socket.is_open()) {
+    return;
+  }
+
+  std::size_t pos = 0;
+  while(pos < t_length) {
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_packets.html
+    // The packet header, with the command byte of the command's first packet.
+    if(m_packet_header_length < m_packet_header_needed) {
+      m_packet_header[m_packet_header_length++] = t_data[pos++];
+      if(4 == m_packet_header_length) {
+        m_packet_length = m_packet_header[0] | (m_packet_header[1] << 8u)
+            | (m_packet_header[2] << 16u);
+        if(!m_packet_is_continued && 0 == m_packet_header[3]
+            && 0 < m_packet_length) {
+          m_packet_header_needed = 5;
+        }
+      }
+      if(m_packet_header_length == m_packet_header_needed) {
+        packet_is_started();
+      }
+      continue;
+    }
+
+    const std::size_t length = static_cast<std::size_t>(
+        std::min<std::uint64_t>(m_packet_left, t_length - pos));
+    if(m_packet_is_queued) {
+      append(t_data + pos, length);
+    }
+    pos += length;
+    m_packet_left -= length;
+    if(0 == m_packet_left) {
+      packet_is_ended();
+    }
+  }
+}
+
+void MirrorSession::packet_is_started()
+{
+  const std::size_t queue_length = m_settings.m_queue_length;
+  m_packet_left = m_packet_length - (m_packet_header_length - 4);
+
+  if(5 == m_packet_header_length) {
+    // The new command, the response of the MySQL server to it
+    // is paired by its index.
+    QueuedCommand command;
+    command.m_index = m_command_index;
+    command.m_command = static_cast<MySqlCommand::Command>(m_packet_header[4]);
+    command.m_payload_length = m_packet_length;
+    command.m_has_response =
+        MySqlCommand::has_response(command.m_command, m_packet_length);
+    if(command.m_has_response) {
+      ++m_command_index;
+    }
+
+    // The session of the mirror server has its own user.
+    m_packet_is_queued = false;
+    if(MySqlCommand::Command::COM_QUIT != command.m_command
+        && MySqlCommand::Command::COM_CHANGE_USER != command.m_command) {
+      if(m_commands.size() < MAX_COMMANDS
+          && m_queue_size + 4 + m_packet_length <= queue_length) {
+        command.m_has_server_response = !command.m_has_response;
+        m_commands.push_back(command);
+        append(m_packet_header.data(), m_packet_header_length);
+        m_packet_is_queued = true;
+      } else {
+        m_mirror->command_is_dropped();
+      }
+    }
+  } else if(m_packet_is_continued && m_packet_is_queued) {
+    if(m_queue_size + 4 + m_packet_length <= queue_length) {
+      append(m_packet_header.data(), m_packet_header_length);
+    } else {
+      // The long command does not fit, its queued begin is removed.
+      m_queue_size -= m_commands.back().m_length;
+      m_commands.pop_back();
+      m_packet_is_queued = false;
+      m_mirror->command_is_dropped();
+    }
+  } else {
+    // The packets of the command's exchange, e.g. the LOCAL INFILE data,
+    // are not mirrored.
+    m_packet_is_queued = false;
+  }
+
+  if(0 == m_packet_left) {
+    packet_is_ended();
+  }
+}
+
+void MirrorSession::packet_is_ended()
+{
+  m_packet_is_continued = (MySqlPacket::MAX_PAYLOAD_LENGTH == m_packet_length);
+  m_packet_header_length = 0;
+  m_packet_header_needed = 4;
+
+  if(!m_packet_is_continued && m_packet_is_queued) {
+    m_packet_is_queued = false;
+    m_commands.back().m_is_queued = true;
+    do_send();
+  }
+}
+
+void MirrorSession::append(const unsigned char* t_data, std::size_t t_length)
+{
+  const std::size_t capacity = m_settings.m_queue_length;
+  std::size_t end = (m_queue_begin + m_queue_size) % capacity;
+  for(std::size_t pos = 0; pos < t_length;) {
+    const std::size_t length = std::min(t_length - pos, capacity - end);
+    std::memcpy(m_queue.get() + end, t_data + pos, length);
+    pos += length;
+    end = (end + length) % capacity;
+  }
+  m_queue_size += t_length;
+  m_commands.back().m_length += t_length;
+}
+
+unsigned char& MirrorSession::queued_byte(std::size_t t_offset)
+{
+  return m_queue[(m_queue_begin + t_offset) % m_settings.m_queue_length];
+}
+
+}  // namespace proxy
@@ -0,0 +1,322 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_MIRROR_HPP
+#define PROXY_MIRROR_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "endpoint.hpp"
+#include "packet.hpp"
+#include "server_login.hpp"
+#include "settings.hpp"
+
+namespace proxy
+{
+/// The mirror MySQL server of the route, gets the copies of the client's
+/// commands of the sampled sessions. Counts the responses of the mirror
+/// server which differ from the responses of the MySQL server, the counters
+/// are updated by the sessions in the threads of the workers.
+class Mirror
+{
+public:
+  Mirror(const Mirror&) = delete;
+  Mirror(Mirror&&) = delete;
+  Mirror& operator=(const Mirror&) = delete;
+  Mirror& operator=(Mirror&&) = delete;
+
+  ~Mirror() = default;
+
+  explicit Mirror(
+      boost::asio::io_context& t_io_context, const MirrorSettings& t_settings);
+
+  /// Get the settings of the mirror server.
+  const MirrorSettings& settings() const;
+
+  /// Get the endpoint of the mirror server.
+  const StreamProtocol::endpoint& endpoint() const;
+
+  /// Check if the new session is mirrored, every Nth one is sampled.
+  bool is_sampled();
+
+  /// Count the session which could not be mirrored till its end.
+  void session_failed();
+
+  /// Count the command which is not mirrored, the mirror server
+  /// is behind the session.
+  void command_is_dropped();
+
+  /// Compare the response of the MySQL server with the response
+  /// of the mirror server to the same command, the error code is 0
+  /// if the response is not failed.
+  void responses_are_compared(std::chrono::steady_clock::duration t_latency,
+      std::uint16_t t_error_code,
+      std::chrono::steady_clock::duration t_mirror_latency,
+      std::uint16_t t_mirror_error_code);
+
+  /// Print the counters of the mirror server.
+  void print_stats(const std::string& t_route_name) const;
+
+private:
+  const MirrorSettings m_settings;
+  const StreamProtocol::endpoint m_endpoint;
+  const std::chrono::steady_clock::duration m_latency_threshold;
+
+  std::atomic<std::uint64_t> m_session_counter{0};
+
+  std::atomic<std::uint64_t> m_sessions{0};
+  std::atomic<std::uint64_t> m_failed_sessions{0};
+  std::atomic<std::uint64_t> m_commands{0};
+  std::atomic<std::uint64_t> m_dropped_commands{0};
+  std::atomic<std::uint64_t> m_error_mismatches{0};
+  std::atomic<std::uint64_t> m_slower_responses{0};
+  std::atomic<std::uint64_t> m_faster_responses{0};
+
+  /// Sums of the response times in microseconds.
+  std::atomic<std::uint64_t> m_latency_sum{0};
+  std::atomic<std::uint64_t> m_mirror_latency_sum{0};
+};
+
+inline const MirrorSettings& Mirror::settings() const
+{
+  return m_settings;
+}
+
+inline const StreamProtocol::endpoint& Mirror::endpoint() const
+{
+  return m_endpoint;
+}
+
+
+/// The session of the proxy to the mirror server for one client's session.
+/// The client's commands forwarded to the MySQL server are copied
+/// to the bounded queue and are sent to the mirror server one by one,
+/// its responses are discarded after their comparison. The commands which
+/// do not fit the queue are dropped, the client's session is never waiting
+/// for the mirror server. Runs in the worker's thread of the connection,
+/// lives till its last handler is called.
+class MirrorSession : public std::enable_shared_from_this<MirrorSession>
+{
+public:
+  /// Max number of the commands in the queue, the short commands
+  /// are limited by the number, the long ones by the queue length.
+  static const std::size_t MAX_COMMANDS = 4096;
+
+  /// Time to send the queued commands after the client's session is ended.
+  static constexpr std::chrono::seconds CLOSE_TIMEOUT{10};
+
+  MirrorSession(const MirrorSession&) = delete;
+  MirrorSession(MirrorSession&&) = delete;
+  MirrorSession& operator=(const MirrorSession&) = delete;
+  MirrorSession& operator=(MirrorSession&&) = delete;
+
+  ~MirrorSession() = default;
+
+  explicit MirrorSession(
+      boost::asio::io_context& t_io_context, std::shared_ptr<Mirror> t_mirror);
+
+  /// Connect to the mirror server and authenticate with the capabilities
+  /// of the client, the commands are queued meanwhile.
+  void start(std::uint32_t t_client_capabilities, unsigned char t_collation_id);
+
+  /// Close the session after the queued commands are sent, the client's
+  /// session is ended. The commands are discarded after CLOSE_TIMEOUT.
+  void close();
+
+  /// Close the session, the queued commands are discarded.
+  void stop();
+
+  /// Copy the client's data forwarded to the MySQL server in the command
+  /// phase, the commands are framed by the packet headers.
+  void copy(const unsigned char* t_data, std::size_t t_length);
+
+  /// Pair the response of the MySQL server with the command, the responses
+  /// are received in the order of the commands. The statement id is used
+  /// for the response to COM_STMT_PREPARE.
+  void response_is_received(std::chrono::steady_clock::duration t_latency,
+      std::uint16_t t_error_code,
+      std::uint32_t t_statement_id);
+
+private:
+  /// The client's command in the queue.
+  struct QueuedCommand
+  {
+    /// Number of the responses of the MySQL server before the response
+    /// to the command.
+    std::uint64_t m_index = 0;
+
+    MySqlCommand::Command m_command = MySqlCommand::Command::UNKNOWN;
+    std::uint64_t m_payload_length = 0;
+    bool m_has_response = false;
+
+    /// Length of the command packets in the queue, the command is sent
+    /// after it is fully queued.
+    std::size_t m_length = 0;
+    bool m_is_queued = false;
+
+    /// The responses of the MySQL server and of the mirror server.
+    bool m_has_server_response = false;
+    std::chrono::steady_clock::duration m_latency{};
+    std::uint16_t m_error_code = 0;
+    std::uint32_t m_statement_id = 0;
+
+    bool m_has_mirror_response = false;
+    std::chrono::steady_clock::duration m_mirror_latency{};
+    std::uint16_t m_mirror_error_code = 0;
+    std::uint32_t m_mirror_statement_id = 0;
+  };
+
+  /// Close the session after its failure.
+  void fail(const char* t_reason);
+
+  /// Read the packet of the connection phase.
+  void do_read_handshake_packet();
+
+  /// Perform the actions for the packet of the connection phase.
+  void handshake_packet_is_received();
+
+  /// Send the packet of the connection phase made by the login.
+  void do_write_handshake_packet();
+
+  /// Read the responses in the command phase.
+  void do_read();
+
+  /// Collect the responses of the mirror server.
+  void data_is_received(std::size_t t_bytes_transferred);
+
+  /// Send the next fully queued command if no command is in flight.
+  void do_send();
+
+  /// Send COM_QUIT and close the session.
+  void do_quit();
+
+  /// Perform the actions for the response of the mirror server.
+  void mirror_response_is_received();
+
+  /// Compare the responses of the commands which have both of them,
+  /// in the order of the commands.
+  void compare_responses();
+
+  /// Perform the actions for the header of the client's packet.
+  void packet_is_started();
+
+  /// Perform the actions for the end of the client's packet.
+  void packet_is_ended();
+
+  /// Append the bytes to the queue.
+  void append(const unsigned char* t_data, std::size_t t_length);
+
+  /// Get the queued byte at the offset from the queue begin.
+  unsigned char& queued_byte(std::size_t t_offset);
+
+  /// Replace the statement id of the command at the queue begin
+  /// with the statement id of the mirror server.
+  void map_statement_id(const QueuedCommand& t_command);
+
+  const std::shared_ptr<Mirror> m_mirror;
+  const MirrorSettings& m_settings;
+
+  StreamProtocol::socket m_socket;
+
+  /// The authentication of the mirror session.
+  ServerLogin m_login;
+
+  /// The mirror session is authenticated.
+  bool m_is_ready = false;
+
+  /// The client's session is ended, the session is closed after
+  /// the queued commands.
+  bool m_is_closing = false;
+  boost::asio::steady_timer m_close_timer;
+
+  /// The packet of the connection phase.
+  std::array<unsigned char, 4> m_header{};
+  std::vector<unsigned char> m_read_packet;
+
+  /// Collects the responses of the mirror server.
+  MySqlConnectionState m_connection_state =
+      MySqlConnectionState::CONNECTION_PHASE;
+  FromServerPacket m_server_packet;
+
+  // Min BUFFER_LENGTH == 2 for 100 connections, debug build.
+#ifdef PROXY_PACKET_DEBUG
+  static const std::size_t BUFFER_LENGTH = 60;
+#else  // ifdef PROXY_PACKET_DEBUG
+  static const std::size_t BUFFER_LENGTH = 8192;
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  std::array<unsigned char, BUFFER_LENGTH> m_read_buffer{};
+
+  /// The ring buffer of the queued commands and the commands.
+  /// The commands at the begin are sent and wait for the response
+  /// of the MySQL server, their bytes are released.
+  std::unique_ptr<unsigned char[]> m_queue;
+  std::size_t m_queue_begin = 0;
+  std::size_t m_queue_size = 0;
+  std::deque<QueuedCommand> m_commands;
+  std::size_t m_sent_commands = 0;
+
+  /// The command is being written to the mirror server
+  /// or waits for its response.
+  bool m_is_writing = false;
+  bool m_is_in_flight = false;
+  std::chrono::steady_clock::time_point m_send_time;
+  std::size_t m_response_packets = 0;
+
+  /// The empty packet for the LOCAL INFILE request, the mirror server
+  /// gets no file.
+  std::array<unsigned char, 4> m_infile_packet{};
+  bool m_infile_packet_is_pending = false;
+
+  /// Number of the commands with the response of the MySQL server
+  /// and of the received responses of the MySQL server.
+  std::uint64_t m_command_index = 0;
+  std::uint64_t m_response_index = 0;
+
+  /// Framing of the client's packets.
+  std::array<unsigned char, 5> m_packet_header{};
+  std::size_t m_packet_header_length = 0;
+  std::size_t m_packet_header_needed = 4;
+  std::uint64_t m_packet_length = 0;
+  std::uint64_t m_packet_left = 0;
+  bool m_packet_is_continued = false;
+  bool m_packet_is_queued = false;
+
+  /// The statement ids of the MySQL server and of the mirror server.
+  std::unordered_map<std::uint32_t, std::uint32_t> m_statement_ids;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_MIRROR_HPP
@@ -23,6 +23,7 @@
 
 #include "packet.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 
@@ -50,7 +51,7 @@ bool MySqlCommand::is_valid(Command t_command)
     case Command::COM_STMT_RESET:
     case Command::COM_STMT_PREPARE:
     case Command::COM_STMT_EXECUTE:
-    //case MySqlCommands::COM_STMT_FETCH :
+    case Command::COM_STMT_FETCH:
     case Command::COM_STMT_CLOSE:
     case Command::COM_STMT_SEND_LONG_DATA: {
       return true;
@@ -72,6 +73,22 @@ bool MySqlCommand::has_sql_field(Command t_command)
   return false;
 }
 
+// static
+bool MySqlCommand::has_response(
+    Command t_command, std::uint64_t /*t_payload_length*/)
+{
+  switch(t_command) {
+    case Command::COM_QUIT:
+    case Command::COM_STMT_CLOSE:
+    case Command::COM_STMT_SEND_LONG_DATA: {
+      return false;
+    }
+    default: {
+      return true;
+    }
+  }
+}
+
 // static
 const char* MySqlCommand::name(
     Command t_command, std::uint64_t t_payload_length)
@@ -129,15 +146,11 @@ const char* MySqlCommand::name(
     case Command::COM_STMT_EXECUTE: {
       return "COM_STMT_EXECUTE";
     }
-    //case MySqlCommands::COM_STMT_FETCH :
+    case Command::COM_STMT_FETCH: {
+      return "COM_STMT_FETCH";
+    }
     case Command::COM_STMT_CLOSE: {
-      switch(t_payload_length) {
-        case 9:
-          return "COM_STMT_FETCH";
-        case 5:
-          return "COM_STMT_CLOSE";
-      }
-      break;
+      return "COM_STMT_CLOSE";
     }
     case Command::COM_STMT_SEND_LONG_DATA: {
       return "COM_STMT_SEND_LONG_DATA";
@@ -164,8 +177,8 @@ MySqlResponse::Response MySqlResponse::get_response(
       break;
     }
     case Response::EOF_PACKET: {
-      // packet_length == payload_length_ + 4
-      if(t_payload_length < 5) {  // length of packet < 9
+      // 0xFE is the 8-byte length-encoded integer if the payload is longer.
+      if(t_payload_length < 9) {
         return Response::EOF_PACKET;
       }
       break;
@@ -183,6 +196,51 @@ MySqlResponse::Response MySqlResponse::get_response(
 
 // ======== MySqlPacket ========
 
+// static
+bool MySqlPacket::read_lenenc_uint(const unsigned char* t_data,
+    std::size_t t_size,
+    std::size_t& t_pos,
+    std::uint64_t& t_value)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_dt_integers.html
+  if(t_pos >= t_size) {
+    return false;
+  }
+
+  const unsigned char first_byte = t_data[t_pos];
+  std::size_t int_length = 0;
+  switch(first_byte) {
+    case 0xFC: {
+      int_length = 2;
+      break;
+    }
+    case 0xFD: {
+      int_length = 3;
+      break;
+    }
+    case 0xFE: {
+      int_length = 8;
+      break;
+    }
+    default: {
+      t_value = first_byte;
+      ++t_pos;
+      return true;
+    }
+  }
+
+  if(t_pos + 1 + int_length > t_size) {
+    return false;
+  }
+
+  t_value = 0;
+  for(std::size_t i = 0; i < int_length; ++i) {
+    t_value |= static_cast<std::uint64_t>(t_data[t_pos + 1 + i]) << (8u * i);
+  }
+  t_pos += 1 + int_length;
+  return true;
+}
+
 // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_packets.html
 void MySqlPacket::collect(
     unsigned char t_received_byte, MySqlConnectionState& t_connection_state)
@@ -191,6 +249,9 @@ void MySqlPacket::collect(
     case PacketState::PAYLOAD_LENGTH_0: {
       m_payload_is_received = false;
       m_received_bytes = 0;
+      if(m_payload_first_part) {
+        m_payload_head_length = 0;
+      }
       m_payload_length = t_received_byte;
       m_packet_state = PacketState::PAYLOAD_LENGTH_1;
       break;
@@ -223,7 +284,10 @@ void MySqlPacket::collect(
 #endif  // ifdef PROXY_PACKET_DEBUG
 
       if(0 == m_payload_length) {
-        m_payload_is_received = true;
+        if(!m_payload_not_ended) {
+          m_payload_is_received = true;
+          data_is_received();
+        }
         m_payload_first_part = true;
         m_packet_state = PacketState::PAYLOAD_LENGTH_0;
       } else {
@@ -237,6 +301,12 @@ void MySqlPacket::collect(
       m_payload.push_back(t_received_byte);
 #endif  // ifdef PROXY_PACKET_DEBUG
 
+      // Keep the first payload bytes for the header parsing.
+      if(m_payload_first_part && m_received_bytes < PAYLOAD_HEAD_LENGTH) {
+        m_payload_head[m_received_bytes] = t_received_byte;
+        m_payload_head_length = m_received_bytes + 1;
+      }
+
       // Analyse the 1st byte of the packet payload.
       if(0 == m_received_bytes) {
         switch(t_connection_state) {
@@ -276,13 +346,21 @@ void MySqlPacket::collect(
 // ======== FromClientPacket ========
 
 void FromClientPacket::connection_phase_parse(
-    unsigned char /*t_payload_0*/, MySqlConnectionState& /*t_connection_state*/)
+    unsigned char t_payload_0, MySqlConnectionState& /*t_connection_state*/)
 {
-  // Here we do nothing.
+  m_connection_phase_packet = true;
+
+  // The authentication packets after the HandshakeResponse are not captured.
+  if(!m_handshake_is_decoded && m_payload_first_part) {
+    m_login_capturing = true;
+    m_login_payload.assign(1, static_cast<char>(t_payload_0));
+  }
 }
 
 void FromClientPacket::command_phase_parse(unsigned char t_payload_0)
 {
+  m_connection_phase_packet = false;
+
   if(m_payload_first_part) {
     m_command = static_cast<MySqlCommand::Command>(t_payload_0);
     if(MySqlCommand::is_valid(m_command)) {
@@ -294,16 +372,29 @@ void FromClientPacket::command_phase_parse(unsigned char t_payload_0)
         throw std::runtime_error("BAD packet");
       }
     }
+    // The capacity is bounded by the capture limit, keep it for the next
+    // commands.
     m_sql_string.clear();
-    m_sql_string.shrink_to_fit();
+    m_sql_length = 0;
+    m_sql_digest.reset();
+    m_payload_capture = nullptr;
+
+    m_login_capturing = MySqlCommand::Command::COM_CHANGE_USER == m_command;
+    if(m_login_capturing) {
+      m_login_payload.clear();
+    }
   }
 
   if(MySqlCommand::has_sql_field(m_command)) {
+    // A multi-part payload can be up to several GB, only its prefix
+    // is captured, the rest is streamed through.
     if(m_payload_first_part) {
-      m_sql_string.reserve(m_payload_length - 1);
+      m_sql_string.reserve(std::min<std::uint64_t>(
+          m_payload_length - 1, m_sql_capture_limit));
       m_sql_data_receiving = true;
     } else {
-      m_sql_string.reserve(m_sql_string.capacity() + m_payload_length - 1);
+      m_sql_string.reserve(std::min<std::uint64_t>(
+          m_sql_string.size() + m_payload_length, m_sql_capture_limit));
     }
   }
 }
@@ -311,21 +402,162 @@ void FromClientPacket::command_phase_parse(unsigned char t_payload_0)
 void FromClientPacket::collect_data(unsigned char t_received_byte)
 {
   if(m_sql_data_receiving) {
-    m_sql_string.push_back(static_cast<char>(t_received_byte));
+    if(m_sql_string.size() < m_sql_capture_limit) {
+      m_sql_string.push_back(static_cast<char>(t_received_byte));
+    }
+    ++m_sql_length;
+    m_sql_digest.update(static_cast<char>(t_received_byte));
+  }
+
+  if(nullptr != m_payload_capture
+      && m_payload_capture->size() < m_payload_capture->capacity()) {
+    m_payload_capture->push_back(t_received_byte);
+  }
+
+  if(m_login_capturing && m_login_payload.size() < LOGIN_CAPTURE_LIMIT) {
+    m_login_payload.push_back(static_cast<char>(t_received_byte));
   }
 }
 
 void FromClientPacket::data_is_received()
 {
   m_sql_data_receiving = false;
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_response.html
+  // The first client's packet is HandshakeResponse or SSLRequest,
+  // both start with the capability flags.
+  if(m_connection_phase_packet && 0 == m_capabilities
+      && m_payload_head_length >= 4) {
+    m_capabilities = read_uint32(m_payload_head.data());
+    if((m_capabilities & MySqlCapability::CLIENT_PROTOCOL_41)
+        && m_payload_head_length >= 9) {
+      m_collation_id = m_payload_head[8];
+    }
+  }
+
+  if(m_login_capturing) {
+    m_login_capturing = false;
+    decode_login();
+    // The payload is not kept till the next COM_CHANGE_USER.
+    m_login_payload.clear();
+    m_login_payload.shrink_to_fit();
+  }
+}
+
+void FromClientPacket::decode_login()
+{
+  const auto* data =
+      reinterpret_cast<const unsigned char*>(m_login_payload.data());
+  const std::size_t size = m_login_payload.size();
+  std::size_t pos = 0;
+
+  if(m_connection_phase_packet) {
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_response.html
+    // The SSLRequest is the fixed part of the HandshakeResponse only,
+    // the full one is sent after the TLS handshake.
+    if(32 >= m_payload_length) {
+      return;
+    }
+    m_handshake_is_decoded = true;
+    if(!(m_capabilities & MySqlCapability::CLIENT_PROTOCOL_41)) {
+      return;
+    }
+    pos = 32;
+  }
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_change_user.html
+  // COM_CHANGE_USER is captured without its command byte.
+
+  const std::size_t user_end = m_login_payload.find('\0', pos);
+  if(std::string::npos == user_end) {
+    return;
+  }
+  std::string user = m_login_payload.substr(pos, user_end - pos);
+  pos = user_end + 1;
+
+  // Skip the authentication data.
+  std::uint64_t auth_length = 0;
+  if(m_connection_phase_packet
+      && (m_capabilities
+          & MySqlCapability::CLIENT_PLUGIN_AUTH_LENENC_CLIENT_DATA)) {
+    if(!read_lenenc_uint(data, size, pos, auth_length)) {
+      return;
+    }
+  } else if(m_capabilities & MySqlCapability::CLIENT_SECURE_CONNECTION) {
+    if(pos >= size) {
+      return;
+    }
+    auth_length = data[pos++];
+  } else {
+    const std::size_t auth_end = m_login_payload.find('\0', pos);
+    if(std::string::npos == auth_end) {
+      return;
+    }
+    auth_length = auth_end + 1 - pos;
+  }
+  pos += static_cast<std::size_t>(std::min<std::uint64_t>(auth_length, size));
+
+  std::string schema;
+  const bool has_schema = !m_connection_phase_packet
+      || (m_capabilities & MySqlCapability::CLIENT_CONNECT_WITH_DB);
+  if(has_schema && pos < size) {
+    const std::size_t schema_end = m_login_payload.find('\0', pos);
+    if(std::string::npos == schema_end) {
+      return;
+    }
+    schema = m_login_payload.substr(pos, schema_end - pos);
+  }
+
+  m_login_user = std::move(user);
+  m_login_schema = std::move(schema);
 }
 
 
 // ======== FromServerPacket ========
 
+void FromServerPacket::expect_response(MySqlCommand::Command t_command,
+    std::uint64_t t_command_length,
+    std::uint32_t t_client_capabilities)
+{
+  m_response_command = t_command;
+  m_response_failed = false;
+  m_error_code = 0;
+  m_deprecate_eof = (t_client_capabilities & m_capabilities
+                        & MySqlCapability::CLIENT_DEPRECATE_EOF)
+      != 0;
+
+  if(!MySqlCommand::has_response(t_command, t_command_length)) {
+    m_response_state = ResponseState::NONE;
+    return;
+  }
+
+  switch(t_command) {
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_stmt_fetch.html
+    // The binary rows of the cursor have no column count and definitions.
+    case MySqlCommand::Command::COM_STMT_FETCH:
+    case MySqlCommand::Command::COM_FIELD_LIST: {
+      m_response_state = ResponseState::ROWS;
+      break;
+    }
+    case MySqlCommand::Command::COM_STATISTICS: {
+      m_response_state = ResponseState::ONE_PACKET;
+      break;
+    }
+    case MySqlCommand::Command::COM_CHANGE_USER: {
+      m_response_state = ResponseState::AUTHENTICATION;
+      break;
+    }
+    default: {
+      m_response_state = ResponseState::FIRST_PACKET;
+      break;
+    }
+  }
+}
+
 void FromServerPacket::connection_phase_parse(
     unsigned char t_payload_0, MySqlConnectionState& t_connection_state)
 {
+  m_connection_phase_packet = true;
+
   // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_lifecycle.html
   if(m_payload_first_part) {
     const MySqlResponse::Response response =
@@ -353,7 +585,7 @@ void FromServerPacket::connection_phase_parse(
 
 void FromServerPacket::command_phase_parse(unsigned char /*t_payload_0*/)
 {
-  // Here we do nothing.
+  m_connection_phase_packet = false;
 }
 
 void FromServerPacket::collect_data(unsigned char /*t_received_byte*/)
@@ -363,7 +595,234 @@ void FromServerPacket::collect_data(unsigned char /*t_received_byte*/)
 
 void FromServerPacket::data_is_received()
 {
-  // Here we do nothing.
+  if(0 == m_payload_head_length) {
+    return;
+  }
+
+  if(m_connection_phase_packet) {
+    // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_v10.html
+    if(0 == m_capabilities && 0x0A == m_payload_head[0]) {
+      parse_greeting();
+    } else if(MySqlResponse::Response::OK_PACKET
+        == MySqlResponse::get_response(m_payload_head[0], m_payload_length)) {
+      parse_ok_status();
+    }
+    return;
+  }
+
+  response_packet_is_received();
+}
+
+void FromServerPacket::parse_greeting()
+{
+  const unsigned char* head = m_payload_head.data();
+  std::size_t pos = 1;
+
+  // Human readable server version, like "5.7.25" or "8.0.15".
+  m_version_major = 0;
+  for(; pos < m_payload_head_length && 0 != head[pos]; ++pos) {
+    if('0' <= head[pos] && head[pos] <= '9') {
+      m_version_major = m_version_major * 10 + (head[pos] - '0');
+    } else {
+      break;
+    }
+  }
+  for(; pos < m_payload_head_length && 0 != head[pos]; ++pos) {
+  }
+  ++pos;  // NUL
+
+  // thread id, auth-plugin-data-part-1, filler.
+  pos += 4 + 8 + 1;
+
+  if(pos + 2 > m_payload_head_length) {
+    return;
+  }
+  m_capabilities = read_uint16(head + pos);
+  pos += 2;
+
+  // character_set, status_flags, capability_flags_2.
+  if(pos + 5 <= m_payload_head_length) {
+    m_status_flags = read_uint16(head + pos + 1);
+    m_capabilities |= static_cast<std::uint32_t>(read_uint16(head + pos + 3))
+        << 16u;
+  }
+}
+
+void FromServerPacket::parse_ok_status()
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_ok_packet.html
+  std::size_t pos = 1;
+  std::uint64_t affected_rows = 0;
+  std::uint64_t last_insert_id = 0;
+  if(read_lenenc_uint(
+         m_payload_head.data(), m_payload_head_length, pos, affected_rows)
+      && read_lenenc_uint(
+          m_payload_head.data(), m_payload_head_length, pos, last_insert_id)
+      && pos + 2 <= m_payload_head_length) {
+    m_status_flags = read_uint16(m_payload_head.data() + pos);
+    m_has_status_flags = true;
+  }
+}
+
+void FromServerPacket::parse_eof_status()
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_eof_packet.html
+  if(5 <= m_payload_head_length) {
+    m_status_flags = read_uint16(m_payload_head.data() + 3);
+    m_has_status_flags = true;
+  }
+}
+
+void FromServerPacket::parse_error_code()
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_err_packet.html
+  m_response_failed = true;
+  if(3 <= m_payload_head_length) {
+    m_error_code = read_uint16(m_payload_head.data() + 1);
+  }
+}
+
+void FromServerPacket::response_packet_is_received()
+{
+  const unsigned char header = m_payload_head[0];
+
+  switch(m_response_state) {
+    case ResponseState::NONE: {
+      // Here we do nothing.
+      break;
+    }
+
+    case ResponseState::FIRST_PACKET: {
+      // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_query_response.html
+      if(0xFF == header) {
+        parse_error_code();
+        m_response_state = ResponseState::NONE;
+
+      } else if(0x00 == header
+          && MySqlCommand::Command::COM_STMT_PREPARE == m_response_command) {
+        // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_stmt_prepare.html
+        if(m_payload_head_length < 9) {
+          m_response_state = ResponseState::NONE;
+          break;
+        }
+        m_statement_id = read_uint32(&m_payload_head[1]);
+        const std::uint16_t num_columns = read_uint16(&m_payload_head[5]);
+        const std::uint16_t num_params = read_uint16(&m_payload_head[7]);
+        m_statement_num_params = num_params;
+        m_after_definitions = ResponseState::NONE;
+        if(0 < num_params) {
+          m_definitions_left = num_params;
+          m_next_definitions = num_columns;
+          m_response_state = ResponseState::DEFINITIONS;
+        } else if(0 < num_columns) {
+          m_definitions_left = num_columns;
+          m_next_definitions = 0;
+          m_response_state = ResponseState::DEFINITIONS;
+        } else {
+          m_response_state = ResponseState::NONE;
+        }
+
+      } else if(0x00 == header) {
+        parse_ok_status();
+        if(!(m_status_flags & MySqlServerStatus::SERVER_MORE_RESULTS_EXISTS)) {
+          m_response_state = ResponseState::NONE;
+        }
+
+      } else if(MySqlResponse::Response::EOF_PACKET
+          == MySqlResponse::get_response(header, m_payload_length)) {
+        parse_eof_status();
+        m_response_state = ResponseState::NONE;
+
+      } else if(0xFB == header) {
+        // LOCAL INFILE Request, the server will send OK or ERR
+        // after the file content from the client.
+
+      } else {
+        // Text or binary resultset, starts with the column count.
+        std::size_t pos = 0;
+        std::uint64_t num_columns = 0;
+        read_lenenc_uint(
+            m_payload_head.data(), m_payload_head_length, pos, num_columns);
+        m_definitions_left = num_columns;
+        m_next_definitions = 0;
+        m_after_definitions = ResponseState::ROWS;
+        m_response_state = (0 < num_columns) ? ResponseState::DEFINITIONS
+                                              : ResponseState::ROWS;
+      }
+      break;
+    }
+
+    case ResponseState::ONE_PACKET: {
+      if(0xFF == header) {
+        parse_error_code();
+      }
+      m_response_state = ResponseState::NONE;
+      break;
+    }
+
+    case ResponseState::AUTHENTICATION: {
+      // Skip the authentication exchange till OK or ERR.
+      if(0x00 == header) {
+        parse_ok_status();
+        m_response_state = ResponseState::NONE;
+      } else if(0xFF == header) {
+        parse_error_code();
+        m_response_state = ResponseState::NONE;
+      }
+      break;
+    }
+
+    case ResponseState::DEFINITIONS: {
+      if(0 < m_definitions_left) {
+        --m_definitions_left;
+      }
+      if(0 == m_definitions_left) {
+        if(m_deprecate_eof) {
+          definitions_are_received();
+        } else {
+          m_response_state = ResponseState::DEFINITIONS_EOF;
+        }
+      }
+      break;
+    }
+
+    case ResponseState::DEFINITIONS_EOF: {
+      definitions_are_received();
+      break;
+    }
+
+    case ResponseState::ROWS: {
+      if(0xFF == header) {
+        parse_error_code();
+        m_response_state = ResponseState::NONE;
+
+      } else if(0xFE == header
+          && m_payload_length
+              < (m_deprecate_eof ? MAX_PAYLOAD_LENGTH : std::uint64_t(9))) {
+        if(m_deprecate_eof) {
+          parse_ok_status();
+        } else {
+          parse_eof_status();
+        }
+        m_response_state =
+            (m_status_flags & MySqlServerStatus::SERVER_MORE_RESULTS_EXISTS)
+            ? ResponseState::FIRST_PACKET
+            : ResponseState::NONE;
+      }
+      break;
+    }
+  }
+}
+
+void FromServerPacket::definitions_are_received()
+{
+  if(0 < m_next_definitions) {
+    m_definitions_left = m_next_definitions;
+    m_next_definitions = 0;
+    m_response_state = ResponseState::DEFINITIONS;
+  } else {
+    m_response_state = m_after_definitions;
+  }
 }
 
 }  // namespace proxy
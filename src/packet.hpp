@@ -24,14 +24,19 @@
 #ifndef PROXY_PACKET_HPP
 #define PROXY_PACKET_HPP
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <string>
-#ifdef PROXY_PACKET_DEBUG
-  #include <vector>
-#endif  // ifdef PROXY_PACKET_DEBUG
+#include <utility>
+#include <vector>
+
+#include "sql_digest.hpp"
 
 namespace proxy
 {
+struct PreparedStatement;
+
 // ======== MySqlConnectionState ========
 
 // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_lifecycle.html
@@ -43,6 +48,60 @@ enum class MySqlConnectionState
 };
 
 
+// ======== MySqlCapability ========
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/group__group__cs__capabilities__flags.html
+/// Capability flags of the client and the MySQL server.
+class MySqlCapability
+{
+public:
+  MySqlCapability(const MySqlCapability&) = delete;
+  MySqlCapability(MySqlCapability&&) = delete;
+  MySqlCapability& operator=(const MySqlCapability&) = delete;
+  MySqlCapability& operator=(MySqlCapability&&) = delete;
+
+  ~MySqlCapability() = default;
+
+  static const std::uint32_t CLIENT_CONNECT_WITH_DB = 0x00000008;
+  static const std::uint32_t CLIENT_COMPRESS = 0x00000020;
+  static const std::uint32_t CLIENT_PROTOCOL_41 = 0x00000200;
+  static const std::uint32_t CLIENT_SSL = 0x00000800;
+  static const std::uint32_t CLIENT_TRANSACTIONS = 0x00002000;
+  static const std::uint32_t CLIENT_SECURE_CONNECTION = 0x00008000;
+  static const std::uint32_t CLIENT_PLUGIN_AUTH = 0x00080000;
+  static const std::uint32_t CLIENT_CONNECT_ATTRS = 0x00100000;
+  static const std::uint32_t CLIENT_PLUGIN_AUTH_LENENC_CLIENT_DATA = 0x00200000;
+  static const std::uint32_t CLIENT_DEPRECATE_EOF = 0x01000000;
+  static const std::uint32_t CLIENT_ZSTD_COMPRESSION_ALGORITHM = 0x04000000;
+  static const std::uint32_t CLIENT_QUERY_ATTRIBUTES = 0x08000000;
+
+private:
+};
+
+
+// ======== MySqlServerStatus ========
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/mysql__com_8h.html
+/// Status flags of the MySQL server from the OK and EOF packets.
+class MySqlServerStatus
+{
+public:
+  MySqlServerStatus(const MySqlServerStatus&) = delete;
+  MySqlServerStatus(MySqlServerStatus&&) = delete;
+  MySqlServerStatus& operator=(const MySqlServerStatus&) = delete;
+  MySqlServerStatus& operator=(MySqlServerStatus&&) = delete;
+
+  ~MySqlServerStatus() = default;
+
+  static const std::uint16_t SERVER_STATUS_IN_TRANS = 0x0001;
+  static const std::uint16_t SERVER_STATUS_AUTOCOMMIT = 0x0002;
+  static const std::uint16_t SERVER_MORE_RESULTS_EXISTS = 0x0008;
+  static const std::uint16_t SERVER_SESSION_STATE_CHANGED = 0x4000;
+
+private:
+};
+
+
 // ======== MySqlCommand ========
 
 /// Commands from the client to the MySQL server.
@@ -76,7 +135,7 @@ public:
 
     COM_STMT_PREPARE = 0x16,  // has SQL string
     COM_STMT_EXECUTE = 0x17,
-    //COM_STMT_FETCH = 0x19,  // length == 9, equal to COM_STMT_CLOSE
+    COM_STMT_FETCH = 0x1C,  // length == 9
     COM_STMT_CLOSE = 0x19,  // length == 5
     COM_STMT_RESET = 0x1A,  // length == 5
     COM_STMT_SEND_LONG_DATA = 0x18
@@ -88,6 +147,9 @@ public:
   /// Check if the command has the SQL field string.
   static bool has_sql_field(Command t_command);
 
+  /// Check if the MySQL server responds to the command.
+  static bool has_response(Command t_command, std::uint64_t t_payload_length);
+
   /// Get the name string of the command.
   static const char* name(Command t_command, std::uint64_t t_payload_length);
 
@@ -112,7 +174,7 @@ public:
   enum class Response : unsigned char
   {
     OK_PACKET = 0x00,  // length of packet > 7
-    EOF_PACKET = 0xFE,  // length of packet < 9
+    EOF_PACKET = 0xFE,  // length of payload < 9
     ERR_PACKET = 0xFF,
     OTHER_PACKET = 0x01
   };
@@ -131,6 +193,7 @@ private:
 /// Represents the data packets between the client and the MySQL server.
 class MySqlPacket
 {
+public:
   // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_basic_packets.html
   /// Data between client and server is exchanged in packets of max 16MByte
   /// size. If the payload is larger than or equal to 2^24-1 bytes
@@ -140,6 +203,10 @@ class MySqlPacket
 
   static const std::uint64_t MAX_PAYLOAD_LENGTH = 0xffffff;
 
+  /// Number of the first payload bytes kept for the packet header parsing.
+  static const std::size_t PAYLOAD_HEAD_LENGTH = 128;
+
+private:
   enum class PacketState
   {
     PAYLOAD_LENGTH_0,
@@ -165,12 +232,42 @@ public:
   /// Check if the packet is fully received.
   bool is_received() const;
 
-#ifdef PROXY_PACKET_DEBUG
+  /// Check if the next byte will start a new packet.
+  bool is_packet_start() const;
+
+  /// Check if the next byte is the sequence id of the packet.
+  bool is_sequence_id_next() const;
+
+  /// Check if the next byte is in the payload of the packet's first part,
+  /// at the offset received_bytes().
+  bool is_first_payload_next() const;
+
+  /// Get the number of the received payload bytes of the current packet part.
+  std::uint64_t received_bytes() const;
+
   std::uint64_t payload_length() const;
   unsigned char sequence_id() const;
+#ifdef PROXY_PACKET_DEBUG
   const std::vector<unsigned char>& payload() const;
 #endif  // ifdef PROXY_PACKET_DEBUG
 
+  /// Get the first bytes of the packet payload.
+  const unsigned char* payload_head() const;
+  std::size_t payload_head_length() const;
+
+  /// Read the little-endian 2-byte integer.
+  static std::uint16_t read_uint16(const unsigned char* t_data);
+
+  /// Read the little-endian 4-byte integer.
+  static std::uint32_t read_uint32(const unsigned char* t_data);
+
+  /// Read the length-encoded integer from the position t_pos
+  /// and move t_pos behind it. Returns false if the data is too short.
+  static bool read_lenenc_uint(const unsigned char* t_data,
+      std::size_t t_size,
+      std::size_t& t_pos,
+      std::uint64_t& t_value);
+
 protected:
   virtual void connection_phase_parse(
       unsigned char t_payload_0, MySqlConnectionState& t_connection_state) = 0;
@@ -186,6 +283,10 @@ protected:
   unsigned char m_sequence_id = 0;
   std::uint64_t m_received_bytes = 0;
 
+  /// The first bytes of the packet payload, including the 0-byte.
+  std::array<unsigned char, PAYLOAD_HEAD_LENGTH> m_payload_head{};
+  std::size_t m_payload_head_length = 0;
+
 private:
   PacketState m_packet_state = PacketState::PAYLOAD_LENGTH_0;
 
@@ -199,7 +300,27 @@ inline bool MySqlPacket::is_received() const
   return m_payload_is_received;
 }
 
-#ifdef PROXY_PACKET_DEBUG
+inline bool MySqlPacket::is_packet_start() const
+{
+  return m_packet_state == PacketState::PAYLOAD_LENGTH_0
+      && m_payload_first_part;
+}
+
+inline bool MySqlPacket::is_sequence_id_next() const
+{
+  return m_packet_state == PacketState::SEQUENCE_ID;
+}
+
+inline bool MySqlPacket::is_first_payload_next() const
+{
+  return m_packet_state == PacketState::PAYLOAD && m_payload_first_part;
+}
+
+inline std::uint64_t MySqlPacket::received_bytes() const
+{
+  return m_received_bytes;
+}
+
 inline std::uint64_t MySqlPacket::payload_length() const
 {
   return m_payload_length;
@@ -210,12 +331,38 @@ inline unsigned char MySqlPacket::sequence_id() const
   return m_sequence_id;
 }
 
+inline const unsigned char* MySqlPacket::payload_head() const
+{
+  return m_payload_head.data();
+}
+
+inline std::size_t MySqlPacket::payload_head_length() const
+{
+  return m_payload_head_length;
+}
+
+#ifdef PROXY_PACKET_DEBUG
 inline const std::vector<unsigned char>& MySqlPacket::payload() const
 {
   return m_payload;
 }
 #endif  // ifdef PROXY_PACKET_DEBUG
 
+// static
+inline std::uint16_t MySqlPacket::read_uint16(const unsigned char* t_data)
+{
+  return static_cast<std::uint16_t>(t_data[0] | (t_data[1] << 8u));
+}
+
+// static
+inline std::uint32_t MySqlPacket::read_uint32(const unsigned char* t_data)
+{
+  return static_cast<std::uint32_t>(t_data[0])
+      | (static_cast<std::uint32_t>(t_data[1]) << 8u)
+      | (static_cast<std::uint32_t>(t_data[2]) << 16u)
+      | (static_cast<std::uint32_t>(t_data[3]) << 24u);
+}
+
 
 // ======== FromClientPacket ========
 
@@ -232,6 +379,11 @@ public:
   explicit FromClientPacket() = default;
   ~FromClientPacket() override = default;
 
+  static const std::size_t DEFAULT_SQL_CAPTURE_LIMIT = 64 * 1024;
+
+  /// Get the client's command.
+  MySqlCommand::Command command() const;
+
   /// Get the string representation of the client's command.
   const char* get_command_string() const;
 
@@ -241,6 +393,55 @@ public:
   /// Check if the command has the SQL field string.
   bool has_sql_string() const;
 
+  /// Get the full length of the SQL field string, it is longer than
+  /// the captured string if the string is truncated.
+  std::uint64_t sql_length() const;
+
+  /// Check if the SQL field string is captured partially.
+  bool sql_is_truncated() const;
+
+  /// Set the maximum length of the captured SQL field string.
+  /// The rest of the string is counted in the length and the digest only.
+  void set_sql_capture_limit(std::size_t t_sql_capture_limit);
+
+  /// Move the SQL field string out of the packet.
+  std::string take_sql_string();
+
+  /// Get the digest of the SQL field string.
+  std::uint64_t sql_digest() const;
+
+  /// Get the statement id of the COM_STMT_* commands,
+  /// except COM_STMT_PREPARE.
+  std::uint32_t statement_id() const;
+
+  /// Capture the payload of the current command to the buffer,
+  /// till the buffer capacity. Must be set after the 0-byte of the payload.
+  void capture_payload(std::vector<unsigned char>* t_buffer);
+
+  /// Get the decoded parameters of the command, set by the connection
+  /// for the packet logging. The pointer is valid till the next packet.
+  const std::string* statement_params() const;
+  void set_statement_params(const std::string* t_statement_params);
+
+  /// Get the prepared statement of the command, set by the connection
+  /// for the packet logging. The pointer is valid till the next packet.
+  const PreparedStatement* prepared_statement() const;
+  void set_prepared_statement(const PreparedStatement* t_prepared_statement);
+
+  /// Get the capability flags from the client's HandshakeResponse.
+  std::uint32_t capabilities() const;
+
+  /// Get the collation id from the client's HandshakeResponse.
+  unsigned char collation_id() const;
+
+  /// Get the user name from the client's HandshakeResponse
+  /// or from the last COM_CHANGE_USER, empty if it is not decoded.
+  const std::string& login_user() const;
+
+  /// Get the default schema from the client's HandshakeResponse
+  /// or from the last COM_CHANGE_USER, empty if it is not set.
+  const std::string& login_schema() const;
+
 protected:
   void connection_phase_parse(unsigned char t_payload_0,
       MySqlConnectionState& t_connection_state) override;
@@ -249,11 +450,42 @@ protected:
   void data_is_received() override;
 
 private:
+  /// Decode the user name and the schema of the captured HandshakeResponse
+  /// or COM_CHANGE_USER payload.
+  void decode_login();
+
+  /// Maximum length of the captured login payload, the user name,
+  /// the authentication data and the schema fit it.
+  static const std::size_t LOGIN_CAPTURE_LIMIT = 1024;
+
   MySqlCommand::Command m_command = MySqlCommand::Command::UNKNOWN;
   bool m_sql_data_receiving = false;
   std::string m_sql_string;
+  std::uint64_t m_sql_length = 0;
+  std::size_t m_sql_capture_limit = DEFAULT_SQL_CAPTURE_LIMIT;
+  SqlDigest m_sql_digest;
+  const PreparedStatement* m_prepared_statement = nullptr;
+  const std::string* m_statement_params = nullptr;
+  std::vector<unsigned char>* m_payload_capture = nullptr;
+
+  bool m_connection_phase_packet = false;
+  std::uint32_t m_capabilities = 0;
+  unsigned char m_collation_id = 0;
+
+  /// The login payload is captured once per session for the HandshakeResponse
+  /// and for each COM_CHANGE_USER.
+  bool m_login_capturing = false;
+  bool m_handshake_is_decoded = false;
+  std::string m_login_payload;
+  std::string m_login_user;
+  std::string m_login_schema;
 };
 
+inline MySqlCommand::Command FromClientPacket::command() const
+{
+  return m_command;
+}
+
 inline const char* FromClientPacket::get_command_string() const
 {
   return MySqlCommand::name(m_command, m_payload_length);
@@ -266,7 +498,90 @@ inline const std::string& FromClientPacket::get_sql_string() const
 
 inline bool FromClientPacket::has_sql_string() const
 {
-  return !m_sql_string.empty();
+  return 0 < m_sql_length;
+}
+
+inline std::uint64_t FromClientPacket::sql_length() const
+{
+  return m_sql_length;
+}
+
+inline bool FromClientPacket::sql_is_truncated() const
+{
+  return m_sql_string.size() < m_sql_length;
+}
+
+inline void FromClientPacket::set_sql_capture_limit(
+    std::size_t t_sql_capture_limit)
+{
+  m_sql_capture_limit = t_sql_capture_limit;
+}
+
+inline std::string FromClientPacket::take_sql_string()
+{
+  return std::move(m_sql_string);
+}
+
+inline std::uint64_t FromClientPacket::sql_digest() const
+{
+  return m_sql_digest.value();
+}
+
+inline std::uint32_t FromClientPacket::statement_id() const
+{
+  return (5 <= m_payload_head_length) ? read_uint32(&m_payload_head[1]) : 0;
+}
+
+inline void FromClientPacket::capture_payload(
+    std::vector<unsigned char>* t_buffer)
+{
+  m_payload_capture = t_buffer;
+  if(nullptr != m_payload_capture) {
+    m_payload_capture->assign(
+        m_payload_head.begin(), m_payload_head.begin() + m_payload_head_length);
+  }
+}
+
+inline const std::string* FromClientPacket::statement_params() const
+{
+  return m_statement_params;
+}
+
+inline void FromClientPacket::set_statement_params(
+    const std::string* t_statement_params)
+{
+  m_statement_params = t_statement_params;
+}
+
+inline const PreparedStatement* FromClientPacket::prepared_statement() const
+{
+  return m_prepared_statement;
+}
+
+inline void FromClientPacket::set_prepared_statement(
+    const PreparedStatement* t_prepared_statement)
+{
+  m_prepared_statement = t_prepared_statement;
+}
+
+inline std::uint32_t FromClientPacket::capabilities() const
+{
+  return m_capabilities;
+}
+
+inline unsigned char FromClientPacket::collation_id() const
+{
+  return m_collation_id;
+}
+
+inline const std::string& FromClientPacket::login_user() const
+{
+  return m_login_user;
+}
+
+inline const std::string& FromClientPacket::login_schema() const
+{
+  return m_login_schema;
 }
 
 
@@ -274,9 +589,21 @@ inline bool FromClientPacket::has_sql_string() const
 
 // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase.html
 /// Represents the data packets from the MySQL server to the client.
-/// Currently used only to set the connection state.
+/// Sets the connection state and tracks the end of the server's responses.
 class FromServerPacket : public MySqlPacket
 {
+  /// Parts of the server's response to the client's command.
+  enum class ResponseState
+  {
+    NONE,
+    FIRST_PACKET,
+    ONE_PACKET,
+    AUTHENTICATION,
+    DEFINITIONS,
+    DEFINITIONS_EOF,
+    ROWS
+  };
+
 public:
   FromServerPacket(const FromServerPacket&) = delete;
   FromServerPacket(FromServerPacket&&) = delete;
@@ -286,14 +613,118 @@ public:
   explicit FromServerPacket() = default;
   ~FromServerPacket() override = default;
 
+  /// Set the command which the server will respond to.
+  void expect_response(MySqlCommand::Command t_command,
+      std::uint64_t t_command_length,
+      std::uint32_t t_client_capabilities);
+
+  /// Check if the response to the last command is fully received.
+  bool is_response_complete() const;
+
+  /// Check if the last response is ended with the ERR packet.
+  bool is_response_failed() const;
+
+  /// Get the error code of the ERR packet of the last response,
+  /// 0 if the response is not failed.
+  std::uint16_t error_code() const;
+
+  /// Check if the status flags are received from the server.
+  bool has_status_flags() const;
+
+  /// Get the status flags from the last OK or EOF packet.
+  std::uint16_t status_flags() const;
+
+  /// Get the statement id from the last COM_STMT_PREPARE_OK.
+  std::uint32_t statement_id() const;
+
+  /// Get the number of the parameters from the last COM_STMT_PREPARE_OK.
+  std::uint16_t statement_num_params() const;
+
+  /// Get the capability flags from the server's greeting.
+  std::uint32_t capabilities() const;
+
+  /// Get the major version number from the server's greeting.
+  unsigned int version_major() const;
+
 protected:
   void connection_phase_parse(unsigned char t_payload_0,
       MySqlConnectionState& t_connection_state) override;
   void command_phase_parse(unsigned char t_payload_0) override;
   void collect_data(unsigned char t_received_byte) override;
   void data_is_received() override;
+
+private:
+  void parse_greeting();
+  void parse_ok_status();
+  void parse_eof_status();
+  void parse_error_code();
+  void response_packet_is_received();
+  void definitions_are_received();
+
+  bool m_connection_phase_packet = false;
+  std::uint32_t m_capabilities = 0;
+  unsigned int m_version_major = 0;
+  bool m_has_status_flags = false;
+  std::uint16_t m_status_flags = 0;
+
+  ResponseState m_response_state = ResponseState::NONE;
+  MySqlCommand::Command m_response_command = MySqlCommand::Command::UNKNOWN;
+  bool m_deprecate_eof = false;
+  bool m_response_failed = false;
+  std::uint16_t m_error_code = 0;
+  std::uint64_t m_definitions_left = 0;
+  std::uint64_t m_next_definitions = 0;
+  ResponseState m_after_definitions = ResponseState::NONE;
+
+  std::uint32_t m_statement_id = 0;
+  std::uint16_t m_statement_num_params = 0;
 };
 
+inline bool FromServerPacket::is_response_complete() const
+{
+  return m_response_state == ResponseState::NONE;
+}
+
+inline bool FromServerPacket::is_response_failed() const
+{
+  return m_response_failed;
+}
+
+inline std::uint16_t FromServerPacket::error_code() const
+{
+  return m_error_code;
+}
+
+inline bool FromServerPacket::has_status_flags() const
+{
+  return m_has_status_flags;
+}
+
+inline std::uint16_t FromServerPacket::status_flags() const
+{
+  return m_status_flags;
+}
+
+inline std::uint32_t FromServerPacket::statement_id() const
+{
+  return m_statement_id;
+}
+
+inline std::uint16_t FromServerPacket::statement_num_params() const
+{
+  return m_statement_num_params;
+}
+
+inline std::uint32_t FromServerPacket::capabilities() const
+{
+  return m_capabilities;
+}
+
+inline unsigned int FromServerPacket::version_major() const
+{
+  return m_version_major;
+}
+
 }  // namespace proxy
 
 #endif  // PROXY_PACKET_HPP
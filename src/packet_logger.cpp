@@ -23,6 +23,8 @@
 
 #include "packet_logger.hpp"
 
+#include <chrono>
+#include <ios>
 #include <string>
 #include <string_view>
 
@@ -30,6 +32,8 @@
 #include <iostream>
 #endif  // ifdef PROXY_PACKET_DEBUG
 
+#include "prepared_statements.hpp"
+
 namespace proxy
 {
 PacketLogger::PacketLogger(const std::string& t_log_file_path)
@@ -37,40 +41,82 @@ PacketLogger::PacketLogger(const std::string& t_log_file_path)
   m_log_file.open(t_log_file_path);
 }
 
-void PacketLogger::packet_logger(
-    const MySqlPacket* t_packet, bool t_from_client_to_server)
+void PacketLogger::client_packet_logger(const MySqlPacket* t_packet)
 {
-  // If the packet is from the client, write it to the log file.
-  if(t_from_client_to_server) {
-    const auto* client_packet = dynamic_cast<const FromClientPacket*>(t_packet);
-    if(client_packet == nullptr) {
-      return;
-    }
+  const auto* client_packet = dynamic_cast<const FromClientPacket*>(t_packet);
+  if(client_packet == nullptr) {
+    return;
+  }
 
-    // Get the string representation of the client's command.
-    const std::string_view command_string = client_packet->get_command_string();
+  // Get the string representation of the client's command.
+  const std::string_view command_string = client_packet->get_command_string();
+
+  if(!command_string.empty()) {
+    const std::lock_guard<std::mutex> lock(m_mutex);
 
-    if(!command_string.empty()) {
 #ifdef PROXY_PACKET_DEBUG
-      std::cout << command_string;
+    std::cout << command_string;
 #endif  // ifdef PROXY_PACKET_DEBUG
-      m_log_file << command_string;
+    m_log_file << command_string;
+
+    // If the command has the SQL field string, write it to the log file.
+    if(client_packet->has_sql_string()) {
+      const std::string& sql_str = client_packet->get_sql_string();
 
-      // If the command has the SQL field string, write it to the log file.
-      if(client_packet->has_sql_string()) {
-        const std::string& sql_str = client_packet->get_sql_string();
+#ifdef PROXY_PACKET_DEBUG
+      std::cout << ", SQL: " << sql_str;
+#endif  // ifdef PROXY_PACKET_DEBUG
+      m_log_file << ", SQL: " << sql_str;
 
+      // If the SQL string is too long, only its prefix is captured.
+      if(client_packet->sql_is_truncated()) {
 #ifdef PROXY_PACKET_DEBUG
-        std::cout << ", SQL: " << sql_str;
+        std::cout << "... (SQL length: " << client_packet->sql_length()
+                  << ", digest: " << std::hex << client_packet->sql_digest()
+                  << std::dec << ")";
 #endif  // ifdef PROXY_PACKET_DEBUG
-        m_log_file << ", SQL: " << sql_str;
+        m_log_file << "... (SQL length: " << client_packet->sql_length()
+                   << ", digest: " << std::hex << client_packet->sql_digest()
+                   << std::dec << ")";
       }
+    }
+
+    // If the command is for the prepared statement, write its SQL string.
+    const PreparedStatement* statement = client_packet->prepared_statement();
+    if(statement != nullptr) {
+      const auto execution_time =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              statement->m_execution_time)
+              .count();
 
 #ifdef PROXY_PACKET_DEBUG
-      std::cout << "\n";
+      std::cout << ", stmt_id: " << statement->m_id
+                << ", executions: " << statement->m_executions
+                << ", execution time: " << execution_time << " us";
 #endif  // ifdef PROXY_PACKET_DEBUG
-      m_log_file << "\n";
+      m_log_file << ", stmt_id: " << statement->m_id
+                 << ", executions: " << statement->m_executions
+                 << ", execution time: " << execution_time << " us";
+
+      // If the parameters are decoded, write them to the log file.
+      const std::string* params = client_packet->statement_params();
+      if(params != nullptr) {
+#ifdef PROXY_PACKET_DEBUG
+        std::cout << ", params: " << *params;
+#endif  // ifdef PROXY_PACKET_DEBUG
+        m_log_file << ", params: " << *params;
+      }
+
+#ifdef PROXY_PACKET_DEBUG
+      std::cout << ", SQL: " << statement->m_sql;
+#endif  // ifdef PROXY_PACKET_DEBUG
+      m_log_file << ", SQL: " << statement->m_sql;
     }
+
+#ifdef PROXY_PACKET_DEBUG
+    std::cout << "\n";
+#endif  // ifdef PROXY_PACKET_DEBUG
+    m_log_file << "\n";
   }
 }
 
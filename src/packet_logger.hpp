@@ -25,6 +25,7 @@
 #define PROXY_PACKET_LOGGER_HPP
 
 #include <fstream>
+#include <mutex>
 
 #include <boost/asio.hpp>
 
@@ -32,7 +33,8 @@
 
 namespace proxy
 {
-/// Represents the file logger for the MySQL packets.
+/// Represents the file logger for the MySQL packets, can be used
+/// from the threads of the workers.
 class PacketLogger
 {
 public:
@@ -45,19 +47,35 @@ public:
 
   explicit PacketLogger(const std::string& t_log_file_path);
 
-  /// Writes the packet to the log file.
+  /// Writes the packet to the log file. Only the client's packets
+  /// are written, the server's ones are skipped inline.
   void packet_logger(const MySqlPacket* t_packet, bool t_from_client_to_server);
 
   /// Synchronizes with the underlying storage device.
   void flush();
 
 private:
+  /// Writes the client's packet to the log file.
+  void client_packet_logger(const MySqlPacket* t_packet);
+
   /// Write the log to this file.
   std::ofstream m_log_file;
+
+  /// The log is written by the connections of all workers.
+  std::mutex m_mutex;
 };
 
+inline void PacketLogger::packet_logger(
+    const MySqlPacket* t_packet, bool t_from_client_to_server)
+{
+  if(t_from_client_to_server) {
+    client_packet_logger(t_packet);
+  }
+}
+
 inline void PacketLogger::flush()
 {
+  const std::lock_guard<std::mutex> lock(m_mutex);
   m_log_file.flush();
 }
 
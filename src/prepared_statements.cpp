@@ -0,0 +1,136 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "prepared_statements.hpp"
+
+#include <utility>
+
+namespace proxy
+{
+PreparedStatement& PreparedStatements::add(std::uint32_t t_id,
+    std::uint16_t t_num_params,
+    std::uint64_t t_digest,
+    std::string&& t_sql)
+{
+  // Keep the load factor not greater than 1/2.
+  if(2 * (m_size + 1) > m_slots.size()) {
+    grow();
+  }
+
+  std::size_t index = slot_index(t_id);
+  while(m_used[index] && m_slots[index].m_id != t_id) {
+    index = (index + 1) & (m_slots.size() - 1);
+  }
+  if(!m_used[index]) {
+    m_used[index] = true;
+    ++m_size;
+  }
+
+  PreparedStatement& statement = m_slots[index];
+  statement.m_id = t_id;
+  statement.m_num_params = t_num_params;
+  statement.m_param_types.assign(t_num_params, 0);
+  statement.m_param_types_known = false;
+  statement.m_digest = t_digest;
+  statement.m_sql = std::move(t_sql);
+  statement.m_executions = 0;
+  statement.m_execution_time = {};
+  return statement;
+}
+
+PreparedStatement* PreparedStatements::find(std::uint32_t t_id)
+{
+  if(0 == m_size) {
+    return nullptr;
+  }
+
+  std::size_t index = slot_index(t_id);
+  while(m_used[index]) {
+    if(m_slots[index].m_id == t_id) {
+      return &m_slots[index];
+    }
+    index = (index + 1) & (m_slots.size() - 1);
+  }
+  return nullptr;
+}
+
+void PreparedStatements::remove(std::uint32_t t_id)
+{
+  PreparedStatement* statement = find(t_id);
+  if(nullptr == statement) {
+    return;
+  }
+
+  const std::size_t mask = m_slots.size() - 1;
+  std::size_t hole = static_cast<std::size_t>(statement - m_slots.data());
+  m_used[hole] = false;
+  m_slots[hole].m_sql.clear();
+  m_slots[hole].m_param_types.clear();
+  --m_size;
+
+  // Shift back the following statements of the probe sequence,
+  // so the search does not stop at the removed slot.
+  std::size_t index = (hole + 1) & mask;
+  while(m_used[index]) {
+    const std::size_t home = slot_index(m_slots[index].m_id);
+    if(((index - home) & mask) >= ((index - hole) & mask)) {
+      m_slots[hole] = std::move(m_slots[index]);
+      m_used[hole] = true;
+      m_used[index] = false;
+      hole = index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+void PreparedStatements::clear()
+{
+  m_slots.clear();
+  m_slots.shrink_to_fit();
+  m_used.clear();
+  m_used.shrink_to_fit();
+  m_size = 0;
+}
+
+void PreparedStatements::grow()
+{
+  std::vector<PreparedStatement> slots(
+      m_slots.empty() ? INITIAL_CAPACITY : 2 * m_slots.size());
+  std::vector<bool> used(slots.size(), false);
+
+  m_slots.swap(slots);
+  m_used.swap(used);
+
+  for(std::size_t i = 0; i < slots.size(); ++i) {
+    if(used[i]) {
+      std::size_t index = slot_index(slots[i].m_id);
+      while(m_used[index]) {
+        index = (index + 1) & (m_slots.size() - 1);
+      }
+      m_slots[index] = std::move(slots[i]);
+      m_used[index] = true;
+    }
+  }
+}
+
+}  // namespace proxy
@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_PREPARED_STATEMENTS_HPP
+#define PROXY_PREPARED_STATEMENTS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace proxy
+{
+/// Represents the statement prepared by the client with COM_STMT_PREPARE.
+struct PreparedStatement
+{
+  /// Statement id from the server's COM_STMT_PREPARE_OK.
+  std::uint32_t m_id = 0;
+
+  /// Number of the statement parameters.
+  std::uint16_t m_num_params = 0;
+
+  /// Types of the parameters from the last COM_STMT_EXECUTE
+  /// with new-params-bound-flag, used if the types are not sent again.
+  std::vector<std::uint16_t> m_param_types;
+  bool m_param_types_known = false;
+
+  /// Digest of the statement's SQL string.
+  std::uint64_t m_digest = 0;
+
+  /// SQL string of the statement.
+  std::string m_sql;
+
+  /// Number of the COM_STMT_EXECUTE commands for the statement.
+  std::uint64_t m_executions = 0;
+
+  /// Summary time of the statement executions.
+  std::chrono::steady_clock::duration m_execution_time{};
+};
+
+
+/// The prepared statements of the connection, mapped by the statement id.
+/// The open addressing hash table with the linear probing,
+/// the statements are stored in the table itself.
+class PreparedStatements
+{
+public:
+  PreparedStatements(const PreparedStatements&) = delete;
+  PreparedStatements(PreparedStatements&&) = delete;
+  PreparedStatements& operator=(const PreparedStatements&) = delete;
+  PreparedStatements& operator=(PreparedStatements&&) = delete;
+
+  ~PreparedStatements() = default;
+
+  explicit PreparedStatements() = default;
+
+  /// Add the statement, replaces the statement with the same id.
+  PreparedStatement& add(std::uint32_t t_id,
+      std::uint16_t t_num_params,
+      std::uint64_t t_digest,
+      std::string&& t_sql);
+
+  /// Find the statement by the id, nullptr if it is not found.
+  /// The pointer is valid till the next add() or remove().
+  PreparedStatement* find(std::uint32_t t_id);
+
+  /// Remove the statement by the id.
+  void remove(std::uint32_t t_id);
+
+  /// Remove all statements.
+  void clear();
+
+  /// Get the number of the statements.
+  std::size_t size() const;
+
+private:
+  /// Initial number of the table slots, must be the power of 2.
+  static const std::size_t INITIAL_CAPACITY = 8;
+
+  std::size_t slot_index(std::uint32_t t_id) const;
+  void grow();
+
+  /// The table slots, the slot is empty if its m_used is false.
+  std::vector<PreparedStatement> m_slots;
+  std::vector<bool> m_used;
+  std::size_t m_size = 0;
+};
+
+inline std::size_t PreparedStatements::size() const
+{
+  return m_size;
+}
+
+inline std::size_t PreparedStatements::slot_index(std::uint32_t t_id) const
+{
+  // Fibonacci hashing of the sequential statement ids.
+  return static_cast<std::size_t>(
+             (static_cast<std::uint64_t>(t_id) * 0x9E3779B97F4A7C15ULL) >> 32u)
+      & (m_slots.size() - 1);
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_PREPARED_STATEMENTS_HPP
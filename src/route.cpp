@@ -0,0 +1,124 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "route.hpp"
+
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "endpoint.hpp"
+
+namespace proxy
+{
+Route::Route(boost::asio::io_context& t_io_context,
+    TimingWheel& t_timing_wheel,
+    const RouteSettings& t_settings,
+    std::size_t t_workers,
+    std::shared_ptr<PacketLogger> t_packet_logger)
+    : m_settings(t_settings)
+    , m_packet_logger(std::move(t_packet_logger))
+{
+  // Set the MySQL servers for the server sockets, the main one is the first.
+  m_backends.add(std::make_unique<Backend>(t_io_context, m_settings.m_server,
+      resolve_endpoint(t_io_context, m_settings.m_server),
+      m_settings.m_connection, t_timing_wheel));
+  for(const std::string& backup_server :
+      m_settings.m_connection.m_backup_servers) {
+    m_backends.add(std::make_unique<Backend>(t_io_context, backup_server,
+        resolve_endpoint(t_io_context, backup_server), m_settings.m_connection,
+        t_timing_wheel));
+  }
+
+  m_local_replies.reserve(t_workers);
+  m_transaction_stats.reserve(t_workers);
+  m_account_stats.reserve(t_workers);
+  for(std::size_t i = 0; i < t_workers; ++i) {
+    m_local_replies.push_back(std::make_unique<LocalReply>());
+    m_transaction_stats.push_back(std::make_unique<TransactionStats>());
+    m_account_stats.push_back(std::make_unique<AccountStats>());
+  }
+
+  // The new ticket keys of the reloaded route, the clients make
+  // the full handshake once after the reload.
+  const TlsSettings& tls_settings = m_settings.m_connection.m_tls;
+  if(tls_settings.is_enabled()) {
+    const TicketKeys ticket_keys = TlsContext::make_ticket_keys();
+    m_tls_contexts.reserve(t_workers);
+    for(std::size_t i = 0; i < t_workers; ++i) {
+      m_tls_contexts.push_back(
+          std::make_unique<TlsContext>(tls_settings, ticket_keys));
+    }
+  }
+
+  if(m_settings.m_connection.m_mirror.is_enabled()) {
+    m_mirror =
+        std::make_shared<Mirror>(t_io_context, m_settings.m_connection.m_mirror);
+  }
+
+  const ShardSettings& shard_settings = m_settings.m_connection.m_shard;
+  if(shard_settings.is_enabled()) {
+    m_shard_router =
+        std::make_shared<ShardRouter>(t_io_context, shard_settings);
+  } else if(!shard_settings.m_servers.empty()) {
+    std::cout << "Route " << m_settings.m_name
+              << ": the shards are not used without shard-proxy-account=1\n";
+  }
+
+  if(m_settings.m_connection.m_table_stats) {
+    m_table_stats.reserve(t_workers);
+    for(std::size_t i = 0; i < t_workers; ++i) {
+      m_table_stats.push_back(std::make_unique<TableStats>());
+    }
+  }
+}
+
+void Route::start()
+{
+  m_backends.start_health_checks();
+}
+
+void Route::stop()
+{
+  m_backends.stop();
+}
+
+void Route::print_table_stats() const
+{
+  if(!m_table_stats.empty()) {
+    TableStats::print(m_settings.m_name, m_table_stats);
+  }
+}
+
+void Route::print_transaction_stats() const
+{
+  TransactionStats::print(m_settings.m_name, m_transaction_stats);
+}
+
+void Route::print_account_stats() const
+{
+  AccountStats::print(
+      m_settings.m_name, m_account_users, m_account_schemas, m_account_stats);
+}
+
+}  // namespace proxy
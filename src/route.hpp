@@ -0,0 +1,240 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_ROUTE_HPP
+#define PROXY_ROUTE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "account_stats.hpp"
+#include "backend.hpp"
+#include "local_reply.hpp"
+#include "mirror.hpp"
+#include "packet_logger.hpp"
+#include "settings.hpp"
+#include "shard.hpp"
+#include "table_stats.hpp"
+#include "timing_wheel.hpp"
+#include "tls_context.hpp"
+#include "transaction_stats.hpp"
+
+namespace proxy
+{
+class Route;
+
+using RoutePtr = std::shared_ptr<Route>;
+
+/// The snapshot of the route configuration: its settings, MySQL servers
+/// and logger. The snapshot is not changed after its creation, the reload
+/// creates the new one. The connections keep their snapshot alive
+/// till they are closed.
+class Route
+{
+public:
+  Route(const Route&) = delete;
+  Route(Route&&) = delete;
+  Route& operator=(const Route&) = delete;
+  Route& operator=(Route&&) = delete;
+
+  ~Route() = default;
+
+  /// Construct the route, its MySQL servers are checked
+  /// in the io_context of the accepting thread.
+  explicit Route(boost::asio::io_context& t_io_context,
+      TimingWheel& t_timing_wheel,
+      const RouteSettings& t_settings,
+      std::size_t t_workers,
+      std::shared_ptr<PacketLogger> t_packet_logger);
+
+  /// Start the health checks of the MySQL servers.
+  void start();
+
+  /// Stop the health checks, the route is replaced by the reload.
+  void stop();
+
+  /// Get the settings of the route.
+  const RouteSettings& settings() const;
+
+  /// Get the MySQL servers of the route.
+  BackendPool& backends();
+
+  /// Get the logger of the route.
+  PacketLogger& packet_logger();
+  const std::shared_ptr<PacketLogger>& shared_packet_logger() const;
+
+  /// Get the local replies of the route for the worker.
+  LocalReply& local_reply(std::size_t t_worker_index);
+
+  /// Get the TLS contexts of the route for the worker,
+  /// nullptr if the route has no TLS settings.
+  TlsContext* tls_context(std::size_t t_worker_index);
+
+  /// Get the mirror server of the route, nullptr if the sessions
+  /// are not mirrored.
+  const std::shared_ptr<Mirror>& mirror() const;
+
+  /// Get the shards of the route, nullptr if the queries
+  /// are not routed to the shards.
+  const std::shared_ptr<ShardRouter>& shard_router() const;
+
+  /// Get the table statistics of the route for the worker,
+  /// nullptr if the tables are not counted.
+  TableStats* table_stats(std::size_t t_worker_index);
+
+  /// Print the table statistics summed over the workers,
+  /// if the tables are counted.
+  void print_table_stats() const;
+
+  /// Get the transaction statistics of the route for the worker.
+  TransactionStats& transaction_stats(std::size_t t_worker_index);
+
+  /// Print the transaction statistics summed over the workers.
+  void print_transaction_stats() const;
+
+  /// Get the interned user names of the route.
+  AccountNames& account_users();
+
+  /// Get the interned schema names of the route.
+  AccountNames& account_schemas();
+
+  /// Get the user and schema statistics of the route for the worker.
+  AccountStats& account_stats(std::size_t t_worker_index);
+
+  /// Print the user and schema statistics summed over the workers.
+  void print_account_stats() const;
+
+private:
+  const RouteSettings m_settings;
+
+  /// The MySQL servers for the connections.
+  BackendPool m_backends;
+
+  /// Packet logger which writes the SQL requests to the log file,
+  /// shared by the routes with the same log file.
+  std::shared_ptr<PacketLogger> m_packet_logger;
+
+  /// The answers to the commands which do not need the MySQL server,
+  /// for each worker.
+  std::vector<std::unique_ptr<LocalReply>> m_local_replies;
+
+  /// The TLS contexts for each worker, empty if the route has
+  /// no TLS settings.
+  std::vector<std::unique_ptr<TlsContext>> m_tls_contexts;
+
+  /// The mirror server, shared with the mirror sessions which can outlive
+  /// their connections.
+  std::shared_ptr<Mirror> m_mirror;
+
+  /// The shards, shared with the shard sessions which can outlive
+  /// their connections.
+  std::shared_ptr<ShardRouter> m_shard_router;
+
+  /// The table statistics for each worker, empty if the tables
+  /// are not counted.
+  std::vector<std::unique_ptr<TableStats>> m_table_stats;
+
+  /// The transaction statistics for each worker.
+  std::vector<std::unique_ptr<TransactionStats>> m_transaction_stats;
+
+  /// The user and schema names, their ids are shared by the workers.
+  AccountNames m_account_users;
+  AccountNames m_account_schemas;
+
+  /// The user and schema statistics for each worker.
+  std::vector<std::unique_ptr<AccountStats>> m_account_stats;
+};
+
+inline const RouteSettings& Route::settings() const
+{
+  return m_settings;
+}
+
+inline BackendPool& Route::backends()
+{
+  return m_backends;
+}
+
+inline PacketLogger& Route::packet_logger()
+{
+  return *m_packet_logger;
+}
+
+inline const std::shared_ptr<PacketLogger>& Route::shared_packet_logger() const
+{
+  return m_packet_logger;
+}
+
+inline LocalReply& Route::local_reply(std::size_t t_worker_index)
+{
+  return *m_local_replies[t_worker_index];
+}
+
+inline TlsContext* Route::tls_context(std::size_t t_worker_index)
+{
+  return m_tls_contexts.empty() ? nullptr
+                                : m_tls_contexts[t_worker_index].get();
+}
+
+inline const std::shared_ptr<Mirror>& Route::mirror() const
+{
+  return m_mirror;
+}
+
+inline const std::shared_ptr<ShardRouter>& Route::shard_router() const
+{
+  return m_shard_router;
+}
+
+inline TableStats* Route::table_stats(std::size_t t_worker_index)
+{
+  return m_table_stats.empty() ? nullptr
+                               : m_table_stats[t_worker_index].get();
+}
+
+inline TransactionStats& Route::transaction_stats(std::size_t t_worker_index)
+{
+  return *m_transaction_stats[t_worker_index];
+}
+
+inline AccountNames& Route::account_users()
+{
+  return m_account_users;
+}
+
+inline AccountNames& Route::account_schemas()
+{
+  return m_account_schemas;
+}
+
+inline AccountStats& Route::account_stats(std::size_t t_worker_index)
+{
+  return *m_account_stats[t_worker_index];
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_ROUTE_HPP
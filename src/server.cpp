@@ -23,101 +23,354 @@
 
 #include "server.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <csignal>
-#include <utility>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
 
 namespace proxy
 {
-Server::Server(const std::string& t_client_address,
-    const std::string& t_client_port,
-    const std::string& t_server_address,
-    const std::string& t_server_port,
-    const std::string& t_log_file_path)
+Server::Server(const ProxySettings& t_settings,
+    const std::string& t_config_file_path,
+    const std::vector<std::string>& t_command_line)
     : m_io_context(1)
     , m_signals(m_io_context)
-    , m_acceptor(m_io_context)
-    , m_packet_logger(t_log_file_path)
+    , m_reload_signals(m_io_context)
+    , m_config_file_path(t_config_file_path)
+    , m_drain_signals(m_io_context)
+    , m_upgrade_signals(m_io_context)
+    , m_command_line(t_command_line)
+    , m_drain_timeout(t_settings.m_drain_timeout)
+    , m_stats_signals(m_io_context)
+    , m_timing_wheel(m_io_context)
+    , m_admission(t_settings.m_max_connections,
+          t_settings.m_max_connections_per_ip)
+    , m_retire_timer([this]() -> void { release_retired_routes(); })
 {
   // Register to handle the signals that indicate when the server should exit.
   // It is safe to register for the same signal multiple times in a program,
   // provided all registration for the specified signal is made through Asio.
   m_signals.add(SIGINT);
   m_signals.add(SIGTERM);
+
+  do_await_stop();
+
 #if defined(SIGQUIT)
-  m_signals.add(SIGQUIT);
+  m_drain_signals.add(SIGQUIT);
+  do_await_drain();
 #endif  // if defined(SIGQUIT)
 
-  do_await_stop();
+#if defined(SIGHUP)
+  m_reload_signals.add(SIGHUP);
+  do_await_reload();
+#endif  // if defined(SIGHUP)
 
-  // Start listening on the client socket.
-  boost::asio::ip::tcp::resolver resolver(m_io_context);
-  const boost::asio::ip::tcp::endpoint client_ep =
-      *resolver.resolve(t_client_address, t_client_port).begin();
+#if defined(SIGUSR2)
+  m_upgrade_signals.add(SIGUSR2);
+  do_await_upgrade();
+#endif  // if defined(SIGUSR2)
 
-  // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-  m_acceptor.open(client_ep.protocol());
-  m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-  m_acceptor.bind(client_ep);
-  m_acceptor.listen();
+  m_workers.reserve(t_settings.m_threads);
+  for(std::size_t i = 0; i < t_settings.m_threads; ++i) {
+    m_workers.push_back(std::make_unique<Worker>(
+        i, m_admission, t_settings.m_max_connecting));
+  }
 
-  // Set the server endpoint for the server socket.
-  m_server_endpoint =
-      *resolver.resolve(t_server_address, t_server_port).begin();
+  // The old process of the upgrade stops accepting after the confirmation.
+  SocketHandoff handoff;
+  set_routes(t_settings, &handoff);
+  handoff.confirm();
 
-  do_accept();
+#if defined(SIGUSR1)
+  m_memory_baseline = read_memory_stats();
+  m_stats_signals.add(SIGUSR1);
+  do_await_stats();
+#endif  // if defined(SIGUSR1)
 }
 
 void Server::run()
 {
+  std::vector<std::thread> threads;
+  threads.reserve(m_workers.size());
+  m_running_workers = m_workers.size();
+  for(const auto& worker : m_workers) {
+    threads.emplace_back([this, &worker]() {
+      worker->run();
+
+      // The drained process exits after the last worker.
+      boost::asio::post(m_io_context, [this]() {
+        if(0 == --m_running_workers) {
+          m_signals.cancel();
+        }
+      });
+    });
+  }
+
   // The io_context::run() call will block until all asynchronous operations
   // have finished. While the server is running, there is always at least one
   // asynchronous operation outstanding: the asynchronous accept call waiting
   // for new incoming connections.
   m_io_context.run();
-}
 
-void Server::do_accept()
-{
-  m_acceptor.async_accept([this](boost::system::error_code l_error,
-                              boost::asio::ip::tcp::socket l_client_socket) {
-    // Check whether the server was stopped by a signal before this
-    // completion handler had a chance to run.
-    if(!m_acceptor.is_open()) {
-      return;
-    }
-
-    if(!l_error) {
-      m_connection_manager.start(std::make_shared<Connection>(
-          std::move(l_client_socket), m_server_endpoint,
-
-          // Set the actions for the connection stop.
-          [this](ConnectionPtr l_connection) -> void {
-            m_connection_manager.stop(std::move(l_connection));
-            m_packet_logger.flush();
-          },
-
-          // Set the actions for the packet logging.
-          [this](const MySqlPacket* l_packet,
-              bool l_from_client_to_server) -> void {
-            m_packet_logger.packet_logger(l_packet, l_from_client_to_server);
-          }));
-    }
-
-    do_accept();
-  });
+  for(auto& thread : threads) {
+    thread.join();
+  }
 }
 
 void Server::do_await_stop()
 {
   m_signals.async_wait(
-      [this](boost::system::error_code /*l_error*/, int /*l_signo*/) {
+      [this](boost::system::error_code l_error, int /*l_signo*/) {
+        if(l_error) {
+          return;
+        }
+
         // The server is stopped by cancelling all outstanding asynchronous
         // operations. Once all operations have finished the io_context::run()
         // call will exit.
-        m_acceptor.close();
-        m_connection_manager.stop_all();
-        m_packet_logger.flush();
+        stop_accepting();
+        for(const auto& worker : m_workers) {
+          worker->stop();
+        }
+      });
+}
+
+void Server::do_await_reload()
+{
+  m_reload_signals.async_wait(
+      [this](boost::system::error_code l_error, int /*l_signo*/) {
+        if(l_error) {
+          return;
+        }
+
+        if(m_config_file_path.empty()) {
+          std::cout << "Reload: no configuration file\n";
+        } else {
+          // The current routes are kept if the new configuration is wrong.
+          try {
+            ProxySettings settings;
+            settings.load_file(m_config_file_path);
+            if(settings.m_threads != m_workers.size()) {
+              std::cout << "Reload: the number of threads is not changed"
+                           " without the restart\n";
+            }
+            set_routes(settings);
+            std::cout << "Reload: " << m_routes.size() << " routes\n";
+          } catch(const std::exception& e) {
+            std::cout << "Reload failed: " << e.what() << "\n";
+          }
+        }
+
+        do_await_reload();
       });
 }
 
+void Server::do_await_drain()
+{
+  m_drain_signals.async_wait(
+      [this](boost::system::error_code l_error, int /*l_signo*/) {
+        if(l_error) {
+          return;
+        }
+
+        // The open connections are served till their command boundaries
+        // or the drain timeout, a stop signal stops them at once.
+        std::cout << "Drain: closing the connections\n";
+        stop_accepting();
+        for(const auto& worker : m_workers) {
+          worker->drain(m_drain_timeout);
+        }
+      });
+}
+
+void Server::do_await_upgrade()
+{
+  m_upgrade_signals.async_wait(
+      [this](boost::system::error_code l_error, int /*l_signo*/) {
+        if(l_error) {
+          return;
+        }
+
+        std::vector<HandoffSocket> sockets;
+        for(const auto& listener : m_listeners) {
+          sockets.push_back(
+              HandoffSocket{listener->address(), listener->native_handle()});
+        }
+
+        // The accepting is blocked till the new process is ready,
+        // the kernel queues the connections meanwhile.
+        if(!SocketHandoff::upgrade(m_command_line, sockets,
+               std::chrono::seconds(10))) {
+          std::cout << "Upgrade failed: the new process is not ready\n";
+          do_await_upgrade();
+          return;
+        }
+
+        std::cout << "Upgrade: the new process is ready,"
+                     " draining the connections\n";
+        stop_accepting();
+        for(const auto& worker : m_workers) {
+          worker->drain(m_drain_timeout);
+        }
+      });
+}
+
+void Server::do_await_stats()
+{
+  m_stats_signals.async_wait(
+      [this](boost::system::error_code l_error, int /*l_signo*/) {
+        if(l_error) {
+          return;
+        }
+
+        // The growth since the start is divided by the connections,
+        // the allocator keeps the freed memory of the closed connections.
+        const MemoryStats stats = read_memory_stats();
+        const std::size_t connections = m_admission.connections();
+        std::cout << "Memory: " << connections << " connections, resident "
+                  << stats.m_resident << " bytes, heap " << stats.m_heap_in_use
+                  << " bytes in use and " << stats.m_heap_free
+                  << " bytes free";
+        if(0 < connections) {
+          const std::size_t resident =
+              (stats.m_resident > m_memory_baseline.m_resident)
+              ? stats.m_resident - m_memory_baseline.m_resident
+              : 0;
+          const std::size_t heap =
+              (stats.m_heap_in_use > m_memory_baseline.m_heap_in_use)
+              ? stats.m_heap_in_use - m_memory_baseline.m_heap_in_use
+              : 0;
+          std::cout << ", per connection: resident " << resident / connections
+                    << " bytes, heap " << heap / connections << " bytes";
+        }
+        std::cout << "\n";
+
+        for(const RoutePtr& route : m_routes) {
+          if(route->mirror()) {
+            route->mirror()->print_stats(route->settings().m_name);
+          }
+          if(route->shard_router()) {
+            route->shard_router()->print_stats(route->settings().m_name);
+          }
+          route->print_transaction_stats();
+          route->print_account_stats();
+          route->print_table_stats();
+        }
+
+        do_await_stats();
+      });
+}
+
+void Server::stop_accepting()
+{
+  m_reload_signals.cancel();
+  m_drain_signals.cancel();
+  m_upgrade_signals.cancel();
+  m_stats_signals.cancel();
+  for(const auto& listener : m_listeners) {
+    listener->stop();
+  }
+  for(const auto& route : m_routes) {
+    route->stop();
+    route->packet_logger().flush();
+  }
+  for(const auto& route : m_retired_routes) {
+    route->stop();
+  }
+  m_timing_wheel.stop();
+}
+
+void Server::set_routes(
+    const ProxySettings& t_settings, SocketHandoff* t_handoff)
+{
+  // Make all new snapshots and listeners before any change,
+  // an error leaves the current ones.
+  std::vector<RoutePtr> routes;
+  std::vector<ListenerPtr> listeners;
+  for(const RouteSettings& route_settings : t_settings.m_routes) {
+    // The log file which is already open is shared with the new route.
+    std::shared_ptr<PacketLogger> packet_logger;
+    for(const auto& route : m_routes) {
+      if(route->settings().m_log_file == route_settings.m_log_file) {
+        packet_logger = route->shared_packet_logger();
+        break;
+      }
+    }
+    if(!packet_logger) {
+      packet_logger =
+          std::make_shared<PacketLogger>(route_settings.m_log_file);
+    }
+
+    routes.push_back(std::make_shared<Route>(m_io_context, m_timing_wheel,
+        route_settings, m_workers.size(), std::move(packet_logger)));
+
+    // The listener on the same address keeps its socket.
+    const auto listener_it = std::find_if(m_listeners.begin(),
+        m_listeners.end(), [&route_settings](const ListenerPtr& l_listener) {
+          return l_listener->address() == route_settings.m_listen;
+        });
+    if(m_listeners.end() != listener_it) {
+      listeners.push_back(*listener_it);
+    } else {
+      const int handoff_fd = (nullptr != t_handoff)
+          ? t_handoff->take_socket(route_settings.m_listen)
+          : -1;
+      listeners.push_back(std::make_shared<Listener>(m_io_context,
+          route_settings.m_listen, m_workers, m_admission, t_settings,
+          handoff_fd));
+    }
+  }
+
+  // Publish the new snapshots, the connections which are accepted
+  // with the old ones keep them till the connections are closed.
+  for(const auto& listener : m_listeners) {
+    if(listeners.end()
+        == std::find(listeners.begin(), listeners.end(), listener)) {
+      listener->stop();
+    }
+  }
+  for(std::size_t i = 0; i < listeners.size(); ++i) {
+    const bool is_new_listener = m_listeners.end()
+        == std::find(m_listeners.begin(), m_listeners.end(), listeners[i]);
+    listeners[i]->set_route(routes[i]);
+    if(is_new_listener) {
+      listeners[i]->start();
+    }
+  }
+  for(const auto& route : routes) {
+    route->start();
+  }
+  for(const auto& route : m_routes) {
+    route->stop();
+    m_retired_routes.push_back(route);
+  }
+
+  m_routes = std::move(routes);
+  m_listeners = std::move(listeners);
+
+  // The stopped routes are not released by this handler, the aborted
+  // health checks of their backends are completed after it.
+  if(!m_retired_routes.empty() && !m_retire_timer.is_armed()) {
+    m_timing_wheel.arm(m_retire_timer, std::chrono::seconds(1));
+  }
+}
+
+void Server::release_retired_routes()
+{
+  // The route is used only by the server if its use count is 1,
+  // the workers have no copy to increment it.
+  m_retired_routes.erase(std::remove_if(m_retired_routes.begin(),
+                             m_retired_routes.end(),
+                             [](const RoutePtr& l_route) {
+                               return 1 == l_route.use_count();
+                             }),
+      m_retired_routes.end());
+
+  if(!m_retired_routes.empty()) {
+    m_timing_wheel.arm(m_retire_timer, std::chrono::seconds(1));
+  }
+}
+
 }  // namespace proxy
@@ -24,12 +24,21 @@
 #ifndef PROXY_SERVER_HPP
 #define PROXY_SERVER_HPP
 
+#include <chrono>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 
-#include "connection_manager.hpp"
-#include "packet_logger.hpp"
+#include "admission.hpp"
+#include "listener.hpp"
+#include "memory_stats.hpp"
+#include "route.hpp"
+#include "settings.hpp"
+#include "socket_handoff.hpp"
+#include "timing_wheel.hpp"
+#include "worker.hpp"
 
 namespace proxy
 {
@@ -44,42 +53,97 @@ public:
 
   ~Server() = default;
 
-  /// Construct the server to listen on the specified client TCP address and port,
-  /// to connect to the specified server TCP address and port,
-  /// and to write SQL requests to the specified log file.
-  explicit Server(const std::string& t_client_address,
-      const std::string& t_client_port,
-      const std::string& t_server_address,
-      const std::string& t_server_port,
-      const std::string& t_log_file_path);
-
-  /// Run the server's io_context loop.
+  /// Construct the server to listen on the addresses of the routes,
+  /// to connect to the MySQL servers of the routes,
+  /// and to write SQL requests to the log files of the routes.
+  /// The routes are reloaded from the configuration file on SIGHUP
+  /// if the file path is not empty. On SIGQUIT the connections are closed
+  /// at their command boundaries before the exit. On SIGUSR2 the process is upgraded,
+  /// the command line starts the new process which gets the listening
+  /// sockets, then this process serves its open connections and exits.
+  /// On SIGUSR1 the memory usage of the connections and the counters
+  /// of the mirror servers, of the shards, of the transactions,
+  /// of the users and schemas and of the tables are printed.
+  explicit Server(const ProxySettings& t_settings,
+      const std::string& t_config_file_path,
+      const std::vector<std::string>& t_command_line);
+
+  /// Run the server's io_context loop and the workers' threads.
   void run();
 
 private:
-  /// Perform an asynchronous accept operation.
-  void do_accept();
-
   /// Wait for a request to stop the server.
   void do_await_stop();
 
-  /// The io_context used to perform asynchronous operations.
+  /// Wait for a request to reload the configuration.
+  void do_await_reload();
+
+  /// Wait for a request to close the connections at their command
+  /// boundaries and exit.
+  void do_await_drain();
+
+  /// Wait for a request to upgrade the process.
+  void do_await_upgrade();
+
+  /// Wait for a request to print the memory usage, the mirror,
+  /// the shard, the transaction, the user and schema and the table counters.
+  void do_await_stats();
+
+  /// Stop the listeners, the health checks and the waiting
+  /// for the reload and the upgrade.
+  void stop_accepting();
+
+  /// Replace the routes with the new ones from the settings.
+  /// The new listeners take the sockets of the handoff if it is not null.
+  void set_routes(
+      const ProxySettings& t_settings, SocketHandoff* t_handoff = nullptr);
+
+  /// Destroy the replaced routes which are not used by the connections.
+  void release_retired_routes();
+
+  /// The io_context used to accept the connections and check the health
+  /// of the MySQL servers.
   boost::asio::io_context m_io_context;
 
   /// The signal_set is used to register for process termination notifications.
   boost::asio::signal_set m_signals;
 
-  /// Acceptor used to listen for incoming connections.
-  boost::asio::ip::tcp::acceptor m_acceptor;
+  /// The signal_set for the configuration reload notifications.
+  boost::asio::signal_set m_reload_signals;
+  const std::string m_config_file_path;
+
+  /// The signal_set for the graceful stop notifications.
+  boost::asio::signal_set m_drain_signals;
+
+  /// The signal_set for the upgrade notifications.
+  boost::asio::signal_set m_upgrade_signals;
+  const std::vector<std::string> m_command_line;
+  const std::chrono::milliseconds m_drain_timeout;
+
+  /// The signal_set for the statistics notifications and the memory usage
+  /// without the connections, the connections use the rest.
+  boost::asio::signal_set m_stats_signals;
+  MemoryStats m_memory_baseline;
+
+  /// The timeouts of the health checks, must outlive the routes.
+  TimingWheel m_timing_wheel;
+
+  /// The limits of the connections of the workers.
+  Admission m_admission;
 
-  /// Endpoint for the server socket.
-  boost::asio::ip::tcp::endpoint m_server_endpoint;
+  /// The workers which serve the connections, one thread for each.
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::size_t m_running_workers = 0;
 
-  /// The connection manager which owns all live connections.
-  ConnectionManager m_connection_manager;
+  /// The snapshots of the routes from the listeners to the MySQL servers,
+  /// published to the workers with the accepted connections.
+  std::vector<RoutePtr> m_routes;
+  std::vector<ListenerPtr> m_listeners;
 
-  /// Packet logger which writes the SQL requests to the log file.
-  PacketLogger m_packet_logger;
+  /// The replaced routes which can be used by the connections yet.
+  /// They are destroyed in this thread, their health checks use it.
+  std::vector<RoutePtr> m_retired_routes;
+  WheelTimer m_retire_timer;
 };
 
 }  // namespace proxy
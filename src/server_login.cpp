@@ -0,0 +1,296 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "server_login.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include <openssl/evp.h>
+
+#include "packet.hpp"
+
+namespace proxy
+{
+namespace
+{
+/// Digest of the concatenated data.
+template<std::size_t Length>
+std::array<unsigned char, Length> digest(const EVP_MD* t_md,
+    const unsigned char* t_data,
+    std::size_t t_length,
+    const unsigned char* t_data_2 = nullptr,
+    std::size_t t_length_2 = 0)
+{
+  std::array<unsigned char, Length> result{};
+  EVP_MD_CTX* context = EVP_MD_CTX_new();
+  if(nullptr != context) {
+    EVP_DigestInit_ex(context, t_md, nullptr);
+    EVP_DigestUpdate(context, t_data, t_length);
+    if(0 < t_length_2) {
+      EVP_DigestUpdate(context, t_data_2, t_length_2);
+    }
+    EVP_DigestFinal_ex(context, result.data(), nullptr);
+    EVP_MD_CTX_free(context);
+  }
+  return result;
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_authentication_methods_native_password_authentication.html
+/// SHA1(password) XOR SHA1(scramble + SHA1(SHA1(password))).
+std::string native_password_auth(
+    const std::string& t_password, const std::vector<unsigned char>& t_scramble)
+{
+  const auto* password =
+      reinterpret_cast<const unsigned char*>(t_password.data());
+  const auto hash = digest<20>(EVP_sha1(), password, t_password.size());
+  const auto hash_2 = digest<20>(EVP_sha1(), hash.data(), hash.size());
+  const auto hash_3 = digest<20>(EVP_sha1(), t_scramble.data(),
+      t_scramble.size(), hash_2.data(), hash_2.size());
+
+  std::string auth(hash.size(), '\0');
+  for(std::size_t i = 0; i < hash.size(); ++i) {
+    auth[i] = static_cast<char>(hash[i] ^ hash_3[i]);
+  }
+  return auth;
+}
+
+// See https://dev.mysql.com/doc/dev/mysql-server/latest/page_caching_sha2_authentication_exchanges.html
+/// SHA256(password) XOR SHA256(SHA256(SHA256(password)) + scramble).
+std::string caching_sha2_password_auth(
+    const std::string& t_password, const std::vector<unsigned char>& t_scramble)
+{
+  const auto* password =
+      reinterpret_cast<const unsigned char*>(t_password.data());
+  const auto hash = digest<32>(EVP_sha256(), password, t_password.size());
+  const auto hash_2 = digest<32>(EVP_sha256(), hash.data(), hash.size());
+  const auto hash_3 = digest<32>(EVP_sha256(), hash_2.data(), hash_2.size(),
+      t_scramble.data(), t_scramble.size());
+
+  std::string auth(hash.size(), '\0');
+  for(std::size_t i = 0; i < hash.size(); ++i) {
+    auth[i] = static_cast<char>(hash[i] ^ hash_3[i]);
+  }
+  return auth;
+}
+
+/// Length of the scramble of the authentication plugins.
+const std::size_t SCRAMBLE_LENGTH = 20;
+
+}  // namespace
+
+
+ServerLogin::ServerLogin(const std::string& t_user,
+    const std::string& t_password,
+    const std::string& t_schema)
+    : m_user(t_user)
+    , m_password(t_password)
+    , m_schema(t_schema)
+{
+}
+
+ServerLogin::Step ServerLogin::packet_is_received(
+    unsigned char t_sequence_id, const std::vector<unsigned char>& t_payload)
+{
+  if(t_payload.empty()) {
+    return fail("the server sent the empty packet");
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_lifecycle.html
+  switch(t_payload[0]) {
+    case 0x0A: {
+      if(0 == t_sequence_id) {
+        if(Step::FAILED == make_handshake_response(t_payload)) {
+          return Step::FAILED;
+        }
+        return send(t_sequence_id);
+      }
+      break;
+    }
+    case 0x00: {
+      return Step::DONE;
+    }
+    case 0xFF: {
+      return fail("the server refused the session");
+    }
+    case 0xFE: {
+      // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_auth_switch_request.html
+      const auto plugin_end =
+          std::find(t_payload.begin() + 1, t_payload.end(), 0);
+      if(plugin_end != t_payload.end()) {
+        const std::string plugin(t_payload.begin() + 1, plugin_end);
+        if(Step::FAILED
+            == make_auth_data(t_payload, plugin,
+                static_cast<std::size_t>(plugin_end - t_payload.begin()) + 1)) {
+          return Step::FAILED;
+        }
+        return send(t_sequence_id);
+      }
+      break;
+    }
+    case 0x01: {
+      // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_caching_sha2_authentication_exchanges.html
+      // The fast authentication is followed by OK, the full one needs
+      // the TLS or the RSA key of the server.
+      if(2 <= t_payload.size() && 0x04 == t_payload[1]) {
+        return fail("the server needs the full authentication of the user");
+      }
+      return Step::READ;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return fail("the server sent the unexpected packet");
+}
+
+ServerLogin::Step ServerLogin::make_handshake_response(
+    const std::vector<unsigned char>& t_greeting)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_v10.html
+  const auto version_end =
+      std::find(t_greeting.begin() + 1, t_greeting.end(), 0);
+  std::size_t pos =
+      static_cast<std::size_t>(version_end - t_greeting.begin()) + 1;
+
+  // thread id, auth-plugin-data-part-1, filler, capability flags, character
+  // set, status flags, capability flags, auth plugin data length, reserved.
+  if(pos + 4 + 8 + 1 + 2 + 1 + 2 + 2 + 1 + 10 > t_greeting.size()) {
+    return fail("the greeting of the server is broken");
+  }
+  m_scramble.assign(
+      t_greeting.begin() + pos + 4, t_greeting.begin() + pos + 12);
+  const std::uint32_t server_capabilities =
+      MySqlPacket::read_uint16(&t_greeting[pos + 13])
+      | (static_cast<std::uint32_t>(
+             MySqlPacket::read_uint16(&t_greeting[pos + 18]))
+          << 16u);
+  pos += 4 + 8 + 1 + 2 + 1 + 2 + 2 + 1 + 10;
+
+  // auth-plugin-data-part-2 with the NUL and the auth plugin name.
+  const std::size_t part_2_length =
+      std::min(SCRAMBLE_LENGTH - m_scramble.size(), t_greeting.size() - pos);
+  m_scramble.insert(m_scramble.end(), t_greeting.begin() + pos,
+      t_greeting.begin() + pos + part_2_length);
+  pos = std::min(pos + part_2_length + 1, t_greeting.size());
+  const std::string plugin(t_greeting.begin() + pos,
+      std::find(t_greeting.begin() + pos, t_greeting.end(), 0));
+
+  const std::uint32_t required = MySqlCapability::CLIENT_PROTOCOL_41
+      | MySqlCapability::CLIENT_SECURE_CONNECTION;
+  if((m_client_capabilities & server_capabilities & required) != required) {
+    return fail("the server or the client has no protocol 4.1");
+  }
+
+  // The commands keep the format of the client's capabilities,
+  // the proxy's session has no TLS, compression and attributes.
+  const std::uint32_t dropped = MySqlCapability::CLIENT_CONNECT_WITH_DB
+      | MySqlCapability::CLIENT_COMPRESS | MySqlCapability::CLIENT_SSL
+      | MySqlCapability::CLIENT_CONNECT_ATTRS
+      | MySqlCapability::CLIENT_PLUGIN_AUTH_LENENC_CLIENT_DATA
+      | MySqlCapability::CLIENT_ZSTD_COMPRESSION_ALGORITHM;
+  m_capabilities = (m_client_capabilities & server_capabilities & ~dropped)
+      | (server_capabilities & MySqlCapability::CLIENT_PLUGIN_AUTH);
+  if(!m_schema.empty()) {
+    m_capabilities |=
+        server_capabilities & MySqlCapability::CLIENT_CONNECT_WITH_DB;
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_connection_phase_packets_protocol_handshake_response.html
+  m_packet.assign(4 + 4 + 4 + 1 + 23, 0);
+  m_packet[4] = static_cast<unsigned char>(m_capabilities);
+  m_packet[5] = static_cast<unsigned char>(m_capabilities >> 8u);
+  m_packet[6] = static_cast<unsigned char>(m_capabilities >> 16u);
+  m_packet[7] = static_cast<unsigned char>(m_capabilities >> 24u);
+  m_packet[11] = 1;  // max packet size 16M
+  m_packet[12] = m_collation_id;
+  m_packet.insert(m_packet.end(), m_user.begin(), m_user.end());
+  m_packet.push_back(0);
+
+  const std::string auth = (plugin == "caching_sha2_password")
+      ? caching_sha2_password_auth(m_password, m_scramble)
+      : native_password_auth(m_password, m_scramble);
+  if(m_password.empty()) {
+    m_packet.push_back(0);
+  } else {
+    m_packet.push_back(static_cast<unsigned char>(auth.size()));
+    m_packet.insert(m_packet.end(), auth.begin(), auth.end());
+  }
+
+  if(m_capabilities & MySqlCapability::CLIENT_CONNECT_WITH_DB) {
+    m_packet.insert(m_packet.end(), m_schema.begin(), m_schema.end());
+    m_packet.push_back(0);
+  }
+  if(m_capabilities & MySqlCapability::CLIENT_PLUGIN_AUTH) {
+    const std::string auth_plugin = (plugin == "caching_sha2_password")
+        ? plugin
+        : std::string("mysql_native_password");
+    m_packet.insert(m_packet.end(), auth_plugin.begin(), auth_plugin.end());
+    m_packet.push_back(0);
+  }
+  return Step::SEND;
+}
+
+ServerLogin::Step ServerLogin::make_auth_data(
+    const std::vector<unsigned char>& t_payload,
+    const std::string& t_plugin,
+    std::size_t t_scramble_pos)
+{
+  if(t_plugin != "mysql_native_password"
+      && t_plugin != "caching_sha2_password") {
+    return fail("the server needs the unsupported authentication plugin");
+  }
+
+  const std::size_t scramble_pos = std::min(t_scramble_pos, t_payload.size());
+  m_scramble.assign(t_payload.begin() + scramble_pos,
+      t_payload.begin()
+          + std::min(scramble_pos + SCRAMBLE_LENGTH, t_payload.size()));
+
+  m_packet.assign(4, 0);
+  if(!m_password.empty()) {
+    const std::string auth = (t_plugin == "caching_sha2_password")
+        ? caching_sha2_password_auth(m_password, m_scramble)
+        : native_password_auth(m_password, m_scramble);
+    m_packet.insert(m_packet.end(), auth.begin(), auth.end());
+  }
+  return Step::SEND;
+}
+
+ServerLogin::Step ServerLogin::send(unsigned char t_sequence_id)
+{
+  const std::size_t payload_length = m_packet.size() - 4;
+  m_packet[0] = static_cast<unsigned char>(payload_length);
+  m_packet[1] = static_cast<unsigned char>(payload_length >> 8u);
+  m_packet[2] = static_cast<unsigned char>(payload_length >> 16u);
+  m_packet[3] = static_cast<unsigned char>(t_sequence_id + 1);
+  return Step::SEND;
+}
+
+ServerLogin::Step ServerLogin::fail(const char* t_error)
+{
+  m_error = t_error;
+  return Step::FAILED;
+}
+
+}  // namespace proxy
@@ -0,0 +1,138 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SERVER_LOGIN_HPP
+#define PROXY_SERVER_LOGIN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace proxy
+{
+/// The authentication of the proxy's own session to the MySQL server
+/// with the account of the settings, the clients' credentials are not known
+/// to the proxy. Makes the answers to the server's packets of the connection
+/// phase, the session reads and writes them.
+class ServerLogin
+{
+public:
+  /// The next action of the session.
+  enum class Step
+  {
+    SEND,  // Send packet() and read the next server's packet.
+    READ,  // Read the next server's packet.
+    DONE,  // The session is authenticated.
+    FAILED  // The session is refused, see error().
+  };
+
+  ServerLogin(const ServerLogin&) = delete;
+  ServerLogin(ServerLogin&&) = delete;
+  ServerLogin& operator=(const ServerLogin&) = delete;
+  ServerLogin& operator=(ServerLogin&&) = delete;
+
+  ~ServerLogin() = default;
+
+  /// The account and the default schema are kept by the owner
+  /// of the session.
+  explicit ServerLogin(const std::string& t_user,
+      const std::string& t_password,
+      const std::string& t_schema);
+
+  /// Set the capabilities and the collation of the client whose commands
+  /// are sent in the session.
+  void set_client(
+      std::uint32_t t_client_capabilities, unsigned char t_collation_id);
+
+  /// Perform the actions for the server's packet of the connection phase.
+  Step packet_is_received(
+      unsigned char t_sequence_id, const std::vector<unsigned char>& t_payload);
+
+  /// Get the packet to send with its header.
+  const std::vector<unsigned char>& packet() const;
+
+  /// Get the capabilities of the session.
+  std::uint32_t capabilities() const;
+
+  /// Get the reason of the refused session.
+  const char* error() const;
+
+private:
+  /// Make the HandshakeResponse for the server's greeting.
+  Step make_handshake_response(const std::vector<unsigned char>& t_greeting);
+
+  /// Make the authentication data of the plugin for the scramble
+  /// of the AuthSwitchRequest.
+  Step make_auth_data(const std::vector<unsigned char>& t_payload,
+      const std::string& t_plugin,
+      std::size_t t_scramble_pos);
+
+  /// Set the header of the packet, the answer follows the sequence id
+  /// of the server's packet.
+  Step send(unsigned char t_sequence_id);
+
+  /// Refuse the session for the reason.
+  Step fail(const char* t_error);
+
+  const std::string& m_user;
+  const std::string& m_password;
+  const std::string& m_schema;
+
+  std::uint32_t m_client_capabilities = 0;
+  std::uint32_t m_capabilities = 0;
+  unsigned char m_collation_id = 0;
+
+  /// The scramble of the authentication, from the greeting
+  /// or from the authentication switch.
+  std::vector<unsigned char> m_scramble;
+
+  std::vector<unsigned char> m_packet;
+  const char* m_error = "";
+};
+
+inline void ServerLogin::set_client(
+    std::uint32_t t_client_capabilities, unsigned char t_collation_id)
+{
+  m_client_capabilities = t_client_capabilities;
+  m_collation_id = t_collation_id;
+}
+
+inline const std::vector<unsigned char>& ServerLogin::packet() const
+{
+  return m_packet;
+}
+
+inline std::uint32_t ServerLogin::capabilities() const
+{
+  return m_capabilities;
+}
+
+inline const char* ServerLogin::error() const
+{
+  return m_error;
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_SERVER_LOGIN_HPP
@@ -0,0 +1,385 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "settings.hpp"
+
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace proxy
+{
+namespace
+{
+std::uint64_t to_uint(const std::string& t_name,
+    const std::string& t_value,
+    std::uint64_t t_max = std::numeric_limits<std::uint32_t>::max())
+{
+  std::size_t pos = 0;
+  std::uint64_t value = 0;
+  try {
+    value = std::stoull(t_value, &pos);
+  } catch(const std::exception&) {
+    pos = 0;
+  }
+  if(t_value.empty() || pos != t_value.size() || '-' == t_value[0]
+      || value > t_max) {
+    throw std::invalid_argument(
+        "Wrong value '" + t_value + "' of the option '" + t_name + "'");
+  }
+  return value;
+}
+
+std::string trim(const std::string& t_string)
+{
+  const char* const whitespaces = " \t\r\n";
+  const std::size_t begin = t_string.find_first_not_of(whitespaces);
+  if(std::string::npos == begin) {
+    return std::string();
+  }
+  const std::size_t end = t_string.find_last_not_of(whitespaces);
+  return t_string.substr(begin, end - begin + 1);
+}
+
+}  // namespace
+
+void SocketSettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("tcp-nodelay" == t_name) {
+    m_tcp_nodelay = 0 != to_uint(t_name, t_value, 1);
+  } else if("tcp-quickack" == t_name) {
+    m_tcp_quickack = 0 != to_uint(t_name, t_value, 1);
+  } else if("receive-buffer" == t_name) {
+    m_receive_buffer = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else if("send-buffer" == t_name) {
+    m_send_buffer = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else if("keepalive-idle" == t_name) {
+    m_keepalive_idle = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else if("keepalive-interval" == t_name) {
+    m_keepalive_interval = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else if("keepalive-count" == t_name) {
+    m_keepalive_count = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else if("busy-poll" == t_name) {
+    m_busy_poll = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else if("notsent-lowat" == t_name) {
+    m_notsent_lowat = static_cast<std::uint32_t>(
+        to_uint(t_name, t_value, std::numeric_limits<int>::max()));
+  } else {
+    throw std::invalid_argument("Unknown option '" + t_name + "'");
+  }
+}
+
+void TlsSettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("tls-cert" == t_name) {
+    m_cert_file = t_value;
+  } else if("tls-key" == t_name) {
+    m_key_file = t_value;
+  } else if("tls-session-timeout" == t_name) {
+    m_session_timeout = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("tls-server" == t_name) {
+    m_server_tls = 0 != to_uint(t_name, t_value, 1);
+  } else if("tls-server-ca" == t_name) {
+    m_server_ca_file = t_value;
+  } else {
+    throw std::invalid_argument("Unknown option '" + t_name + "'");
+  }
+}
+
+bool TlsSettings::is_client_tls() const
+{
+  return !m_cert_file.empty();
+}
+
+bool TlsSettings::is_enabled() const
+{
+  return is_client_tls() || m_server_tls;
+}
+
+void MirrorSettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("mirror-server" == t_name) {
+    m_server = t_value;
+  } else if("mirror-user" == t_name) {
+    m_user = t_value;
+  } else if("mirror-password" == t_name) {
+    m_password = t_value;
+  } else if("mirror-schema" == t_name) {
+    m_schema = t_value;
+  } else if("mirror-sample-rate" == t_name) {
+    m_sample_rate = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+    if(0 == m_sample_rate) {
+      throw std::invalid_argument(
+          "Wrong value '" + t_value + "' of the option '" + t_name + "'");
+    }
+  } else if("mirror-queue-length" == t_name) {
+    m_queue_length = static_cast<std::size_t>(to_uint(t_name, t_value));
+  } else if("mirror-latency-threshold" == t_name) {
+    m_latency_threshold = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else {
+    throw std::invalid_argument("Unknown option '" + t_name + "'");
+  }
+}
+
+bool MirrorSettings::is_enabled() const
+{
+  return !m_server.empty();
+}
+
+void ShardSettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("shard-server" == t_name) {
+    // "<address>:<port>" or "unix:<path>".
+    const std::size_t colon_pos = t_value.rfind(':');
+    if(std::string::npos == colon_pos || 0 == colon_pos
+        || colon_pos + 1 == t_value.size()) {
+      throw std::invalid_argument(
+          "Wrong value '" + t_value + "' of the option '" + t_name + "'");
+    }
+    m_servers.push_back(t_value);
+  } else if("shard-column" == t_name) {
+    m_column = t_value;
+  } else if("shard-user" == t_name) {
+    m_user = t_value;
+  } else if("shard-password" == t_name) {
+    m_password = t_value;
+  } else if("shard-schema" == t_name) {
+    m_schema = t_value;
+  } else if("shard-proxy-account" == t_name) {
+    m_proxy_account = 0 != to_uint(t_name, t_value, 1);
+  } else {
+    throw std::invalid_argument("Unknown option '" + t_name + "'");
+  }
+}
+
+bool ShardSettings::is_enabled() const
+{
+  return !m_servers.empty() && m_proxy_account;
+}
+
+void ConnectionSettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("params-sample-rate" == t_name) {
+    m_params_sample_rate = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("sql-capture-limit" == t_name) {
+    m_sql_capture_limit = static_cast<std::size_t>(to_uint(t_name, t_value));
+  } else if("connect-timeout" == t_name) {
+    m_connect_timeout = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("handshake-timeout" == t_name) {
+    m_handshake_timeout = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("idle-timeout" == t_name) {
+    m_idle_timeout = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("query-timeout" == t_name) {
+    m_query_timeout = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("long-transaction-threshold" == t_name) {
+    m_long_transaction_threshold =
+        static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("health-check-interval" == t_name) {
+    m_health_check_interval =
+        static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("health-check-timeout" == t_name) {
+    m_health_check_timeout =
+        static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("health-check-rise" == t_name) {
+    m_health_check_rise = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("health-check-fall" == t_name) {
+    m_health_check_fall = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("health-check-user" == t_name) {
+    m_health_check_user = t_value;
+  } else if("health-check-password" == t_name) {
+    m_health_check_password = t_value;
+  } else if("backup-server" == t_name) {
+    // "<address>:<port>" or "unix:<path>".
+    const std::size_t colon_pos = t_value.rfind(':');
+    if(std::string::npos == colon_pos || 0 == colon_pos
+        || colon_pos + 1 == t_value.size()) {
+      throw std::invalid_argument(
+          "Wrong value '" + t_value + "' of the option '" + t_name + "'");
+    }
+    m_backup_servers.push_back(t_value);
+  } else if("compression" == t_name) {
+    // "none" or the list of "zlib" and "zstd", separated by commas.
+    m_zlib_compression = false;
+    m_zstd_compression = false;
+    if("none" == t_value) {
+      return;
+    }
+    std::size_t begin = 0;
+    while(begin <= t_value.size()) {
+      std::size_t end = t_value.find(',', begin);
+      if(std::string::npos == end) {
+        end = t_value.size();
+      }
+      const std::string algorithm = trim(t_value.substr(begin, end - begin));
+      if("zlib" == algorithm) {
+        m_zlib_compression = true;
+      } else if("zstd" == algorithm) {
+        m_zstd_compression = true;
+      } else {
+        throw std::invalid_argument(
+            "Wrong value '" + t_value + "' of the option '" + t_name + "'");
+      }
+      begin = end + 1;
+    }
+  } else if("table-stats" == t_name) {
+    m_table_stats = 0 != to_uint(t_name, t_value, 1);
+  } else if(0 == t_name.compare(0, 4, "tls-")) {
+    m_tls.set_option(t_name, t_value);
+  } else if(0 == t_name.compare(0, 7, "mirror-")) {
+    m_mirror.set_option(t_name, t_value);
+  } else if(0 == t_name.compare(0, 6, "shard-")) {
+    m_shard.set_option(t_name, t_value);
+  } else {
+    m_socket.set_option(t_name, t_value);
+  }
+}
+
+void RouteSettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("listen" == t_name) {
+    m_listen = t_value;
+  } else if("server" == t_name) {
+    m_server = t_value;
+  } else if("log-file" == t_name) {
+    m_log_file = t_value;
+  } else {
+    m_connection.set_option(t_name, t_value);
+  }
+}
+
+void ProxySettings::set_option(
+    const std::string& t_name, const std::string& t_value)
+{
+  if("threads" == t_name) {
+    m_threads = static_cast<std::size_t>(to_uint(t_name, t_value, 1024));
+    if(0 == m_threads) {
+      throw std::invalid_argument(
+          "Wrong value '" + t_value + "' of the option '" + t_name + "'");
+    }
+  } else if("drain-timeout" == t_name) {
+    m_drain_timeout = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("max-connections" == t_name) {
+    m_max_connections = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("max-connections-per-ip" == t_name) {
+    m_max_connections_per_ip =
+        static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("max-connecting" == t_name) {
+    m_max_connecting = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else if("listen-backlog" == t_name) {
+    m_listen_backlog =
+        static_cast<std::uint32_t>(to_uint(t_name, t_value, 65535));
+  } else if("defer-accept" == t_name) {
+    m_defer_accept = static_cast<std::uint32_t>(to_uint(t_name, t_value));
+  } else {
+    throw std::invalid_argument("Unknown option '" + t_name + "'");
+  }
+}
+
+// static
+bool ProxySettings::is_option(const std::string& t_name)
+{
+  return "threads" == t_name || "drain-timeout" == t_name
+      || "max-connections" == t_name || "max-connections-per-ip" == t_name
+      || "max-connecting" == t_name || "listen-backlog" == t_name
+      || "defer-accept" == t_name;
+}
+
+void ProxySettings::load_file(const std::string& t_file_path)
+{
+  std::ifstream file(t_file_path);
+  if(!file) {
+    throw std::invalid_argument(
+        "Can not read the configuration file '" + t_file_path + "'");
+  }
+
+  // The connection options before the routes are the defaults of the routes.
+  ConnectionSettings defaults;
+  m_routes.clear();
+
+  std::string line;
+  std::size_t line_number = 0;
+  while(std::getline(file, line)) {
+    ++line_number;
+    line = trim(line);
+    if(line.empty() || '#' == line[0] || ';' == line[0]) {
+      continue;
+    }
+
+    try {
+      if('[' == line[0]) {
+        const std::string section = trim(line.substr(1, line.find(']') - 1));
+        if(']' != line.back() || 0 != section.compare(0, 6, "route ")) {
+          throw std::invalid_argument("Wrong section '" + line + "'");
+        }
+        m_routes.emplace_back();
+        m_routes.back().m_name = trim(section.substr(6));
+        m_routes.back().m_connection = defaults;
+        continue;
+      }
+
+      const std::size_t equal_pos = line.find('=');
+      if(std::string::npos == equal_pos) {
+        throw std::invalid_argument("Wrong line '" + line + "'");
+      }
+      const std::string name = trim(line.substr(0, equal_pos));
+      const std::string value = trim(line.substr(equal_pos + 1));
+
+      if(!m_routes.empty()) {
+        m_routes.back().set_option(name, value);
+      } else if(is_option(name)) {
+        set_option(name, value);
+      } else {
+        defaults.set_option(name, value);
+      }
+    } catch(const std::invalid_argument& e) {
+      throw std::invalid_argument(t_file_path + ":"
+          + std::to_string(line_number) + ": " + e.what());
+    }
+  }
+
+  if(m_routes.empty()) {
+    throw std::invalid_argument(
+        "No routes in the configuration file '" + t_file_path + "'");
+  }
+  for(const RouteSettings& route : m_routes) {
+    if(route.m_listen.empty() || route.m_server.empty()
+        || route.m_log_file.empty()) {
+      throw std::invalid_argument("The route '" + route.m_name
+          + "' needs the 'listen', 'server' and 'log-file' options");
+    }
+  }
+}
+
+}  // namespace proxy
@@ -0,0 +1,329 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SETTINGS_HPP
+#define PROXY_SETTINGS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace proxy
+{
+/// Options of the TCP sockets of the client's and the MySQL server's
+/// connections, the Unix domain sockets are not changed.
+struct SocketSettings
+{
+  /// Set the option by its name. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// TCP_NODELAY, the small packets are sent without the Nagle's delay.
+  bool m_tcp_nodelay = true;
+
+  /// TCP_QUICKACK after each read, the received data is acknowledged
+  /// without the delay.
+  bool m_tcp_quickack = false;
+
+  /// SO_RCVBUF and SO_SNDBUF in bytes, 0 keeps the system's defaults.
+  std::uint32_t m_receive_buffer = 0;
+  std::uint32_t m_send_buffer = 0;
+
+  /// SO_KEEPALIVE with TCP_KEEPIDLE in seconds, 0 turns the keepalive off.
+  /// TCP_KEEPINTVL in seconds and TCP_KEEPCNT, 0 keeps the system's defaults.
+  std::uint32_t m_keepalive_idle = 0;
+  std::uint32_t m_keepalive_interval = 0;
+  std::uint32_t m_keepalive_count = 0;
+
+  /// SO_BUSY_POLL in microseconds, 0 turns the busy polling off.
+  std::uint32_t m_busy_poll = 0;
+
+  /// TCP_NOTSENT_LOWAT in bytes, limits the unsent data in the send buffer
+  /// of the streamed result sets. 0 keeps the system's default.
+  std::uint32_t m_notsent_lowat = 0;
+};
+
+
+/// TLS settings of the client's and the MySQL server's connections.
+struct TlsSettings
+{
+  /// Set the option by its name. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// Check if the proxy terminates the TLS of the clients.
+  bool is_client_tls() const;
+
+  /// Check if the proxy has the TLS settings, the connections
+  /// without them relay the TLS of the clients as is.
+  bool is_enabled() const;
+
+  /// PEM files of the certificate chain and the private key
+  /// of the proxy for the clients, the TLS of the clients is terminated
+  /// by the proxy if they are set. The key is read from the certificate
+  /// file if its file is not set.
+  std::string m_cert_file;
+  std::string m_key_file;
+
+  /// Lifetime of the TLS sessions and the session tickets in seconds,
+  /// the reconnecting clients resume their sessions without
+  /// the full handshake.
+  std::uint32_t m_session_timeout = 3600;
+
+  /// The proxy connects to the MySQL servers over TLS.
+  bool m_server_tls = false;
+
+  /// PEM file of the CA certificates for the verification
+  /// of the MySQL servers, empty turns the verification off.
+  std::string m_server_ca_file;
+};
+
+
+/// Settings of the mirror MySQL server which gets the copies
+/// of the client's commands of the sampled sessions.
+struct MirrorSettings
+{
+  /// Set the option by its name. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// Check if the sessions are mirrored.
+  bool is_enabled() const;
+
+  /// The mirror MySQL server as "<address>:<port>" or "unix:<path>",
+  /// empty turns the mirroring off.
+  std::string m_server;
+
+  /// The account and the default schema of the proxy's sessions
+  /// to the mirror server, the clients' credentials are not known
+  /// to the proxy.
+  std::string m_user;
+  std::string m_password;
+  std::string m_schema;
+
+  /// Mirror every Nth session of the clients.
+  std::uint32_t m_sample_rate = 1;
+
+  /// Bytes of the commands queued for the mirror server in each session,
+  /// the commands which do not fit are dropped.
+  std::size_t m_queue_length = 256 * 1024;
+
+  /// Difference of the response times in milliseconds which is counted
+  /// as the latency mismatch.
+  std::uint32_t m_latency_threshold = 10;
+};
+
+
+/// Settings of the shards, the MySQL servers of the sharded tables.
+/// The queries with the shard key are routed to the shard of the key,
+/// the other ones are sent to the MySQL server of the session.
+struct ShardSettings
+{
+  /// Set the option by its name. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// Check if the queries are routed to the shards: the shards are set
+  /// and the proxy's account is allowed for the clients' queries.
+  bool is_enabled() const;
+
+  /// The shards as "<address>:<port>" or "unix:<path>", the key is mapped
+  /// to the shard by its index in the list.
+  std::vector<std::string> m_servers;
+
+  /// The column of the shard key, case-insensitive. Its value is taken
+  /// from the equality "<column> = <literal>" after WHERE or SET
+  /// and from the VALUES of INSERT. The comment "/* shard_key=<value> */"
+  /// sets the key of any SELECT, INSERT, UPDATE or DELETE.
+  std::string m_column;
+
+  /// The account and the default schema of the proxy's sessions
+  /// to the shards, the clients' credentials are not known to the proxy.
+  std::string m_user;
+  std::string m_password;
+  std::string m_schema;
+
+  /// The clients' queries routed to the shards run with the privileges
+  /// of the proxy's account instead of the clients' grants, the routing
+  /// is turned on explicitly.
+  bool m_proxy_account = false;
+};
+
+
+/// Settings of the proxy connections.
+struct ConnectionSettings
+{
+  /// Set the option by its name. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// Decode the parameters of every Nth COM_STMT_EXECUTE for the logging,
+  /// 0 turns the decoding off.
+  std::uint32_t m_params_sample_rate = 0;
+
+  /// Maximum length of the SQL string captured for the logging,
+  /// the longer strings are logged truncated with their length and digest.
+  std::size_t m_sql_capture_limit = 64 * 1024;
+
+  /// Timeouts of the connection in milliseconds, 0 turns the timeout off.
+  /// Connection to the MySQL server.
+  std::uint32_t m_connect_timeout = 10000;
+  /// Handshake from the server's greeting to the OK of the authentication.
+  std::uint32_t m_handshake_timeout = 10000;
+  /// Time without the client's commands between the queries.
+  std::uint32_t m_idle_timeout = 0;
+  /// Duration of the query from the command to the server's response end.
+  std::uint32_t m_query_timeout = 0;
+
+  /// The transactions open longer than this time in milliseconds
+  /// are logged, again after each such time while they are open,
+  /// 0 turns the logging off.
+  std::uint32_t m_long_transaction_threshold = 0;
+
+  /// Health checks of the MySQL servers. The interval and the timeout
+  /// of the probes in milliseconds, the interval 0 turns the checks off.
+  /// The checks are off by default, the MySQL server counts the probes
+  /// without the account as the handshake errors of the proxy host.
+  std::uint32_t m_health_check_interval = 0;
+  std::uint32_t m_health_check_timeout = 1000;
+  /// Number of the successful probes in a row to mark the server up.
+  std::uint32_t m_health_check_rise = 2;
+  /// Number of the failed probes in a row to mark the server down.
+  std::uint32_t m_health_check_fall = 3;
+  /// The account of the probes which log in and quit, the probes
+  /// without it read the greeting only.
+  std::string m_health_check_user;
+  std::string m_health_check_password;
+
+  /// The MySQL servers as "<address>:<port>" or "unix:<path>" which take the new sessions
+  /// in the given order if the main server is down.
+  std::vector<std::string> m_backup_servers;
+
+  /// Algorithms of the compressed protocol which the proxy negotiates
+  /// with the clients, the MySQL servers get the uncompressed packets.
+  bool m_zlib_compression = true;
+  bool m_zstd_compression = true;
+
+  /// Count the reads and the writes of the tables by the statements.
+  bool m_table_stats = false;
+
+  /// Options of the client's and the MySQL server's sockets.
+  SocketSettings m_socket;
+
+  /// TLS of the client's and the MySQL server's connections.
+  TlsSettings m_tls;
+
+  /// The mirror server of the sampled sessions.
+  MirrorSettings m_mirror;
+
+  /// The shards of the queries with the shard key.
+  ShardSettings m_shard;
+};
+
+
+/// Settings of the route from the listener to the MySQL servers.
+struct RouteSettings
+{
+  /// Set the option by its name, the connection options are passed
+  /// to the connection settings. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// Name of the route for the messages.
+  std::string m_name;
+
+  /// Listener address as "<address>:<port>" or "unix:<path>".
+  std::string m_listen;
+
+  /// Main MySQL server as "<address>:<port>" or "unix:<path>".
+  std::string m_server;
+
+  /// Log file of the SQL requests.
+  std::string m_log_file;
+
+  /// Settings of the route's connections.
+  ConnectionSettings m_connection;
+};
+
+
+/// Settings of the proxy process.
+struct ProxySettings
+{
+  /// Set the option of the process by its name. Throws std::invalid_argument
+  /// if the option is unknown or the value is wrong.
+  void set_option(const std::string& t_name, const std::string& t_value);
+
+  /// Check whether the option is the option of the process,
+  /// not of the route.
+  static bool is_option(const std::string& t_name);
+
+  /// Load the settings from the configuration file. Throws
+  /// std::invalid_argument if the file can not be read or has the errors.
+  ///
+  /// The file has the lines "<option> = <value>". The process options
+  /// and the default connection options of the routes are at the file
+  /// beginning, each route starts with the line "[route <name>]":
+  ///
+  ///   threads = 4
+  ///   idle-timeout = 600000
+  ///
+  ///   [route orders]
+  ///   listen = 0.0.0.0:3307
+  ///   server = 10.0.0.1:3306
+  ///   backup-server = 10.0.0.2:3306
+  ///   log-file = /var/log/proxy/orders.log
+  ///   query-timeout = 5000
+  ///
+  /// The lines starting with '#' or ';' are the comments.
+  void load_file(const std::string& t_file_path);
+
+  /// Number of the threads which serve the connections.
+  std::size_t m_threads = 1;
+
+  /// Time in milliseconds for the queries in flight to finish
+  /// when the process is drained, the remaining connections are stopped then.
+  std::uint32_t m_drain_timeout = 60000;
+
+  /// Limits of the connections of the process and of the connections
+  /// from one client's IP address, 0 turns the limit off.
+  std::uint32_t m_max_connections = 0;
+  std::uint32_t m_max_connections_per_ip = 0;
+
+  /// Limit of the MySQL server connects and handshakes in progress
+  /// in each thread, the next clients wait in the queue. 0 turns it off.
+  std::uint32_t m_max_connecting = 0;
+
+  /// Backlog of the listening sockets, 0 is the system's max.
+  std::uint32_t m_listen_backlog = 0;
+
+  /// TCP_DEFER_ACCEPT of the listening sockets in seconds, 0 turns it off.
+  std::uint32_t m_defer_accept = 0;
+
+  /// The routes of the process.
+  std::vector<RouteSettings> m_routes;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_SETTINGS_HPP
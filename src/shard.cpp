@@ -0,0 +1,343 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "shard.hpp"
+
+#include <iostream>
+#include <utility>
+
+#include "connection.hpp"
+#include "socket_options.hpp"
+
+namespace proxy
+{
+namespace
+{
+// FNV-1a, see http://www.isthe.com/chongo/tech/comp/fnv/
+std::uint64_t key_hash(std::string_view t_key)
+{
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for(const char ch : t_key) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+
+// ======== ShardRouter ========
+
+ShardRouter::ShardRouter(
+    boost::asio::io_context& t_io_context, const ShardSettings& t_settings)
+    : m_settings(t_settings)
+    , m_queries(new std::atomic<std::uint64_t>[t_settings.m_servers.size()])
+{
+  m_endpoints.reserve(m_settings.m_servers.size());
+  for(std::size_t i = 0; i < m_settings.m_servers.size(); ++i) {
+    m_endpoints.push_back(
+        resolve_endpoint(t_io_context, m_settings.m_servers[i]));
+    m_queries[i] = 0;
+  }
+}
+
+std::size_t ShardRouter::select(std::string_view t_sql) const
+{
+  const std::string_view key = find_key(t_sql, m_settings.m_column);
+  if(key.empty()) {
+    return NO_SHARD;
+  }
+  return jump_hash(key_hash(key), m_endpoints.size());
+}
+
+std::size_t ShardRouter::jump_hash(std::uint64_t t_key, std::size_t t_buckets)
+{
+  // See https://arxiv.org/abs/1406.2294
+  std::int64_t bucket = -1;
+  std::int64_t next = 0;
+  while(next < static_cast<std::int64_t>(t_buckets)) {
+    bucket = next;
+    t_key = t_key * 2862933555777941757ULL + 1;
+    next = static_cast<std::int64_t>(static_cast<double>(bucket + 1)
+        * (static_cast<double>(1LL << 31)
+            / static_cast<double>((t_key >> 33) + 1)));
+  }
+  return static_cast<std::size_t>(bucket);
+}
+
+void ShardRouter::query_is_routed(std::size_t t_shard)
+{
+  m_queries[t_shard].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShardRouter::session_failed()
+{
+  m_failed_sessions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShardRouter::print_stats(const std::string& t_route_name) const
+{
+  std::cout << "Shards of route " << t_route_name << ":";
+  for(std::size_t i = 0; i < m_endpoints.size(); ++i) {
+    std::cout << " " << m_settings.m_servers[i] << " "
+              << m_queries[i].load(std::memory_order_relaxed) << " queries,";
+  }
+  std::cout << " " << m_failed_sessions.load(std::memory_order_relaxed)
+            << " sessions failed\n";
+}
+
+
+// ======== ShardSession ========
+
+ShardSession::ShardSession(boost::asio::io_context& t_io_context,
+    std::shared_ptr<ShardRouter> t_router,
+    std::size_t t_shard,
+    Connection& t_connection)
+    : m_router(std::move(t_router))
+    , m_shard(t_shard)
+    , m_connection(&t_connection)
+    , m_socket(t_io_context)
+    , m_login(m_router->settings().m_user, m_router->settings().m_password,
+          m_router->settings().m_schema)
+{
+}
+
+void ShardSession::start(
+    std::uint32_t t_client_capabilities, unsigned char t_collation_id)
+{
+  m_login.set_client(t_client_capabilities, t_collation_id);
+
+  const StreamProtocol::endpoint& endpoint = m_router->endpoint(m_shard);
+  boost::system::error_code error;
+  m_socket.open(endpoint.protocol(), error);
+  if(error) {
+    // The connection gets the failure after its query is sent.
+    boost::asio::post(m_socket.get_executor(),
+        [this, l_self = shared_from_this()]() -> void {
+          fail("the socket can not be opened");
+        });
+    return;
+  }
+  if(is_tcp_endpoint(endpoint)) {
+    SocketSettings socket_settings;
+    set_socket_options(m_socket, socket_settings);
+  }
+
+  m_socket.async_connect(endpoint,
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error) -> void {
+        if(!l_error) {
+          do_read_handshake_packet();
+        } else if(l_error != boost::asio::error::operation_aborted) {
+          fail("the shard is not available");
+        }
+      });
+}
+
+void ShardSession::send(
+    const std::vector<unsigned char>& t_query, std::uint64_t t_payload_length)
+{
+  m_query = t_query;
+  m_payload_length = t_payload_length;
+  m_is_in_flight = true;
+  m_response_is_started = false;
+
+  if(m_is_ready) {
+    do_write_query();
+  } else {
+    m_query_is_pending = true;
+  }
+}
+
+void ShardSession::close()
+{
+  m_connection = nullptr;
+  if(!m_is_ready || m_is_in_flight) {
+    boost::system::error_code error;
+    m_socket.close(error);
+    return;
+  }
+
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_quit.html
+  // The MySQL server does not count the session as the aborted one.
+  static const std::array<unsigned char, 5> quit_packet{
+      1, 0, 0, 0, static_cast<unsigned char>(MySqlCommand::Command::COM_QUIT)};
+  boost::asio::async_write(m_socket, boost::asio::buffer(quit_packet),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& /*l_error*/,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        boost::system::error_code error;
+        m_socket.close(error);
+      });
+}
+
+void ShardSession::fail(const char* t_reason)
+{
+  std::cout << "Shard: " << t_reason << "\n";
+  m_router->session_failed();
+  boost::system::error_code error;
+  m_socket.close(error);
+
+  if(nullptr != m_connection) {
+    // The pointer keeps the connection alive till its actions are finished.
+    const ConnectionPtr connection(m_connection);
+    m_connection = nullptr;
+    connection->shard_failed(this);
+  }
+}
+
+void ShardSession::do_read_handshake_packet()
+{
+  boost::asio::async_read(m_socket, boost::asio::buffer(m_header),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(l_error) {
+          if(l_error != boost::asio::error::operation_aborted) {
+            fail("the shard closed the connection");
+          }
+          return;
+        }
+
+        for(const unsigned char header_byte : m_header) {
+          m_server_packet.collect(header_byte, m_connection_state);
+        }
+        m_read_packet.resize(m_header[0] | (m_header[1] << 8u)
+            | (m_header[2] << 16u));
+
+        boost::asio::async_read(m_socket, boost::asio::buffer(m_read_packet),
+            [this, l_self](const boost::system::error_code& l_error,
+                std::size_t /*l_bytes_transferred*/) -> void {
+              if(l_error) {
+                if(l_error != boost::asio::error::operation_aborted) {
+                  fail("the shard closed the connection");
+                }
+                return;
+              }
+              for(const unsigned char payload_byte : m_read_packet) {
+                m_server_packet.collect(payload_byte, m_connection_state);
+              }
+              handshake_packet_is_received();
+            });
+      });
+}
+
+void ShardSession::handshake_packet_is_received()
+{
+  switch(m_login.packet_is_received(m_header[3], m_read_packet)) {
+    case ServerLogin::Step::SEND: {
+      do_write_handshake_packet();
+      do_read_handshake_packet();
+      return;
+    }
+    case ServerLogin::Step::READ: {
+      do_read_handshake_packet();
+      return;
+    }
+    case ServerLogin::Step::DONE: {
+      m_is_ready = true;
+      m_read_packet = std::vector<unsigned char>();
+      do_read();
+      if(m_query_is_pending) {
+        m_query_is_pending = false;
+        do_write_query();
+      }
+      return;
+    }
+    case ServerLogin::Step::FAILED: {
+      fail(m_login.error());
+      return;
+    }
+  }
+}
+
+void ShardSession::do_write_handshake_packet()
+{
+  boost::asio::async_write(m_socket, boost::asio::buffer(m_login.packet()),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(l_error && l_error != boost::asio::error::operation_aborted) {
+          fail("the shard closed the connection");
+        }
+      });
+}
+
+void ShardSession::do_write_query()
+{
+  // The response is in the format of the session's capabilities,
+  // they are the client's ones which the shard supports.
+  m_server_packet.expect_response(MySqlCommand::Command::COM_QUERY,
+      m_payload_length, m_login.capabilities());
+  boost::asio::async_write(m_socket, boost::asio::buffer(m_query),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t /*l_bytes_transferred*/) -> void {
+        if(l_error && l_error != boost::asio::error::operation_aborted) {
+          fail("the shard closed the connection");
+        }
+      });
+}
+
+void ShardSession::do_read()
+{
+  m_socket.async_read_some(boost::asio::buffer(m_read_buffer),
+      [this, l_self = shared_from_this()](
+          const boost::system::error_code& l_error,
+          std::size_t l_bytes_transferred) -> void {
+        if(!l_error) {
+          data_is_received(l_bytes_transferred);
+          do_read();
+        } else if(l_error != boost::asio::error::operation_aborted) {
+          fail("the shard closed the connection");
+        }
+      });
+}
+
+void ShardSession::data_is_received(std::size_t t_bytes_transferred)
+{
+  if(nullptr == m_connection || !m_is_in_flight) {
+    return;
+  }
+
+  bool is_complete = false;
+  for(std::size_t i = 0; i < t_bytes_transferred; ++i) {
+    m_server_packet.collect(m_read_buffer[i], m_connection_state);
+    if(m_server_packet.is_received() && m_server_packet.is_response_complete()) {
+      is_complete = true;
+    }
+  }
+
+  // The pointer keeps the connection alive till its actions are finished.
+  const ConnectionPtr connection(m_connection);
+  m_response_is_started = true;
+  connection->shard_data_is_received(
+      boost::asio::buffer(m_read_buffer, t_bytes_transferred));
+  if(is_complete) {
+    m_is_in_flight = false;
+    connection->shard_response_is_received();
+  }
+}
+
+}  // namespace proxy
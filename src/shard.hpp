@@ -0,0 +1,253 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SHARD_HPP
+#define PROXY_SHARD_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "endpoint.hpp"
+#include "packet.hpp"
+#include "server_login.hpp"
+#include "settings.hpp"
+
+namespace proxy
+{
+class Connection;
+
+/// The shards of the route. The shard key of the query is found
+/// by the scan of its SQL string, without the SQL parsing, and is mapped
+/// to the shard by the jump consistent hash of its FNV-1a hash.
+/// The counters are updated by the sessions in the threads of the workers.
+class ShardRouter
+{
+public:
+  /// The query has no shard key, it is sent to the MySQL server
+  /// of the session.
+  static const std::size_t NO_SHARD = static_cast<std::size_t>(-1);
+
+  ShardRouter(const ShardRouter&) = delete;
+  ShardRouter(ShardRouter&&) = delete;
+  ShardRouter& operator=(const ShardRouter&) = delete;
+  ShardRouter& operator=(ShardRouter&&) = delete;
+
+  ~ShardRouter() = default;
+
+  explicit ShardRouter(
+      boost::asio::io_context& t_io_context, const ShardSettings& t_settings);
+
+  /// Get the settings of the shards.
+  const ShardSettings& settings() const;
+
+  /// Get the number of the shards.
+  std::size_t size() const;
+
+  /// Get the endpoint of the shard.
+  const StreamProtocol::endpoint& endpoint(std::size_t t_shard) const;
+
+  /// Get the shard of the query by its shard key, NO_SHARD
+  /// if the query has no key.
+  std::size_t select(std::string_view t_sql) const;
+
+  /// Find the value of the shard key in the SQL string: the comment
+  /// "/* shard_key=<value> */", the literal of "<column> = <literal>"
+  /// after WHERE, or after SET of INSERT, and the literal of the column
+  /// in the row of INSERT ... VALUES. The first one in the string
+  /// is taken, the strings are taken as written, without the quotes.
+  /// Empty if the string has no key or is not SELECT, INSERT, UPDATE
+  /// or DELETE. Without the comment, empty also if the condition has OR,
+  /// XOR, NOT, IN, "||" or "!", the statement has a subquery
+  /// or INSERT has more than one row.
+  static std::string_view find_key(
+      std::string_view t_sql, std::string_view t_column);
+
+  /// Check if the statement changes the state of the session which
+  /// the shard sessions do not have: SET, USE, LOCK, PREPARE
+  /// and CREATE TEMPORARY.
+  static bool changes_session_state(std::string_view t_sql);
+
+  /// Map the hash of the key to one of the buckets, only 1/N of the keys
+  /// are moved to the new bucket N.
+  static std::size_t jump_hash(std::uint64_t t_key, std::size_t t_buckets);
+
+  /// Count the query routed to the shard.
+  void query_is_routed(std::size_t t_shard);
+
+  /// Count the session to the shard which is failed.
+  void session_failed();
+
+  /// Print the counters of the shards.
+  void print_stats(const std::string& t_route_name) const;
+
+private:
+  const ShardSettings m_settings;
+  std::vector<StreamProtocol::endpoint> m_endpoints;
+
+  /// Number of the queries routed to each shard.
+  std::unique_ptr<std::atomic<std::uint64_t>[]> m_queries;
+  std::atomic<std::uint64_t> m_failed_sessions{0};
+};
+
+inline const ShardSettings& ShardRouter::settings() const
+{
+  return m_settings;
+}
+
+inline std::size_t ShardRouter::size() const
+{
+  return m_endpoints.size();
+}
+
+inline const StreamProtocol::endpoint& ShardRouter::endpoint(
+    std::size_t t_shard) const
+{
+  return m_endpoints[t_shard];
+}
+
+
+/// The session of the proxy to the shard for one client's session,
+/// opened by the first query routed to the shard. The query is sent
+/// after the authentication, the shard's response is relayed
+/// to the client by the connection. Runs in the worker's thread
+/// of the connection, lives till its last handler is called.
+class ShardSession : public std::enable_shared_from_this<ShardSession>
+{
+public:
+  ShardSession(const ShardSession&) = delete;
+  ShardSession(ShardSession&&) = delete;
+  ShardSession& operator=(const ShardSession&) = delete;
+  ShardSession& operator=(ShardSession&&) = delete;
+
+  ~ShardSession() = default;
+
+  explicit ShardSession(boost::asio::io_context& t_io_context,
+      std::shared_ptr<ShardRouter> t_router,
+      std::size_t t_shard,
+      Connection& t_connection);
+
+  /// Get the index of the shard.
+  std::size_t shard() const;
+
+  /// Connect to the shard and authenticate with the capabilities
+  /// of the client's session, the query waits meanwhile.
+  void start(std::uint32_t t_client_capabilities, unsigned char t_collation_id);
+
+  /// Send the client's query with its packet header, the response
+  /// is relayed to the client.
+  void send(
+      const std::vector<unsigned char>& t_query, std::uint64_t t_payload_length);
+
+  /// Check if a part of the response is relayed to the client.
+  bool is_response_started() const;
+
+  /// Close the session, the connection gets no more data from it.
+  /// The shard gets COM_QUIT if no query is in flight.
+  void close();
+
+private:
+  /// Close the session after its failure, the connection gets
+  /// the failure of its query.
+  void fail(const char* t_reason);
+
+  /// Read the packet of the connection phase.
+  void do_read_handshake_packet();
+
+  /// Perform the actions for the packet of the connection phase.
+  void handshake_packet_is_received();
+
+  /// Send the packet of the connection phase made by the login.
+  void do_write_handshake_packet();
+
+  /// Send the query, the session is authenticated.
+  void do_write_query();
+
+  /// Read the responses in the command phase.
+  void do_read();
+
+  /// Relay the received response to the client.
+  void data_is_received(std::size_t t_bytes_transferred);
+
+  const std::shared_ptr<ShardRouter> m_router;
+  const std::size_t m_shard;
+
+  /// The connection of the client's session, nullptr after it is stopped.
+  Connection* m_connection;
+
+  StreamProtocol::socket m_socket;
+
+  /// The authentication of the shard session.
+  ServerLogin m_login;
+
+  /// The shard session is authenticated.
+  bool m_is_ready = false;
+
+  /// The packet of the connection phase.
+  std::array<unsigned char, 4> m_header{};
+  std::vector<unsigned char> m_read_packet;
+
+  /// The query which waits for the authentication.
+  std::vector<unsigned char> m_query;
+  std::uint64_t m_payload_length = 0;
+  bool m_query_is_pending = false;
+
+  /// The response to the query is not fully relayed.
+  bool m_is_in_flight = false;
+  bool m_response_is_started = false;
+
+  /// Collects the responses of the shard.
+  MySqlConnectionState m_connection_state =
+      MySqlConnectionState::CONNECTION_PHASE;
+  FromServerPacket m_server_packet;
+
+  // Min BUFFER_LENGTH == 2 for 100 connections, debug build.
+#ifdef PROXY_PACKET_DEBUG
+  static const std::size_t BUFFER_LENGTH = 60;
+#else  // ifdef PROXY_PACKET_DEBUG
+  static const std::size_t BUFFER_LENGTH = 8192;
+#endif  // ifdef PROXY_PACKET_DEBUG
+
+  std::array<unsigned char, BUFFER_LENGTH> m_read_buffer{};
+};
+
+inline std::size_t ShardSession::shard() const
+{
+  return m_shard;
+}
+
+inline bool ShardSession::is_response_started() const
+{
+  return m_response_is_started;
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_SHARD_HPP
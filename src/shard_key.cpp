@@ -0,0 +1,240 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "shard.hpp"
+
+#include "sql_scanner.hpp"
+
+namespace proxy
+{
+namespace
+{
+/// Check if the token ends the literal value, not an expression.
+bool is_value_end(const SqlToken& t_token)
+{
+  switch(t_token.m_type) {
+    case SqlTokenType::END:
+    case SqlTokenType::WORD: {
+      return true;
+    }
+    case SqlTokenType::SYMBOL: {
+      return ")" == t_token.m_text || "," == t_token.m_text
+          || ";" == t_token.m_text;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+bool is_keyword(const SqlToken& t_token, std::string_view t_word)
+{
+  return SqlTokenType::WORD == t_token.m_type
+      && SqlScanner::equals_nocase(t_token.m_text, t_word);
+}
+
+/// Check if the token can select the rows of more than one key
+/// in the condition: OR, XOR, NOT, IN and the operators "||" and "!".
+bool is_multi_key_operator(const SqlToken& t_token)
+{
+  switch(t_token.m_type) {
+    case SqlTokenType::WORD: {
+      return is_keyword(t_token, "or") || is_keyword(t_token, "xor")
+          || is_keyword(t_token, "not") || is_keyword(t_token, "in");
+    }
+    case SqlTokenType::SYMBOL: {
+      return "|" == t_token.m_text || "!" == t_token.m_text;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+bool is_literal(const SqlToken& t_token)
+{
+  return SqlTokenType::STRING == t_token.m_type
+      || SqlTokenType::NUMBER == t_token.m_type;
+}
+
+}  // namespace
+
+
+// ======== ShardRouter ========
+
+std::string_view ShardRouter::find_key(
+    std::string_view t_sql, std::string_view t_column)
+{
+  /// States of the INSERT scan.
+  enum class InsertState
+  {
+    NONE,
+    TABLE,  // The table name, the column list or VALUES is next.
+    COLUMNS,  // Inside the column list.
+    VALUES,  // After VALUES, the first row is next.
+    ROW,  // Inside the first row.
+    ROW_END  // After the first row, the next row is not allowed.
+  };
+
+  SqlScanner scanner(t_sql, "shard_key");
+  InsertState insert_state = InsertState::NONE;
+  std::size_t column_index = 0;
+  std::size_t key_index = static_cast<std::size_t>(-1);
+  std::size_t depth = 0;
+
+  // The equalities are searched after WHERE, or after SET of INSERT.
+  bool in_condition = false;
+  bool is_first = true;
+  SqlToken before_previous;
+  SqlToken previous;
+  SqlToken key_candidate;
+  std::string_view key;
+  bool is_multi_key = false;
+
+  for(SqlToken token = scanner.next(); true; token = scanner.next()) {
+    // The shard sessions run the plain DML only, the other statements
+    // with the key hint are not run with the account of the proxy.
+    if(is_first) {
+      is_first = false;
+      if(is_keyword(token, "insert")) {
+        insert_state = InsertState::TABLE;
+      } else if(!is_keyword(token, "select") && !is_keyword(token, "update")
+          && !is_keyword(token, "delete")) {
+        return {};
+      }
+    } else if(is_keyword(token, "select")
+        || (in_condition && is_multi_key_operator(token))) {
+      // The whole statement is scanned, the key is not taken if the query
+      // can touch the rows of the other keys: the conditions with OR, NOT
+      // or IN, the subqueries and INSERT ... SELECT.
+      is_multi_key = true;
+    }
+
+    if(!scanner.hint().empty()) {
+      return scanner.hint();
+    }
+    if(SqlTokenType::END != key_candidate.m_type) {
+      if(is_value_end(token) && key.empty()) {
+        key = key_candidate.m_text;
+      }
+      key_candidate = SqlToken{};
+    }
+    if(SqlTokenType::END == token.m_type) {
+      return is_multi_key ? std::string_view{} : key;
+    }
+
+    if(SqlTokenType::WORD == token.m_type) {
+      if(SqlScanner::equals_nocase(token.m_text, "where")) {
+        in_condition = true;
+      } else if(InsertState::NONE != insert_state
+          && SqlScanner::equals_nocase(token.m_text, "set")) {
+        in_condition = true;
+      } else if(InsertState::TABLE == insert_state
+          && (SqlScanner::equals_nocase(token.m_text, "values")
+              || SqlScanner::equals_nocase(token.m_text, "value"))) {
+        insert_state = InsertState::VALUES;
+      }
+    }
+
+    switch(insert_state) {
+      case InsertState::TABLE: {
+        if("(" == token.m_text && SqlTokenType::SYMBOL == token.m_type) {
+          insert_state = InsertState::COLUMNS;
+          column_index = 0;
+        }
+        break;
+      }
+      case InsertState::COLUMNS: {
+        if(SqlTokenType::WORD == token.m_type
+            && SqlScanner::equals_nocase(token.m_text, t_column)) {
+          key_index = column_index;
+        } else if(SqlTokenType::SYMBOL == token.m_type) {
+          if("," == token.m_text) {
+            ++column_index;
+          } else if(")" == token.m_text) {
+            insert_state = InsertState::TABLE;
+          }
+        }
+        break;
+      }
+      case InsertState::VALUES: {
+        if(SqlTokenType::SYMBOL == token.m_type && "(" == token.m_text) {
+          insert_state = InsertState::ROW;
+          column_index = 0;
+          depth = 1;
+        }
+        break;
+      }
+      case InsertState::ROW: {
+        if(SqlTokenType::SYMBOL == token.m_type) {
+          if("(" == token.m_text) {
+            ++depth;
+          } else if(")" == token.m_text && 0 == --depth) {
+            insert_state = InsertState::ROW_END;
+          } else if("," == token.m_text && 1 == depth) {
+            ++column_index;
+          }
+        } else if(1 == depth && column_index == key_index && is_literal(token)
+            && ("(" == previous.m_text || "," == previous.m_text)) {
+          key_candidate = token;
+        }
+        break;
+      }
+      case InsertState::ROW_END: {
+        // The rows of INSERT ... VALUES can have the different keys.
+        if(SqlTokenType::SYMBOL == token.m_type && "," == token.m_text) {
+          is_multi_key = true;
+        }
+        insert_state = InsertState::NONE;
+        break;
+      }
+      case InsertState::NONE: {
+        break;
+      }
+    }
+
+    // "<column> = <literal>", the column can be qualified.
+    if(in_condition && is_literal(token)
+        && SqlTokenType::SYMBOL == previous.m_type && "=" == previous.m_text
+        && SqlTokenType::WORD == before_previous.m_type
+        && SqlScanner::equals_nocase(before_previous.m_text, t_column)) {
+      key_candidate = token;
+    }
+
+    before_previous = previous;
+    previous = token;
+  }
+}
+
+bool ShardRouter::changes_session_state(std::string_view t_sql)
+{
+  SqlScanner scanner(t_sql);
+  const SqlToken first = scanner.next();
+  if(is_keyword(first, "create")) {
+    return is_keyword(scanner.next(), "temporary");
+  }
+  return is_keyword(first, "set") || is_keyword(first, "use")
+      || is_keyword(first, "lock") || is_keyword(first, "prepare");
+}
+
+}  // namespace proxy
@@ -0,0 +1,331 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "socket_handoff.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/asio.hpp>
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <csignal>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+extern char** environ;
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+namespace proxy
+{
+namespace
+{
+/// Max number of the sockets in the handoff, SCM_MAX_FD of Linux.
+const std::size_t MAX_SOCKETS = 253;
+
+/// The byte of the new process confirmation.
+const char READY = 'R';
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+void append_uint32(std::string& t_data, std::uint32_t t_value)
+{
+  for(unsigned int i = 0; i < 4; ++i) {
+    t_data.push_back(static_cast<char>((t_value >> (8u * i)) & 0xFFu));
+  }
+}
+
+std::uint32_t read_uint32(const std::string& t_data, std::size_t& t_pos)
+{
+  if(t_pos + 4 > t_data.size()) {
+    throw std::runtime_error("Wrong socket handoff message");
+  }
+  std::uint32_t value = 0;
+  for(unsigned int i = 0; i < 4; ++i) {
+    value |= static_cast<std::uint32_t>(
+                 static_cast<unsigned char>(t_data[t_pos + i]))
+        << (8u * i);
+  }
+  t_pos += 4;
+  return value;
+}
+
+/// Find the executable file as execvp() does it, but before fork().
+std::string find_executable(const std::string& t_name)
+{
+  if(std::string::npos != t_name.find('/')) {
+    return t_name;
+  }
+
+  const char* path = std::getenv("PATH");
+  std::string dirs = (nullptr != path) ? path : "/usr/local/bin:/usr/bin:/bin";
+  std::size_t begin = 0;
+  while(begin <= dirs.size()) {
+    std::size_t end = dirs.find(':', begin);
+    if(std::string::npos == end) {
+      end = dirs.size();
+    }
+    const std::string dir = dirs.substr(begin, end - begin);
+    const std::string file = (dir.empty() ? "." : dir) + "/" + t_name;
+    if(0 == ::access(file.c_str(), X_OK)) {
+      return file;
+    }
+    begin = end + 1;
+  }
+  return t_name;
+}
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+}  // namespace
+
+constexpr char SocketHandoff::FD_ENV_NAME[];
+
+SocketHandoff::SocketHandoff()
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  const char* handoff_fd = std::getenv(FD_ENV_NAME);
+  if(nullptr == handoff_fd) {
+    return;
+  }
+  m_handoff_fd = std::atoi(handoff_fd);
+  // The next upgrade sets it again.
+  ::unsetenv(FD_ENV_NAME);
+
+  // The message is the data length, then the address length and the address
+  // of each socket. The sockets are in the ancillary data of its beginning.
+  std::string data(64 * 1024, '\0');
+  alignas(cmsghdr) char control[CMSG_SPACE(MAX_SOCKETS * sizeof(int))];
+  iovec iov{&data[0], data.size()};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  const ssize_t received = ::recvmsg(m_handoff_fd, &message, 0);
+  if(received < 4) {
+    throw std::runtime_error("Can not receive the sockets of the old process");
+  }
+
+  std::vector<int> fds;
+  for(cmsghdr* header = CMSG_FIRSTHDR(&message); nullptr != header;
+      header = CMSG_NXTHDR(&message, header)) {
+    if(SOL_SOCKET == header->cmsg_level && SCM_RIGHTS == header->cmsg_type) {
+      const std::size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      const auto* header_fds = reinterpret_cast<const int*>(CMSG_DATA(header));
+      fds.insert(fds.end(), header_fds, header_fds + count);
+    }
+  }
+
+  // Read the rest of the data which is not received by the first call.
+  std::size_t pos = 0;
+  std::size_t length = static_cast<std::size_t>(received);
+  const std::size_t data_length = read_uint32(data, pos) + 4u;
+  if(data_length > data.size()) {
+    throw std::runtime_error("Wrong socket handoff message");
+  }
+  while(length < data_length) {
+    const ssize_t rest =
+        ::recv(m_handoff_fd, &data[length], data_length - length, 0);
+    if(rest <= 0) {
+      throw std::runtime_error("Can not receive the sockets of the old process");
+    }
+    length += static_cast<std::size_t>(rest);
+  }
+  data.resize(data_length);
+
+  for(const int fd : fds) {
+    const std::size_t address_length = read_uint32(data, pos);
+    if(pos + address_length > data.size()) {
+      throw std::runtime_error("Wrong socket handoff message");
+    }
+    m_sockets.push_back(HandoffSocket{data.substr(pos, address_length), fd});
+    pos += address_length;
+  }
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+}
+
+SocketHandoff::~SocketHandoff()
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  // The old process is not confirmed, it keeps accepting.
+  for(const HandoffSocket& socket : m_sockets) {
+    ::close(socket.m_fd);
+  }
+  if(0 <= m_handoff_fd) {
+    ::close(m_handoff_fd);
+  }
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+}
+
+int SocketHandoff::take_socket(const std::string& t_address)
+{
+  for(auto it = m_sockets.begin(); it != m_sockets.end(); ++it) {
+    if(it->m_address == t_address) {
+      const int fd = it->m_fd;
+      m_sockets.erase(it);
+      return fd;
+    }
+  }
+  return -1;
+}
+
+void SocketHandoff::confirm()
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  for(const HandoffSocket& socket : m_sockets) {
+    ::close(socket.m_fd);
+  }
+  m_sockets.clear();
+
+  if(0 <= m_handoff_fd) {
+    const ssize_t sent = ::send(m_handoff_fd, &READY, 1, MSG_NOSIGNAL);
+    (void)sent;
+    ::close(m_handoff_fd);
+    m_handoff_fd = -1;
+  }
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+}
+
+// static
+bool SocketHandoff::upgrade(const std::vector<std::string>& t_command_line,
+    const std::vector<HandoffSocket>& t_sockets,
+    std::chrono::milliseconds t_timeout)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  if(t_command_line.empty() || t_sockets.size() > MAX_SOCKETS) {
+    return false;
+  }
+
+  int pair_fds[2];
+  if(0 != ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair_fds)) {
+    return false;
+  }
+
+  // Everything for the new process is prepared before fork(),
+  // the child of the multithreaded process only closes and execs.
+  const std::string executable = find_executable(t_command_line[0]);
+  std::vector<char*> argv;
+  for(const std::string& arg : t_command_line) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  const std::string fd_env =
+      std::string(FD_ENV_NAME) + "=" + std::to_string(pair_fds[1]);
+  std::vector<char*> envp;
+  for(char** env = environ; nullptr != *env; ++env) {
+    if(0 != std::strncmp(*env, FD_ENV_NAME, std::strlen(FD_ENV_NAME))) {
+      envp.push_back(*env);
+    }
+  }
+  envp.push_back(const_cast<char*>(fd_env.c_str()));
+  envp.push_back(nullptr);
+
+  const long max_fd = ::sysconf(_SC_OPEN_MAX);
+
+  const pid_t pid = ::fork();
+  if(0 == pid) {
+    // The new process gets only the standard streams and the handoff socket,
+    // the connections of the old process are not kept open by it.
+    for(long fd = 3; fd < max_fd; ++fd) {
+      if(fd != pair_fds[1]) {
+        ::close(static_cast<int>(fd));
+      }
+    }
+    ::execve(executable.c_str(), argv.data(), envp.data());
+    ::_exit(127);
+  }
+
+  ::close(pair_fds[1]);
+  if(pid < 0) {
+    ::close(pair_fds[0]);
+    return false;
+  }
+
+  // Send the addresses and the sockets.
+  std::string addresses;
+  for(const HandoffSocket& socket : t_sockets) {
+    append_uint32(
+        addresses, static_cast<std::uint32_t>(socket.m_address.size()));
+    addresses.append(socket.m_address);
+  }
+  std::string data;
+  append_uint32(data, static_cast<std::uint32_t>(addresses.size()));
+  data.append(addresses);
+
+  alignas(cmsghdr) char control[CMSG_SPACE(MAX_SOCKETS * sizeof(int))] = {};
+  iovec iov{&data[0], data.size()};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  if(!t_sockets.empty()) {
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(t_sockets.size() * sizeof(int));
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(t_sockets.size() * sizeof(int));
+    auto* header_fds = reinterpret_cast<int*>(CMSG_DATA(header));
+    for(std::size_t i = 0; i < t_sockets.size(); ++i) {
+      header_fds[i] = t_sockets[i].m_fd;
+    }
+  }
+
+  bool is_ready = false;
+  ssize_t sent = ::sendmsg(pair_fds[0], &message, MSG_NOSIGNAL);
+  std::size_t length = (0 < sent) ? static_cast<std::size_t>(sent) : 0;
+  while(0 < sent && length < data.size()) {
+    sent = ::send(pair_fds[0], &data[length], data.size() - length, MSG_NOSIGNAL);
+    length += (0 < sent) ? static_cast<std::size_t>(sent) : 0;
+  }
+
+  // Wait for the new process confirmation.
+  if(length == data.size()) {
+    pollfd poll_fd{pair_fds[0], POLLIN, 0};
+    char reply = 0;
+    is_ready = 1 == ::poll(&poll_fd, 1, static_cast<int>(t_timeout.count()))
+        && 1 == ::recv(pair_fds[0], &reply, 1, 0) && READY == reply;
+  }
+  ::close(pair_fds[0]);
+
+  if(!is_ready) {
+    ::kill(pid, SIGTERM);
+    ::waitpid(pid, nullptr, 0);
+  }
+  return is_ready;
+#else  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  (void)t_command_line;
+  (void)t_sockets;
+  (void)t_timeout;
+  return false;
+#endif  // if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+}
+
+}  // namespace proxy
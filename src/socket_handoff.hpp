@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SOCKET_HANDOFF_HPP
+#define PROXY_SOCKET_HANDOFF_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace proxy
+{
+/// The listening socket passed to the new process by the binary upgrade.
+struct HandoffSocket
+{
+  /// Listener address, "<address>:<port>" or "unix:<path>".
+  std::string m_address;
+
+  /// Socket descriptor.
+  int m_fd = -1;
+};
+
+
+/// Handoff of the listening sockets to the new process of the binary upgrade.
+/// The old process starts the new one with the Unix socket pair
+/// and sends the listening sockets with SCM_RIGHTS. The new process
+/// listens on them and confirms that it is ready, then the old process
+/// stops accepting and drains its connections. The listen queues are
+/// not closed at any moment, so the clients are not refused.
+class SocketHandoff
+{
+public:
+  SocketHandoff(const SocketHandoff&) = delete;
+  SocketHandoff(SocketHandoff&&) = delete;
+  SocketHandoff& operator=(const SocketHandoff&) = delete;
+  SocketHandoff& operator=(SocketHandoff&&) = delete;
+
+  ~SocketHandoff();
+
+  /// Name of the environment variable with the descriptor
+  /// of the handoff socket in the new process.
+  static constexpr char FD_ENV_NAME[] = "BOOST_ASIO_MYSQL_PROXY_HANDOFF_FD";
+
+  /// Receive the sockets from the old process if the process is started
+  /// by the upgrade. Throws std::runtime_error if the sockets can not
+  /// be received.
+  explicit SocketHandoff();
+
+  /// Take the passed socket of the listener address, -1 if it is not passed.
+  int take_socket(const std::string& t_address);
+
+  /// Tell the old process that the new one is ready to accept,
+  /// close the passed sockets which are not taken.
+  void confirm();
+
+  /// Start the new process with the command line and pass the sockets to it.
+  /// Returns true if the new process is ready in the timeout,
+  /// the old process must stop accepting then.
+  static bool upgrade(const std::vector<std::string>& t_command_line,
+      const std::vector<HandoffSocket>& t_sockets,
+      std::chrono::milliseconds t_timeout);
+
+private:
+  /// The handoff socket of the new process, -1 if it is not started
+  /// by the upgrade.
+  int m_handoff_fd = -1;
+
+  /// The passed sockets which are not taken yet.
+  std::vector<HandoffSocket> m_sockets;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_SOCKET_HANDOFF_HPP
@@ -0,0 +1,144 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "socket_options.hpp"
+
+namespace proxy
+{
+namespace
+{
+// The options which are not in Boost.Asio, if the system has them.
+template<int t_level, int t_name>
+using IntegerOption = boost::asio::detail::socket_option::integer<t_level, t_name>;
+
+#if defined(TCP_KEEPIDLE)
+using KeepAliveIdle = IntegerOption<IPPROTO_TCP, TCP_KEEPIDLE>;
+#endif  // if defined(TCP_KEEPIDLE)
+
+#if defined(TCP_KEEPINTVL)
+using KeepAliveInterval = IntegerOption<IPPROTO_TCP, TCP_KEEPINTVL>;
+#endif  // if defined(TCP_KEEPINTVL)
+
+#if defined(TCP_KEEPCNT)
+using KeepAliveCount = IntegerOption<IPPROTO_TCP, TCP_KEEPCNT>;
+#endif  // if defined(TCP_KEEPCNT)
+
+#if defined(SO_BUSY_POLL)
+using BusyPoll = IntegerOption<SOL_SOCKET, SO_BUSY_POLL>;
+#endif  // if defined(SO_BUSY_POLL)
+
+#if defined(TCP_NOTSENT_LOWAT)
+using NotSentLowAt = IntegerOption<IPPROTO_TCP, TCP_NOTSENT_LOWAT>;
+#endif  // if defined(TCP_NOTSENT_LOWAT)
+
+#if defined(TCP_QUICKACK)
+using QuickAck = IntegerOption<IPPROTO_TCP, TCP_QUICKACK>;
+#endif  // if defined(TCP_QUICKACK)
+
+#if defined(TCP_DEFER_ACCEPT)
+using DeferAccept = IntegerOption<IPPROTO_TCP, TCP_DEFER_ACCEPT>;
+#endif  // if defined(TCP_DEFER_ACCEPT)
+
+}  // namespace
+
+void set_socket_options(
+    StreamProtocol::socket& t_socket, const SocketSettings& t_settings)
+{
+  boost::system::error_code error;
+
+  t_socket.set_option(
+      boost::asio::ip::tcp::no_delay(t_settings.m_tcp_nodelay), error);
+
+  if(0 < t_settings.m_receive_buffer) {
+    t_socket.set_option(boost::asio::socket_base::receive_buffer_size(
+                            static_cast<int>(t_settings.m_receive_buffer)),
+        error);
+  }
+  if(0 < t_settings.m_send_buffer) {
+    t_socket.set_option(boost::asio::socket_base::send_buffer_size(
+                            static_cast<int>(t_settings.m_send_buffer)),
+        error);
+  }
+
+  if(0 < t_settings.m_keepalive_idle) {
+    t_socket.set_option(boost::asio::socket_base::keep_alive(true), error);
+#if defined(TCP_KEEPIDLE)
+    t_socket.set_option(
+        KeepAliveIdle(static_cast<int>(t_settings.m_keepalive_idle)), error);
+#endif  // if defined(TCP_KEEPIDLE)
+#if defined(TCP_KEEPINTVL)
+    if(0 < t_settings.m_keepalive_interval) {
+      t_socket.set_option(
+          KeepAliveInterval(static_cast<int>(t_settings.m_keepalive_interval)),
+          error);
+    }
+#endif  // if defined(TCP_KEEPINTVL)
+#if defined(TCP_KEEPCNT)
+    if(0 < t_settings.m_keepalive_count) {
+      t_socket.set_option(
+          KeepAliveCount(static_cast<int>(t_settings.m_keepalive_count)), error);
+    }
+#endif  // if defined(TCP_KEEPCNT)
+  }
+
+#if defined(SO_BUSY_POLL)
+  if(0 < t_settings.m_busy_poll) {
+    t_socket.set_option(
+        BusyPoll(static_cast<int>(t_settings.m_busy_poll)), error);
+  }
+#endif  // if defined(SO_BUSY_POLL)
+
+#if defined(TCP_NOTSENT_LOWAT)
+  if(0 < t_settings.m_notsent_lowat) {
+    t_socket.set_option(
+        NotSentLowAt(static_cast<int>(t_settings.m_notsent_lowat)), error);
+  }
+#endif  // if defined(TCP_NOTSENT_LOWAT)
+
+  if(t_settings.m_tcp_quickack) {
+    set_quick_ack(t_socket);
+  }
+}
+
+void set_quick_ack(StreamProtocol::socket& t_socket)
+{
+#if defined(TCP_QUICKACK)
+  boost::system::error_code error;
+  t_socket.set_option(QuickAck(1), error);
+#else  // if defined(TCP_QUICKACK)
+  (void)t_socket;
+#endif  // if defined(TCP_QUICKACK)
+}
+
+void set_defer_accept(StreamAcceptor& t_acceptor, std::uint32_t t_seconds)
+{
+#if defined(TCP_DEFER_ACCEPT)
+  boost::system::error_code error;
+  t_acceptor.set_option(DeferAccept(static_cast<int>(t_seconds)), error);
+#else  // if defined(TCP_DEFER_ACCEPT)
+  (void)t_acceptor;
+  (void)t_seconds;
+#endif  // if defined(TCP_DEFER_ACCEPT)
+}
+
+}  // namespace proxy
@@ -0,0 +1,49 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SOCKET_OPTIONS_HPP
+#define PROXY_SOCKET_OPTIONS_HPP
+
+#include <cstdint>
+
+#include <boost/asio.hpp>
+
+#include "endpoint.hpp"
+#include "settings.hpp"
+
+namespace proxy
+{
+/// Set the options of the TCP socket of the connection. The errors
+/// are ignored, an option can be not supported by the system.
+void set_socket_options(
+    StreamProtocol::socket& t_socket, const SocketSettings& t_settings);
+
+/// Turn TCP_QUICKACK on after the read, the system turns it off by itself.
+void set_quick_ack(StreamProtocol::socket& t_socket);
+
+/// Set TCP_DEFER_ACCEPT of the listening TCP socket in seconds.
+void set_defer_accept(StreamAcceptor& t_acceptor, std::uint32_t t_seconds);
+
+}  // namespace proxy
+
+#endif  // PROXY_SOCKET_OPTIONS_HPP
@@ -0,0 +1,233 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "sql_digest.hpp"
+
+#include <cctype>
+
+namespace proxy
+{
+// static
+std::uint64_t SqlDigest::compute(std::string_view t_sql)
+{
+  SqlDigest digest;
+  for(const char sql_char : t_sql) {
+    digest.update(sql_char);
+  }
+  return digest.value();
+}
+
+void SqlDigest::update(char t_sql_char)
+{
+  const auto ch = static_cast<unsigned char>(t_sql_char);
+
+  switch(m_state) {
+    case DigestState::TOKEN: {
+      add_token_char(t_sql_char);
+      break;
+    }
+
+    case DigestState::STRING: {
+      if('\\' == ch) {
+        m_state = DigestState::STRING_ESCAPE;
+      } else if(t_sql_char == m_quote) {
+        m_state = DigestState::STRING_QUOTE;
+      }
+      break;
+    }
+
+    case DigestState::STRING_ESCAPE: {
+      m_state = DigestState::STRING;
+      break;
+    }
+
+    case DigestState::STRING_QUOTE: {
+      // The doubled quote is the quote inside the string.
+      if(t_sql_char == m_quote) {
+        m_state = DigestState::STRING;
+      } else {
+        m_state = DigestState::TOKEN;
+        add_token_char(t_sql_char);
+      }
+      break;
+    }
+
+    case DigestState::NUMBER: {
+      if('e' == ch || 'E' == ch) {
+        m_state = DigestState::NUMBER_EXPONENT;
+      } else if(!std::isalnum(ch) && '.' != ch) {
+        m_state = DigestState::TOKEN;
+        add_token_char(t_sql_char);
+      }
+      break;
+    }
+
+    case DigestState::NUMBER_EXPONENT: {
+      if(std::isalnum(ch) || '.' == ch || '+' == ch || '-' == ch) {
+        m_state = DigestState::NUMBER;
+      } else {
+        m_state = DigestState::TOKEN;
+        add_token_char(t_sql_char);
+      }
+      break;
+    }
+
+    case DigestState::QUOTED_IDENTIFIER: {
+      add_char(t_sql_char);
+      if('`' == ch) {
+        m_state = DigestState::TOKEN;
+      }
+      break;
+    }
+
+    case DigestState::SLASH: {
+      if('*' == ch) {
+        m_state = DigestState::BLOCK_COMMENT;
+      } else {
+        m_state = DigestState::TOKEN;
+        add_space();
+        add_char('/');
+        add_token_char(t_sql_char);
+      }
+      break;
+    }
+
+    case DigestState::BLOCK_COMMENT: {
+      if('*' == ch) {
+        m_state = DigestState::BLOCK_COMMENT_END;
+      }
+      break;
+    }
+
+    case DigestState::BLOCK_COMMENT_END: {
+      if('/' == ch) {
+        m_state = DigestState::TOKEN;
+        m_space = true;
+      } else if('*' != ch) {
+        m_state = DigestState::BLOCK_COMMENT;
+      }
+      break;
+    }
+
+    case DigestState::DASH: {
+      if('-' == ch) {
+        m_state = DigestState::DASH_DASH;
+      } else {
+        m_state = DigestState::TOKEN;
+        add_space();
+        add_char('-');
+        add_token_char(t_sql_char);
+      }
+      break;
+    }
+
+    case DigestState::DASH_DASH: {
+      // See https://dev.mysql.com/doc/refman/8.0/en/ansi-diff-comments.html
+      if(std::isspace(ch)) {
+        m_state = DigestState::LINE_COMMENT;
+      } else {
+        m_state = DigestState::TOKEN;
+        add_space();
+        add_char('-');
+        add_char('-');
+        add_token_char(t_sql_char);
+      }
+      break;
+    }
+
+    case DigestState::LINE_COMMENT: {
+      if('\n' == ch) {
+        m_state = DigestState::TOKEN;
+        m_space = true;
+      }
+      break;
+    }
+  }
+}
+
+void SqlDigest::add_space()
+{
+  // The whitespaces are added before the next token only.
+  if(m_space && 0 != m_last_char) {
+    add_char(' ');
+  }
+  m_space = false;
+}
+
+void SqlDigest::add_token_char(char t_char)
+{
+  const auto ch = static_cast<unsigned char>(t_char);
+
+  if(std::isspace(ch)) {
+    m_space = true;
+    return;
+  }
+
+  switch(ch) {
+    case '\'':
+    case '"': {
+      add_space();
+      add_char('?');
+      m_quote = t_char;
+      m_state = DigestState::STRING;
+      return;
+    }
+    case '`': {
+      add_space();
+      add_char('`');
+      m_state = DigestState::QUOTED_IDENTIFIER;
+      return;
+    }
+    case '/': {
+      m_state = DigestState::SLASH;
+      return;
+    }
+    case '-': {
+      m_state = DigestState::DASH;
+      return;
+    }
+    case '#': {
+      m_state = DigestState::LINE_COMMENT;
+      return;
+    }
+    default: {
+      break;
+    }
+  }
+
+  const auto last_ch = static_cast<unsigned char>(m_last_char);
+  const bool in_identifier = !m_space
+      && (std::isalnum(last_ch) || '_' == last_ch || '$' == last_ch);
+
+  if(std::isdigit(ch) && !in_identifier) {
+    add_space();
+    add_char('?');
+    m_state = DigestState::NUMBER;
+    return;
+  }
+
+  add_space();
+  add_char(static_cast<char>(std::tolower(ch)));
+}
+
+}  // namespace proxy
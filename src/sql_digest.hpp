@@ -0,0 +1,117 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SQL_DIGEST_HPP
+#define PROXY_SQL_DIGEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace proxy
+{
+/// Calculates the digest of the SQL string byte by byte.
+/// The literals are replaced with '?', the whitespaces and the comments
+/// are collapsed and the letters are lowercased, so the statements
+/// which differ only in the values have the same digest.
+class SqlDigest
+{
+  enum class DigestState
+  {
+    TOKEN,
+    STRING,
+    STRING_QUOTE,
+    STRING_ESCAPE,
+    NUMBER,
+    NUMBER_EXPONENT,
+    QUOTED_IDENTIFIER,
+    SLASH,
+    BLOCK_COMMENT,
+    BLOCK_COMMENT_END,
+    DASH,
+    DASH_DASH,
+    LINE_COMMENT
+  };
+
+public:
+  SqlDigest(const SqlDigest&) = default;
+  SqlDigest(SqlDigest&&) = default;
+  SqlDigest& operator=(const SqlDigest&) = default;
+  SqlDigest& operator=(SqlDigest&&) = default;
+
+  ~SqlDigest() = default;
+
+  explicit SqlDigest() = default;
+
+  /// Calculate the digest of the whole SQL string.
+  static std::uint64_t compute(std::string_view t_sql);
+
+  /// Add the next byte of the SQL string.
+  void update(char t_sql_char);
+
+  /// Start the digest of the new SQL string.
+  void reset();
+
+  /// Get the digest of the added bytes.
+  std::uint64_t value() const;
+
+private:
+  void add_char(char t_char);
+  void add_space();
+  void add_token_char(char t_char);
+
+  // FNV-1a, see http://www.isthe.com/chongo/tech/comp/fnv/
+  static const std::uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+  static const std::uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+  std::uint64_t m_hash = FNV_OFFSET_BASIS;
+  DigestState m_state = DigestState::TOKEN;
+  char m_quote = 0;
+  char m_last_char = 0;
+  bool m_space = false;
+};
+
+inline void SqlDigest::reset()
+{
+  m_hash = FNV_OFFSET_BASIS;
+  m_state = DigestState::TOKEN;
+  m_quote = 0;
+  m_last_char = 0;
+  m_space = false;
+}
+
+inline std::uint64_t SqlDigest::value() const
+{
+  return m_hash;
+}
+
+inline void SqlDigest::add_char(char t_char)
+{
+  m_hash ^= static_cast<unsigned char>(t_char);
+  m_hash *= FNV_PRIME;
+  m_last_char = t_char;
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_SQL_DIGEST_HPP
@@ -0,0 +1,189 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "sql_scanner.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace proxy
+{
+namespace
+{
+/// The classes of the characters, the table lookup is faster
+/// than the locale-aware <cctype> calls.
+enum CharClass : unsigned char
+{
+  SPACE_CHAR = 1,
+  DIGIT_CHAR = 2,
+  WORD_CHAR = 4
+};
+
+constexpr std::array<unsigned char, 256> make_char_classes()
+{
+  std::array<unsigned char, 256> classes{};
+  for(std::size_t ch = 0; ch < classes.size(); ++ch) {
+    if(' ' == ch || ('\t' <= ch && ch <= '\r')) {
+      classes[ch] = SPACE_CHAR;
+    } else if('0' <= ch && ch <= '9') {
+      classes[ch] = DIGIT_CHAR | WORD_CHAR;
+    } else if(('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z')
+        || '_' == ch || '$' == ch || 0x80 <= ch) {
+      classes[ch] = WORD_CHAR;
+    }
+  }
+  return classes;
+}
+
+constexpr std::array<unsigned char, 256> CHAR_CLASSES = make_char_classes();
+
+bool is_word_char(char t_char)
+{
+  return 0 != (CHAR_CLASSES[static_cast<unsigned char>(t_char)] & WORD_CHAR);
+}
+
+bool is_digit(char t_char)
+{
+  return 0 != (CHAR_CLASSES[static_cast<unsigned char>(t_char)] & DIGIT_CHAR);
+}
+
+bool is_space(char t_char)
+{
+  return 0 != (CHAR_CLASSES[static_cast<unsigned char>(t_char)] & SPACE_CHAR);
+}
+
+}  // namespace
+
+SqlScanner::SqlScanner(std::string_view t_sql, std::string_view t_hint_name)
+    : m_sql(t_sql)
+    , m_hint_name(t_hint_name)
+{
+}
+
+SqlToken SqlScanner::next()
+{
+  const std::size_t size = m_sql.size();
+  while(m_pos < size) {
+    const char ch = m_sql[m_pos];
+    if(is_space(ch)) {
+      ++m_pos;
+    } else if('/' == ch && m_pos + 1 < size && '*' == m_sql[m_pos + 1]) {
+      std::size_t end = m_sql.find("*/", m_pos + 2);
+      if(std::string_view::npos == end) {
+        end = size;
+      }
+      if(!m_hint_name.empty()) {
+        read_hint(m_sql.substr(m_pos + 2, end - m_pos - 2));
+      }
+      m_pos = std::min(end + 2, size);
+    } else if('#' == ch
+        || ('-' == ch && m_pos + 1 < size && '-' == m_sql[m_pos + 1]
+            && (m_pos + 2 == size || is_space(m_sql[m_pos + 2])))) {
+      // See https://dev.mysql.com/doc/refman/8.0/en/comments.html
+      m_pos = std::min(m_sql.find('\n', m_pos), size);
+    } else {
+      break;
+    }
+  }
+  if(m_pos >= size) {
+    return SqlToken{};
+  }
+
+  const std::size_t begin = m_pos;
+  const char ch = m_sql[m_pos];
+  if('\'' == ch || '"' == ch || '`' == ch) {
+    // The quotes inside are doubled, or escaped in the strings.
+    ++m_pos;
+    while(m_pos < size) {
+      if('\\' == m_sql[m_pos] && '`' != ch) {
+        m_pos += 2;
+      } else if(ch != m_sql[m_pos]) {
+        ++m_pos;
+      } else if(m_pos + 1 < size && ch == m_sql[m_pos + 1]) {
+        m_pos += 2;
+      } else {
+        break;
+      }
+    }
+    const std::size_t end = std::min(m_pos, size);
+    m_pos = std::min(m_pos + 1, size);
+    m_sign_is_allowed = false;
+    return SqlToken{('`' == ch) ? SqlTokenType::WORD : SqlTokenType::STRING,
+        m_sql.substr(begin + 1, end - begin - 1)};
+  }
+
+  const bool is_signed = '-' == ch && m_sign_is_allowed && m_pos + 1 < size
+      && is_digit(m_sql[m_pos + 1]);
+  if(is_digit(ch) || is_signed) {
+    ++m_pos;
+    while(m_pos < size
+        && (is_word_char(m_sql[m_pos]) || '.' == m_sql[m_pos])) {
+      ++m_pos;
+    }
+    m_sign_is_allowed = false;
+    return SqlToken{SqlTokenType::NUMBER, m_sql.substr(begin, m_pos - begin)};
+  }
+
+  if(is_word_char(ch)) {
+    while(m_pos < size && is_word_char(m_sql[m_pos])) {
+      ++m_pos;
+    }
+    m_sign_is_allowed = false;
+    return SqlToken{SqlTokenType::WORD, m_sql.substr(begin, m_pos - begin)};
+  }
+
+  ++m_pos;
+  m_sign_is_allowed = (')' != ch);
+  return SqlToken{SqlTokenType::SYMBOL, m_sql.substr(begin, 1)};
+}
+
+void SqlScanner::read_hint(std::string_view t_comment)
+{
+  std::size_t pos = 0;
+  while(pos < t_comment.size() && is_space(t_comment[pos])) {
+    ++pos;
+  }
+  if(!m_hint.empty()
+      || !equals_nocase(
+          t_comment.substr(pos, m_hint_name.size()), m_hint_name)) {
+    return;
+  }
+  pos += m_hint_name.size();
+  while(pos < t_comment.size() && is_space(t_comment[pos])) {
+    ++pos;
+  }
+  if(pos == t_comment.size() || '=' != t_comment[pos]) {
+    return;
+  }
+  ++pos;
+  while(pos < t_comment.size() && is_space(t_comment[pos])) {
+    ++pos;
+  }
+  std::size_t end = pos;
+  while(end < t_comment.size() && !is_space(t_comment[end])) {
+    ++end;
+  }
+  m_hint = t_comment.substr(pos, end - pos);
+}
+
+}  // namespace proxy
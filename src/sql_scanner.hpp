@@ -0,0 +1,118 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_SQL_SCANNER_HPP
+#define PROXY_SQL_SCANNER_HPP
+
+#include <cstddef>
+#include <string_view>
+
+namespace proxy
+{
+/// Kinds of the tokens of the SQL string.
+enum class SqlTokenType
+{
+  END,
+  WORD,  // Keyword or identifier, with or without the backticks.
+  STRING,  // Quoted string, without the quotes.
+  NUMBER,  // Number with its sign.
+  SYMBOL  // Any other character.
+};
+
+struct SqlToken
+{
+  SqlTokenType m_type = SqlTokenType::END;
+  std::string_view m_text;
+};
+
+
+/// Splits the SQL string to the tokens in a single pass, without
+/// the SQL parsing. The whitespaces and the comments are skipped,
+/// the value of the comment "/* <hint name>=<value> */" is kept as the hint.
+class SqlScanner
+{
+public:
+  SqlScanner(const SqlScanner&) = delete;
+  SqlScanner(SqlScanner&&) = delete;
+  SqlScanner& operator=(const SqlScanner&) = delete;
+  SqlScanner& operator=(SqlScanner&&) = delete;
+
+  ~SqlScanner() = default;
+
+  /// The hints are not read if the hint name is empty.
+  explicit SqlScanner(
+      std::string_view t_sql, std::string_view t_hint_name = {});
+
+  /// Get the next token, END at the string end.
+  SqlToken next();
+
+  /// Get the value of the hint comment, empty if no hint is scanned.
+  std::string_view hint() const;
+
+  /// Compare the token's text with the word case-insensitively.
+  static bool equals_nocase(std::string_view t_text, std::string_view t_word);
+
+private:
+  /// Keep the hint value of the comment text.
+  void read_hint(std::string_view t_comment);
+
+  const std::string_view m_sql;
+  const std::string_view m_hint_name;
+  std::size_t m_pos = 0;
+  std::string_view m_hint;
+
+  /// The previous token is an operator, the minus is the number's sign.
+  bool m_sign_is_allowed = true;
+};
+
+inline std::string_view SqlScanner::hint() const
+{
+  return m_hint;
+}
+
+inline bool SqlScanner::equals_nocase(
+    std::string_view t_text, std::string_view t_word)
+{
+  if(t_text.size() != t_word.size()) {
+    return false;
+  }
+  // ASCII case folding, the keywords and the column names are compared.
+  for(std::size_t i = 0; i < t_text.size(); ++i) {
+    char ch = t_text[i];
+    if('A' <= ch && ch <= 'Z') {
+      ch = static_cast<char>(ch - 'A' + 'a');
+    }
+    char word_ch = t_word[i];
+    if('A' <= word_ch && word_ch <= 'Z') {
+      word_ch = static_cast<char>(word_ch - 'A' + 'a');
+    }
+    if(ch != word_ch) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_SQL_SCANNER_HPP
@@ -0,0 +1,486 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "statement_params.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "packet.hpp"
+
+namespace proxy
+{
+StatementParams::StatementParams()
+{
+  m_payload.reserve(MAX_PAYLOAD_LENGTH);
+  m_text.reserve(MAX_TEXT_LENGTH);
+}
+
+// static
+std::size_t StatementParams::read_header(const unsigned char* t_payload,
+    std::size_t t_length,
+    std::uint32_t t_capabilities,
+    PreparedStatement& t_statement,
+    std::size_t& t_null_bitmap_pos)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_stmt_execute.html
+  // command, statement_id, flags, iteration_count.
+  std::size_t pos = 10;
+  if(t_length < pos) {
+    return 0;
+  }
+
+  const bool query_attributes =
+      (t_capabilities & MySqlCapability::CLIENT_QUERY_ATTRIBUTES) != 0;
+  const unsigned char PARAMETER_COUNT_AVAILABLE = 0x08;
+
+  std::uint64_t num_params = t_statement.m_num_params;
+  if(query_attributes
+      && (0 < num_params || (t_payload[5] & PARAMETER_COUNT_AVAILABLE))) {
+    if(!MySqlPacket::read_lenenc_uint(t_payload, t_length, pos, num_params)) {
+      return 0;
+    }
+  }
+  if(0 == t_statement.m_num_params) {
+    return pos;
+  }
+
+  // The count is from the client, the query attributes follow
+  // the statement parameters and only the latter are decoded.
+  const std::uint64_t MAX_PARAMS = 0xffff;
+  if(num_params > MAX_PARAMS || num_params < t_statement.m_num_params
+      || t_statement.m_param_types.size() != t_statement.m_num_params) {
+    return 0;
+  }
+
+  // The NULL bitmap and the new-params-bound-flag.
+  const std::uint64_t null_bitmap_length = (num_params + 7) / 8;
+  if(null_bitmap_length + 1 > t_length - pos) {
+    return 0;
+  }
+  t_null_bitmap_pos = pos;
+  pos += null_bitmap_length;
+
+  const bool new_params_bound = (1 == t_payload[pos++]);
+  if(new_params_bound) {
+    if(2 * num_params > t_length - pos) {
+      return 0;
+    }
+    t_statement.m_param_types_known = false;
+    for(std::uint64_t i = 0; i < num_params; ++i) {
+      if(pos + 2 > t_length) {
+        return 0;
+      }
+      const std::uint16_t type = MySqlPacket::read_uint16(t_payload + pos);
+      if(i < t_statement.m_num_params) {
+        t_statement.m_param_types[i] = type;
+      }
+      pos += 2;
+
+      // The parameter name.
+      std::uint64_t name_length = 0;
+      if(query_attributes
+          && !MySqlPacket::read_lenenc_uint(
+              t_payload, t_length, pos, name_length)) {
+        return 0;
+      }
+      if(name_length > t_length - pos) {
+        return 0;
+      }
+      pos += name_length;
+    }
+    t_statement.m_param_types_known = true;
+  }
+
+  return t_statement.m_param_types_known ? pos : 0;
+}
+
+// static
+void StatementParams::read_types(const unsigned char* t_payload,
+    std::size_t t_length,
+    std::uint32_t t_capabilities,
+    PreparedStatement& t_statement)
+{
+  std::size_t null_bitmap_pos = 0;
+  read_header(t_payload, t_length, t_capabilities, t_statement, null_bitmap_pos);
+}
+
+const std::string& StatementParams::decode_execute(
+    std::uint32_t t_capabilities, PreparedStatement& t_statement)
+{
+  m_text.clear();
+
+  std::size_t null_bitmap_pos = 0;
+  std::size_t pos = read_header(m_payload.data(), m_payload.size(),
+      t_capabilities, t_statement, null_bitmap_pos);
+  if(0 == pos) {
+    append("(unknown)");
+    reset_long_data(t_statement.m_id);
+    return m_text;
+  }
+
+  append("(");
+  const std::size_t num_params = t_statement.m_param_types.size();
+  for(std::size_t i = 0; i < num_params; ++i) {
+    if(0 < i) {
+      append(", ");
+    }
+
+    if(m_payload[null_bitmap_pos + i / 8] & (1u << (i % 8))) {
+      append("NULL");
+      continue;
+    }
+
+    // The value sent with COM_STMT_SEND_LONG_DATA is not in the payload.
+    const LongData* long_data =
+        find_long_data(t_statement.m_id, static_cast<std::uint16_t>(i));
+    if(nullptr != long_data) {
+      append_quoted(long_data->m_prefix.data(), long_data->m_prefix_length);
+      if(long_data->m_prefix_length < long_data->m_length) {
+        append("...");
+      }
+      append(" (");
+      append_uint(long_data->m_length);
+      append(" bytes)");
+      continue;
+    }
+
+    if(!append_value(t_statement.m_param_types[i], pos)) {
+      append("...");
+      break;
+    }
+  }
+  append(")");
+
+  reset_long_data(t_statement.m_id);
+  return m_text;
+}
+
+bool StatementParams::append_value(std::uint16_t t_type, std::size_t& t_pos)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_binary_resultset.html
+  const unsigned char* data = m_payload.data();
+  const std::size_t length = m_payload.size();
+  const bool is_unsigned = (t_type & 0x8000u) != 0;
+
+  auto read_int = [&](std::size_t l_size, std::uint64_t& l_value) -> bool {
+    if(t_pos + l_size > length) {
+      return false;
+    }
+    l_value = 0;
+    for(std::size_t i = 0; i < l_size; ++i) {
+      l_value |= static_cast<std::uint64_t>(data[t_pos + i]) << (8u * i);
+    }
+    t_pos += l_size;
+    return true;
+  };
+
+  auto append_integer = [&](std::size_t l_size) -> bool {
+    std::uint64_t value = 0;
+    if(!read_int(l_size, value)) {
+      return false;
+    }
+    if(is_unsigned || 8 == l_size) {
+      if(is_unsigned) {
+        append_uint(value);
+      } else {
+        append_int(static_cast<std::int64_t>(value));
+      }
+    } else {
+      // Sign extension.
+      const std::uint64_t sign_bit = 1ull << (8u * l_size - 1);
+      append_int(static_cast<std::int64_t>((value ^ sign_bit) - sign_bit));
+    }
+    return true;
+  };
+
+  switch(t_type & 0xFFu) {
+    case 0x01: {  // MYSQL_TYPE_TINY
+      return append_integer(1);
+    }
+    case 0x02:  // MYSQL_TYPE_SHORT
+    case 0x0D: {  // MYSQL_TYPE_YEAR
+      return append_integer(2);
+    }
+    case 0x03:  // MYSQL_TYPE_LONG
+    case 0x09: {  // MYSQL_TYPE_INT24
+      return append_integer(4);
+    }
+    case 0x08: {  // MYSQL_TYPE_LONGLONG
+      return append_integer(8);
+    }
+
+    case 0x04: {  // MYSQL_TYPE_FLOAT
+      std::uint64_t bits = 0;
+      if(!read_int(4, bits)) {
+        return false;
+      }
+      const auto bits32 = static_cast<std::uint32_t>(bits);
+      float value = 0;
+      std::memcpy(&value, &bits32, sizeof(value));
+      append_double(value, 9);
+      return true;
+    }
+    case 0x05: {  // MYSQL_TYPE_DOUBLE
+      std::uint64_t bits = 0;
+      if(!read_int(8, bits)) {
+        return false;
+      }
+      double value = 0;
+      std::memcpy(&value, &bits, sizeof(value));
+      append_double(value, 17);
+      return true;
+    }
+
+    case 0x06: {  // MYSQL_TYPE_NULL
+      append("NULL");
+      return true;
+    }
+
+    case 0x07:  // MYSQL_TYPE_TIMESTAMP
+    case 0x0A:  // MYSQL_TYPE_DATE
+    case 0x0C: {  // MYSQL_TYPE_DATETIME
+      std::uint64_t size = 0;
+      std::uint64_t year = 0;
+      std::uint64_t month = 0;
+      std::uint64_t day = 0;
+      std::uint64_t hour = 0;
+      std::uint64_t minute = 0;
+      std::uint64_t second = 0;
+      std::uint64_t microsecond = 0;
+      if(!read_int(1, size) || t_pos + size > length) {
+        return false;
+      }
+      if(4 <= size) {
+        read_int(2, year);
+        read_int(1, month);
+        read_int(1, day);
+      }
+      if(7 <= size) {
+        read_int(1, hour);
+        read_int(1, minute);
+        read_int(1, second);
+      }
+      if(11 <= size) {
+        read_int(4, microsecond);
+      }
+      append("'");
+      append_padded(year, 4);
+      append("-");
+      append_padded(month, 2);
+      append("-");
+      append_padded(day, 2);
+      if(0x0A != (t_type & 0xFFu)) {
+        append(" ");
+        append_padded(hour, 2);
+        append(":");
+        append_padded(minute, 2);
+        append(":");
+        append_padded(second, 2);
+        if(0 < microsecond) {
+          append(".");
+          append_padded(microsecond, 6);
+        }
+      }
+      append("'");
+      return true;
+    }
+
+    case 0x0B: {  // MYSQL_TYPE_TIME
+      std::uint64_t size = 0;
+      std::uint64_t is_negative = 0;
+      std::uint64_t days = 0;
+      std::uint64_t hour = 0;
+      std::uint64_t minute = 0;
+      std::uint64_t second = 0;
+      std::uint64_t microsecond = 0;
+      if(!read_int(1, size) || t_pos + size > length) {
+        return false;
+      }
+      if(8 <= size) {
+        read_int(1, is_negative);
+        read_int(4, days);
+        read_int(1, hour);
+        read_int(1, minute);
+        read_int(1, second);
+      }
+      if(12 <= size) {
+        read_int(4, microsecond);
+      }
+      append(is_negative ? "'-" : "'");
+      append_padded(days * 24 + hour, 2);
+      append(":");
+      append_padded(minute, 2);
+      append(":");
+      append_padded(second, 2);
+      if(0 < microsecond) {
+        append(".");
+        append_padded(microsecond, 6);
+      }
+      append("'");
+      return true;
+    }
+
+    default: {
+      // The length encoded strings: MYSQL_TYPE_STRING, MYSQL_TYPE_VARCHAR,
+      // MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_ENUM, MYSQL_TYPE_SET,
+      // MYSQL_TYPE_*BLOB, MYSQL_TYPE_GEOMETRY, MYSQL_TYPE_BIT,
+      // MYSQL_TYPE_DECIMAL, MYSQL_TYPE_NEWDECIMAL, MYSQL_TYPE_JSON.
+      std::uint64_t size = 0;
+      if(!MySqlPacket::read_lenenc_uint(data, length, t_pos, size)) {
+        return false;
+      }
+      const std::size_t available = std::min<std::uint64_t>(
+          size, std::min(length - t_pos, MAX_VALUE_LENGTH));
+      append_quoted(reinterpret_cast<const char*>(data + t_pos), available);
+      if(available < size) {
+        append("...");
+      }
+      if(t_pos + size > length) {
+        return false;
+      }
+      t_pos += size;
+      return true;
+    }
+  }
+}
+
+void StatementParams::add_long_data(std::uint64_t t_payload_length)
+{
+  // See https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_stmt_send_long_data.html
+  // command, statement_id, param_id, data.
+  const std::size_t data_pos = 7;
+  if(m_payload.size() < data_pos || t_payload_length < data_pos) {
+    return;
+  }
+
+  const std::uint32_t statement_id = MySqlPacket::read_uint32(&m_payload[1]);
+  const std::uint16_t param_id = MySqlPacket::read_uint16(&m_payload[5]);
+
+  LongData* long_data = find_long_data(statement_id, param_id);
+  if(nullptr == long_data) {
+    if(m_long_data_count == m_long_data.size()) {
+      return;
+    }
+    long_data = &m_long_data[m_long_data_count++];
+    long_data->m_statement_id = statement_id;
+    long_data->m_param_id = param_id;
+    long_data->m_length = 0;
+    long_data->m_prefix_length = 0;
+  }
+
+  const std::size_t copy_length = std::min(m_payload.size() - data_pos,
+      long_data->m_prefix.size() - long_data->m_prefix_length);
+  std::copy(m_payload.begin() + data_pos,
+      m_payload.begin() + data_pos + copy_length,
+      long_data->m_prefix.begin() + long_data->m_prefix_length);
+  long_data->m_prefix_length += copy_length;
+  long_data->m_length += t_payload_length - data_pos;
+}
+
+void StatementParams::reset_long_data(std::uint32_t t_statement_id)
+{
+  for(std::size_t i = 0; i < m_long_data_count;) {
+    if(m_long_data[i].m_statement_id == t_statement_id) {
+      m_long_data[i] = m_long_data[--m_long_data_count];
+    } else {
+      ++i;
+    }
+  }
+}
+
+StatementParams::LongData* StatementParams::find_long_data(
+    std::uint32_t t_statement_id, std::uint16_t t_param_id)
+{
+  for(std::size_t i = 0; i < m_long_data_count; ++i) {
+    if(m_long_data[i].m_statement_id == t_statement_id
+        && m_long_data[i].m_param_id == t_param_id) {
+      return &m_long_data[i];
+    }
+  }
+  return nullptr;
+}
+
+void StatementParams::append(const char* t_str, std::size_t t_length)
+{
+  // The text is not longer than the reserved capacity.
+  const std::size_t free_length = MAX_TEXT_LENGTH - m_text.size();
+  m_text.append(t_str, std::min(t_length, free_length));
+}
+
+void StatementParams::append(const char* t_str)
+{
+  append(t_str, std::strlen(t_str));
+}
+
+void StatementParams::append_quoted(const char* t_str, std::size_t t_length)
+{
+  append("'");
+  for(std::size_t i = 0; i < t_length; ++i) {
+    const auto ch = static_cast<unsigned char>(t_str[i]);
+    if('\'' == ch || '\\' == ch) {
+      append("\\", 1);
+      append(t_str + i, 1);
+    } else if(ch < 0x20 || 0x7F == ch) {
+      append(".", 1);
+    } else {
+      append(t_str + i, 1);
+    }
+  }
+  append("'");
+}
+
+void StatementParams::append_int(std::int64_t t_value)
+{
+  std::array<char, 24> buffer{};
+  const int length = std::snprintf(
+      buffer.data(), buffer.size(), "%lld", static_cast<long long>(t_value));
+  append(buffer.data(), static_cast<std::size_t>(length));
+}
+
+void StatementParams::append_uint(std::uint64_t t_value)
+{
+  std::array<char, 24> buffer{};
+  const int length = std::snprintf(buffer.data(), buffer.size(), "%llu",
+      static_cast<unsigned long long>(t_value));
+  append(buffer.data(), static_cast<std::size_t>(length));
+}
+
+void StatementParams::append_double(double t_value, int t_precision)
+{
+  std::array<char, 32> buffer{};
+  const int length = std::snprintf(
+      buffer.data(), buffer.size(), "%.*g", t_precision, t_value);
+  append(buffer.data(), static_cast<std::size_t>(length));
+}
+
+void StatementParams::append_padded(std::uint64_t t_value, int t_width)
+{
+  std::array<char, 24> buffer{};
+  const int length = std::snprintf(buffer.data(), buffer.size(), "%0*llu",
+      t_width, static_cast<unsigned long long>(t_value));
+  append(buffer.data(), static_cast<std::size_t>(length));
+}
+
+}  // namespace proxy
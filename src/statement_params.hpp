@@ -0,0 +1,142 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_STATEMENT_PARAMS_HPP
+#define PROXY_STATEMENT_PARAMS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "prepared_statements.hpp"
+
+namespace proxy
+{
+/// Decodes the parameters of COM_STMT_EXECUTE from the binary protocol
+/// to the text for the packet logging. All buffers are allocated once
+/// in the constructor, the decoding does not allocate the memory.
+class StatementParams
+{
+public:
+  StatementParams(const StatementParams&) = delete;
+  StatementParams(StatementParams&&) = delete;
+  StatementParams& operator=(const StatementParams&) = delete;
+  StatementParams& operator=(StatementParams&&) = delete;
+
+  ~StatementParams() = default;
+
+  explicit StatementParams();
+
+  /// Max number of the captured payload bytes of the command.
+  static const std::size_t MAX_PAYLOAD_LENGTH = 4096;
+
+  /// Max length of the decoded parameters text.
+  static const std::size_t MAX_TEXT_LENGTH = 1024;
+
+  /// Max length of the string value in the text.
+  static constexpr std::size_t MAX_VALUE_LENGTH = 64;
+
+  /// Max number of the parameters with COM_STMT_SEND_LONG_DATA.
+  static const std::size_t MAX_LONG_DATA_PARAMS = 8;
+
+  /// Max length of the long data kept for the text.
+  static const std::size_t MAX_LONG_DATA_LENGTH = 32;
+
+  /// Buffer for the payload capture, its capacity is MAX_PAYLOAD_LENGTH.
+  std::vector<unsigned char>& payload();
+
+  /// Remember the parameter types from the payload begin
+  /// of COM_STMT_EXECUTE which is not decoded.
+  static void read_types(const unsigned char* t_payload,
+      std::size_t t_length,
+      std::uint32_t t_capabilities,
+      PreparedStatement& t_statement);
+
+  /// Decode the captured payload of COM_STMT_EXECUTE.
+  const std::string& decode_execute(
+      std::uint32_t t_capabilities, PreparedStatement& t_statement);
+
+  /// Remember the captured payload of COM_STMT_SEND_LONG_DATA.
+  void add_long_data(std::uint64_t t_payload_length);
+
+  /// Forget the long data of the statement, the server does it
+  /// after COM_STMT_EXECUTE and COM_STMT_RESET.
+  void reset_long_data(std::uint32_t t_statement_id);
+
+  /// Get the last decoded text.
+  const std::string& text() const;
+
+private:
+  /// The long data of the parameter.
+  struct LongData
+  {
+    std::uint32_t m_statement_id = 0;
+    std::uint16_t m_param_id = 0;
+    std::uint64_t m_length = 0;
+    std::size_t m_prefix_length = 0;
+    std::array<char, MAX_LONG_DATA_LENGTH> m_prefix{};
+  };
+
+  /// Read the parameter count, the NULL bitmap position and the types.
+  /// Returns the position of the values or 0 if the payload is too short.
+  static std::size_t read_header(const unsigned char* t_payload,
+      std::size_t t_length,
+      std::uint32_t t_capabilities,
+      PreparedStatement& t_statement,
+      std::size_t& t_null_bitmap_pos);
+
+  /// Decode the value of the type, returns false if the payload is too short.
+  bool append_value(std::uint16_t t_type, std::size_t& t_pos);
+
+  LongData* find_long_data(
+      std::uint32_t t_statement_id, std::uint16_t t_param_id);
+
+  void append(const char* t_str, std::size_t t_length);
+  void append(const char* t_str);
+  void append_quoted(const char* t_str, std::size_t t_length);
+  void append_int(std::int64_t t_value);
+  void append_uint(std::uint64_t t_value);
+  void append_double(double t_value, int t_precision);
+  void append_padded(std::uint64_t t_value, int t_width);
+
+  std::vector<unsigned char> m_payload;
+  std::string m_text;
+  std::array<LongData, MAX_LONG_DATA_PARAMS> m_long_data;
+  std::size_t m_long_data_count = 0;
+};
+
+inline std::vector<unsigned char>& StatementParams::payload()
+{
+  return m_payload;
+}
+
+inline const std::string& StatementParams::text() const
+{
+  return m_text;
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_STATEMENT_PARAMS_HPP
@@ -0,0 +1,378 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "table_stats.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include "sql_scanner.hpp"
+
+namespace proxy
+{
+namespace
+{
+/// The sums of the counters of the workers.
+struct TableTotals
+{
+  std::uint64_t m_reads = 0;
+  std::uint64_t m_writes = 0;
+  std::uint64_t m_read_time = 0;
+  std::uint64_t m_write_time = 0;
+
+  void add(const TableCounters& t_counters)
+  {
+    m_reads += t_counters.m_reads.load(std::memory_order_relaxed);
+    m_writes += t_counters.m_writes.load(std::memory_order_relaxed);
+    m_read_time += t_counters.m_read_time.load(std::memory_order_relaxed);
+    m_write_time += t_counters.m_write_time.load(std::memory_order_relaxed);
+  }
+};
+
+bool is_keyword(const SqlToken& t_token, std::string_view t_word)
+{
+  return SqlTokenType::WORD == t_token.m_type
+      && SqlScanner::equals_nocase(t_token.m_text, t_word);
+}
+
+bool is_symbol(const SqlToken& t_token, char t_symbol)
+{
+  return SqlTokenType::SYMBOL == t_token.m_type
+      && t_symbol == t_token.m_text[0];
+}
+
+/// Check if the word is between the keyword and the table name,
+/// e.g. "INSERT IGNORE INTO" or "LOAD DATA ... INTO TABLE".
+bool is_table_modifier(std::string_view t_word)
+{
+  static const std::string_view MODIFIERS[] = {"into", "table", "ignore",
+      "low_priority", "high_priority", "delayed", "quick", "lateral"};
+  return std::any_of(std::begin(MODIFIERS), std::end(MODIFIERS),
+      [t_word](std::string_view l_modifier) -> bool {
+        return SqlScanner::equals_nocase(t_word, l_modifier);
+      });
+}
+
+/// Check if the word starts the clause after the list of the tables.
+bool ends_table_list(std::string_view t_word)
+{
+  static const std::string_view CLAUSES[] = {"where", "on", "using", "set",
+      "group", "order", "limit", "having", "window", "union", "except",
+      "intersect", "values", "value", "select", "for", "lock"};
+  return std::any_of(std::begin(CLAUSES), std::end(CLAUSES),
+      [t_word](std::string_view l_clause) -> bool {
+        return SqlScanner::equals_nocase(t_word, l_clause);
+      });
+}
+
+void print_totals(const std::string& t_name, const TableTotals& t_totals)
+{
+  std::cout << "  " << t_name << ": " << t_totals.m_reads << " reads, "
+            << t_totals.m_writes << " writes";
+  if(0 < t_totals.m_reads) {
+    std::cout << ", average read " << t_totals.m_read_time / t_totals.m_reads
+              << " us";
+  }
+  if(0 < t_totals.m_writes) {
+    std::cout << ", average write "
+              << t_totals.m_write_time / t_totals.m_writes << " us";
+  }
+  std::cout << "\n";
+}
+
+}  // namespace
+
+const TableStats::Accesses& TableStats::statement_tables(
+    std::uint64_t t_digest, std::string_view t_sql)
+{
+  const auto found = m_statements.find(t_digest);
+  if(m_statements.end() != found) {
+    return found->second;
+  }
+
+  if(MAX_STATEMENTS <= m_statements.size()) {
+    m_statements.clear();
+  }
+
+  scan(t_sql, m_scanned_tables);
+  Accesses accesses;
+  if(!m_scanned_tables.empty()) {
+    accesses.reserve(m_scanned_tables.size());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const TableAccess& table : m_scanned_tables) {
+      accesses.push_back(Access{counters(table.m_table), table.m_is_write});
+    }
+  }
+  return m_statements.emplace(t_digest, std::move(accesses)).first->second;
+}
+
+TableCounters* TableStats::counters(const std::string& t_table)
+{
+  const auto found = m_tables.find(t_table);
+  if(m_tables.end() != found) {
+    return &found->second;
+  }
+  if(MAX_TABLES <= m_tables.size()) {
+    return &m_other_tables;
+  }
+  // The map nodes are not moved by the rehash, the statements keep
+  // the pointers to the counters.
+  return &m_tables.try_emplace(t_table).first->second;
+}
+
+void TableStats::add_access(
+    const Accesses& t_accesses, std::chrono::steady_clock::duration t_time)
+{
+  const auto time = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(t_time).count());
+
+  // The counters are written by the thread of their worker only,
+  // the atomic stores are for the readers of the stats output.
+  const auto add = [](std::atomic<std::uint64_t>& l_counter,
+                       std::uint64_t l_value) -> void {
+    l_counter.store(l_counter.load(std::memory_order_relaxed) + l_value,
+        std::memory_order_relaxed);
+  };
+  for(const Access& access : t_accesses) {
+    if(access.m_is_write) {
+      add(access.m_counters->m_writes, 1);
+      add(access.m_counters->m_write_time, time);
+    } else {
+      add(access.m_counters->m_reads, 1);
+      add(access.m_counters->m_read_time, time);
+    }
+  }
+}
+
+void TableStats::scan(
+    std::string_view t_sql, std::vector<TableAccess>& t_tables)
+{
+  // The bits of the parentheses depths: the query, not the function
+  // arguments like "EXTRACT(YEAR FROM date)", the list of the tables
+  // of FROM or of the multiple-table UPDATE, and its tables are written.
+  // The deeper parentheses are skipped.
+  static const std::size_t MAX_DEPTH = 64;
+
+  t_tables.clear();
+  SqlScanner scanner(t_sql);
+  std::size_t depth = 0;
+  std::uint64_t query_depths = 1;
+  std::uint64_t table_list_depths = 0;
+  std::uint64_t write_list_depths = 0;
+  const auto depth_bit = [&depth]() -> std::uint64_t {
+    return (depth < MAX_DEPTH) ? (std::uint64_t{1} << depth) : 0;
+  };
+
+  // The table name is next.
+  bool expect_table = false;
+  bool table_is_write = false;
+  const auto start_table_list = [&table_list_depths, &write_list_depths,
+                                    &table_is_write, &depth_bit]() -> void {
+    table_list_depths |= depth_bit();
+    if(table_is_write) {
+      write_list_depths |= depth_bit();
+    } else {
+      write_list_depths &= ~depth_bit();
+    }
+  };
+
+  // The table name can be qualified by the schema.
+  bool table_is_last = false;
+  bool table_is_qualified = false;
+
+  // The first table after FROM of DELETE is written.
+  bool is_delete = false;
+  bool is_first = true;
+
+  for(SqlToken token = scanner.next(); SqlTokenType::END != token.m_type;
+      token = scanner.next()) {
+    if(table_is_qualified) {
+      table_is_qualified = false;
+      if(SqlTokenType::WORD == token.m_type) {
+        t_tables.back().m_table.append(1, '.').append(token.m_text);
+        continue;
+      }
+    }
+    if(table_is_last) {
+      table_is_last = false;
+      if(is_symbol(token, '.')) {
+        table_is_qualified = true;
+        continue;
+      }
+    }
+
+    if(is_first) {
+      is_first = false;
+      if(is_keyword(token, "insert") || is_keyword(token, "replace")
+          || is_keyword(token, "update")) {
+        expect_table = true;
+        table_is_write = true;
+        continue;
+      }
+      if(is_keyword(token, "show") || is_keyword(token, "explain")
+          || is_keyword(token, "describe") || is_keyword(token, "desc")) {
+        // The statements about the tables do not access their data.
+        return;
+      }
+      is_delete = is_keyword(token, "delete");
+    }
+
+    if(expect_table) {
+      if(SqlTokenType::WORD == token.m_type) {
+        if(is_table_modifier(token.m_text)) {
+          continue;
+        }
+        expect_table = false;
+        if(is_keyword(token, "dual") || is_keyword(token, "outfile")
+            || is_keyword(token, "dumpfile")) {
+          continue;
+        }
+        if(!is_keyword(token, "select") && !is_keyword(token, "with")) {
+          t_tables.push_back(
+              TableAccess{std::string(token.m_text), table_is_write});
+          table_is_last = true;
+          start_table_list();
+          continue;
+        }
+      } else if(is_symbol(token, '(')) {
+        // The derived table or the tables in the parentheses,
+        // the list goes on after them.
+        start_table_list();
+        ++depth;
+        query_depths |= depth_bit();
+        table_list_depths &= ~depth_bit();
+        continue;
+      } else {
+        expect_table = false;
+      }
+    }
+
+    switch(token.m_type) {
+      case SqlTokenType::WORD: {
+        if(0 == (query_depths & depth_bit())) {
+          break;
+        }
+        if(is_keyword(token, "from")) {
+          expect_table = true;
+          table_is_write = is_delete && 0 == depth;
+          is_delete = false;
+        } else if(is_keyword(token, "join")
+            || is_keyword(token, "straight_join")) {
+          expect_table = true;
+          table_is_write = false;
+        } else if(is_keyword(token, "into")) {
+          expect_table = true;
+          table_is_write = true;
+        } else if(0 != (table_list_depths & depth_bit())
+            && ends_table_list(token.m_text)) {
+          table_list_depths &= ~depth_bit();
+        }
+        break;
+      }
+      case SqlTokenType::SYMBOL: {
+        if(is_symbol(token, '(')) {
+          ++depth;
+          query_depths &= ~depth_bit();
+          table_list_depths &= ~depth_bit();
+        } else if(is_symbol(token, ')')) {
+          if(0 < depth) {
+            --depth;
+          }
+        } else if(is_symbol(token, ',')
+            && 0 != (table_list_depths & depth_bit())) {
+          expect_table = true;
+          table_is_write = 0 != (write_list_depths & depth_bit());
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+
+    // The subquery, its FROM and JOIN are scanned.
+    if(is_keyword(token, "select")) {
+      query_depths |= depth_bit();
+    }
+  }
+
+  // A table is counted once per statement for each kind of its access.
+  std::size_t size = 0;
+  for(std::size_t i = 0; i < t_tables.size(); ++i) {
+    const bool is_repeated = std::any_of(t_tables.begin(),
+        t_tables.begin() + static_cast<std::ptrdiff_t>(size),
+        [&table = t_tables[i]](const TableAccess& l_table) -> bool {
+          return l_table.m_is_write == table.m_is_write
+              && l_table.m_table == table.m_table;
+        });
+    if(!is_repeated) {
+      if(size != i) {
+        t_tables[size] = std::move(t_tables[i]);
+      }
+      ++size;
+    }
+  }
+  t_tables.resize(size);
+}
+
+void TableStats::print(const std::string& t_route_name,
+    const std::vector<std::unique_ptr<TableStats>>& t_stats)
+{
+  std::map<std::string, TableTotals> tables;
+  TableTotals other_tables;
+  for(const std::unique_ptr<TableStats>& stats : t_stats) {
+    std::lock_guard<std::mutex> lock(stats->m_mutex);
+    for(const auto& table : stats->m_tables) {
+      tables[table.first].add(table.second);
+    }
+    other_tables.add(stats->m_other_tables);
+  }
+
+  std::vector<std::pair<std::string, TableTotals>> sorted(
+      tables.begin(), tables.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+      [](const auto& l_first, const auto& l_second) -> bool {
+        return l_first.second.m_reads + l_first.second.m_writes
+            > l_second.second.m_reads + l_second.second.m_writes;
+      });
+
+  std::cout << "Tables of route " << t_route_name << ": " << sorted.size()
+            << " tables\n";
+  const std::size_t printed = std::min(sorted.size(), MAX_PRINTED_TABLES);
+  for(std::size_t i = 0; i < printed; ++i) {
+    print_totals(sorted[i].first, sorted[i].second);
+  }
+  for(std::size_t i = printed; i < sorted.size(); ++i) {
+    other_tables.m_reads += sorted[i].second.m_reads;
+    other_tables.m_writes += sorted[i].second.m_writes;
+    other_tables.m_read_time += sorted[i].second.m_read_time;
+    other_tables.m_write_time += sorted[i].second.m_write_time;
+  }
+  if(0 < other_tables.m_reads + other_tables.m_writes) {
+    print_totals("other tables", other_tables);
+  }
+}
+
+}  // namespace proxy
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_TABLE_STATS_HPP
+#define PROXY_TABLE_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace proxy
+{
+/// The table of the statement and the kind of its access.
+struct TableAccess
+{
+  /// Table name as it is written in the statement, without the backticks,
+  /// qualified by the schema if the statement qualifies it.
+  std::string m_table;
+
+  /// The statement changes the table.
+  bool m_is_write = false;
+};
+
+
+/// The access counters of the table, updated by the thread of the worker
+/// and read by the stats output.
+struct TableCounters
+{
+  std::atomic<std::uint64_t> m_reads{0};
+  std::atomic<std::uint64_t> m_writes{0};
+
+  /// Summary time of the statements in microseconds.
+  std::atomic<std::uint64_t> m_read_time{0};
+  std::atomic<std::uint64_t> m_write_time{0};
+};
+
+
+/// The per-table statistics of the statements of a worker. The tables
+/// of the statement are found by the scan of its SQL string, without
+/// the SQL parsing, and are cached by the statement digest, so the repeated
+/// statements are not scanned again. The statistics of all the workers
+/// are merged by the stats output.
+class TableStats
+{
+public:
+  /// Maximum number of the counted tables, the accesses to the other
+  /// tables are counted together.
+  static const std::size_t MAX_TABLES = 4096;
+
+  /// Maximum number of the cached statements, the cache is cleared
+  /// when it is full.
+  static const std::size_t MAX_STATEMENTS = 4096;
+
+  /// The counters of the statement's table, valid while the stats exist.
+  struct Access
+  {
+    TableCounters* m_counters = nullptr;
+    bool m_is_write = false;
+  };
+
+  using Accesses = std::vector<Access>;
+
+  TableStats(const TableStats&) = delete;
+  TableStats(TableStats&&) = delete;
+  TableStats& operator=(const TableStats&) = delete;
+  TableStats& operator=(TableStats&&) = delete;
+
+  ~TableStats() = default;
+
+  explicit TableStats() = default;
+
+  /// Get the tables of the statement by its digest, the SQL string
+  /// is scanned if the digest is not cached. The result is valid
+  /// till the next call.
+  const Accesses& statement_tables(
+      std::uint64_t t_digest, std::string_view t_sql);
+
+  /// Count the access of the statement to its tables.
+  static void add_access(
+      const Accesses& t_accesses, std::chrono::steady_clock::duration t_time);
+
+  /// Find the tables after FROM, JOIN, INTO and UPDATE of the SQL string
+  /// in a single pass.
+  static void scan(std::string_view t_sql, std::vector<TableAccess>& t_tables);
+
+  /// Print the counters of the route summed over the workers.
+  static void print(const std::string& t_route_name,
+      const std::vector<std::unique_ptr<TableStats>>& t_stats);
+
+private:
+  /// Get the counters of the table, the new table is added.
+  TableCounters* counters(const std::string& t_table);
+
+  /// Maximum number of the printed tables, the most accessed ones.
+  static constexpr std::size_t MAX_PRINTED_TABLES = 50;
+
+  /// The tables are added by the worker and are read by the stats output,
+  /// the counters are updated without the lock.
+  std::mutex m_mutex;
+  std::unordered_map<std::string, TableCounters> m_tables;
+  TableCounters m_other_tables;
+
+  /// The tables of the statements by their digests, used by the worker only.
+  std::unordered_map<std::uint64_t, Accesses> m_statements;
+  std::vector<TableAccess> m_scanned_tables;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_TABLE_STATS_HPP
@@ -0,0 +1,210 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "timing_wheel.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace proxy
+{
+// ======== WheelTimer ========
+
+WheelTimer::WheelTimer(ExpireFunc&& t_expire_func)
+    : m_expire_func(std::move(t_expire_func))
+{
+}
+
+WheelTimer::~WheelTimer()
+{
+  cancel();
+}
+
+void WheelTimer::cancel()
+{
+  if(nullptr == m_slot) {
+    return;
+  }
+
+  if(nullptr != m_prev) {
+    m_prev->m_next = m_next;
+  } else {
+    *m_slot = m_next;
+  }
+  if(nullptr != m_next) {
+    m_next->m_prev = m_prev;
+  }
+
+  --m_wheel->m_armed_timers;
+  m_wheel = nullptr;
+  m_slot = nullptr;
+  m_prev = nullptr;
+  m_next = nullptr;
+}
+
+
+// ======== TimingWheel ========
+
+constexpr std::chrono::milliseconds TimingWheel::TICK_DURATION;
+
+TimingWheel::TimingWheel(boost::asio::io_context& t_io_context)
+    : m_tick_timer(t_io_context)
+    , m_start_time(std::chrono::steady_clock::now())
+{
+}
+
+void TimingWheel::arm(WheelTimer& t_timer, std::chrono::milliseconds t_timeout)
+{
+  t_timer.cancel();
+  if(m_is_stopped) {
+    return;
+  }
+
+  // The wheel is not ticking without the timers, its slots are empty
+  // and the current tick can be moved to the current time at once.
+  const std::uint64_t tick = now_tick();
+  if(!m_is_ticking) {
+    m_current_tick = tick;
+  }
+
+  // Round up, the timer never expires earlier than the timeout.
+  // The current time is inside its tick, so the timer expires
+  // at the start of the tick after the timeout ticks.
+  const std::uint64_t timeout_ticks = static_cast<std::uint64_t>(
+      (t_timeout + TICK_DURATION - std::chrono::milliseconds(1))
+      / TICK_DURATION);
+
+  // The expiration is counted from the current time, the current tick
+  // of the ticking wheel can lag behind it by the ticks of a busy loop.
+  // The timer is placed by its distance from the current tick.
+  t_timer.m_expire_tick = std::min(
+      tick + std::min(timeout_ticks, MAX_TIMEOUT_TICKS - 1) + 1,
+      m_current_tick + MAX_TIMEOUT_TICKS);
+  t_timer.m_wheel = this;
+  ++m_armed_timers;
+  place(t_timer);
+
+  if(!m_is_ticking) {
+    m_is_ticking = true;
+    schedule_tick();
+  }
+}
+
+void TimingWheel::stop()
+{
+  m_is_stopped = true;
+  m_is_ticking = false;
+  m_tick_timer.cancel();
+}
+
+void TimingWheel::place(WheelTimer& t_timer)
+{
+  // The level is chosen by the distance to the expiration,
+  // the slot is hashed by the expiration tick bits of the level.
+  const std::uint64_t distance = t_timer.m_expire_tick - m_current_tick;
+  std::size_t level = 0;
+  while(level + 1 < LEVELS
+      && distance >= (std::uint64_t{1} << (LEVEL_BITS * (level + 1)))) {
+    ++level;
+  }
+  const std::size_t index =
+      (t_timer.m_expire_tick >> (LEVEL_BITS * level)) & (LEVEL_SLOTS - 1);
+
+  WheelTimer*& slot = m_levels[level][index];
+  t_timer.m_slot = &slot;
+  t_timer.m_prev = nullptr;
+  t_timer.m_next = slot;
+  if(nullptr != slot) {
+    slot->m_prev = &t_timer;
+  }
+  slot = &t_timer;
+}
+
+void TimingWheel::do_tick()
+{
+  const std::uint64_t tick = now_tick();
+  while(m_current_tick < tick && 0 < m_armed_timers && !m_is_stopped) {
+    advance();
+  }
+
+  if(0 == m_armed_timers || m_is_stopped) {
+    m_is_ticking = false;
+    return;
+  }
+
+  schedule_tick();
+}
+
+void TimingWheel::schedule_tick()
+{
+  m_tick_timer.expires_at(m_start_time
+      + TICK_DURATION * static_cast<std::int64_t>(m_current_tick + 1));
+  m_tick_timer.async_wait([this](const boost::system::error_code& l_error) {
+    if(!l_error) {
+      do_tick();
+    }
+  });
+}
+
+void TimingWheel::advance()
+{
+  ++m_current_tick;
+
+  // When the lower level turns around, the next slot of the upper level
+  // is distributed to the lower levels.
+  for(std::size_t level = 1; level < LEVELS; ++level) {
+    const std::uint64_t lower_bits = LEVEL_BITS * level;
+    if(0 != (m_current_tick & ((std::uint64_t{1} << lower_bits) - 1))) {
+      break;
+    }
+
+    const std::size_t index =
+        (m_current_tick >> lower_bits) & (LEVEL_SLOTS - 1);
+    WheelTimer* timer = m_levels[level][index];
+    m_levels[level][index] = nullptr;
+    while(nullptr != timer) {
+      WheelTimer* next = timer->m_next;
+      place(*timer);
+      timer = next;
+    }
+  }
+
+  // Expire the timers of the tick. The slot head is read again
+  // after each handler, the handler may cancel or destroy other timers.
+  WheelTimer*& slot = m_levels[0][m_current_tick & (LEVEL_SLOTS - 1)];
+  while(nullptr != slot) {
+    WheelTimer* timer = slot;
+    timer->cancel();
+    if(timer->m_expire_func) {
+      timer->m_expire_func();
+    }
+  }
+}
+
+std::uint64_t TimingWheel::now_tick() const
+{
+  return static_cast<std::uint64_t>(
+      (std::chrono::steady_clock::now() - m_start_time) / TICK_DURATION);
+}
+
+}  // namespace proxy
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_TIMING_WHEEL_HPP
+#define PROXY_TIMING_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <boost/asio.hpp>
+
+namespace proxy
+{
+class TimingWheel;
+
+/// The timer of the timing wheel, intended to be a member of its owner.
+/// The handler is set once, the arming and the cancellation do not allocate.
+class WheelTimer
+{
+public:
+  WheelTimer(const WheelTimer&) = delete;
+  WheelTimer(WheelTimer&&) = delete;
+  WheelTimer& operator=(const WheelTimer&) = delete;
+  WheelTimer& operator=(WheelTimer&&) = delete;
+
+  /// Functor for the actions for the timer expiration.
+  /// The handler may destroy the timer.
+  using ExpireFunc = std::function<void()>;
+
+  explicit WheelTimer(ExpireFunc&& t_expire_func);
+  ~WheelTimer();
+
+  /// Check if the timer is armed.
+  bool is_armed() const;
+
+  /// Disarm the timer, O(1).
+  void cancel();
+
+private:
+  friend class TimingWheel;
+
+  ExpireFunc m_expire_func;
+
+  /// Links of the wheel slot list, m_slot is nullptr if not armed.
+  TimingWheel* m_wheel = nullptr;
+  WheelTimer** m_slot = nullptr;
+  WheelTimer* m_prev = nullptr;
+  WheelTimer* m_next = nullptr;
+
+  /// Wheel tick of the expiration.
+  std::uint64_t m_expire_tick = 0;
+};
+
+inline bool WheelTimer::is_armed() const
+{
+  return nullptr != m_slot;
+}
+
+
+/// The hierarchical hashed timing wheel driven by one steady_timer.
+/// The timers are armed and cancelled in O(1), the timers of the upper
+/// levels are cascaded to the lower levels when their time is close.
+/// One wheel serves the connections of one io_context thread,
+/// it is not thread-safe.
+class TimingWheel
+{
+public:
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel(TimingWheel&&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+  TimingWheel& operator=(TimingWheel&&) = delete;
+
+  ~TimingWheel() = default;
+
+  explicit TimingWheel(boost::asio::io_context& t_io_context);
+
+  /// Wheel resolution.
+  static constexpr std::chrono::milliseconds TICK_DURATION{10};
+
+  /// Arm the timer to expire after the timeout, rearms the armed timer.
+  /// The timeouts longer than the wheel range are clamped to the range.
+  void arm(WheelTimer& t_timer, std::chrono::milliseconds t_timeout);
+
+  /// Stop the wheel ticking, the armed timers do not expire after it.
+  void stop();
+
+private:
+  /// Each level has 64 slots, the level slot is 64 times longer
+  /// than the slot of the lower level. 5 levels cover 2^30 ticks.
+  static const std::size_t LEVEL_BITS = 6;
+  static const std::size_t LEVEL_SLOTS = 1u << LEVEL_BITS;
+  static const std::size_t LEVELS = 5;
+  static const std::uint64_t MAX_TIMEOUT_TICKS =
+      (std::uint64_t{1} << (LEVEL_BITS * LEVELS)) - 1;
+
+  using Slots = std::array<WheelTimer*, LEVEL_SLOTS>;
+
+  /// Link the timer to the slot of its expiration tick.
+  void place(WheelTimer& t_timer);
+
+  /// Expire the timers of the passed ticks and schedule the next tick.
+  void do_tick();
+
+  /// Wait for the next tick.
+  void schedule_tick();
+
+  /// Move to the next tick, cascade the upper level slots
+  /// and expire the timers of the tick.
+  void advance();
+
+  /// Get the wheel tick for the current time.
+  std::uint64_t now_tick() const;
+
+  boost::asio::steady_timer m_tick_timer;
+  std::chrono::steady_clock::time_point m_start_time;
+  std::uint64_t m_current_tick = 0;
+
+  friend class WheelTimer;
+
+  std::array<Slots, LEVELS> m_levels{};
+  std::size_t m_armed_timers = 0;
+  bool m_is_ticking = false;
+  bool m_is_stopped = false;
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_TIMING_WHEEL_HPP
@@ -0,0 +1,169 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "tls_context.hpp"
+
+#include <cstdint>
+
+#include <openssl/rand.h>
+
+namespace proxy
+{
+namespace
+{
+const long TLS_OPTIONS = boost::asio::ssl::context::default_workarounds
+    | boost::asio::ssl::context::no_sslv2 | boost::asio::ssl::context::no_sslv3
+    | boost::asio::ssl::context::no_tlsv1
+    | boost::asio::ssl::context::no_tlsv1_1
+    | boost::asio::ssl::context::single_dh_use;
+
+/// The sessions of the clients are resumed only by this application.
+const unsigned char SESSION_ID_CONTEXT[] = "boost-asio-mysql-proxy";
+
+/// Size of the ticket keys of OpenSSL 1.1 and above,
+/// OpenSSL 1.0.2 uses the first 48 bytes of them.
+const std::size_t TICKET_KEYS_LENGTH = 80;
+
+// The application data of OpenSSL is taken by Boost.Asio
+// for the verify callbacks, the own indexes are used instead.
+int context_data_index()
+{
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+int stream_data_index()
+{
+  static const int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+}  // namespace
+
+TlsContext::TlsContext(
+    const TlsSettings& t_settings, const TicketKeys& t_ticket_keys)
+{
+  if(t_settings.is_client_tls()) {
+    m_client_context = std::make_unique<boost::asio::ssl::context>(
+        boost::asio::ssl::context::sslv23_server);
+    m_client_context->set_options(TLS_OPTIONS);
+    m_client_context->use_certificate_chain_file(t_settings.m_cert_file);
+    m_client_context->use_private_key_file(t_settings.m_key_file.empty()
+            ? t_settings.m_cert_file
+            : t_settings.m_key_file,
+        boost::asio::ssl::context::pem);
+
+    // See https://www.openssl.org/docs/man1.1.1/man3/SSL_CTX_set_tlsext_ticket_keys.html
+    // The session cache is not shared by the workers, the tickets
+    // with the same keys resume the session in any worker.
+    SSL_CTX* context = m_client_context->native_handle();
+    SSL_CTX_set_session_id_context(
+        context, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_timeout(context, static_cast<long>(t_settings.m_session_timeout));
+    TicketKeys ticket_keys = t_ticket_keys;
+    const long keys_length = SSL_CTX_set_tlsext_ticket_keys(context, nullptr, 0);
+    if(0 < keys_length
+        && static_cast<std::size_t>(keys_length) <= ticket_keys.size()) {
+      SSL_CTX_set_tlsext_ticket_keys(context, ticket_keys.data(), keys_length);
+    }
+  }
+
+  if(t_settings.m_server_tls) {
+    m_server_context = std::make_unique<boost::asio::ssl::context>(
+        boost::asio::ssl::context::sslv23_client);
+    m_server_context->set_options(TLS_OPTIONS);
+    if(t_settings.m_server_ca_file.empty()) {
+      m_server_context->set_verify_mode(boost::asio::ssl::verify_none);
+    } else {
+      m_server_context->load_verify_file(t_settings.m_server_ca_file);
+      m_server_context->set_verify_mode(boost::asio::ssl::verify_peer);
+    }
+
+    // See https://www.openssl.org/docs/man1.1.1/man3/SSL_CTX_sess_set_new_cb.html
+    // The sessions of TLS 1.3 come after the handshake, they are kept
+    // by the callback.
+    SSL_CTX* context = m_server_context->native_handle();
+    SSL_CTX_set_ex_data(context, context_data_index(), this);
+    SSL_CTX_set_session_cache_mode(
+        context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(context, &TlsContext::server_session_is_received);
+  }
+}
+
+// static
+TicketKeys TlsContext::make_ticket_keys()
+{
+  TicketKeys ticket_keys(TICKET_KEYS_LENGTH);
+  if(1 != RAND_bytes(ticket_keys.data(), static_cast<int>(ticket_keys.size()))) {
+    // The contexts keep their own random keys.
+    ticket_keys.clear();
+  }
+  return ticket_keys;
+}
+
+void TlsContext::resume_server_session(
+    TlsStream& t_stream, std::size_t t_backend_index)
+{
+  SSL* ssl = t_stream.native_handle();
+  SSL_set_ex_data(ssl, stream_data_index(),
+      reinterpret_cast<void*>(static_cast<std::uintptr_t>(t_backend_index)));
+  if(t_backend_index < m_server_sessions.size()
+      && m_server_sessions[t_backend_index]) {
+    SSL_set_session(ssl, m_server_sessions[t_backend_index].get());
+  }
+}
+
+// static
+void TlsContext::keep_session(TlsStream& t_stream)
+{
+  // See https://www.openssl.org/docs/man1.1.1/man3/SSL_set_shutdown.html
+  // OpenSSL removes the session of the stream freed without the shutdown.
+  SSL_set_shutdown(
+      t_stream.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+}
+
+// static
+int TlsContext::server_session_is_received(SSL* t_ssl, SSL_SESSION* t_session)
+{
+  auto* tls_context = static_cast<TlsContext*>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(t_ssl), context_data_index()));
+  const auto backend_index =
+      static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(
+          SSL_get_ex_data(t_ssl, stream_data_index())));
+  if(backend_index >= tls_context->m_server_sessions.size()) {
+    tls_context->m_server_sessions.resize(backend_index + 1);
+  }
+
+  // The callback owns the session if it returns 1.
+  tls_context->m_server_sessions[backend_index].reset(t_session);
+  return 1;
+}
+
+void TlsContext::SessionDeleter::operator()(SSL_SESSION* t_session) const
+{
+  SSL_SESSION_free(t_session);
+}
+
+}  // namespace proxy
@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_TLS_CONTEXT_HPP
+#define PROXY_TLS_CONTEXT_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "endpoint.hpp"
+#include "settings.hpp"
+
+namespace proxy
+{
+/// TLS stream over the socket which is owned by the connection.
+using TlsStream = boost::asio::ssl::stream<StreamProtocol::socket&>;
+
+/// Keys of the TLS session tickets, shared by the contexts of the route's
+/// workers, so the ticket is accepted by any worker.
+using TicketKeys = std::vector<unsigned char>;
+
+/// The TLS contexts of the route for one worker. Each worker has its own
+/// contexts, the handshakes of the workers do not contend on the locks
+/// of the shared context and its session cache.
+class TlsContext
+{
+public:
+  TlsContext(const TlsContext&) = delete;
+  TlsContext(TlsContext&&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+  TlsContext& operator=(TlsContext&&) = delete;
+
+  ~TlsContext() = default;
+
+  /// Construct the contexts for the settings. Throws
+  /// boost::system::system_error if the files can not be read.
+  explicit TlsContext(
+      const TlsSettings& t_settings, const TicketKeys& t_ticket_keys);
+
+  /// Make the random keys of the session tickets.
+  static TicketKeys make_ticket_keys();
+
+  /// Get the context of the TLS with the clients, the proxy is
+  /// the TLS server. nullptr if the proxy does not terminate the TLS
+  /// of the clients.
+  boost::asio::ssl::context* client_context();
+
+  /// Get the context of the TLS with the MySQL servers, the proxy is
+  /// the TLS client. nullptr if the MySQL servers are connected
+  /// without the TLS.
+  boost::asio::ssl::context* server_context();
+
+  /// Set the last session with the MySQL server to the stream
+  /// for the resumption, the new session from the server is kept
+  /// for the next connection.
+  void resume_server_session(TlsStream& t_stream, std::size_t t_backend_index);
+
+  /// Keep the session of the stream resumable after the connection
+  /// is closed without the TLS shutdown, as the MySQL connections are.
+  static void keep_session(TlsStream& t_stream);
+
+private:
+  /// OpenSSL callback of the new session with the MySQL server.
+  static int server_session_is_received(SSL* t_ssl, SSL_SESSION* t_session);
+
+  struct SessionDeleter
+  {
+    void operator()(SSL_SESSION* t_session) const;
+  };
+
+  using SessionPtr = std::unique_ptr<SSL_SESSION, SessionDeleter>;
+
+  std::unique_ptr<boost::asio::ssl::context> m_client_context;
+  std::unique_ptr<boost::asio::ssl::context> m_server_context;
+
+  /// The last sessions with the MySQL servers by the backend index.
+  std::vector<SessionPtr> m_server_sessions;
+};
+
+inline boost::asio::ssl::context* TlsContext::client_context()
+{
+  return m_client_context.get();
+}
+
+inline boost::asio::ssl::context* TlsContext::server_context()
+{
+  return m_server_context.get();
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_TLS_CONTEXT_HPP
@@ -0,0 +1,145 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "transaction_stats.hpp"
+
+#include <iostream>
+
+#include "sql_scanner.hpp"
+
+namespace proxy
+{
+namespace
+{
+/// The counters are written by the thread of their worker only,
+/// the atomic stores are for the readers of the stats output.
+void add(std::atomic<std::uint64_t>& t_counter, std::uint64_t t_value)
+{
+  t_counter.store(t_counter.load(std::memory_order_relaxed) + t_value,
+      std::memory_order_relaxed);
+}
+
+bool is_keyword(const SqlToken& t_token, std::string_view t_word)
+{
+  return SqlTokenType::WORD == t_token.m_type
+      && SqlScanner::equals_nocase(t_token.m_text, t_word);
+}
+
+}  // namespace
+
+TransactionStats::Statement TransactionStats::statement_kind(
+    std::string_view t_sql)
+{
+  // See https://dev.mysql.com/doc/refman/8.0/en/commit.html
+  SqlScanner scanner(t_sql);
+  const SqlToken first = scanner.next();
+  if(is_keyword(first, "begin")) {
+    return Statement::BEGIN;
+  }
+  if(is_keyword(first, "start")) {
+    return is_keyword(scanner.next(), "transaction") ? Statement::BEGIN
+                                                     : Statement::OTHER;
+  }
+  if(is_keyword(first, "commit")) {
+    return Statement::COMMIT;
+  }
+  if(is_keyword(first, "rollback")) {
+    SqlToken next = scanner.next();
+    if(is_keyword(next, "work")) {
+      next = scanner.next();
+    }
+    return is_keyword(next, "to") ? Statement::OTHER : Statement::ROLLBACK;
+  }
+  return Statement::OTHER;
+}
+
+void TransactionStats::transaction_is_started()
+{
+  add(m_open, 1);
+}
+
+void TransactionStats::transaction_is_ended(
+    std::chrono::steady_clock::duration t_duration,
+    std::uint32_t t_statements,
+    bool t_is_rolled_back)
+{
+  m_open.store(
+      m_open.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+  add(t_is_rolled_back ? m_rolled_back : m_committed, 1);
+  add(m_statements, t_statements);
+  add(m_duration,
+      static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(t_duration)
+              .count()));
+
+  const auto milliseconds = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(t_duration)
+          .count());
+  std::size_t bucket = 0;
+  while(bucket + 1 < BUCKETS && 0 != (milliseconds >> bucket)) {
+    ++bucket;
+  }
+  add(m_durations[bucket], 1);
+}
+
+void TransactionStats::print(const std::string& t_route_name,
+    const std::vector<std::unique_ptr<TransactionStats>>& t_stats)
+{
+  std::uint64_t open = 0;
+  std::uint64_t committed = 0;
+  std::uint64_t rolled_back = 0;
+  std::uint64_t statements = 0;
+  std::uint64_t duration = 0;
+  std::array<std::uint64_t, BUCKETS> durations{};
+  for(const std::unique_ptr<TransactionStats>& stats : t_stats) {
+    open += stats->m_open.load(std::memory_order_relaxed);
+    committed += stats->m_committed.load(std::memory_order_relaxed);
+    rolled_back += stats->m_rolled_back.load(std::memory_order_relaxed);
+    statements += stats->m_statements.load(std::memory_order_relaxed);
+    duration += stats->m_duration.load(std::memory_order_relaxed);
+    for(std::size_t i = 0; i < BUCKETS; ++i) {
+      durations[i] += stats->m_durations[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  std::cout << "Transactions of route " << t_route_name << ": " << open
+            << " open, " << committed << " committed, " << rolled_back
+            << " rolled back";
+  const std::uint64_t ended = committed + rolled_back;
+  if(0 < ended) {
+    std::cout << ", average " << statements / ended << " statements and "
+              << duration / ended << " us, durations:";
+    const char* separator = " ";
+    for(std::size_t i = 0; i < BUCKETS; ++i) {
+      if(0 < durations[i]) {
+        std::cout << separator << ((i + 1 < BUCKETS) ? "<" : ">=")
+                  << (std::uint64_t{1} << ((i + 1 < BUCKETS) ? i : i - 1))
+                  << " ms " << durations[i];
+        separator = ", ";
+      }
+    }
+  }
+  std::cout << "\n";
+}
+
+}  // namespace proxy
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_TRANSACTION_STATS_HPP
+#define PROXY_TRANSACTION_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace proxy
+{
+/// The transactions of the sessions of a worker. The transactions
+/// are tracked by the connections from the status flags of the server's
+/// OK and EOF packets. The counters are written by the thread
+/// of the worker only and are summed over the workers by the stats output.
+class TransactionStats
+{
+public:
+  /// Kinds of the client's statements for the transaction tracking.
+  enum class Statement
+  {
+    OTHER,
+    BEGIN,  // BEGIN or START TRANSACTION.
+    COMMIT,
+    ROLLBACK  // ROLLBACK, but not ROLLBACK TO SAVEPOINT.
+  };
+
+  /// Buckets of the duration histogram, the bucket N counts
+  /// the transactions shorter than 2^N ms, the last bucket counts
+  /// the longer transactions too.
+  static const std::size_t BUCKETS = 24;
+
+  TransactionStats(const TransactionStats&) = delete;
+  TransactionStats(TransactionStats&&) = delete;
+  TransactionStats& operator=(const TransactionStats&) = delete;
+  TransactionStats& operator=(TransactionStats&&) = delete;
+
+  ~TransactionStats() = default;
+
+  explicit TransactionStats() = default;
+
+  /// Get the kind of the statement by its first words.
+  static Statement statement_kind(std::string_view t_sql);
+
+  /// Count the started transaction.
+  void transaction_is_started();
+
+  /// Count the ended transaction with its duration and number
+  /// of the statements.
+  void transaction_is_ended(std::chrono::steady_clock::duration t_duration,
+      std::uint32_t t_statements,
+      bool t_is_rolled_back);
+
+  /// Print the counters of the route summed over the workers.
+  static void print(const std::string& t_route_name,
+      const std::vector<std::unique_ptr<TransactionStats>>& t_stats);
+
+private:
+  std::atomic<std::uint64_t> m_open{0};
+  std::atomic<std::uint64_t> m_committed{0};
+  std::atomic<std::uint64_t> m_rolled_back{0};
+  std::atomic<std::uint64_t> m_statements{0};
+
+  /// Summary duration of the ended transactions in microseconds.
+  std::atomic<std::uint64_t> m_duration{0};
+
+  std::array<std::atomic<std::uint64_t>, BUCKETS> m_durations{};
+};
+
+}  // namespace proxy
+
+#endif  // PROXY_TRANSACTION_STATS_HPP
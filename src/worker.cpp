@@ -0,0 +1,160 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "worker.hpp"
+
+#include <exception>
+#include <iostream>
+#include <utility>
+
+namespace proxy
+{
+Worker::Worker(std::size_t t_index,
+    Admission& t_admission,
+    std::size_t t_max_connecting)
+    : m_index(t_index)
+    , m_io_context(1)
+    , m_work_guard(boost::asio::make_work_guard(m_io_context))
+    , m_timing_wheel(m_io_context)
+    , m_connection_manager(t_index)
+    , m_admission(t_admission)
+    , m_max_connecting(t_max_connecting)
+    , m_drain_timer([this]() -> void {
+      std::cout << "Drain timeout: " << m_connection_manager.size()
+                << " connections are closed\n";
+      do_stop();
+    })
+{
+}
+
+void Worker::run()
+{
+  // See https://www.boost.org/doc/libs/1_69_0/doc/html/boost_asio/reference/io_context.html#boost_asio.reference.io_context.effect_of_exceptions_thrown_from_handlers
+  while(true) {
+    try {
+      m_io_context.run();
+      break;
+    } catch(std::exception& e) {
+      std::cerr << "Worker " << m_index << ": handler exception: " << e.what()
+                << "\n";
+
+      // Only the connection whose data was handled is stopped.
+      const ConnectionPtr connection = std::move(m_handled_connection);
+      m_handled_connection.reset();
+      if(connection
+          && m_connection_manager.find(connection->id()) == connection.get()) {
+        stop_connection(connection);
+      }
+    }
+  }
+}
+
+void Worker::post_connection(RoutePtr t_route,
+    StreamProtocol::socket&& t_socket,
+    std::string&& t_client_ip)
+{
+  boost::asio::post(m_io_context,
+      [this, l_route = std::move(t_route), l_socket = std::move(t_socket),
+          l_client_ip = std::move(t_client_ip)]() mutable {
+        start_connection(
+            std::move(l_route), std::move(l_socket), std::move(l_client_ip));
+      });
+}
+
+void Worker::start_connection(RoutePtr t_route,
+    StreamProtocol::socket&& t_socket,
+    std::string&& t_client_ip)
+{
+  // The connection keeps its route snapshot alive.
+  m_connection_manager.start(
+      m_connection_pool.make_connection(std::move(t_socket), std::move(t_route),
+          *this, std::move(t_client_ip)));
+}
+
+void Worker::stop_connection(const ConnectionPtr& t_connection)
+{
+  m_connection_manager.stop(t_connection);
+  if(m_is_draining && 0 == m_connection_manager.size()) {
+    do_stop();
+  }
+}
+
+bool Worker::begin_connect(const ConnectionPtr& t_connection)
+{
+  if(0 < m_max_connecting && m_connecting >= m_max_connecting) {
+    m_connect_queue.push_back(t_connection);
+    return false;
+  }
+  ++m_connecting;
+  return true;
+}
+
+void Worker::end_connect()
+{
+  --m_connecting;
+
+  // The queued connections which are stopped meanwhile are skipped.
+  while(!m_connect_queue.empty() && m_connecting < m_max_connecting) {
+    const ConnectionPtr connection = std::move(m_connect_queue.front());
+    m_connect_queue.pop_front();
+    if(m_connection_manager.find(connection->id()) == connection.get()) {
+      ++m_connecting;
+      connection->connect();
+    }
+  }
+}
+
+void Worker::stop()
+{
+  boost::asio::post(m_io_context, [this]() { do_stop(); });
+}
+
+void Worker::drain(std::chrono::milliseconds t_timeout)
+{
+  boost::asio::post(m_io_context, [this, t_timeout]() {
+    // The connections which are closed by the drain at once
+    // do not stop the worker in the middle of it.
+    m_connection_manager.drain_all();
+    m_is_draining = true;
+    if(0 == m_connection_manager.size()) {
+      do_stop();
+    } else {
+      m_timing_wheel.arm(m_drain_timer, t_timeout);
+    }
+  });
+}
+
+void Worker::do_stop()
+{
+  // The worker is stopped by cancelling all outstanding asynchronous
+  // operations. Once all operations have finished the io_context::run()
+  // call will exit.
+  m_is_draining = false;
+  m_drain_timer.cancel();
+  m_connect_queue.clear();
+  m_timing_wheel.stop();
+  m_connection_manager.stop_all();
+  m_work_guard.reset();
+}
+
+}  // namespace proxy
@@ -0,0 +1,190 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#ifndef PROXY_WORKER_HPP
+#define PROXY_WORKER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include "admission.hpp"
+#include "connection_manager.hpp"
+#include "connection_pool.hpp"
+#include "endpoint.hpp"
+#include "route.hpp"
+#include "timing_wheel.hpp"
+
+namespace proxy
+{
+/// The thread of the thread pool with its own io_context, serves
+/// the connections accepted by the routes. The connections, their timeouts
+/// and the local replies of a worker are used only by its thread.
+class Worker
+{
+public:
+  Worker(const Worker&) = delete;
+  Worker(Worker&&) = delete;
+  Worker& operator=(const Worker&) = delete;
+  Worker& operator=(Worker&&) = delete;
+
+  ~Worker() = default;
+
+  /// Construct the worker with its index in the workers. The connections
+  /// are released by the admission when they are closed, the MySQL server
+  /// connects in progress are limited by the max number, 0 turns it off.
+  explicit Worker(std::size_t t_index,
+      Admission& t_admission,
+      std::size_t t_max_connecting);
+
+  /// Get the index of the worker in the workers.
+  std::size_t index() const;
+
+  /// Get the io_context of the worker.
+  boost::asio::io_context& io_context();
+
+  /// Get the timeouts of the worker's connections.
+  TimingWheel& timing_wheel();
+
+  /// Get the allocator of the worker's connections.
+  ConnectionPool& connection_pool();
+
+  /// Get the admission of the worker's connections.
+  Admission& admission();
+
+  /// Run the worker's io_context loop till the worker is stopped.
+  /// The connection whose handler throws is stopped, the loop goes on.
+  void run();
+
+  /// Set the connection whose received data is handled in the worker's
+  /// thread, it is stopped if the handling throws. The nullptr is set
+  /// after the handling.
+  void set_handled_connection(Connection* t_connection);
+
+  /// Start the accepted and admitted connection from the client's IP address
+  /// with the route snapshot in the worker's thread, can be called
+  /// from any thread.
+  void post_connection(RoutePtr t_route,
+      StreamProtocol::socket&& t_socket,
+      std::string&& t_client_ip);
+
+  /// Stop all connections of the worker and let its loop exit,
+  /// can be called from any thread.
+  void stop();
+
+  /// Close the connections at their command boundaries and let the loop
+  /// exit then, stop the connections which are open after the timeout.
+  /// Can be called from any thread.
+  void drain(std::chrono::milliseconds t_timeout);
+
+  /// Perform the actions for the connection stop, runs in the worker's thread.
+  void stop_connection(const ConnectionPtr& t_connection);
+
+  /// Take the place of the MySQL server connect in progress
+  /// for the connection. Returns false if the connects are at the limit,
+  /// the connection waits in the queue for connect() then.
+  bool begin_connect(const ConnectionPtr& t_connection);
+
+  /// Free the place of the connect when the handshake is complete
+  /// or the connection is stopped, the next queued connection connects.
+  void end_connect();
+
+private:
+  /// Stop all connections and let the loop exit.
+  void do_stop();
+
+  /// Start the accepted connection, runs in the worker's thread.
+  void start_connection(RoutePtr t_route,
+      StreamProtocol::socket&& t_socket,
+      std::string&& t_client_ip);
+
+  const std::size_t m_index;
+
+  /// The io_context used to perform asynchronous operations.
+  boost::asio::io_context m_io_context;
+
+  /// Keeps the loop running while the worker has no connections.
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      m_work_guard;
+
+  /// The timeouts of the connections, must outlive the connections.
+  TimingWheel m_timing_wheel;
+
+  /// The connections are allocated in it, must outlive the connections.
+  ConnectionPool m_connection_pool;
+
+  /// The connection manager which owns all live connections of the worker.
+  ConnectionManager m_connection_manager;
+
+  Admission& m_admission;
+
+  /// The MySQL server connects in progress and the connections which wait
+  /// for them.
+  const std::size_t m_max_connecting;
+  std::size_t m_connecting = 0;
+  std::deque<ConnectionPtr> m_connect_queue;
+
+  /// The connection whose received data is handled.
+  ConnectionPtr m_handled_connection;
+
+  /// The worker exits after its connections are closed.
+  bool m_is_draining = false;
+  WheelTimer m_drain_timer;
+};
+
+inline std::size_t Worker::index() const
+{
+  return m_index;
+}
+
+inline boost::asio::io_context& Worker::io_context()
+{
+  return m_io_context;
+}
+
+inline TimingWheel& Worker::timing_wheel()
+{
+  return m_timing_wheel;
+}
+
+inline ConnectionPool& Worker::connection_pool()
+{
+  return m_connection_pool;
+}
+
+inline Admission& Worker::admission()
+{
+  return m_admission;
+}
+
+inline void Worker::set_handled_connection(Connection* t_connection)
+{
+  m_handled_connection = t_connection;
+}
+
+}  // namespace proxy
+
+#endif  // PROXY_WORKER_HPP
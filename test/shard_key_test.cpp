@@ -0,0 +1,88 @@
+/*****************************************************************************
+ * Project:  Boost_Asio_MySQL_Proxy
+ * Purpose:  Test project
+ * Author:   NikitaFeodonit, nfeodonit@yandex.com
+ *****************************************************************************
+ *   Copyright (c) 2019 NikitaFeodonit
+ *
+ *    This file is part of the Boost_Asio_MySQL_Proxy project.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the License,
+ *    or (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *    See the GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program. If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+
+#include "shard.hpp"
+
+namespace
+{
+/// The query and its expected shard key, empty if it is not routed.
+struct Case
+{
+  std::string_view m_sql;
+  std::string_view m_key;
+};
+
+const Case CASES[] = {
+    {"SELECT * FROM t WHERE user_id = 42", "42"},
+    {"select a from t where t.USER_ID='abc' and x = 1", "abc"},
+    {"SELECT * FROM t WHERE `user_id`=-5", "-5"},
+    {"DELETE FROM t WHERE id = 3 AND user_id = 77 LIMIT 1", "77"},
+    {"INSERT INTO t (a, user_id, b) VALUES (1, 'k1', f(2, 3))", "k1"},
+    {"INSERT INTO t SET a = 1, user_id = 555", "555"},
+    {"/* shard_key=9 */ SELECT 1", "9"},
+    {"SELECT 1 /* shard_key = xyz */", "xyz"},
+    {"SELECT * FROM t WHERE user_id = 5 + 1", ""},
+    {"UPDATE t SET user_id = 5 WHERE id = 3", ""},
+    {"SELECT user_id = 1 FROM t", ""},
+    {"/* shard_key=1 */ DROP TABLE t", ""},
+
+    // The queries which can touch the rows of the other keys.
+    {"SELECT * FROM t WHERE user_id = 1 OR user_id = 2", ""},
+    {"SELECT * FROM t WHERE user_id = 1 OR name = 'x'", ""},
+    {"SELECT * FROM t WHERE user_id = 1 || name = 'x'", ""},
+    {"SELECT * FROM t WHERE user_id = 1 XOR a = 2", ""},
+    {"SELECT * FROM t WHERE NOT user_id = 1", ""},
+    {"SELECT * FROM t WHERE !(user_id = 1)", ""},
+    {"SELECT * FROM t WHERE user_id = 1 AND a IN (1, 2)", ""},
+    {"SELECT * FROM t WHERE user_id IN (1, 2)", ""},
+    {"DELETE FROM t WHERE user_id = 1 AND a = (SELECT MAX(a) FROM u)", ""},
+    {"SELECT * FROM t WHERE user_id = 1 UNION SELECT * FROM t", ""},
+    {"INSERT INTO t (user_id, a) VALUES (1, 'a'), (2, 'b')", ""},
+    {"INSERT INTO t (user_id, a) SELECT user_id, a FROM u WHERE user_id = 1",
+        ""},
+    {"UPDATE t SET a = 1 WHERE user_id = 1 OR 1 = 1", ""},
+    {"SELECT * FROM t WHERE user_id = 1 OR a = 2 /* shard_key=7 */", "7"},
+};
+
+}  // namespace
+
+int main()
+{
+  std::size_t failed = 0;
+  for(const Case& test_case : CASES) {
+    const std::string_view key =
+        proxy::ShardRouter::find_key(test_case.m_sql, "user_id");
+    if(key != test_case.m_key) {
+      std::cout << "FAILED: " << test_case.m_sql << "\n  key: '" << key
+                << "', expected: '" << test_case.m_key << "'\n";
+      ++failed;
+    }
+  }
+  std::cout << (sizeof(CASES) / sizeof(CASES[0]) - failed) << " of "
+            << sizeof(CASES) / sizeof(CASES[0]) << " cases passed\n";
+  return 0 == failed ? 0 : 1;
+}